@@ -20,6 +20,7 @@
  ***********************************************************************/
 #include <string>
 #include <fstream>
+#include "util/mmap.hh"
 #include "Vocab.h"
 #include "PhraseNode.h"
 
@@ -39,6 +40,9 @@ protected:
   int m_numSourceFactors, m_numTargetFactors, m_numScores;
   std::fstream m_fileMisc, m_fileVocab, m_fileSource, m_fileTarget, m_fileTargetInd, m_fileTargetColl;
 
+  // when loading, the binary files are memory mapped & read-only so lookups can be done by many threads
+  util::scoped_memory m_memSource, m_memTargetInd, m_memTargetColl;
+
   size_t m_defaultNodeSize;
   PhraseNode *m_rootSourceNode;
 
@@ -47,6 +51,7 @@ protected:
   void SaveMisc();
   bool OpenForLoad(const std::string &filePath);
   bool LoadMisc();
+  void MapForLoad(const std::string &path, util::scoped_memory &mem);
 
 public:
   static int VERSION_NUM;
@@ -83,6 +88,16 @@ public:
     return m_fileVocab;
   }
 
+  const char *GetMemSource() const {
+    return (const char*) m_memSource.get();
+  }
+  const char *GetMemTargetInd() const {
+    return (const char*) m_memTargetInd.get();
+  }
+  const char *GetMemTargetColl() const {
+    return (const char*) m_memTargetColl.get();
+  }
+
   size_t GetNumSourceFactors() const {
     return m_numSourceFactors;
   }
@@ -70,8 +70,7 @@ size_t Word::WriteToMemory(char *mem) const
 
 size_t Word::ReadFromMemory(const char *mem)
 {
-  uint64_t *vocabMem = (uint64_t*) mem;
-  m_vocabId = vocabMem[0];
+  m_vocabId = ReadU64(mem);
 
   size_t memUsed = sizeof(uint64_t);
 
@@ -84,18 +83,6 @@ size_t Word::ReadFromMemory(const char *mem)
   return memUsed;
 }
 
-size_t Word::ReadFromFile(std::fstream &file)
-{
-  const size_t memAlloc = sizeof(uint64_t) + sizeof(char);
-  char mem[sizeof(uint64_t) + sizeof(char)];
-  file.read(mem, memAlloc);
-
-  size_t memUsed = ReadFromMemory(mem);
-  assert(memAlloc == memUsed);
-
-  return memAlloc;
-}
-
 int Word::Compare(const Word &compare) const
 {
   int ret;
@@ -18,6 +18,7 @@
  License along with this library; if not, write to the Free Software
  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  ***********************************************************************/
+#include <cstring>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -34,6 +35,14 @@ namespace OnDiskPt
 {
 class Vocab;
 
+//! 64-bit field of the mmapped table. Words are 9 bytes so most fields aren't aligned
+inline uint64_t ReadU64(const char *mem)
+{
+  uint64_t ret;
+  std::memcpy(&ret, mem, sizeof(uint64_t));
+  return ret;
+}
+
 /* A wrapper around a vocab id, and a boolean indicating whther it is a term or non-term.
  * Factors can be represented by using a vocab string with | character, eg go|VB
  */
@@ -65,7 +74,6 @@ public:
 
   size_t WriteToMemory(char *mem) const;
   size_t ReadFromMemory(const char *mem);
-  size_t ReadFromFile(std::fstream &file);
 
   uint64_t GetVocabId() const {
     return m_vocabId;
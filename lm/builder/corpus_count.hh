@@ -30,7 +30,10 @@ class CorpusCount {
 
     // token_count: out.
     // type_count aka vocabulary size.  Initialize to an estimate.  It is set to the exact value.
-    CorpusCount(util::FilePiece &from, int vocab_write, uint64_t &token_count, WordIndex &type_count, std::vector<bool> &prune_words, const std::string& prune_vocab_filename, std::size_t entries_per_block, WarningAction disallowed_symbol);
+    // With shard_count > 1, only n-grams whose last word hashes to shard_index
+    // are written.  Every shard still sees all the words, so vocabulary ids and
+    // counts agree across shards.
+    CorpusCount(util::FilePiece &from, int vocab_write, uint64_t &token_count, WordIndex &type_count, std::vector<bool> &prune_words, const std::string& prune_vocab_filename, std::size_t entries_per_block, WarningAction disallowed_symbol, std::size_t shard_index = 0, std::size_t shard_count = 1);
 
     void Run(const util::stream::ChainPosition &position);
 
@@ -46,6 +49,8 @@ class CorpusCount {
     util::scoped_malloc dedupe_mem_;
 
     WarningAction disallowed_symbol_action_;
+
+    std::size_t shard_index_, shard_count_;
 };
 
 } // namespace builder
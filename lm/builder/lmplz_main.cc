@@ -2,16 +2,25 @@
 #include "lm/builder/pipeline.hh"
 #include "lm/common/size_option.hh"
 #include "lm/lm_exception.hh"
+#include "lm/model.hh"
 #include "util/file.hh"
 #include "util/file_piece.hh"
 #include "util/usage.hh"
 
 #include <iostream>
 
+#include <boost/lexical_cast.hpp>
 #include <boost/program_options.hpp>
 #include <boost/version.hpp>
+#include <string>
 #include <vector>
 
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 namespace {
 
 // Parse and validate pruning thresholds then return vector of threshold counts
@@ -64,6 +73,71 @@ lm::builder::Discount ParseDiscountFallback(const std::vector<std::string> &para
   return ret;
 }
 
+uint8_t ParseBitCount(unsigned int bits) {
+  UTIL_THROW_IF(bits > 25, util::Exception, "Bit counts are limited to 25, not " << bits);
+  return bits;
+}
+
+// Like build_binary's model type argument and -q, -b, -a.
+lm::ngram::ModelType ParseBinaryType(const std::string &type, bool quantize, bool bhiksha) {
+  if (type == "probing") {
+    UTIL_THROW_IF(quantize || bhiksha, util::Exception, "Quantization and pointer compression are only supported by the trie");
+    return lm::ngram::PROBING;
+  }
+  UTIL_THROW_IF(type != "trie", util::Exception, "Unknown binary type " << type << ".  Use probing or trie.");
+  if (quantize) {
+    return bhiksha ? lm::ngram::QUANT_ARRAY_TRIE : lm::ngram::QUANT_TRIE;
+  } else {
+    return bhiksha ? lm::ngram::ARRAY_TRIE : lm::ngram::TRIE;
+  }
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+// Count each shard in its own process with an equal part of the memory.
+// Returns the shard files, which the caller should delete.
+std::vector<std::string> CountShardsInChildren(lm::builder::PipelineConfig config, const std::string &text, std::size_t shards) {
+  config.sort.total_memory /= shards;
+  std::string base(config.sort.temp_prefix + "shard" + boost::lexical_cast<std::string>(getpid()) + "_");
+  std::vector<std::string> files;
+  std::vector<pid_t> children;
+  for (std::size_t i = 0; i < shards; ++i) {
+    lm::builder::ShardConfig shard;
+    shard.index = i;
+    shard.count = shards;
+    shard.file = base + boost::lexical_cast<std::string>(i);
+    files.push_back(shard.file);
+    pid_t pid = fork();
+    UTIL_THROW_IF(pid == -1, util::ErrnoException, "fork for shard " << i << " failed");
+    if (!pid) {
+      try {
+        lm::builder::CountShard(config, util::OpenReadOrThrow(text.c_str()), shard);
+      } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        _exit(1);
+      }
+      _exit(0);
+    }
+    children.push_back(pid);
+  }
+  bool failed = false;
+  for (std::vector<pid_t>::const_iterator i = children.begin(); i != children.end(); ++i) {
+    int status;
+    UTIL_THROW_IF(-1 == waitpid(*i, &status, 0), util::ErrnoException, "waitpid failed");
+    failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+  }
+  UTIL_THROW_IF(failed, util::Exception, "Counting failed in a shard");
+  return files;
+}
+
+void DeleteShardFiles(const std::vector<std::string> &files) {
+  for (std::vector<std::string>::const_iterator i = files.begin(); i != files.end(); ++i) {
+    unlink(i->c_str());
+    unlink((*i + ".vocab").c_str());
+    unlink((*i + ".info").c_str());
+  }
+}
+#endif
+
 } // namespace
 
 int main(int argc, char *argv[]) {
@@ -72,7 +146,11 @@ int main(int argc, char *argv[]) {
     po::options_description options("Language model building options");
     lm::builder::PipelineConfig pipeline;
 
-    std::string text, intermediate, arpa;
+    std::string text, intermediate, arpa, binary, binary_type, shard_file;
+    std::size_t shards, shard_index;
+    std::vector<std::string> merge_shards;
+    lm::ngram::Config binary_config;
+    unsigned int prob_bits, backoff_bits, array_bits;
     std::vector<std::string> pruning;
     std::vector<std::string> discount_fallback;
     std::vector<std::string> discount_fallback_default;
@@ -94,6 +172,7 @@ int main(int argc, char *argv[]) {
       ("memory,S", lm:: SizeOption(pipeline.sort.total_memory, util::GuessPhysicalMemory() ? "80%" : "1G"), "Sorting memory")
       ("minimum_block", lm::SizeOption(pipeline.minimum_block, "8K"), "Minimum block size to allow")
       ("sort_block", lm::SizeOption(pipeline.sort.buffer_size, "64M"), "Size of IO operations for sort (determines arity)")
+      ("sort_threads", po::value<std::size_t>(&pipeline.sort.threads)->default_value(1), "Threads sorting each block.  Each sort then needs a spare block of memory beyond -S.")
       ("block_count", po::value<std::size_t>(&pipeline.block_count)->default_value(2), "Block count (per order)")
       ("vocab_estimate", po::value<lm::WordIndex>(&pipeline.vocab_estimate)->default_value(1000000), "Assume this vocabulary size for purposes of calculating memory in step 1 (corpus count) and pre-sizing the hash table")
       ("vocab_pad", po::value<uint64_t>(&pipeline.vocab_size_for_unk)->default_value(0), "If the vocabulary is smaller than this value, pad with <unk> to reach this size. Requires --interpolate_unigrams")
@@ -101,10 +180,19 @@ int main(int argc, char *argv[]) {
       ("text", po::value<std::string>(&text), "Read text from a file instead of stdin")
       ("arpa", po::value<std::string>(&arpa), "Write ARPA to a file instead of stdout")
       ("intermediate", po::value<std::string>(&intermediate), "Write ngrams to intermediate files.  Turns off ARPA output (which can be reactivated by --arpa file).  Forces --renumber on.")
+      ("binary", po::value<std::string>(&binary), "Write a KenLM binary file instead of ARPA, without going through ARPA and build_binary.  ARPA can still be written with --arpa file.")
+      ("binary_type", po::value<std::string>(&binary_type)->default_value("probing"), "Binary data structure: probing or trie.  trie forces --renumber on.")
+      ("prob_bits", po::value<unsigned int>(&prob_bits), "Quantize trie probabilities to this many bits, like build_binary -q")
+      ("backoff_bits", po::value<unsigned int>(&backoff_bits), "Quantize trie backoffs to this many bits, like build_binary -b.  Defaults to --prob_bits.")
+      ("array_bits", po::value<unsigned int>(&array_bits), "Compress trie pointers, keeping at most this many high bits in an array, like build_binary -a")
       ("renumber", po::bool_switch(&pipeline.renumber_vocabulary), "Rrenumber the vocabulary identifiers so that they are monotone with the hash of each string.  This is consistent with the ordering used by the trie data structure.")
       ("collapse_values", po::bool_switch(&pipeline.output_q), "Collapse probability and backoff into a single value, q that yields the same sentence-level probabilities.  See http://kheafield.com/professional/edinburgh/rest_paper.pdf for more details, including a proof.")
       ("prune", po::value<std::vector<std::string> >(&pruning)->multitoken(), "Prune n-grams with count less than or equal to the given threshold.  Specify one value for each order i.e. 0 0 1 to prune singleton trigrams and above.  The sequence of values must be non-decreasing and the last value applies to any remaining orders. Default is to not prune, which is equivalent to --prune 0.")
       ("limit_vocab_file", po::value<std::string>(&pipeline.prune_vocab_file)->default_value(""), "Read allowed vocabulary separated by whitespace. N-grams that contain vocabulary items not in this list will be pruned. Can be combined with --prune arg")
+      ("shards", po::value<std::size_t>(&shards)->default_value(1), "Count n-grams in this many shards, split by the hash of their last word.  Without --shard, each is counted by its own process with an equal part of -S, then estimation continues from all of them.  Requires --text.")
+      ("shard", po::value<std::size_t>(&shard_index), "Only count this shard (from 0) of --shards to --shard_file, for example on another disk or machine")
+      ("shard_file", po::value<std::string>(&shard_file), "Where --shard writes sorted n-grams.  The vocabulary and counts go to the same name plus .vocab and .info.")
+      ("merge_shards", po::value<std::vector<std::string> >(&merge_shards)->multitoken(), "Estimate from the --shard_file of every shard instead of reading text")
       ("discount_fallback", po::value<std::vector<std::string> >(&discount_fallback)->multitoken()->implicit_value(discount_fallback_default, "0.5 1 1.5"), "The closed-form estimate for Kneser-Ney discounts does not work without singletons or doubletons.  It can also fail if these values are out of range.  This option falls back to user-specified discounts when the closed-form estimate fails.  Note that this option is generally a bad idea: you should deduplicate your corpus instead.  However, class-based models need custom discounts because they lack singleton unigrams.  Provide up to three discounts (for adjusted counts 1, 2, and 3+), which will be applied to all orders where the closed-form estimates fail.");
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, options), vm);
@@ -188,11 +276,28 @@ int main(int argc, char *argv[]) {
     initial.adder_out.block_count = 2;
     pipeline.read_backoffs = initial.adder_out;
 
+    UTIL_THROW_IF(!shards, util::Exception, "There must be at least one shard.");
+    bool sharded = shards > 1 || !merge_shards.empty();
+    UTIL_THROW_IF(sharded && pipeline.prune_vocab, util::Exception, "--limit_vocab_file does not work with shards.");
+    UTIL_THROW_IF(vm.count("shard") != vm.count("shard_file"), util::Exception, "--shard and --shard_file go together.");
+    UTIL_THROW_IF(vm.count("shard") && !merge_shards.empty(), util::Exception, "--shard counts a shard and --merge_shards estimates from them.  Run them separately.");
+    UTIL_THROW_IF(shards > 1 && !vm.count("shard") && !vm.count("text"), util::Exception, "Each shard reads all of the text, so --shards needs --text.");
+
     // Read from stdin, write to stdout by default
     util::scoped_fd in(0), out(1);
     if (vm.count("text")) {
       in.reset(util::OpenReadOrThrow(text.c_str()));
     }
+
+    if (vm.count("shard")) {
+      lm::builder::ShardConfig shard;
+      shard.index = shard_index;
+      shard.count = shards;
+      shard.file = shard_file;
+      lm::builder::CountShard(pipeline, in.release(), shard);
+      util::PrintUsage(std::cerr);
+      return 0;
+    }
     if (vm.count("arpa")) {
       out.reset(util::CreateOrThrow(arpa.c_str()));
     }
@@ -202,11 +307,41 @@ int main(int argc, char *argv[]) {
       if (writing_intermediate) {
         pipeline.renumber_vocabulary = true;
       }
+      bool writing_binary = vm.count("binary");
+      lm::ngram::ModelType binary_model = lm::ngram::PROBING;
+      if (writing_binary) {
+        binary_model = ParseBinaryType(binary_type, vm.count("prob_bits"), vm.count("array_bits"));
+        UTIL_THROW_IF(vm.count("backoff_bits") && !vm.count("prob_bits"), util::Exception, "You specified --backoff_bits but not --prob_bits");
+        if (vm.count("prob_bits")) {
+          binary_config.prob_bits = ParseBitCount(prob_bits);
+          binary_config.backoff_bits = ParseBitCount(vm.count("backoff_bits") ? backoff_bits : prob_bits);
+        }
+        if (vm.count("array_bits")) binary_config.pointer_bhiksha_bits = ParseBitCount(array_bits);
+        // The trie can be built from the n-grams as they come if the vocabulary ids are in its order.
+        if (binary_model != lm::ngram::PROBING) pipeline.renumber_vocabulary = true;
+        binary_config.temporary_directory_prefix = pipeline.sort.temp_prefix;
+        binary_config.write_method = lm::ngram::Config::WRITE_MMAP;
+      }
       lm::builder::Output output(writing_intermediate ? intermediate : pipeline.sort.temp_prefix, writing_intermediate, pipeline.output_q);
-      if (!writing_intermediate || vm.count("arpa")) {
+      if ((!writing_intermediate && !writing_binary) || vm.count("arpa")) {
         output.Add(new lm::builder::PrintHook(out.release(), verbose_header));
       }
-      lm::builder::Pipeline(pipeline, in.release(), output);
+      if (writing_binary) {
+        output.Add(new lm::builder::BinaryHook(binary, binary_model, binary_config, pipeline.renumber_vocabulary));
+      }
+      if (!merge_shards.empty()) {
+        lm::builder::Pipeline(pipeline, merge_shards, output);
+      } else if (shards > 1) {
+#if !defined(_WIN32) && !defined(_WIN64)
+        std::vector<std::string> files(CountShardsInChildren(pipeline, text, shards));
+        lm::builder::Pipeline(pipeline, files, output);
+        DeleteShardFiles(files);
+#else
+        UTIL_THROW(util::Exception, "Counting shards in parallel needs fork.  Run each --shard separately then --merge_shards.");
+#endif
+      } else {
+        lm::builder::Pipeline(pipeline, in.release(), output);
+      }
     } catch (const util::MallocException &e) {
       std::cerr << e.what() << std::endl;
       std::cerr << "Try rerunning with a more conservative -S setting than " << vm["memory"].as<std::string>() << std::endl;
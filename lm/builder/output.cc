@@ -1,10 +1,16 @@
 #include "lm/builder/output.hh"
 
 #include "lm/common/model_buffer.hh"
+#include "lm/common/ngram_stream.hh"
 #include "lm/common/print.hh"
+#include "lm/model.hh"
+#include "lm/ngram_source.hh"
 #include "util/file_stream.hh"
 #include "util/stream/multi_stream.hh"
 
+#include <boost/scoped_ptr.hpp>
+
+#include <algorithm>
 #include <iostream>
 
 namespace lm { namespace builder {
@@ -25,7 +31,7 @@ void Output::SinkProbs(util::stream::Chains &chains) {
   chains >> util::stream::kRecycle;
   chains.Wait(false);
   if (Have(PROB_SEQUENTIAL_HOOK)) {
-    std::cerr << "=== 5/5 Writing ARPA model ===" << std::endl;
+    std::cerr << "=== 5/5 Writing model ===" << std::endl;
     buffer_.Source(chains);
     Apply(PROB_SEQUENTIAL_HOOK, chains);
     chains >> util::stream::kRecycle;
@@ -49,4 +55,100 @@ void PrintHook::Sink(const HeaderInfo &info, int vocab_file, util::stream::Chain
   chains >> PrintARPA(vocab_file, file_.get(), info.counts_pruned);
 }
 
+namespace {
+
+// Reads the orders one after another, like PrintARPA.
+class ChainSource : public ngram::NGramSource {
+  public:
+    ChainSource(int vocab_file, const std::vector<uint64_t> &counts, const util::stream::ChainPositions &positions, bool renumbered)
+      : vocab_(vocab_file), counts_(counts), positions_(positions), renumbered_(renumbered), order_(0) {}
+
+    ~ChainSource() {
+      // The chains are waiting for all of their blocks to be read.
+      while (order_ < positions_.size()) BeginOrder(order_ + 1);
+      Drain();
+    }
+
+    const std::vector<uint64_t> &Counts() const { return counts_; }
+
+    StringPiece Word(WordIndex index) const { return vocab_.LookupPiece(index); }
+
+    bool TrieOrder() const { return renumbered_; }
+
+    void BeginOrder(unsigned char order) {
+      UTIL_THROW_IF(order != order_ + 1, util::Exception, "Orders must be read in sequence");
+      Drain();
+      order_ = order;
+      if (order == positions_.size()) {
+        highest_.reset(new ProxyStream<NGram<Prob> >(positions_[order - 1], NGram<Prob>(NULL, order)));
+      } else {
+        lower_.reset(new ProxyStream<NGram<ProbBackoff> >(positions_[order - 1], NGram<ProbBackoff>(NULL, order)));
+      }
+    }
+
+    bool Next(WordIndex *words, ProbBackoff &weights) {
+      if (order_ == positions_.size()) {
+        ProxyStream<NGram<Prob> > &stream = *highest_;
+        if (!stream) return false;
+        std::copy(stream->begin(), stream->end(), words);
+        weights.prob = stream->Value().prob;
+        weights.backoff = 0.0;
+        ++stream;
+      } else {
+        ProxyStream<NGram<ProbBackoff> > &stream = *lower_;
+        if (!stream) return false;
+        std::copy(stream->begin(), stream->end(), words);
+        weights = stream->Value();
+        ++stream;
+      }
+      return true;
+    }
+
+  private:
+    void Drain() {
+      if (!order_) return;
+      if (order_ == positions_.size()) {
+        while (*highest_) ++*highest_;
+      } else {
+        while (*lower_) ++*lower_;
+      }
+    }
+
+    VocabReconstitute vocab_;
+    const std::vector<uint64_t> &counts_;
+    const util::stream::ChainPositions &positions_;
+    bool renumbered_;
+    std::size_t order_;
+
+    boost::scoped_ptr<ProxyStream<NGram<ProbBackoff> > > lower_;
+    boost::scoped_ptr<ProxyStream<NGram<Prob> > > highest_;
+};
+
+class WriteBinary {
+  public:
+    WriteBinary(int vocab_file, const std::vector<uint64_t> &counts, ngram::ModelType model_type, const ngram::Config &config, bool renumbered)
+      : vocab_file_(vocab_file), counts_(counts), model_type_(model_type), config_(config), renumbered_(renumbered) {}
+
+    void Run(const util::stream::ChainPositions &positions) {
+      ChainSource source(vocab_file_, counts_, positions, renumbered_);
+      ngram::WriteBinary(source, model_type_, config_);
+    }
+
+  private:
+    int vocab_file_;
+    std::vector<uint64_t> counts_;
+    ngram::ModelType model_type_;
+    ngram::Config config_;
+    bool renumbered_;
+};
+
+} // namespace
+
+void BinaryHook::Sink(const HeaderInfo &info, int vocab_file, util::stream::Chains &chains) {
+  UTIL_THROW_IF(model_type_ != ngram::PROBING && model_type_ != ngram::REST_PROBING && !renumbered_, util::Exception, "Renumber the vocabulary to build a trie");
+  ngram::Config config(config_);
+  config.write_mmap = file_.c_str();
+  chains >> WriteBinary(vocab_file, info.counts_pruned, model_type_, config, renumbered_);
+}
+
 }} // namespaces
@@ -3,11 +3,15 @@
 
 #include "lm/builder/header_info.hh"
 #include "lm/common/model_buffer.hh"
+#include "lm/binary_format.hh"
+#include "lm/config.hh"
 #include "util/file.hh"
 
 #include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/utility.hpp>
 
+#include <string>
+
 namespace util { namespace stream { class Chains; class ChainPositions; } }
 
 /* Outputs from lmplz: ARPA, sharded files, etc */
@@ -80,6 +84,22 @@ class PrintHook : public OutputHook {
     bool verbose_header_;
 };
 
+// Builds a binary file straight from the probabilities, without an ARPA file in between.
+class BinaryHook : public OutputHook {
+  public:
+    // The trie needs renumber_vocabulary so the vocabulary ids are in its order.
+    BinaryHook(const std::string &file, ngram::ModelType model_type, const ngram::Config &config, bool renumbered)
+      : OutputHook(PROB_SEQUENTIAL_HOOK), file_(file), model_type_(model_type), config_(config), renumbered_(renumbered) {}
+
+    void Sink(const HeaderInfo &info, int vocab_file, util::stream::Chains &chains);
+
+  private:
+    std::string file_;
+    ngram::ModelType model_type_;
+    ngram::Config config_;
+    bool renumbered_;
+};
+
 }} // namespaces
 
 #endif // LM_BUILDER_OUTPUT_H
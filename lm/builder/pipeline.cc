@@ -15,6 +15,9 @@
 
 #include "util/exception.hh"
 #include "util/file.hh"
+#include "util/file_piece.hh"
+#include "util/file_stream.hh"
+#include "util/fixed_array.hh"
 #include "util/stream/io.hh"
 
 #include <algorithm>
@@ -209,7 +212,7 @@ class Master {
     const unsigned int steps_;
 };
 
-util::stream::Sort<SuffixOrder, CombineCounts> *CountText(int text_file /* input */, int vocab_file /* output */, Master &master, uint64_t &token_count, WordIndex &type_count, std::string &text_file_name, std::vector<bool> &prune_words) {
+util::stream::Sort<SuffixOrder, CombineCounts> *CountText(int text_file /* input */, int vocab_file /* output */, Master &master, uint64_t &token_count, WordIndex &type_count, std::string &text_file_name, std::vector<bool> &prune_words, std::size_t shard_index = 0, std::size_t shard_count = 1) {
   const PipelineConfig &config = master.Config();
   std::cerr << "=== 1/" << master.Steps() << " Counting and sorting n-grams ===" << std::endl;
 
@@ -227,7 +230,7 @@ util::stream::Sort<SuffixOrder, CombineCounts> *CountText(int text_file /* input
   type_count = config.vocab_estimate;
   util::FilePiece text(text_file, NULL, &std::cerr);
   text_file_name = text.FileName();
-  CorpusCount counter(text, vocab_file, token_count, type_count, prune_words, config.prune_vocab_file, chain.BlockSize() / chain.EntrySize(), config.disallowed_symbol_action);
+  CorpusCount counter(text, vocab_file, token_count, type_count, prune_words, config.prune_vocab_file, chain.BlockSize() / chain.EntrySize(), config.disallowed_symbol_action, shard_index, shard_count);
   chain >> boost::ref(counter);
 
   util::scoped_ptr<util::stream::Sort<SuffixOrder, CombineCounts> > sorter(new util::stream::Sort<SuffixOrder, CombineCounts>(chain, config.sort, SuffixOrder(config.order), CombineCounts()));
@@ -326,9 +329,46 @@ class VocabNumbering {
     SpecialVocab specials_;
 };
 
-} // namespace
+// The counts that CountText returns, saved by a shard.
+struct ShardInfo {
+  std::size_t order;
+  uint64_t token_count;
+  WordIndex type_count;
+  std::size_t index, count;
+  std::string text_file_name;
+};
 
-void Pipeline(PipelineConfig &config, int text_file, Output &output) {
+const char kShardMagic[] = "lmplz_shard";
+
+void WriteShardInfo(const std::string &name, const ShardInfo &info) {
+  util::scoped_fd file(util::CreateOrThrow(name.c_str()));
+  util::FileStream out(file.get());
+  out << kShardMagic << ' ' << info.order << ' ' << info.token_count << ' ' << info.type_count << ' ' << info.index << ' ' << info.count << '\n' << info.text_file_name << '\n';
+}
+
+ShardInfo ReadShardInfo(const std::string &name) {
+  util::FilePiece in(name.c_str());
+  UTIL_THROW_IF(in.ReadDelimited() != kShardMagic, util::Exception, name << " is not an lmplz shard info file.");
+  ShardInfo ret;
+  ret.order = in.ReadULong();
+  ret.token_count = in.ReadULong();
+  ret.type_count = in.ReadULong();
+  ret.index = in.ReadULong();
+  ret.count = in.ReadULong();
+  in.ReadLine();
+  ret.text_file_name = in.ReadLine().as_string();
+  return ret;
+}
+
+void CopyFile(int from, int to) {
+  util::scoped_malloc buffer(util::MallocOrThrow(1 << 20));
+  std::size_t got;
+  while ((got = util::ReadOrEOF(from, buffer.get(), 1 << 20))) {
+    util::WriteOrThrow(to, buffer.get(), got);
+  }
+}
+
+void CheckConfig(PipelineConfig &config) {
   // Some fail-fast sanity checks.
   if (config.sort.buffer_size * 4 > config.TotalMemory()) {
     config.sort.buffer_size = config.TotalMemory() / 4;
@@ -341,6 +381,40 @@ void Pipeline(PipelineConfig &config, int text_file, Output &output) {
   UTIL_THROW_IF(config.sort.buffer_size < config.minimum_block, util::Exception, "Sort block size " << config.sort.buffer_size << " is below the minimum block size " << config.minimum_block << ".");
   UTIL_THROW_IF(config.TotalMemory() < config.minimum_block * config.order * config.block_count, util::Exception,
       "Not enough memory to fit " << (config.order * config.block_count) << " blocks with minimum size " << config.minimum_block << ".  Increase memory to " << (config.minimum_block * config.order * config.block_count) << " bytes or decrease the minimum block size.");
+}
+
+// Steps 2 onward, given the sorted counts.  The vocabulary has already been written to numbering.WriteOnTheFly().
+void Estimate(Master &master, VocabNumbering &numbering, util::scoped_ptr<util::stream::Sort<SuffixOrder, CombineCounts> > &sorted_counts, uint64_t token_count, WordIndex type_count, const std::string &text_file_name, std::vector<bool> &prune_words, Output &output) {
+  const PipelineConfig &config = master.Config();
+  std::cerr << "Unigram tokens " << token_count << " types " << type_count << std::endl;
+
+  // Create vocab mapping, which uses temporary memory, while nothing else is happening.
+  std::size_t subtract_for_numbering = numbering.ComputeMapping(type_count);
+
+  std::cerr << "=== 2/" << master.Steps() << " Calculating and sorting adjusted counts ===" << std::endl;
+  master.InitForAdjust(*sorted_counts, type_count, subtract_for_numbering);
+  sorted_counts.reset();
+
+  std::vector<uint64_t> counts;
+  std::vector<uint64_t> counts_pruned;
+  std::vector<Discount> discounts;
+  master >> AdjustCounts(config.prune_thresholds, counts, counts_pruned, prune_words, config.discount, discounts);
+  numbering.ApplyRenumber(master.MutableChains());
+
+  {
+    util::FixedArray<util::stream::FileBuffer> gammas;
+    Sorts<SuffixOrder> primary;
+    InitialProbabilities(counts, counts_pruned, discounts, master, primary, gammas, config.prune_thresholds, config.prune_vocab, numbering.Specials());
+    output.SetHeader(HeaderInfo(text_file_name, token_count, counts_pruned));
+    // Also does output.
+    InterpolateProbabilities(counts_pruned, master, primary, gammas, output, numbering.Specials());
+  }
+}
+
+} // namespace
+
+void Pipeline(PipelineConfig &config, int text_file, Output &output) {
+  CheckConfig(config);
 
   Master master(config, output.Steps());
   // master's destructor will wait for chains.  But they might be deadlocked if
@@ -353,29 +427,82 @@ void Pipeline(PipelineConfig &config, int text_file, Output &output) {
     std::vector<bool> prune_words;
     util::scoped_ptr<util::stream::Sort<SuffixOrder, CombineCounts> > sorted_counts(
         CountText(text_file, numbering.WriteOnTheFly(), master, token_count, type_count, text_file_name, prune_words));
-    std::cerr << "Unigram tokens " << token_count << " types " << type_count << std::endl;
+    Estimate(master, numbering, sorted_counts, token_count, type_count, text_file_name, prune_words, output);
+  } catch (const util::Exception &e) {
+    std::cerr << e.what() << std::endl;
+    abort();
+  }
+}
 
-    // Create vocab mapping, which uses temporary memory, while nothing else is happening.
-    std::size_t subtract_for_numbering = numbering.ComputeMapping(type_count);
+void CountShard(PipelineConfig &config, int text_file, const ShardConfig &shard) {
+  UTIL_THROW_IF(shard.index >= shard.count, util::Exception, "Shard " << shard.index << " does not exist when there are " << shard.count << " shards.  They are numbered from 0.");
+  UTIL_THROW_IF(!config.prune_vocab_file.empty(), util::Exception, "Shards do not support limiting the vocabulary.");
+  CheckConfig(config);
 
-    std::cerr << "=== 2/" << master.Steps() << " Calculating and sorting adjusted counts ===" << std::endl;
-    master.InitForAdjust(*sorted_counts, type_count, subtract_for_numbering);
-    sorted_counts.reset();
+  Master master(config, 0);
+  try {
+    util::scoped_fd vocab(util::CreateOrThrow((shard.file + ".vocab").c_str()));
+    ShardInfo info;
+    info.order = config.order;
+    info.index = shard.index;
+    info.count = shard.count;
+    std::vector<bool> prune_words;
+    util::scoped_ptr<util::stream::Sort<SuffixOrder, CombineCounts> > sorted_counts(
+        CountText(text_file, vocab.get(), master, info.token_count, info.type_count, info.text_file_name, prune_words, shard.index, shard.count));
+
+    // Merge into one sorted file, as lazily as memory allows.
+    util::scoped_fd out(util::CreateOrThrow(shard.file.c_str()));
+    util::stream::Chain chain(util::stream::ChainConfig(NGram<BuildingPayload>::TotalSize(config.order), 2, config.sort.buffer_size));
+    sorted_counts->Output(chain, config.TotalMemory() - config.sort.buffer_size);
+    chain >> util::stream::WriteAndRecycle(out.get());
+    chain.Wait(true);
+
+    WriteShardInfo(shard.file + ".info", info);
+    std::cerr << "Shard " << shard.index << " of " << shard.count << " wrote " << util::SizeOrThrow(out.get()) / NGram<BuildingPayload>::TotalSize(config.order) << ' ' << config.order << "-grams." << std::endl;
+  } catch (const util::Exception &e) {
+    std::cerr << e.what() << std::endl;
+    abort();
+  }
+}
 
-    std::vector<uint64_t> counts;
-    std::vector<uint64_t> counts_pruned;
-    std::vector<Discount> discounts;
-    master >> AdjustCounts(config.prune_thresholds, counts, counts_pruned, prune_words, config.discount, discounts);
-    numbering.ApplyRenumber(master.MutableChains());
+void Pipeline(PipelineConfig &config, const std::vector<std::string> &shard_files, Output &output) {
+  UTIL_THROW_IF(shard_files.empty(), util::Exception, "No shards to merge.");
+  UTIL_THROW_IF(!config.prune_vocab_file.empty(), util::Exception, "Shards do not support limiting the vocabulary.");
+  std::vector<ShardInfo> infos;
+  std::vector<bool> seen(shard_files.size());
+  for (std::vector<std::string>::const_iterator i = shard_files.begin(); i != shard_files.end(); ++i) {
+    infos.push_back(ReadShardInfo(*i + ".info"));
+    const ShardInfo &info = infos.back(), &first = infos.front();
+    UTIL_THROW_IF(info.order != config.order, util::Exception, "Shard " << *i << " has order " << info.order << " but the model has order " << config.order << ".");
+    UTIL_THROW_IF(info.count != shard_files.size(), util::Exception, "Shard " << *i << " is one of " << info.count << " shards, not " << shard_files.size() << ".");
+    UTIL_THROW_IF(info.token_count != first.token_count || info.type_count != first.type_count || info.text_file_name != first.text_file_name, util::Exception, "Shard " << *i << " counted different text from shard " << shard_files.front() << ".");
+    UTIL_THROW_IF(seen[info.index], util::Exception, "Shard " << info.index << " appears twice.");
+    seen[info.index] = true;
+  }
 
+  CheckConfig(config);
+  Master master(config, output.Steps());
+  try {
+    VocabNumbering numbering(output.VocabFile(), config.TempPrefix(), config.renumber_vocabulary);
+    {
+      // All shards have the same vocabulary.
+      util::scoped_fd vocab(util::OpenReadOrThrow((shard_files.front() + ".vocab").c_str()));
+      CopyFile(vocab.get(), numbering.WriteOnTheFly());
+    }
+    // The sort merges the shards in place, so they stay open until estimation is done.
+    util::FixedArray<util::scoped_fd> files(shard_files.size());
+    util::scoped_ptr<util::stream::Sort<SuffixOrder, CombineCounts> > sorted_counts;
     {
-      util::FixedArray<util::stream::FileBuffer> gammas;
-      Sorts<SuffixOrder> primary;
-      InitialProbabilities(counts, counts_pruned, discounts, master, primary, gammas, config.prune_thresholds, config.prune_vocab, numbering.Specials());
-      output.SetHeader(HeaderInfo(text_file_name, token_count, counts_pruned));
-      // Also does output.
-      InterpolateProbabilities(counts_pruned, master, primary, gammas, output, numbering.Specials());
+      std::cerr << "=== 1/" << master.Steps() << " Reading " << shard_files.size() << " shards of sorted n-grams ===" << std::endl;
+      std::vector<int> fds;
+      for (std::vector<std::string>::const_iterator i = shard_files.begin(); i != shard_files.end(); ++i) {
+        files.push_back(util::OpenReadOrThrow(i->c_str()));
+        fds.push_back(files.back().get());
+      }
+      sorted_counts.reset(new util::stream::Sort<SuffixOrder, CombineCounts>(fds, NGram<BuildingPayload>::TotalSize(config.order), config.sort, SuffixOrder(config.order), CombineCounts()));
     }
+    std::vector<bool> prune_words;
+    Estimate(master, numbering, sorted_counts, infos.front().token_count, infos.front().type_count, infos.front().text_file_name, prune_words, output);
   } catch (const util::Exception &e) {
     std::cerr << e.what() << std::endl;
     abort();
@@ -11,6 +11,7 @@
 
 #include <string>
 #include <cstddef>
+#include <vector>
 
 namespace lm { namespace builder {
 
@@ -72,5 +73,26 @@ struct PipelineConfig {
 // Takes ownership of text_file and out_arpa.
 void Pipeline(PipelineConfig &config, int text_file, Output &output);
 
+/* Sharded counting.  Counting and sorting n-grams (step 1) takes the most
+ * memory and temporary disk.  Shards split it by the hash of each n-gram's
+ * last word and can run as separate processes with their own -S and -T.  The
+ * rest of estimation needs n-grams from every shard at once (each context's
+ * sum in initial probabilities mixes last words) so it runs once, merging the
+ * shards' sorted n-grams like the runs of one big sort.
+ */
+struct ShardConfig {
+  // This shard is index of count.
+  std::size_t index, count;
+  // Sorted n-grams go here, the vocabulary to file + ".vocab" and counts to
+  // file + ".info".
+  std::string file;
+};
+
+// Step 1 for one shard.  Every shard reads all of text_file.  Takes ownership of text_file.
+void CountShard(PipelineConfig &config, int text_file, const ShardConfig &shard);
+
+// Steps 2 onward from the files of all the shards.
+void Pipeline(PipelineConfig &config, const std::vector<std::string> &shard_files, Output &output);
+
 }} // namespaces
 #endif // LM_BUILDER_PIPELINE_H
@@ -48,6 +48,9 @@ class ModelBuffer {
 
     bool Keep() const { return keep_buffer_; }
 
+    // Whether the payload is collapsed q values instead of probability and backoff.
+    bool OutputQ() const { return output_q_; }
+
   private:
     const std::string file_base_;
     const bool keep_buffer_;
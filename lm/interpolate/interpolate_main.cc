@@ -0,0 +1,106 @@
+#include "lm/builder/output.hh"
+#include "lm/common/size_option.hh"
+#include "lm/interpolate/pipeline.hh"
+#include "util/file.hh"
+#include "util/usage.hh"
+
+#include <boost/program_options.hpp>
+#include <boost/version.hpp>
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+  try {
+    namespace po = boost::program_options;
+    po::options_description options("Interpolation options");
+    lm::interpolate::Config config;
+    std::string mode, arpa, binary, binary_type;
+
+    options.add_options()
+      ("help,h", po::bool_switch(), "Show this help message")
+      ("model,m", po::value<std::vector<std::string> >(&config.models)->multitoken(), "ARPA files or lmplz --intermediate file bases to interpolate")
+      ("weight,w", po::value<std::vector<float> >(&config.weights)->multitoken(), "Weight of each model, in the same order")
+      ("mode", po::value<std::string>(&mode)->default_value("linear"), "linear: mix probabilities, with weights that sum to 1.  loglinear: multiply probabilities raised to the weights, then normalise.")
+      ("temp_prefix,T", po::value<std::string>(&config.sort.temp_prefix)->default_value("/tmp/lm"), "Temporary file prefix")
+      ("memory,S", lm::SizeOption(config.sort.total_memory, "1G"), "Sorting memory.  The models are loaded in addition to this.")
+      ("sort_block", lm::SizeOption(config.sort.buffer_size, "64M"), "Size of IO operations for sort (determines arity)")
+      ("arpa", po::value<std::string>(&arpa), "Write ARPA to a file instead of stdout")
+      ("binary", po::value<std::string>(&binary), "Write a KenLM binary file.  ARPA can still be written with --arpa file.")
+      ("binary_type", po::value<std::string>(&binary_type)->default_value("probing"), "Binary data structure: probing or trie");
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, options), vm);
+
+    if (argc == 1 || vm["help"].as<bool>()) {
+      std::cerr <<
+        "Interpolates ARPA language models into one model, so that decoding takes one\n"
+        "lookup instead of one per model.  The result has the union of the models'\n"
+        "n-grams and vocabularies with backoffs that normalise it.  lmplz\n"
+        "--intermediate output can be given by its file base instead of an ARPA file.\n\n"
+        "Example: interpolate -m in.arpa out.arpa -w 0.7 0.3 --binary mixed.binary\n\n";
+      std::cerr << options << std::endl;
+      return 1;
+    }
+    po::notify(vm);
+
+    if (mode == "linear") {
+      config.mode = lm::interpolate::LINEAR;
+    } else if (mode == "loglinear") {
+      config.mode = lm::interpolate::LOG_LINEAR;
+    } else {
+      std::cerr << "Unknown mode " << mode << ".  Use linear or loglinear." << std::endl;
+      return 1;
+    }
+    if (config.models.size() != config.weights.size()) {
+      std::cerr << "Give one weight for each model." << std::endl;
+      return 1;
+    }
+    if (config.mode == lm::interpolate::LINEAR) {
+      float sum = 0.0;
+      for (std::vector<float>::const_iterator i = config.weights.begin(); i != config.weights.end(); ++i) {
+        if (*i < 0.0) {
+          std::cerr << "Linear weights can not be negative." << std::endl;
+          return 1;
+        }
+        sum += *i;
+      }
+      if (std::fabs(sum - 1.0) > 0.0001) {
+        std::cerr << "Linear weights should sum to 1, not " << sum << '.' << std::endl;
+        return 1;
+      }
+    }
+    if (config.sort.buffer_size * 4 > config.TotalMemory()) {
+      config.sort.buffer_size = config.TotalMemory() / 4;
+      std::cerr << "Warning: changing sort block size to " << config.sort.buffer_size << " bytes due to low total memory." << std::endl;
+    }
+    util::NormalizeTempPrefix(config.sort.temp_prefix);
+
+    boost::ptr_vector<lm::builder::OutputHook> hooks;
+    if (!vm.count("binary") || vm.count("arpa")) {
+      hooks.push_back(new lm::builder::PrintHook(vm.count("arpa") ? util::CreateOrThrow(arpa.c_str()) : 1, false));
+    }
+    if (vm.count("binary")) {
+      lm::ngram::ModelType type;
+      if (binary_type == "probing") {
+        type = lm::ngram::PROBING;
+      } else if (binary_type == "trie") {
+        type = lm::ngram::TRIE;
+      } else {
+        std::cerr << "Unknown binary type " << binary_type << ".  Use probing or trie." << std::endl;
+        return 1;
+      }
+      lm::ngram::Config binary_config;
+      binary_config.temporary_directory_prefix = config.sort.temp_prefix;
+      binary_config.write_method = lm::ngram::Config::WRITE_MMAP;
+      hooks.push_back(new lm::builder::BinaryHook(binary, type, binary_config, true));
+    }
+
+    lm::interpolate::Pipeline(config, hooks);
+    util::PrintUsage(std::cerr);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,700 @@
+#include "lm/interpolate/pipeline.hh"
+
+#include "lm/builder/header_info.hh"
+#include "lm/common/compare.hh"
+#include "lm/common/model_buffer.hh"
+#include "lm/common/ngram.hh"
+#include "lm/common/print.hh"
+#include "lm/model.hh"
+#include "lm/ngram_source.hh"
+#include "lm/read_arpa.hh"
+#include "lm/vocab.hh"
+#include "util/exception.hh"
+#include "util/file.hh"
+#include "util/file_piece.hh"
+#include "util/file_stream.hh"
+#include "util/murmur_hash.hh"
+#include "util/probing_hash_table.hh"
+#include "util/stream/chain.hh"
+#include "util/stream/multi_stream.hh"
+#include "util/stream/sort.hh"
+#include "util/stream/stream.hh"
+
+#include <boost/scoped_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include <sys/stat.h>
+
+namespace lm { namespace interpolate {
+namespace {
+
+typedef ngram::ProbingModel Model;
+
+// How ARPA files write log10(0).
+const float kLogZero = -99.0;
+
+// The highest order only has probabilities, which is what the output hooks expect.
+std::size_t EntrySize(std::size_t order, std::size_t max_order) {
+  return order == max_order ? NGram<Prob>::TotalSize(order) : NGram<ProbBackoff>::TotalSize(order);
+}
+
+// Prob and ProbBackoff both start with the probability.
+float &ProbOf(NGramHeader &gram) {
+  return *reinterpret_cast<float*>(gram.end());
+}
+
+// Looks up merged ids for ReadNGram.
+class MergedIndex {
+  public:
+    MergedIndex(const ngram::GrowableVocab<> &vocab, const std::vector<WordIndex> &renumber)
+      : vocab_(vocab), renumber_(renumber) {}
+
+    WordIndex Index(const StringPiece &str) const {
+      return renumber_[vocab_.Index(str)];
+    }
+
+    // From an id that vocab gave.
+    WordIndex Renumber(WordIndex id) const {
+      return renumber_[id];
+    }
+
+  private:
+    const ngram::GrowableVocab<> &vocab_;
+    const std::vector<WordIndex> &renumber_;
+};
+
+// Adds word to vocab, writing it to words like WriteUniqueWords if it is new.
+WordIndex AddWord(const StringPiece &word, ngram::GrowableVocab<> &vocab, util::FileStream &words) {
+  WordIndex before = vocab.Size();
+  WordIndex ret = vocab.FindOrInsert(word);
+  if (ret == before) words << word << '\0';
+  return ret;
+}
+
+// One of the models to interpolate.  Its n-grams are listed one order at a
+// time, so each file is read once.
+class Input {
+  public:
+    virtual ~Input() {}
+
+    const std::string &Name() const { return name_; }
+
+    const std::vector<uint64_t> &Counts() const { return counts_; }
+
+    virtual void ReadUnigrams(ngram::GrowableVocab<> &vocab, util::FileStream &words) = 0;
+
+    // Writes the n-grams of this order to out with merged ids.
+    virtual void ReadOrder(std::size_t order, const MergedIndex &index, util::stream::Stream &out) = 0;
+
+    // The model for querying.
+    virtual Model *Load(const ngram::Config &config) = 0;
+
+  protected:
+    explicit Input(const std::string &name) : name_(name) {}
+
+    std::string name_;
+    std::vector<uint64_t> counts_;
+};
+
+class ARPAInput : public Input {
+  public:
+    explicit ARPAInput(const std::string &name) : Input(name), file_(name.c_str()) {
+      ReadARPACounts(file_, counts_);
+    }
+
+    void ReadUnigrams(ngram::GrowableVocab<> &vocab, util::FileStream &words) {
+      ReadNGramHeader(file_, 1);
+      for (uint64_t j = 0; j < counts_[0]; ++j) {
+        file_.ReadFloat();
+        UTIL_THROW_IF(file_.get() != '\t', FormatLoadException, "Expected tab after probability in " << name_);
+        AddWord(file_.ReadDelimited(kARPASpaces), vocab, words);
+        float backoff;
+        ReadBackoff(file_, backoff);
+      }
+      if (counts_.size() == 1) ReadEnd(file_);
+    }
+
+    void ReadOrder(std::size_t order, const MergedIndex &index, util::stream::Stream &out) {
+      if (counts_.size() < order) return;
+      PositiveProbWarn warn(SILENT);
+      ProbBackoff ignored;
+      ReadNGramHeader(file_, order);
+      for (uint64_t j = 0; j < counts_[order - 1]; ++j, ++out) {
+        ReadNGram(file_, order, index, static_cast<WordIndex*>(out.Get()), ignored, warn);
+      }
+      if (counts_.size() == order) ReadEnd(file_);
+    }
+
+    Model *Load(const ngram::Config &config) {
+      return new Model(name_.c_str(), config);
+    }
+
+  private:
+    util::FilePiece file_;
+};
+
+// Reads the orders of lmplz --intermediate output one after another.
+class BufferSource : public ngram::NGramSource {
+  public:
+    explicit BufferSource(ModelBuffer &buffer) : buffer_(buffer), vocab_(buffer.VocabFile()), order_(0) {}
+
+    ~BufferSource() { Drain(); }
+
+    const std::vector<uint64_t> &Counts() const { return buffer_.Counts(); }
+
+    StringPiece Word(WordIndex index) const { return vocab_.LookupPiece(index); }
+
+    // --intermediate forces --renumber.
+    bool TrieOrder() const { return true; }
+
+    void BeginOrder(unsigned char order) {
+      Drain();
+      order_ = order;
+      // Every order has room for a backoff, like lmplz's chains.
+      chain_.reset(new util::stream::Chain(util::stream::ChainConfig(NGram<ProbBackoff>::TotalSize(order), 2, kBufferReadMemory)));
+      buffer_.Source(order - 1, *chain_);
+      stream_.reset(new util::stream::Stream(chain_->Add()));
+      *chain_ >> util::stream::kRecycle;
+    }
+
+    bool Next(WordIndex *words, ProbBackoff &weights) {
+      util::stream::Stream &stream = *stream_;
+      if (!stream) return false;
+      NGram<ProbBackoff> gram(stream.Get(), order_);
+      std::copy(gram.begin(), gram.end(), words);
+      weights = gram.Value();
+      if (order_ == buffer_.Order()) weights.backoff = 0.0;
+      ++stream;
+      return true;
+    }
+
+  private:
+    // The chain waits for all of its blocks to be read.
+    void Drain() {
+      if (!stream_) return;
+      while (*stream_) ++*stream_;
+      stream_.reset();
+      chain_.reset();
+    }
+
+    static const std::size_t kBufferReadMemory = 1 << 20;
+
+    ModelBuffer &buffer_;
+    VocabReconstitute vocab_;
+    std::size_t order_;
+
+    boost::scoped_ptr<util::stream::Chain> chain_;
+    boost::scoped_ptr<util::stream::Stream> stream_;
+};
+
+// lmplz --intermediate output, named by its file base.
+class BufferInput : public Input {
+  public:
+    explicit BufferInput(const std::string &name) : Input(name), buffer_(name) {
+      UTIL_THROW_IF(buffer_.OutputQ(), util::Exception, name << " has collapsed q values instead of probabilities and backoffs.  Run lmplz without --collapse_values.");
+      counts_ = buffer_.Counts();
+    }
+
+    void ReadUnigrams(ngram::GrowableVocab<> &vocab, util::FileStream &words) {
+      VocabReconstitute strings(buffer_.VocabFile());
+      ids_.resize(strings.Size());
+      for (WordIndex i = 0; i < strings.Size(); ++i) {
+        ids_[i] = AddWord(strings.LookupPiece(i), vocab, words);
+      }
+    }
+
+    void ReadOrder(std::size_t order, const MergedIndex &index, util::stream::Stream &out) {
+      if (counts_.size() < order) return;
+      BufferSource source(buffer_);
+      source.BeginOrder(order);
+      ProbBackoff ignored;
+      for (uint64_t j = 0; j < counts_[order - 1]; ++j, ++out) {
+        WordIndex *words = static_cast<WordIndex*>(out.Get());
+        UTIL_THROW_IF(!source.Next(words, ignored), FormatLoadException, "Fewer " << order << "-grams than the counts say in " << name_);
+        for (WordIndex *i = words; i != words + order; ++i) {
+          *i = index.Renumber(ids_[*i]);
+        }
+      }
+    }
+
+    Model *Load(const ngram::Config &config) {
+      BufferSource source(buffer_);
+      return new Model(source, config);
+    }
+
+  private:
+    ModelBuffer buffer_;
+    // The buffer's ids to the merged vocabulary's, before renumbering.
+    std::vector<WordIndex> ids_;
+};
+
+bool IsModelBuffer(const std::string &name) {
+  struct stat info;
+  return !stat((name + ".kenlm_intermediate").c_str(), &info);
+}
+
+class Inputs {
+  public:
+    explicit Inputs(const std::vector<std::string> &names) : order_(0) {
+      for (std::size_t i = 0; i < names.size(); ++i) {
+        if (IsModelBuffer(names[i])) {
+          inputs_.push_back(new BufferInput(names[i]));
+        } else {
+          inputs_.push_back(new ARPAInput(names[i]));
+        }
+        order_ = std::max(order_, inputs_.back().Counts().size());
+      }
+    }
+
+    std::size_t Order() const { return order_; }
+
+    std::size_t size() const { return inputs_.size(); }
+
+    Input &operator[](std::size_t i) { return inputs_[i]; }
+
+    uint64_t UnigramBound() const {
+      uint64_t ret = 0;
+      for (std::size_t i = 0; i < inputs_.size(); ++i) ret += inputs_[i].Counts()[0];
+      return ret;
+    }
+
+    // Adds every model's unigrams to vocab, writing new words to words.
+    void ReadUnigrams(ngram::GrowableVocab<> &vocab, util::FileStream &words) {
+      for (std::size_t i = 0; i < inputs_.size(); ++i) {
+        inputs_[i].ReadUnigrams(vocab, words);
+      }
+    }
+
+    // Writes every model's n-grams of this order, with their words mapped by index.
+    void ReadOrder(std::size_t order, const MergedIndex &index, const util::stream::ChainPosition &position) {
+      util::stream::Stream out(position);
+      for (std::size_t i = 0; i < inputs_.size(); ++i) {
+        inputs_[i].ReadOrder(order, index, out);
+      }
+      out.Poison();
+    }
+
+  private:
+    boost::ptr_vector<Input> inputs_;
+    std::size_t order_;
+};
+
+class ReadUnion {
+  public:
+    ReadUnion(Inputs &inputs, const MergedIndex &index, std::size_t order)
+      : inputs_(&inputs), index_(&index), order_(order) {}
+
+    void Run(const util::stream::ChainPosition &position) {
+      inputs_->ReadOrder(order_, *index_, position);
+    }
+
+  private:
+    Inputs *inputs_;
+    const MergedIndex *index_;
+    std::size_t order_;
+};
+
+// Every word is a unigram of the result.
+class AllUnigrams {
+  public:
+    explicit AllUnigrams(WordIndex types) : types_(types) {}
+
+    void Run(const util::stream::ChainPosition &position) {
+      util::stream::Stream out(position);
+      for (WordIndex i = 0; i < types_; ++i, ++out) {
+        *static_cast<WordIndex*>(out.Get()) = i;
+      }
+      out.Poison();
+    }
+
+  private:
+    WordIndex types_;
+};
+
+// Drops copies of an n-gram that several models have while merging.
+struct DropDuplicate {
+  bool operator()(void *first, const void *second, const ContextOrder &compare) const {
+    return !memcmp(first, second, sizeof(WordIndex) * compare.Order());
+  }
+};
+
+// Sort only combines while merging blocks, so copies in the same block remain.
+class Unique {
+  public:
+    explicit Unique(std::size_t order) : order_(order) {}
+
+    void Run(const util::stream::ChainPosition &position) {
+      const std::size_t entry_size = position.GetChain().EntrySize();
+      const std::size_t key_size = order_ * sizeof(WordIndex);
+      std::vector<uint8_t> last(key_size);
+      bool have_last = false;
+      for (util::stream::Link link(position); link; ++link) {
+        uint8_t *const begin = static_cast<uint8_t*>(link->Get());
+        const uint8_t *const end = begin + link->ValidSize();
+        uint8_t *out = begin;
+        for (const uint8_t *in = begin; in != end; in += entry_size) {
+          if (have_last && !memcmp(in, &last[0], key_size)) continue;
+          memcpy(&last[0], in, key_size);
+          have_last = true;
+          if (out != in) memmove(out, in, entry_size);
+          out += entry_size;
+        }
+        link->SetValidSize(out - begin);
+      }
+    }
+
+  private:
+    std::size_t order_;
+};
+
+// The input models, queried with merged ids.
+class Models {
+  public:
+    Models(Inputs &inputs, const std::vector<float> &weights, const VocabReconstitute &vocab) : weights_(weights) {
+      ngram::Config load;
+      load.show_progress = false;
+      ids_.resize(inputs.size());
+      for (std::size_t i = 0; i < inputs.size(); ++i) {
+        std::cerr << "Loading " << inputs[i].Name() << std::endl;
+        models_.push_back(inputs[i].Load(load));
+        const ngram::Vocabulary &model_vocab = models_.back().GetVocabulary();
+        ids_[i].resize(vocab.Size());
+        for (WordIndex w = 0; w < vocab.Size(); ++w) {
+          ids_[i][w] = model_vocab.Index(vocab.LookupPiece(w));
+        }
+      }
+    }
+
+    // Weighted sum of the models' log10 p(*(end - 1) | [begin, end - 1)).
+    double Score(const WordIndex *begin, const WordIndex *end) const {
+      double ret = 0.0;
+      WordIndex reversed[KENLM_MAX_ORDER];
+      ngram::State ignored;
+      for (std::size_t i = 0; i < models_.size(); ++i) {
+        std::size_t context = Reverse(i, begin, end - 1, reversed);
+        ret += weights_[i] * models_[i].FullScoreForgotState(reversed, reversed + context, ids_[i][*(end - 1)], ignored).prob;
+      }
+      return ret;
+    }
+
+    // The linear mixture of the models' p(*(end - 1) | [begin, end - 1)).  A
+    // model contributes nothing for words outside its vocabulary, otherwise
+    // its <unk> mass would be counted once for each of them.
+    double Mixture(const WordIndex *begin, const WordIndex *end) const {
+      double ret = 0.0;
+      WordIndex reversed[KENLM_MAX_ORDER];
+      ngram::State ignored;
+      for (std::size_t i = 0; i < models_.size(); ++i) {
+        if (*(end - 1) != kUNK && ids_[i][*(end - 1)] == kUNK) continue;
+        std::size_t context = Reverse(i, begin, end - 1, reversed);
+        ret += weights_[i] * pow(10.0, models_[i].FullScoreForgotState(reversed, reversed + context, ids_[i][*(end - 1)], ignored).prob);
+      }
+      return ret;
+    }
+
+    // Weighted sum of the log10 backoffs that each model applies to words it
+    // does not list after [begin, end).
+    double Backoff(const WordIndex *begin, const WordIndex *end) const {
+      double ret = 0.0;
+      WordIndex reversed[KENLM_MAX_ORDER];
+      ngram::State state;
+      for (std::size_t i = 0; i < models_.size(); ++i) {
+        // Longer contexts are cut to the model's order, so the word before makes no difference.
+        if (end - begin >= static_cast<std::ptrdiff_t>(models_[i].Order())) continue;
+        std::size_t context = Reverse(i, begin, end, reversed);
+        models_[i].GetState(reversed, reversed + context, state);
+        if (state.length == context) ret += weights_[i] * state.backoff[context - 1];
+      }
+      return ret;
+    }
+
+  private:
+    std::size_t Reverse(std::size_t model, const WordIndex *begin, const WordIndex *end, WordIndex *out) const {
+      std::size_t length = std::min<std::size_t>(end - begin, KENLM_MAX_ORDER - 1);
+      const std::vector<WordIndex> &ids = ids_[model];
+      for (const WordIndex *i = end; i != end - length; ++out) {
+        *out = ids[*--i];
+      }
+      return length;
+    }
+
+    boost::ptr_vector<Model> models_;
+    std::vector<float> weights_;
+    // Merged id to each model's id.
+    std::vector<std::vector<WordIndex> > ids_;
+};
+
+struct LowerEntry {
+  typedef uint64_t Key;
+  uint64_t key;
+  // LINEAR: log10 probability.  LOG_LINEAR: the weighted sum of the models'
+  // log10 probabilities, before dividing by the context's normaliser.
+  float prob;
+  float backoff;
+  // LOG_LINEAR: log10 normaliser, if the n-gram is a context.
+  float log_z;
+  // An n-gram of the result and not only a context.
+  bool listed;
+  bool context;
+
+  Key GetKey() const { return key; }
+  void SetKey(Key to) { key = to; }
+};
+
+// The merged model's n-grams below the highest order, as they are computed.
+class Lower {
+  public:
+    Lower(Mode mode, const Models &models) : mode_(mode), models_(models), unigram_log_z_(0.0) {}
+
+    LowerEntry &Insert(const WordIndex *begin, const WordIndex *end) {
+      LowerEntry entry;
+      entry.key = Hash(begin, end);
+      Table::MutableIterator it;
+      if (!table_.FindOrInsert(entry, it)) {
+        it->prob = 0.0;
+        it->backoff = 0.0;
+        it->log_z = 0.0;
+        it->listed = false;
+        it->context = false;
+      }
+      return *it;
+    }
+
+    const LowerEntry *Find(const WordIndex *begin, const WordIndex *end) const {
+      Table::ConstIterator it;
+      return table_.Find(Hash(begin, end), it) ? &*it : NULL;
+    }
+
+    void SetUnigramLogZ(double to) { unigram_log_z_ = to; }
+
+    // LINEAR: log10 p(*(end - 1) | [begin, end - 1)) with backoff.
+    double LogProb(const WordIndex *begin, const WordIndex *end) const {
+      double backoff = 0.0;
+      for (;; ++begin) {
+        const LowerEntry *entry = Find(begin, end);
+        // Every word is a unigram so this ends.
+        if (entry && entry->listed) return backoff + entry->prob;
+        entry = Find(begin, end - 1);
+        if (entry) backoff += entry->backoff;
+      }
+    }
+
+    // LOG_LINEAR: log10 of the sum over all words w of 10^(weighted sum of
+    // the models' log10 p(w | [begin, end))).
+    double LogZ(const WordIndex *begin, const WordIndex *end) const {
+      if (begin == end) return unigram_log_z_;
+      const LowerEntry *entry = Find(begin, end);
+      if (entry && entry->context) return entry->log_z;
+      // Nothing follows this context, so every word backs off in every model.
+      return models_.Backoff(begin, end) + LogZ(begin + 1, end);
+    }
+
+    Mode GetMode() const { return mode_; }
+    const Models &GetModels() const { return models_; }
+
+  private:
+    static uint64_t Hash(const WordIndex *begin, const WordIndex *end) {
+      return util::MurmurHashNative(begin, (end - begin) * sizeof(WordIndex));
+    }
+
+    typedef util::AutoProbing<LowerEntry, util::IdentityHash> Table;
+    Table table_;
+
+    Mode mode_;
+    const Models &models_;
+    double unigram_log_z_;
+};
+
+/* Computes the n-grams of one order, which arrive grouped by context.  The
+ * probability is written in place.  Contexts' backoffs and normalisers go to
+ * lower since they have a lower order.
+ */
+class Mix {
+  public:
+    Mix(Lower &lower, std::size_t order, std::size_t max_order, WordIndex bos, uint64_t &count)
+      : lower_(lower), models_(lower.GetModels()), order_(order), max_order_(max_order), bos_(bos), count_(count) {}
+
+    void Run(const util::stream::ChainPosition &position) {
+      count_ = 0;
+      std::vector<WordIndex> context;
+      bool started = false;
+      for (util::stream::Stream stream(position); stream; ++stream) {
+        NGramHeader gram(stream.Get(), order_);
+        if (!started || !std::equal(gram.begin(), gram.end() - 1, context.begin())) {
+          if (started) EndContext(context);
+          context.assign(gram.begin(), gram.end() - 1);
+          started = true;
+          sum_ = 0.0;
+          lower_sum_ = 0.0;
+        }
+        ProbOf(gram) = Add(gram);
+        ++count_;
+      }
+      if (started) EndContext(context);
+    }
+
+  private:
+    float Add(const NGramHeader &gram) {
+      double prob;
+      if (*(gram.end() - 1) == bos_) {
+        // The models score <s> as certain, but it is never predicted.
+        prob = kLogZero;
+      } else if (lower_.GetMode() == LINEAR) {
+        double mixed = models_.Mixture(gram.begin(), gram.end());
+        prob = log10(mixed);
+        sum_ += mixed;
+        if (order_ > 1) lower_sum_ += pow(10.0, lower_.LogProb(gram.begin() + 1, gram.end()));
+      } else {
+        prob = models_.Score(gram.begin(), gram.end());
+        sum_ += pow(10.0, prob);
+        if (order_ > 1) lower_sum_ += pow(10.0, models_.Score(gram.begin() + 1, gram.end()));
+      }
+      if (order_ != max_order_) {
+        LowerEntry &entry = lower_.Insert(gram.begin(), gram.end());
+        entry.prob = prob;
+        entry.listed = true;
+      }
+      return prob;
+    }
+
+    void EndContext(const std::vector<WordIndex> &context) {
+      if (context.empty()) {
+        if (lower_.GetMode() == LOG_LINEAR) lower_.SetUnigramLogZ(log10(sum_));
+        return;
+      }
+      const WordIndex *begin = &*context.begin(), *end = begin + context.size();
+      if (lower_.GetMode() == LINEAR) {
+        // Leftover mass over the lower order's mass for the same words.
+        double left = 1.0 - sum_, lower_left = 1.0 - lower_sum_;
+        float backoff = 0.0;
+        if (lower_left > 0.0) backoff = (left > 0.0) ? log10(left / lower_left) : kLogZero;
+        lower_.Insert(begin, end).backoff = backoff;
+      } else {
+        // Words the context does not list get the lower order's score plus
+        // the models' backoffs.  Summing those over all words is the lower
+        // order's normaliser minus the listed words.
+        double backoff = models_.Backoff(begin, end);
+        double lower_log_z = lower_.LogZ(begin + 1, end);
+        double unlisted = std::max(0.0, pow(10.0, lower_log_z) - lower_sum_);
+        double log_z = log10(sum_ + pow(10.0, backoff) * unlisted);
+        LowerEntry &entry = lower_.Insert(begin, end);
+        entry.log_z = log_z;
+        entry.context = true;
+        entry.backoff = backoff + lower_log_z - log_z;
+      }
+    }
+
+    Lower &lower_;
+    const Models &models_;
+    const std::size_t order_, max_order_;
+    const WordIndex bos_;
+    uint64_t &count_;
+
+    // Over the current context.
+    double sum_, lower_sum_;
+};
+
+// Normalises and adds backoffs, which are known once the next order is done.
+class Finish {
+  public:
+    Finish(const Lower &lower, std::size_t order, std::size_t max_order)
+      : lower_(&lower), order_(order), max_order_(max_order) {}
+
+    void Run(const util::stream::ChainPosition &position) {
+      for (util::stream::Stream stream(position); stream; ++stream) {
+        NGramHeader gram(stream.Get(), order_);
+        if (lower_->GetMode() == LOG_LINEAR && ProbOf(gram) > kLogZero) {
+          ProbOf(gram) -= lower_->LogZ(gram.begin(), gram.end() - 1);
+        }
+        if (order_ != max_order_) {
+          reinterpret_cast<ProbBackoff*>(gram.end())->backoff = lower_->Find(gram.begin(), gram.end())->backoff;
+        }
+      }
+    }
+
+  private:
+    const Lower *lower_;
+    std::size_t order_, max_order_;
+};
+
+} // namespace
+
+void Pipeline(const Config &config, boost::ptr_vector<builder::OutputHook> &hooks) {
+  UTIL_THROW_IF(config.models.empty(), util::Exception, "No models to interpolate.");
+  UTIL_THROW_IF(config.models.size() != config.weights.size(), util::Exception, "There are " << config.models.size() << " models but " << config.weights.size() << " weights.");
+  // Each order gets half of the memory for its chain and half for lazily merging.
+  const std::size_t half = config.TotalMemory() / 2;
+  try {
+    std::cerr << "=== 1/4 Merging vocabularies ===" << std::endl;
+    Inputs inputs(config.models);
+    const std::size_t max_order = inputs.Order();
+    UTIL_THROW_IF(max_order > KENLM_MAX_ORDER, util::Exception, "This was compiled with KENLM_MAX_ORDER " << KENLM_MAX_ORDER << " but a model has order " << max_order << ".");
+    ngram::GrowableVocab<> vocab(inputs.UnigramBound(), ngram::NoOpUniqueWords());
+    util::scoped_fd vocab_file(util::MakeTemp(config.TempPrefix()));
+    std::vector<WordIndex> renumber;
+    {
+      util::scoped_fd unordered(util::MakeTemp(config.TempPrefix()));
+      {
+        util::FileStream words(unordered.get());
+        words << "<unk>" << '\0' << "<s>" << '\0' << "</s>" << '\0';
+        inputs.ReadUnigrams(vocab, words);
+      }
+      // Number words the way the trie does, so every binary format can be built.
+      ngram::SortedVocabulary::ComputeRenumbering(vocab.Size(), unordered.get(), vocab_file.get(), renumber);
+    }
+    MergedIndex index(vocab, renumber);
+    std::cerr << "Merged vocabulary has " << vocab.Size() << " words." << std::endl;
+
+    std::cerr << "=== 2/4 Loading models ===" << std::endl;
+    Models models(inputs, config.weights, VocabReconstitute(vocab_file.get()));
+    Lower lower(config.mode, models);
+
+    std::cerr << "=== 3/4 Interpolating ===" << std::endl;
+    std::vector<uint64_t> counts(max_order);
+    util::stream::Sorts<SuffixOrder> sorted(max_order);
+    for (std::size_t order = 1; order <= max_order; ++order) {
+      util::stream::Chain chain(util::stream::ChainConfig(EntrySize(order, max_order), 2, half));
+      if (order == 1) {
+        chain >> AllUnigrams(vocab.Size());
+      } else {
+        chain >> ReadUnion(inputs, index, order);
+      }
+      util::stream::Sort<ContextOrder, DropDuplicate> by_context(chain, config.sort, ContextOrder(order));
+      chain.Wait(true);
+
+      by_context.Output(chain, half);
+      Mix mix(lower, order, max_order, renumber[1], counts[order - 1]);
+      chain >> Unique(order) >> boost::ref(mix);
+      sorted.push_back(chain, config.sort, SuffixOrder(order));
+      chain.Wait(true);
+      std::cerr << order << "-grams: " << counts[order - 1] << std::endl;
+    }
+
+    std::cerr << "=== 4/4 Writing model ===" << std::endl;
+    util::stream::Chains chains(max_order);
+    for (std::size_t order = 1; order <= max_order; ++order) {
+      const std::size_t share = config.TotalMemory() / max_order;
+      chains.push_back(util::stream::ChainConfig(EntrySize(order, max_order), 2, share / 2));
+      sorted[order - 1].Output(chains.back(), share / 2);
+      chains.back() >> Finish(lower, order, max_order);
+    }
+    std::string names(config.models.front());
+    for (std::size_t i = 1; i < config.models.size(); ++i) names += ' ' + config.models[i];
+    builder::HeaderInfo header(names, 0, counts);
+    for (boost::ptr_vector<builder::OutputHook>::iterator hook = hooks.begin(); hook != hooks.end(); ++hook) {
+      hook->Sink(header, vocab_file.get(), chains);
+    }
+    chains >> util::stream::kRecycle;
+    chains.Wait(true);
+  } catch (const util::Exception &e) {
+    // Chains might be deadlocked waiting for this thread.
+    std::cerr << e.what() << std::endl;
+    abort();
+  }
+}
+
+}} // namespaces
@@ -0,0 +1,50 @@
+#ifndef LM_INTERPOLATE_PIPELINE_H
+#define LM_INTERPOLATE_PIPELINE_H
+
+#include "lm/builder/output.hh"
+#include "util/stream/config.hh"
+
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <string>
+#include <vector>
+
+/* Offline interpolation of several models into one.  The n-grams of
+ * the result are the union of the models' n-grams.  Each n-gram's probability
+ * is the mixture of the models' probabilities (with backoff) and each
+ * context's backoff is set so that the result is normalised.
+ */
+namespace lm { namespace interpolate {
+
+enum Mode {
+  // p(w | c) = sum_i weight_i p_i(w | c).  Unlisted n-grams get backoff times
+  // the lower order, as in SRILM's static interpolation, which is not exactly
+  // the mixture.
+  LINEAR,
+  // p(w | c) is proportional to prod_i p_i(w | c)^weight_i.  This is exact:
+  // the backoffs carry the normalisation.
+  LOG_LINEAR
+};
+
+struct Config {
+  // ARPA files or lmplz --intermediate file bases, which list their n-grams.
+  // KenLM binary files are not read: a probing file only stores hashes.
+  std::vector<std::string> models;
+  std::vector<float> weights;
+
+  Mode mode;
+
+  // Memory and temporary files for sorting n-grams.  The models and a table of
+  // the merged lower orders are also held in memory, outside of this.
+  util::stream::SortConfig sort;
+
+  const std::string &TempPrefix() const { return sort.temp_prefix; }
+  std::size_t TotalMemory() const { return sort.total_memory; }
+};
+
+// Each hook gets the whole model.  The vocabulary is in trie order.
+void Pipeline(const Config &config, boost::ptr_vector<builder::OutputHook> &hooks);
+
+}} // namespaces
+
+#endif // LM_INTERPOLATE_PIPELINE_H
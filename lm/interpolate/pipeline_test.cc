@@ -0,0 +1,204 @@
+#include "lm/interpolate/pipeline.hh"
+
+#include "lm/builder/output.hh"
+#include "lm/enumerate_vocab.hh"
+#include "lm/model.hh"
+#include "util/file.hh"
+
+#define BOOST_TEST_MODULE InterpolatePipelineTest
+#include <boost/test/unit_test.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace lm { namespace interpolate { namespace {
+
+typedef ngram::ProbingModel Model;
+
+// Models that lmplz estimated from different texts with different vocabularies.
+// bjam reverses the command line arguments randomly.
+std::string TestLocation(const char *name) {
+  int argc = boost::unit_test::framework::master_test_suite().argc;
+  char **argv = boost::unit_test::framework::master_test_suite().argv;
+  for (int i = 1; i < argc; ++i) {
+    if (strstr(argv[i], name)) return argv[i];
+  }
+  return name;
+}
+
+class CollectVocab : public EnumerateVocab {
+  public:
+    void Add(WordIndex, const StringPiece &str) {
+      words.push_back(std::string(str.data(), str.size()));
+    }
+
+    std::vector<std::string> words;
+};
+
+Model *Load(const char *file, std::vector<std::string> *words = NULL) {
+  CollectVocab vocab;
+  ngram::Config config;
+  config.messages = NULL;
+  if (words) config.enumerate_vocab = &vocab;
+  Model *ret = new Model(file, config);
+  if (words) words->swap(vocab.words);
+  return ret;
+}
+
+// Interpolates the models and loads the result, with its vocabulary in words.
+Model *Interpolate(const std::vector<std::string> &models, const std::vector<float> &weights, Mode mode, std::vector<std::string> &words) {
+  Config config;
+  config.models = models;
+  config.weights = weights;
+  config.mode = mode;
+  config.sort.temp_prefix = "pipeline_test_temp";
+  config.sort.buffer_size = 1 << 16;
+  config.sort.total_memory = 1 << 22;
+  {
+    boost::ptr_vector<builder::OutputHook> hooks;
+    hooks.push_back(new builder::PrintHook(util::CreateOrThrow("pipeline_test.arpa"), false));
+    Pipeline(config, hooks);
+  }
+  Model *ret = Load("pipeline_test.arpa", &words);
+  unlink("pipeline_test.arpa");
+  return ret;
+}
+
+// Every context of up to order - 1 words.  The vocabulary is small.
+void Contexts(const std::vector<std::string> &words, unsigned char order, std::vector<std::vector<std::string> > &out) {
+  out.assign(1, std::vector<std::string>());
+  for (std::size_t begin = 0; begin < out.size(); ++begin) {
+    if (out[begin].size() + 1 == order) continue;
+    for (std::vector<std::string>::const_iterator w = words.begin(); w != words.end(); ++w) {
+      if (*w == "</s>" || (*w == "<s>" && !out[begin].empty())) continue;
+      out.push_back(out[begin]);
+      out.back().insert(out.back().begin(), *w);
+    }
+  }
+}
+
+// log10 p(word | context) with context in text order.
+FullScoreReturn Score(const Model &model, const std::vector<std::string> &context, const std::string &word) {
+  std::vector<WordIndex> reversed;
+  for (std::vector<std::string>::const_reverse_iterator i = context.rbegin(); i != context.rend(); ++i) {
+    reversed.push_back(model.GetVocabulary().Index(*i));
+  }
+  ngram::State ignored;
+  const WordIndex *begin = reversed.empty() ? NULL : &reversed[0];
+  return model.FullScoreForgotState(begin, begin + reversed.size(), model.GetVocabulary().Index(word), ignored);
+}
+
+// Sum over the words that can be predicted.
+void CheckNormalised(const Model &model, const std::vector<std::string> &words) {
+  std::vector<std::vector<std::string> > contexts;
+  Contexts(words, model.Order(), contexts);
+  for (std::vector<std::vector<std::string> >::const_iterator c = contexts.begin(); c != contexts.end(); ++c) {
+    double sum = 0.0;
+    for (std::vector<std::string>::const_iterator w = words.begin(); w != words.end(); ++w) {
+      if (*w != "<s>") sum += pow(10.0, Score(model, *c, *w).prob);
+    }
+    BOOST_CHECK_SMALL(sum - 1.0, 1e-5);
+  }
+}
+
+void SelfMix(Mode mode) {
+  std::vector<std::string> models(2, TestLocation("test_a.arpa")), words;
+  boost::scoped_ptr<Model> original(Load(models[0].c_str()));
+  boost::scoped_ptr<Model> mixed(Interpolate(models, std::vector<float>(2, 0.5), mode, words));
+  BOOST_CHECK_EQUAL(original->GetVocabulary().Bound(), mixed->GetVocabulary().Bound());
+
+  std::vector<std::vector<std::string> > contexts;
+  Contexts(words, mixed->Order(), contexts);
+  for (std::vector<std::vector<std::string> >::const_iterator c = contexts.begin(); c != contexts.end(); ++c) {
+    for (std::vector<std::string>::const_iterator w = words.begin(); w != words.end(); ++w) {
+      if (*w == "<s>") continue;
+      BOOST_CHECK_SMALL(pow(10.0, Score(*mixed, *c, *w).prob) - pow(10.0, Score(*original, *c, *w).prob), 1e-6);
+    }
+  }
+  CheckNormalised(*mixed, words);
+}
+
+BOOST_AUTO_TEST_CASE(SelfMixLinear) {
+  SelfMix(LINEAR);
+}
+
+BOOST_AUTO_TEST_CASE(SelfMixLogLinear) {
+  SelfMix(LOG_LINEAR);
+}
+
+// Listed n-grams are the mixture.  Others back off, SRILM style.
+BOOST_AUTO_TEST_CASE(Linear) {
+  std::vector<std::string> models, words;
+  models.push_back(TestLocation("test_a.arpa"));
+  models.push_back(TestLocation("test_b.arpa"));
+  std::vector<float> weights;
+  weights.push_back(0.3);
+  weights.push_back(0.7);
+  std::vector<std::string> a_words, b_words;
+  boost::scoped_ptr<Model> a(Load(models[0].c_str(), &a_words)), b(Load(models[1].c_str(), &b_words));
+  boost::scoped_ptr<Model> mixed(Interpolate(models, weights, LINEAR, words));
+  // The union of the vocabularies.
+  std::sort(a_words.begin(), a_words.end());
+  std::sort(b_words.begin(), b_words.end());
+  std::vector<std::string> both;
+  std::set_union(a_words.begin(), a_words.end(), b_words.begin(), b_words.end(), std::back_inserter(both));
+  BOOST_CHECK(both.size() > a_words.size() && both.size() > b_words.size());
+  BOOST_CHECK_EQUAL(both.size(), words.size());
+
+  std::vector<std::vector<std::string> > contexts;
+  Contexts(words, mixed->Order(), contexts);
+  unsigned int listed = 0;
+  for (std::vector<std::vector<std::string> >::const_iterator c = contexts.begin(); c != contexts.end(); ++c) {
+    for (std::vector<std::string>::const_iterator w = words.begin(); w != words.end(); ++w) {
+      if (*w == "<s>") continue;
+      FullScoreReturn ret(Score(*mixed, *c, *w));
+      if (ret.ngram_length != c->size() + 1) continue;
+      ++listed;
+      // A model gives no mass to words outside its vocabulary.
+      double expected = 0.0;
+      if (a->GetVocabulary().Index(*w) || *w == "<unk>") expected += weights[0] * pow(10.0, Score(*a, *c, *w).prob);
+      if (b->GetVocabulary().Index(*w) || *w == "<unk>") expected += weights[1] * pow(10.0, Score(*b, *c, *w).prob);
+      BOOST_CHECK_SMALL(pow(10.0, ret.prob) - expected, 1e-6);
+    }
+  }
+  BOOST_CHECK(listed > 100);
+  CheckNormalised(*mixed, words);
+}
+
+// p(w | c) is proportional to the weighted product, in every context.
+BOOST_AUTO_TEST_CASE(LogLinear) {
+  std::vector<std::string> models, words;
+  models.push_back(TestLocation("test_a.arpa"));
+  models.push_back(TestLocation("test_b.arpa"));
+  std::vector<float> weights;
+  weights.push_back(0.6);
+  weights.push_back(0.8);
+  boost::scoped_ptr<Model> a(Load(models[0].c_str())), b(Load(models[1].c_str()));
+  boost::scoped_ptr<Model> mixed(Interpolate(models, weights, LOG_LINEAR, words));
+
+  std::vector<std::vector<std::string> > contexts;
+  Contexts(words, mixed->Order(), contexts);
+  std::vector<double> product(words.size());
+  for (std::vector<std::vector<std::string> >::const_iterator c = contexts.begin(); c != contexts.end(); ++c) {
+    double z = 0.0;
+    for (std::size_t w = 0; w < words.size(); ++w) {
+      if (words[w] == "<s>") continue;
+      product[w] = pow(10.0, weights[0] * Score(*a, *c, words[w]).prob + weights[1] * Score(*b, *c, words[w]).prob);
+      z += product[w];
+    }
+    for (std::size_t w = 0; w < words.size(); ++w) {
+      if (words[w] == "<s>") continue;
+      BOOST_CHECK_SMALL(pow(10.0, Score(*mixed, *c, words[w]).prob) - product[w] / z, 1e-6);
+    }
+  }
+  CheckNormalised(*mixed, words);
+}
+
+}}} // namespaces
@@ -2,9 +2,33 @@
 #include "util/file_stream.hh"
 #include "util/file.hh"
 #include "util/file_piece.hh"
+#include "util/tokenize_piece.hh"
 #include "util/usage.hh"
 
+#include <boost/lexical_cast.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#ifdef WITH_THREADS
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/thread.hpp>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace {
 
@@ -67,53 +91,398 @@ template <class Model, class Width> void QueryFromBytes(const Model &model, int
   std::cout << "RSSMax: " << util::RSSMax() << std::endl;
 }
 
-template <class Model, class Width> void DispatchFunction(const Model &model, bool query) {
-  if (query) {
-    QueryFromBytes<Model, Width>(model, 0);
+// Reads all of the vocabulary ids.  Sentence i is [starts[i], starts[i + 1]).
+template <class Model, class Width> void ReadSentences(const Model &model, int fd_in, std::vector<Width> &text, std::vector<std::size_t> &starts) {
+  Width buf[4096];
+  while (std::size_t got = util::ReadOrEOF(fd_in, buf, sizeof(buf))) {
+    UTIL_THROW_IF2(got % sizeof(Width), "File size not a multiple of vocab id size " << sizeof(Width));
+    text.insert(text.end(), buf, buf + got / sizeof(Width));
+  }
+  const Width kEOS = model.GetVocabulary().EndSentence();
+  starts.assign(1, 0);
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    if (text[i] == kEOS) starts.push_back(i + 1);
+  }
+  if (starts.back() != text.size()) starts.push_back(text.size());
+}
+
+// Like QueryFromBytes, but scores kBatchSentences sentences in lock step with
+// FullScoreBatch.  Queries for the same position in different sentences are
+// independent, so their lookups overlap.
+template <class Model, class Width> void BatchQueryFromBytes(const Model &model, int fd_in) {
+  const std::size_t kBatchSentences = 64;
+
+  std::vector<Width> text;
+  std::vector<std::size_t> starts;
+  ReadSentences(model, fd_in, text, starts);
+
+  std::vector<lm::ngram::State> states(2 * kBatchSentences);
+  std::vector<const lm::ngram::State*> in_states(kBatchSentences);
+  std::vector<lm::ngram::State*> out_states(kBatchSentences);
+  std::vector<lm::WordIndex> words(kBatchSentences);
+  std::vector<lm::FullScoreReturn> ret(kBatchSentences);
+  std::vector<std::size_t> active(kBatchSentences);
+
+  double loaded = util::CPUTime();
+  std::cout << "CPU_to_load: " << loaded << std::endl;
+
+  double total = 0.0;
+  for (std::size_t first = 0; first + 1 < starts.size(); first += kBatchSentences) {
+    std::size_t sentences = std::min(kBatchSentences, starts.size() - 1 - first);
+    float sum = 0.0;
+    for (std::size_t position = 0; ; ++position) {
+      // Collect the sentences that still have a word at this position.
+      std::size_t count = 0;
+      for (std::size_t s = 0; s < sentences; ++s) {
+        std::size_t begin = starts[first + s];
+        if (begin + position >= starts[first + s + 1]) continue;
+        in_states[count] = position ? &states[2 * s + (position - 1) % 2] : &model.BeginSentenceState();
+        out_states[count] = &states[2 * s + position % 2];
+        words[count] = text[begin + position];
+        active[count] = s;
+        ++count;
+      }
+      if (!count) break;
+      model.FullScoreBatch(&in_states[0], &words[0], &out_states[0], &ret[0], count);
+      for (std::size_t i = 0; i < count; ++i) {
+        sum += ret[i].prob;
+      }
+    }
+    total += sum;
+  }
+  double after = util::CPUTime();
+  std::cerr << "Probability sum is " << total << std::endl;
+  std::cout << "Queries: " << text.size() << std::endl;
+  std::cout << "CPU_excluding_load: " << (after - loaded) << "\nCPU_per_query: " << ((after - loaded) / static_cast<double>(text.size())) << std::endl;
+  std::cout << "RSSMax: " << util::RSSMax() << std::endl;
+}
+
+enum Mode { VOCAB, QUERY, BATCH, THREADS };
+
+struct Options {
+  Mode mode;
+  util::LoadMethod load_method;
+  const char *load_name;
+  // For THREADS.
+  std::size_t threads;
+  bool replicate;
+  std::vector<std::vector<int> > nodes;
+};
+
+// CPUs of each NUMA node according to sysfs.  Empty where that is unknown.
+std::vector<std::vector<int> > NUMANodes() {
+  std::vector<std::vector<int> > ret;
+#if defined(__linux__)
+  for (unsigned int node = 0; ; ++node) {
+    std::ifstream in(("/sys/devices/system/node/node" + boost::lexical_cast<std::string>(node) + "/cpulist").c_str());
+    std::string line;
+    if (!std::getline(in, line)) break;
+    ret.resize(ret.size() + 1);
+    // Like 0-3,8-11
+    for (util::TokenIter<util::SingleCharacter, true> range(line, ','); range; ++range) {
+      util::TokenIter<util::SingleCharacter> bound(*range, '-');
+      int first = boost::lexical_cast<int>(*bound);
+      int last = (++bound) ? boost::lexical_cast<int>(*bound) : first;
+      for (int cpu = first; cpu <= last; ++cpu) ret.back().push_back(cpu);
+    }
+  }
+#endif
+  return ret;
+}
+
+// Restricts the calling thread to cpus.  Empty means any CPU.
+void Pin(const std::vector<int> &cpus) {
+#if defined(__linux__)
+  if (cpus.empty()) return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (std::vector<int>::const_iterator i = cpus.begin(); i != cpus.end(); ++i) {
+    CPU_SET(*i, &set);
+  }
+  UTIL_THROW_IF(sched_setaffinity(0, sizeof(cpu_set_t), &set), util::ErrnoException, "sched_setaffinity failed");
+#endif
+}
+
+// Cache misses of the calling thread from perf counters, as a proxy for last
+// level cache misses.  Kernels often forbid them, so they are optional.
+class CacheMisses {
+  public:
+    CacheMisses() {
+#if defined(__linux__)
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof(attr);
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      fd_.reset(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    bool Available() const { return fd_.get() != -1; }
+
+    void Start() {
+#if defined(__linux__)
+      if (!Available()) return;
+      ioctl(fd_.get(), PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_.get(), PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    uint64_t Stop() {
+      uint64_t ret = 0;
+#if defined(__linux__)
+      if (!Available()) return 0;
+      ioctl(fd_.get(), PERF_EVENT_IOC_DISABLE, 0);
+      util::ReadOrThrow(fd_.get(), &ret, sizeof(ret));
+#endif
+      return ret;
+    }
+
+  private:
+    util::scoped_fd fd_;
+};
+
+// Page faults of the calling thread, which count first touches of a lazily mapped model.
+uint64_t ThreadFaults() {
+#if defined(__linux__)
+  struct rusage usage;
+  if (!getrusage(RUSAGE_THREAD, &usage)) return usage.ru_minflt + usage.ru_majflt;
+#endif
+  return 0;
+}
+
+#ifdef WITH_THREADS
+struct ThreadResult {
+  uint64_t queries;
+  double sum;
+  bool have_misses;
+  uint64_t misses;
+  uint64_t faults;
+  double started, finished;
+  // Seconds to score each sentence.
+  std::vector<double> latency;
+};
+
+// Scores every sentence once, beginning at first so that threads do not walk
+// through the model in lock step.
+template <class Model, class Width> class QueryThread {
+  public:
+    QueryThread(const Model &model, const std::vector<Width> &text, const std::vector<std::size_t> &starts, std::size_t first, const std::vector<int> &cpus, boost::barrier &barrier, ThreadResult &result)
+      : model_(&model), text_(&text), starts_(&starts), first_(first), cpus_(&cpus), barrier_(&barrier), result_(&result) {}
+
+    void operator()() {
+      Pin(*cpus_);
+      const std::size_t sentences = starts_->size() - 1;
+      ThreadResult &result = *result_;
+      result.queries = 0;
+      result.sum = 0.0;
+      result.latency.reserve(sentences);
+      lm::ngram::State state[2];
+      CacheMisses misses;
+      barrier_->wait();
+
+      uint64_t faults = ThreadFaults();
+      misses.Start();
+      result.started = util::WallTime();
+      for (std::size_t i = 0; i < sentences; ++i) {
+        std::size_t sentence = (first_ + i) % sentences;
+        const Width *begin = &(*text_)[0] + (*starts_)[sentence], *end = &(*text_)[0] + (*starts_)[sentence + 1];
+        double started = util::WallTime();
+        float sum = 0.0;
+        const lm::ngram::State *in = &model_->BeginSentenceState();
+        for (const Width *word = begin; word != end; ++word) {
+          lm::ngram::State *out = &state[(word - begin) & 1];
+          sum += model_->FullScore(*in, *word, *out).prob;
+          in = out;
+        }
+        result.latency.push_back(util::WallTime() - started);
+        result.sum += sum;
+        result.queries += end - begin;
+      }
+      result.finished = util::WallTime();
+      result.misses = misses.Stop();
+      result.have_misses = misses.Available();
+      result.faults = ThreadFaults() - faults;
+    }
+
+  private:
+    const Model *model_;
+    const std::vector<Width> *text_;
+    const std::vector<std::size_t> *starts_;
+    std::size_t first_;
+    const std::vector<int> *cpus_;
+    boost::barrier *barrier_;
+    ThreadResult *result_;
+};
+
+// Loads a copy of the model from a thread on the node, so that its memory is allocated there.
+template <class Model> class LoadReplica {
+  public:
+    LoadReplica(const char *file, const lm::ngram::Config &config, const std::vector<int> &cpus, Model *&out)
+      : file_(file), config_(&config), cpus_(&cpus), out_(&out) {}
+
+    void operator()() {
+      Pin(*cpus_);
+      *out_ = new Model(file_, *config_);
+    }
+
+  private:
+    const char *file_;
+    const lm::ngram::Config *config_;
+    const std::vector<int> *cpus_;
+    Model **out_;
+};
+
+double Percentile(std::vector<double> &values, double fraction) {
+  std::vector<double>::iterator at = values.begin() + std::min<std::size_t>(values.size() - 1, fraction * values.size());
+  std::nth_element(values.begin(), at, values.end());
+  return *at;
+}
+
+// Several threads share the model, or a replica on their NUMA node, and each
+// scores every sentence.
+template <class Model, class Width> void ThreadedQuery(const Model &model, const char *file, const lm::ngram::Config &config, const Options &options) {
+  std::vector<Width> text;
+  std::vector<std::size_t> starts;
+  ReadSentences(model, 0, text, starts);
+  UTIL_THROW_IF2(starts.size() < 2, "No sentences to query.");
+  const std::size_t sentences = starts.size() - 1;
+
+  const std::vector<std::vector<int> > &nodes = options.nodes;
+  boost::ptr_vector<Model> copies;
+  // Model used by threads on each node.
+  std::vector<const Model*> replicas(1, &model);
+  if (options.replicate && nodes.size() > 1) {
+    if (config.load_method != util::READ && config.load_method != util::PARALLEL_READ) {
+      std::cerr << "Replicas of a mapped file share the page cache, so they are only copies with read or parallel." << std::endl;
+    }
+    std::vector<Model*> loaded(nodes.size(), NULL);
+    boost::thread_group loaders;
+    for (std::size_t n = 1; n < nodes.size(); ++n) {
+      loaders.create_thread(LoadReplica<Model>(file, config, nodes[n], loaded[n]));
+    }
+    loaders.join_all();
+    for (std::size_t n = 1; n < nodes.size(); ++n) {
+      UTIL_THROW_IF2(!loaded[n], "Failed to load a replica for node " << n);
+      copies.push_back(loaded[n]);
+      replicas.push_back(loaded[n]);
+    }
+  }
+
+  const std::vector<int> any_cpu;
+  std::vector<ThreadResult> results(options.threads);
+  boost::barrier barrier(options.threads + 1);
+  boost::thread_group workers;
+  for (std::size_t t = 0; t < options.threads; ++t) {
+    std::size_t node = nodes.empty() ? 0 : t % nodes.size();
+    workers.create_thread(QueryThread<Model, Width>(
+          *replicas[std::min(node, replicas.size() - 1)], text, starts, t * sentences / options.threads,
+          nodes.size() > 1 ? nodes[node] : any_cpu, barrier, results[t]));
+  }
+  barrier.wait();
+  workers.join_all();
+
+  uint64_t queries = 0, misses = 0, faults = 0;
+  double started = results.front().started, finished = results.front().finished;
+  bool have_misses = true;
+  double total = 0.0;
+  std::vector<double> latency;
+  latency.reserve(sentences * options.threads);
+  for (std::vector<ThreadResult>::const_iterator i = results.begin(); i != results.end(); ++i) {
+    queries += i->queries;
+    total += i->sum;
+    have_misses &= i->have_misses;
+    misses += i->misses;
+    faults += i->faults;
+    started = std::min(started, i->started);
+    finished = std::max(finished, i->finished);
+    latency.insert(latency.end(), i->latency.begin(), i->latency.end());
+  }
+  const double elapsed = finished - started;
+  std::cerr << "Probability sum is " << total << std::endl;
+  std::cout << "Model: " << lm::ngram::kModelNames[Model::kModelType] << '\n'
+    << "Threads: " << options.threads << '\n'
+    << "NUMA_nodes: " << nodes.size() << '\n'
+    << "Replicas: " << replicas.size() << '\n'
+    << "Queries: " << queries << '\n'
+    << "Wall_excluding_load: " << elapsed << '\n'
+    << "Queries_per_second: " << (static_cast<double>(queries) / elapsed) << '\n'
+    << "Sentence_p50_us: " << (Percentile(latency, 0.5) * 1e6) << '\n'
+    << "Sentence_p99_us: " << (Percentile(latency, 0.99) * 1e6) << '\n';
+  if (have_misses) {
+    std::cout << "Cache_misses_per_query: " << (static_cast<double>(misses) / static_cast<double>(queries)) << '\n';
   } else {
-    ConvertToBytes<Model, Width>(model, 0);
+    std::cout << "Cache_misses_per_query: unavailable\n";
+  }
+  std::cout << "Page_faults: " << faults << '\n'
+    << "RSSMax: " << util::RSSMax() << std::endl;
+}
+#endif // WITH_THREADS
+
+template <class Model, class Width> void DispatchFunction(const Model &model, const char *file, const lm::ngram::Config &config, const Options &options) {
+  switch (options.mode) {
+    case QUERY:
+      QueryFromBytes<Model, Width>(model, 0);
+      break;
+    case BATCH:
+      BatchQueryFromBytes<Model, Width>(model, 0);
+      break;
+    case THREADS:
+#ifdef WITH_THREADS
+      ThreadedQuery<Model, Width>(model, file, config, options);
+#else
+      UTIL_THROW(util::Exception, "Compile with threads to query with threads.");
+#endif
+      break;
+    default:
+      ConvertToBytes<Model, Width>(model, 0);
   }
 }
 
-template <class Model> void DispatchWidth(const char *file, bool query) {
+template <class Model> void DispatchWidth(const char *file, const Options &options) {
   lm::ngram::Config config;
-  config.load_method = util::READ;
-  std::cerr << "Using load_method = READ." << std::endl;
+  config.load_method = options.load_method;
+  std::cerr << "Using load_method = " << options.load_name << "." << std::endl;
+  // The first replica belongs to node 0.
+  if (options.replicate && options.nodes.size() > 1) Pin(options.nodes[0]);
   Model model(file, config);
   lm::WordIndex bound = model.GetVocabulary().Bound();
   if (bound <= 256) {
-    DispatchFunction<Model, uint8_t>(model, query);
+    DispatchFunction<Model, uint8_t>(model, file, config, options);
   } else if (bound <= 65536) {
-    DispatchFunction<Model, uint16_t>(model, query);
+    DispatchFunction<Model, uint16_t>(model, file, config, options);
   } else if (bound <= (1ULL << 32)) {
-    DispatchFunction<Model, uint32_t>(model, query);
+    DispatchFunction<Model, uint32_t>(model, file, config, options);
   } else {
-    DispatchFunction<Model, uint64_t>(model, query);
+    DispatchFunction<Model, uint64_t>(model, file, config, options);
   }
 }
 
-void Dispatch(const char *file, bool query) {
+void Dispatch(const char *file, const Options &options) {
   using namespace lm::ngram;
   lm::ngram::ModelType model_type;
   if (lm::ngram::RecognizeBinary(file, model_type)) {
     switch(model_type) {
       case PROBING:
-        DispatchWidth<lm::ngram::ProbingModel>(file, query);
+        DispatchWidth<lm::ngram::ProbingModel>(file, options);
         break;
       case REST_PROBING:
-        DispatchWidth<lm::ngram::RestProbingModel>(file, query);
+        DispatchWidth<lm::ngram::RestProbingModel>(file, options);
         break;
       case TRIE:
-        DispatchWidth<lm::ngram::TrieModel>(file, query);
+        DispatchWidth<lm::ngram::TrieModel>(file, options);
         break;
       case QUANT_TRIE:
-        DispatchWidth<lm::ngram::QuantTrieModel>(file, query);
+        DispatchWidth<lm::ngram::QuantTrieModel>(file, options);
         break;
       case ARRAY_TRIE:
-        DispatchWidth<lm::ngram::ArrayTrieModel>(file, query);
+        DispatchWidth<lm::ngram::ArrayTrieModel>(file, options);
         break;
       case QUANT_ARRAY_TRIE:
-        DispatchWidth<lm::ngram::QuantArrayTrieModel>(file, query);
+        DispatchWidth<lm::ngram::QuantArrayTrieModel>(file, options);
         break;
       default:
         UTIL_THROW(util::Exception, "Unrecognized kenlm model type " << model_type);
@@ -123,20 +492,72 @@ void Dispatch(const char *file, bool query) {
   }
 }
 
+void Usage(const char *name) {
+  std::cerr
+    << "Benchmark program for KenLM.  Intended usage:\n"
+    << "#Convert text to vocabulary ids offline.  These ids are tied to a model.\n"
+    << name << " vocab $model <$text >$text.vocab\n"
+    << "#Ensure files are in RAM.\n"
+    << "cat $text.vocab $model >/dev/null\n"
+    << "#Timed query against the model.\n"
+    << name << " query $model <$text.vocab\n"
+    << "#Same queries, sentences scored in parallel with batched lookups.\n"
+    << name << " batch $model <$text.vocab\n"
+    << "#Threads that each score every sentence against a shared model.  Threads are\n"
+    << "#spread over NUMA nodes.  replicate loads a copy of the model on each node.\n"
+    << name << " threads $model $threads [lazy|populate|read|parallel] [replicate] <$text.vocab\n";
+  exit(1);
+}
+
 } // namespace
 
 int main(int argc, char *argv[]) {
-  if (argc != 3 || (strcmp(argv[1], "vocab") && strcmp(argv[1], "query"))) {
-    std::cerr
-      << "Benchmark program for KenLM.  Intended usage:\n"
-      << "#Convert text to vocabulary ids offline.  These ids are tied to a model.\n"
-      << argv[0] << " vocab $model <$text >$text.vocab\n"
-      << "#Ensure files are in RAM.\n"
-      << "cat $text.vocab $model >/dev/null\n"
-      << "#Timed query against the model.\n"
-      << argv[0] << " query $model <$text.vocab\n";
-    return 1;
-  }
-  Dispatch(argv[2], !strcmp(argv[1], "query"));
+  if (argc < 3) Usage(argv[0]);
+  Options options;
+  options.load_method = util::READ;
+  options.load_name = "READ";
+  options.threads = 1;
+  options.replicate = false;
+  if (!strcmp(argv[1], "vocab")) {
+    options.mode = VOCAB;
+  } else if (!strcmp(argv[1], "query")) {
+    options.mode = QUERY;
+  } else if (!strcmp(argv[1], "batch")) {
+    options.mode = BATCH;
+  } else if (!strcmp(argv[1], "threads")) {
+    options.mode = THREADS;
+  } else {
+    Usage(argv[0]);
+  }
+  if (options.mode != THREADS) {
+    if (argc != 3) Usage(argv[0]);
+  } else {
+    if (argc < 4 || argc > 6) Usage(argv[0]);
+    options.threads = boost::lexical_cast<std::size_t>(argv[3]);
+    if (!options.threads) Usage(argv[0]);
+    if (argc > 4) {
+      if (!strcmp(argv[4], "lazy")) {
+        options.load_method = util::LAZY;
+        options.load_name = "LAZY";
+      } else if (!strcmp(argv[4], "populate")) {
+        options.load_method = util::POPULATE_OR_READ;
+        options.load_name = "POPULATE_OR_READ";
+      } else if (!strcmp(argv[4], "read")) {
+        options.load_method = util::READ;
+        options.load_name = "READ";
+      } else if (!strcmp(argv[4], "parallel")) {
+        options.load_method = util::PARALLEL_READ;
+        options.load_name = "PARALLEL_READ";
+      } else {
+        Usage(argv[0]);
+      }
+    }
+    if (argc > 5) {
+      if (strcmp(argv[5], "replicate")) Usage(argv[0]);
+      options.replicate = true;
+    }
+    options.nodes = NUMANodes();
+  }
+  Dispatch(argv[2], options);
   return 0;
 }
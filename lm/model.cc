@@ -2,6 +2,7 @@
 
 #include "lm/blank.hh"
 #include "lm/lm_exception.hh"
+#include "lm/ngram_source.hh"
 #include "lm/search_hashed.hh"
 #include "lm/search_trie.hh"
 #include "lm/read_arpa.hh"
@@ -75,7 +76,15 @@ template <class Search, class VocabularyT> GenericModel<Search, VocabularyT>::Ge
     ComplainAboutARPA(init_config, kModelType);
     InitializeFromARPA(fd.release(), file, init_config);
   }
+  SetupBeginSentence();
+}
+
+template <class Search, class VocabularyT> GenericModel<Search, VocabularyT>::GenericModel(NGramSource &source, const Config &config) : backing_(config) {
+  InitializeFromSource(source, config);
+  SetupBeginSentence();
+}
 
+template <class Search, class VocabularyT> void GenericModel<Search, VocabularyT>::SetupBeginSentence() {
   // g++ prints warnings unless these are fully initialized.
   State begin_sentence = State();
   begin_sentence.length = 1;
@@ -96,13 +105,7 @@ template <class Search, class VocabularyT> void GenericModel<Search, VocabularyT
     std::vector<uint64_t> counts;
     // File counts do not include pruned trigrams that extend to quadgrams etc.   These will be fixed by search_.
     ReadARPACounts(f, counts);
-    CheckCounts(counts);
-    if (counts.size() < 2) UTIL_THROW(FormatLoadException, "This ngram implementation assumes at least a bigram model.");
-    if (config.probing_multiplier <= 1.0) UTIL_THROW(ConfigException, "probing multiplier must be > 1.0");
-
-    std::size_t vocab_size = util::CheckOverflow(VocabularyT::Size(counts[0], config));
-    // Setup the binary file for writing the vocab lookup table.  The search_ is responsible for growing the binary file to its needs.
-    vocab_.SetupMemory(backing_.SetupJustVocab(vocab_size, counts.size()), vocab_size, counts[0], config);
+    CheckBuildCounts(counts, config);
 
     if (config.write_mmap && config.include_vocab) {
       WriteWordsWrapper wrap(config.enumerate_vocab);
@@ -118,12 +121,7 @@ template <class Search, class VocabularyT> void GenericModel<Search, VocabularyT
       search_.InitializeFromARPA(file, f, counts, config, vocab_, backing_);
     }
 
-    if (!vocab_.SawUnk()) {
-      assert(config.unknown_missing != THROW_UP);
-      // Default probabilities for unknown.
-      search_.UnknownUnigram().backoff = 0.0;
-      search_.UnknownUnigram().prob = config.unknown_missing_logprob;
-    }
+    UnknownDefault(config);
     backing_.FinishFile(config, kModelType, kVersion, counts);
   } catch (util::Exception &e) {
     e << " Byte: " << f.Offset();
@@ -131,6 +129,46 @@ template <class Search, class VocabularyT> void GenericModel<Search, VocabularyT
   }
 }
 
+template <class Search, class VocabularyT> void GenericModel<Search, VocabularyT>::InitializeFromSource(NGramSource &source, const Config &config) {
+  std::vector<uint64_t> counts(source.Counts());
+  CheckBuildCounts(counts, config);
+
+  if (config.write_mmap && config.include_vocab) {
+    WriteWordsWrapper wrap(config.enumerate_vocab);
+    vocab_.ConfigureEnumerate(&wrap, counts[0]);
+    search_.InitializeFromSource(source, counts, config, vocab_, backing_);
+    void *vocab_rebase, *search_rebase;
+    backing_.WriteVocabWords(wrap.Buffer(), vocab_rebase, search_rebase);
+    vocab_.Relocate(vocab_rebase);
+    search_.SetupMemory(reinterpret_cast<uint8_t*>(search_rebase), counts, config);
+  } else {
+    vocab_.ConfigureEnumerate(config.enumerate_vocab, counts[0]);
+    search_.InitializeFromSource(source, counts, config, vocab_, backing_);
+  }
+
+  UnknownDefault(config);
+  backing_.FinishFile(config, kModelType, kVersion, counts);
+}
+
+template <class Search, class VocabularyT> void GenericModel<Search, VocabularyT>::CheckBuildCounts(const std::vector<uint64_t> &counts, const Config &config) {
+  CheckCounts(counts);
+  if (counts.size() < 2) UTIL_THROW(FormatLoadException, "This ngram implementation assumes at least a bigram model.");
+  if (config.probing_multiplier <= 1.0) UTIL_THROW(ConfigException, "probing multiplier must be > 1.0");
+
+  std::size_t vocab_size = util::CheckOverflow(VocabularyT::Size(counts[0], config));
+  // Setup the binary file for writing the vocab lookup table.  The search_ is responsible for growing the binary file to its needs.
+  vocab_.SetupMemory(backing_.SetupJustVocab(vocab_size, counts.size()), vocab_size, counts[0], config);
+}
+
+template <class Search, class VocabularyT> void GenericModel<Search, VocabularyT>::UnknownDefault(const Config &config) {
+  if (!vocab_.SawUnk()) {
+    assert(config.unknown_missing != THROW_UP);
+    // Default probabilities for unknown.
+    search_.UnknownUnigram().backoff = 0.0;
+    search_.UnknownUnigram().prob = config.unknown_missing_logprob;
+  }
+}
+
 template <class Search, class VocabularyT> FullScoreReturn GenericModel<Search, VocabularyT>::FullScore(const State &in_state, const WordIndex new_word, State &out_state) const {
   FullScoreReturn ret = ScoreExceptBackoff(in_state.words, in_state.words + in_state.length, new_word, out_state);
   for (const float *i = in_state.backoff + ret.ngram_length - 1; i < in_state.backoff + in_state.length; ++i) {
@@ -139,6 +177,18 @@ template <class Search, class VocabularyT> FullScoreReturn GenericModel<Search,
   return ret;
 }
 
+template <class Search, class VocabularyT> void GenericModel<Search, VocabularyT>::FullScoreBatch(const State *const *in_states, const WordIndex *new_words, State *const *out_states, FullScoreReturn *ret, std::size_t count) const {
+  // Software pipeline: keep kBatchPrefetch queries in flight ahead of the one being scored.
+  std::size_t ahead = count < kBatchPrefetch ? count : kBatchPrefetch;
+  for (std::size_t i = 0; i < ahead; ++i) {
+    Prefetch(*in_states[i], new_words[i]);
+  }
+  for (std::size_t i = 0; i < count; ++i, ++ahead) {
+    if (ahead < count) Prefetch(*in_states[ahead], new_words[ahead]);
+    ret[i] = FullScore(*in_states[i], new_words[i], *out_states[i]);
+  }
+}
+
 template <class Search, class VocabularyT> FullScoreReturn GenericModel<Search, VocabularyT>::FullScoreForgotState(const WordIndex *context_rbegin, const WordIndex *context_rend, const WordIndex new_word, State &out_state) const {
   context_rend = std::min(context_rend, context_rbegin + P::Order() - 1);
   FullScoreReturn ret = ScoreExceptBackoff(context_rbegin, context_rend, new_word, out_state);
@@ -345,5 +395,31 @@ base::Model *LoadVirtual(const char *file_name, const Config &config, ModelType
   }
 }
 
+void WriteBinary(NGramSource &source, ModelType model_type, const Config &config) {
+  UTIL_THROW_IF(!config.write_mmap, ConfigException, "Set write_mmap to the binary file name");
+  switch (model_type) {
+    case PROBING:
+      { ProbingModel model(source, config); }
+      break;
+    case REST_PROBING:
+      { RestProbingModel model(source, config); }
+      break;
+    case TRIE:
+      { TrieModel model(source, config); }
+      break;
+    case QUANT_TRIE:
+      { QuantTrieModel model(source, config); }
+      break;
+    case ARRAY_TRIE:
+      { ArrayTrieModel model(source, config); }
+      break;
+    case QUANT_ARRAY_TRIE:
+      { QuantArrayTrieModel model(source, config); }
+      break;
+    default:
+      UTIL_THROW(FormatLoadException, "Confused by model type " << model_type);
+  }
+}
+
 } // namespace ngram
 } // namespace lm
@@ -23,6 +23,7 @@ namespace util { class FilePiece; }
 
 namespace lm {
 namespace ngram {
+class NGramSource;
 namespace detail {
 
 // Should return the same results as SRI.
@@ -50,6 +51,11 @@ template <class Search, class VocabularyT> class GenericModel : public base::Mod
      */
     explicit GenericModel(const char *file, const Config &config = Config());
 
+    /* Build the model from n-grams that are already in memory, such as those
+     * lmplz estimated.  Set config.write_mmap to save a binary file.
+     */
+    explicit GenericModel(NGramSource &source, const Config &config = Config());
+
     /* Score p(new_word | in_state) and incorporate new_word into out_state.
      * Note that in_state and out_state must be different references:
      * &in_state != &out_state.
@@ -75,6 +81,27 @@ template <class Search, class VocabularyT> class GenericModel : public base::Mod
      */
     void GetState(const WordIndex *context_rbegin, const WordIndex *context_rend, State &out_state) const;
 
+    /* Hint that FullScore(in_state, new_word, ...) will be called soon.  This
+     * only issues prefetches for the memory it will probe.  Decoders with many
+     * independent queries can call it a few queries ahead so that the cache
+     * misses of different queries overlap instead of being paid one by one.
+     */
+    void Prefetch(const State &in_state, const WordIndex new_word) const {
+      search_.Prefetch(new_word, in_state.words, in_state.words + in_state.length);
+    }
+
+    /* Score count independent queries.  Same as
+     *   ret[i] = FullScore(*in_states[i], new_words[i], *out_states[i])
+     * for each i, but the memory for query i + kBatchPrefetch is prefetched
+     * while query i is scored, so the hash probes of different queries
+     * overlap.  The queries must not depend on each other: no out_states[i]
+     * may be one of the in_states.
+     */
+    void FullScoreBatch(const State *const *in_states, const WordIndex *new_words, State *const *out_states, FullScoreReturn *ret, std::size_t count) const;
+
+    // How many queries FullScoreBatch prefetches ahead.
+    static const std::size_t kBatchPrefetch = 8;
+
     /* More efficient version of FullScore where a partial n-gram has already
      * been scored.
      * NOTE: THE RETURNED .rest AND .prob ARE RELATIVE TO THE .rest RETURNED BEFORE.
@@ -113,6 +140,15 @@ template <class Search, class VocabularyT> class GenericModel : public base::Mod
 
     void InitializeFromARPA(int fd, const char *file, const Config &config);
 
+    void InitializeFromSource(NGramSource &source, const Config &config);
+
+    void CheckBuildCounts(const std::vector<uint64_t> &counts, const Config &config);
+
+    void UnknownDefault(const Config &config);
+
+    // Called by the constructors once the search is loaded.
+    void SetupBeginSentence();
+
     float InternalUnRest(const uint64_t *pointers_begin, const uint64_t *pointers_end, unsigned char first_length) const;
 
     BinaryFormat backing_;
@@ -131,6 +167,7 @@ template <class Search, class VocabularyT> class GenericModel : public base::Mod
 class name : public from {\
   public:\
     name(const char *file, const Config &config = Config()) : from(file, config) {}\
+    name(NGramSource &source, const Config &config = Config()) : from(source, config) {}\
 };
 
 LM_NAME_MODEL(ProbingModel, detail::GenericModel<detail::HashedSearch<BackoffValue> LM_COMMA() ProbingVocabulary>);
@@ -149,6 +186,9 @@ typedef ProbingModel Model;
  * classes as template arguments to your own virtual feature function.*/
 base::Model *LoadVirtual(const char *file_name, const Config &config = Config(), ModelType if_arpa = PROBING);
 
+// Build a model of model_type from source and write it to config.write_mmap.
+void WriteBinary(NGramSource &source, ModelType model_type, const Config &config);
+
 } // namespace ngram
 } // namespace lm
 
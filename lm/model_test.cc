@@ -1,7 +1,14 @@
 #include "lm/model.hh"
+#include "lm/ngram_source.hh"
+#include "lm/read_arpa.hh"
+#include "lm/vocab.hh"
+#include "util/file_piece.hh"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <string>
+#include <vector>
 
 #define BOOST_TEST_MODULE ModelTest
 #include <boost/test/unit_test.hpp>
@@ -286,6 +293,40 @@ template <class M> void NoUnkCheck(const M &model) {
   SLOPPY_CHECK_CLOSE(-100.0, ret.prob, 0.001);
 }
 
+template <class M> void BatchTest(const M &model) {
+  // Every word after several contexts, scored as one batch.
+  State contexts[3];
+  contexts[0] = model.BeginSentenceState();
+  contexts[1] = model.NullContextState();
+  contexts[2] = GetState(model, "little", GetState(model, "a", GetState(model, "on", GetState(model, "looking", model.BeginSentenceState()))));
+
+  WordIndex bound = model.GetVocabulary().Bound();
+  std::vector<const State*> in_states;
+  std::vector<WordIndex> words;
+  for (WordIndex w = 0; w < bound; ++w) {
+    for (std::size_t c = 0; c < 3; ++c) {
+      in_states.push_back(&contexts[c]);
+      words.push_back(w);
+    }
+  }
+  std::vector<State> out(words.size());
+  std::vector<State*> out_states;
+  for (std::size_t i = 0; i < out.size(); ++i) {
+    out_states.push_back(&out[i]);
+  }
+  std::vector<FullScoreReturn> ret(words.size());
+  model.FullScoreBatch(&in_states[0], &words[0], &out_states[0], &ret[0], words.size());
+
+  for (std::size_t i = 0; i < words.size(); ++i) {
+    State expect_state;
+    FullScoreReturn expect = model.FullScore(*in_states[i], words[i], expect_state);
+    BOOST_CHECK_EQUAL(expect.prob, ret[i].prob);
+    BOOST_CHECK_EQUAL(expect.ngram_length, ret[i].ngram_length);
+    BOOST_CHECK_EQUAL(expect.independent_left, ret[i].independent_left);
+    BOOST_CHECK_EQUAL(expect_state, out[i]);
+  }
+}
+
 template <class M> void Everything(const M &m) {
   Starters(m);
   Continuation(m);
@@ -294,6 +335,7 @@ template <class M> void Everything(const M &m) {
   MinimalState(m);
   ExtendLeftTest(m);
   Stateless(m);
+  BatchTest(m);
 }
 
 class ExpectEnumerateVocab : public EnumerateVocab {
@@ -431,6 +473,182 @@ BOOST_AUTO_TEST_CASE(write_and_read_quant_array_trie) {
   BinaryTest<QuantArrayTrieModel>();
 }
 
+// An ARPA file in memory, handed out like lmplz does.  In trie order, words
+// are numbered by hash and each order is sorted by its last word first.
+class ARPASource : public NGramSource {
+  public:
+    ARPASource(const char *file, bool trie_order) : trie_order_(trie_order), order_(0), next_(0) {
+      util::FilePiece f(file, NULL);
+      ReadARPACounts(f, counts_);
+      std::vector<std::vector<std::string> > grams(counts_.size());
+      weights_.resize(counts_.size());
+      for (unsigned int n = 1; n <= counts_.size(); ++n) {
+        ReadNGramHeader(f, n);
+        for (uint64_t i = 0; i < counts_[n - 1]; ++i) {
+          ProbBackoff weights;
+          weights.prob = f.ReadFloat();
+          for (unsigned int w = 0; w < n; ++w) {
+            grams[n - 1].push_back(f.ReadDelimited(kARPASpaces).as_string());
+          }
+          if (n == counts_.size()) {
+            Prob ignored;
+            ReadBackoff(f, ignored);
+            weights.backoff = 0.0;
+          } else {
+            ReadBackoff(f, weights.backoff);
+          }
+          weights_[n - 1].push_back(weights);
+        }
+      }
+      ReadEnd(f);
+
+      // <unk> is always 0.
+      words_.push_back("<unk>");
+      for (uint64_t i = 0; i < counts_[0]; ++i) {
+        if (grams[0][i] != "<unk>") words_.push_back(grams[0][i]);
+      }
+      if (trie_order_) std::sort(words_.begin() + 1, words_.end(), HashLess);
+
+      ids_.resize(counts_.size());
+      order_perm_.resize(counts_.size());
+      for (unsigned int n = 1; n <= counts_.size(); ++n) {
+        for (std::vector<std::string>::const_iterator i = grams[n - 1].begin(); i != grams[n - 1].end(); ++i) {
+          ids_[n - 1].push_back(std::find(words_.begin(), words_.end(), *i) - words_.begin());
+        }
+        order_ = n;
+        std::vector<uint64_t> &perm = order_perm_[n - 1];
+        for (uint64_t i = 0; i < counts_[n - 1]; ++i) perm.push_back(i);
+        // Unigrams go in id order so the vocabulary gives the same ids.
+        if (n == 1 || trie_order_) std::sort(perm.begin(), perm.end(), SuffixLess(*this));
+      }
+      order_ = 0;
+    }
+
+    const std::vector<uint64_t> &Counts() const { return counts_; }
+
+    StringPiece Word(WordIndex index) const { return words_[index]; }
+
+    bool TrieOrder() const { return trie_order_; }
+
+    void BeginOrder(unsigned char order) {
+      order_ = order;
+      next_ = 0;
+    }
+
+    bool Next(WordIndex *words, ProbBackoff &weights) {
+      if (next_ == counts_[order_ - 1]) return false;
+      uint64_t index = order_perm_[order_ - 1][next_++];
+      std::copy(Gram(order_, index), Gram(order_, index) + order_, words);
+      weights = weights_[order_ - 1][index];
+      return true;
+    }
+
+  private:
+    static bool HashLess(const std::string &first, const std::string &second) {
+      return detail::HashForVocab(first) < detail::HashForVocab(second);
+    }
+
+    const WordIndex *Gram(unsigned int n, uint64_t index) const {
+      return &ids_[n - 1][index * n];
+    }
+
+    // By the last word, then the one before, etc. of the current order.
+    class SuffixLess {
+      public:
+        explicit SuffixLess(const ARPASource &source) : source_(source) {}
+        bool operator()(uint64_t first, uint64_t second) const {
+          unsigned int n = source_.order_;
+          return std::lexicographical_compare(
+              std::reverse_iterator<const WordIndex*>(source_.Gram(n, first) + n), std::reverse_iterator<const WordIndex*>(source_.Gram(n, first)),
+              std::reverse_iterator<const WordIndex*>(source_.Gram(n, second) + n), std::reverse_iterator<const WordIndex*>(source_.Gram(n, second)));
+        }
+      private:
+        const ARPASource &source_;
+    };
+
+    bool trie_order_;
+    std::vector<uint64_t> counts_;
+    std::vector<std::string> words_;
+    std::vector<std::vector<WordIndex> > ids_;
+    std::vector<std::vector<ProbBackoff> > weights_;
+    std::vector<std::vector<uint64_t> > order_perm_;
+    unsigned int order_;
+    uint64_t next_;
+};
+
+// Score every n-gram of the ARPA file word by word in both models.
+template <class ModelT> void SameScores(const ModelT &expected, const ModelT &actual) {
+  BOOST_REQUIRE_EQUAL(expected.Order(), actual.Order());
+  BOOST_CHECK_EQUAL(expected.GetVocabulary().Bound(), actual.GetVocabulary().Bound());
+  util::FilePiece f(TestLocation(), NULL);
+  std::vector<uint64_t> counts;
+  ReadARPACounts(f, counts);
+  for (unsigned int n = 1; n <= counts.size(); ++n) {
+    ReadNGramHeader(f, n);
+    for (uint64_t i = 0; i < counts[n - 1]; ++i) {
+      f.ReadFloat();
+      State expected_state(expected.NullContextState()), actual_state(actual.NullContextState()), out;
+      for (unsigned int w = 0; w < n; ++w) {
+        StringPiece word(f.ReadDelimited(kARPASpaces));
+        FullScoreReturn expected_ret(expected.FullScore(expected_state, expected.GetVocabulary().Index(word), out));
+        expected_state = out;
+        FullScoreReturn actual_ret(actual.FullScore(actual_state, actual.GetVocabulary().Index(word), out));
+        actual_state = out;
+        BOOST_CHECK_EQUAL(expected_ret.prob, actual_ret.prob);
+        BOOST_CHECK_EQUAL(expected_ret.ngram_length, actual_ret.ngram_length);
+        BOOST_CHECK_EQUAL(expected_ret.independent_left, actual_ret.independent_left);
+        BOOST_CHECK_EQUAL(expected_ret.rest, actual_ret.rest);
+        BOOST_CHECK_EQUAL(expected_state.length, actual_state.length);
+      }
+      f.ReadLine();
+    }
+  }
+}
+
+template <class ModelT> void SourceTest(bool trie_order) {
+  Config config;
+  config.arpa_complain = Config::NONE;
+  config.messages = NULL;
+  ModelT from_arpa(TestLocation(), config);
+  {
+    ARPASource source(TestLocation(), trie_order);
+    ModelT from_source(source, config);
+    Everything(from_source);
+    SameScores(from_arpa, from_source);
+  }
+  // What lmplz --binary does.
+  {
+    ARPASource source(TestLocation(), trie_order);
+    config.write_mmap = "test_source.binary";
+    WriteBinary(source, ModelT::kModelType, config);
+    config.write_mmap = NULL;
+    ModelT binary("test_source.binary", config);
+    Everything(binary);
+    SameScores(from_arpa, binary);
+  }
+  unlink("test_source.binary");
+}
+
+BOOST_AUTO_TEST_CASE(source_probing) {
+  SourceTest<ProbingModel>(false);
+  SourceTest<ProbingModel>(true);
+}
+BOOST_AUTO_TEST_CASE(source_rest_probing) {
+  SourceTest<RestProbingModel>(false);
+}
+BOOST_AUTO_TEST_CASE(source_trie) {
+  SourceTest<TrieModel>(true);
+}
+BOOST_AUTO_TEST_CASE(source_quant_trie) {
+  SourceTest<QuantTrieModel>(true);
+}
+BOOST_AUTO_TEST_CASE(source_array_trie) {
+  SourceTest<ArrayTrieModel>(true);
+}
+BOOST_AUTO_TEST_CASE(source_quant_array_trie) {
+  SourceTest<QuantArrayTrieModel>(true);
+}
+
 BOOST_AUTO_TEST_CASE(rest_max) {
   Config config;
   config.arpa_complain = Config::NONE;
@@ -0,0 +1,101 @@
+#ifndef LM_NGRAM_SOURCE_H
+#define LM_NGRAM_SOURCE_H
+
+#include "lm/lm_exception.hh"
+#include "lm/weights.hh"
+#include "lm/word_index.hh"
+#include "util/string_piece.hh"
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include <stdint.h>
+
+namespace lm {
+namespace ngram {
+
+/* N-grams to build a model from instead of an ARPA file.  lmplz implements
+ * this to write binary files without going through ARPA.  Vocabulary ids
+ * start with <unk> = 0.  Orders are read from 1 up, each one completely.
+ */
+class NGramSource {
+  public:
+    virtual ~NGramSource() {}
+
+    // Number of n-grams of each order, as in an ARPA header.
+    virtual const std::vector<uint64_t> &Counts() const = 0;
+
+    virtual StringPiece Word(WordIndex index) const = 0;
+
+    // Vocabulary ids are in order of their hashes and each order is sorted
+    // by its last word, then the one before, etc.  This is how the trie
+    // stores them, so it can be built without sorting n-grams again.
+    virtual bool TrieOrder() const = 0;
+
+    virtual void BeginOrder(unsigned char order) = 0;
+
+    // The next n-gram of the current order with its words in text order.
+    // Backoff is ignored for the highest order.  False after the last one.
+    virtual bool Next(WordIndex *words, ProbBackoff &weights) = 0;
+};
+
+inline void CopyWeights(const ProbBackoff &from, Prob &to) {
+  to.prob = from.prob;
+}
+inline void CopyWeights(const ProbBackoff &from, ProbBackoff &to) {
+  to = from;
+}
+inline void CopyWeights(const ProbBackoff &from, RestWeights &to) {
+  to.prob = from.prob;
+  to.backoff = from.backoff;
+}
+
+// Like Read1Grams.  Words are inserted in id order so the vocabulary gives them the source's ids.
+template <class Voc, class Weights> void ReadUnigrams(NGramSource &source, Voc &vocab, Weights *unigrams) {
+  source.BeginOrder(1);
+  WordIndex word;
+  ProbBackoff weights;
+  for (uint64_t i = 0; i < source.Counts()[0]; ++i) {
+    UTIL_THROW_IF(!source.Next(&word, weights), FormatLoadException, "Expected " << source.Counts()[0] << " unigrams but got " << i);
+    StringPiece str(source.Word(word));
+    UTIL_THROW_IF(vocab.Insert(str) != word, FormatLoadException, "Vocabulary id of " << str << " is not " << word);
+    CopyWeights(weights, unigrams[word]);
+  }
+  vocab.FinishedLoading(unigrams);
+  // The trie's vocabulary sorts words by hash, which would break the n-grams' ids.
+  for (WordIndex i = 1; i < source.Counts()[0]; ++i) {
+    UTIL_THROW_IF(vocab.Index(source.Word(i)) != i, FormatLoadException, "Vocabulary ids are not sorted by hash.  Renumber the vocabulary before building a trie.");
+  }
+}
+
+// Counterpart of ARPAReader for the n-grams of order 2 and up.
+class SourceReader {
+  public:
+    explicit SourceReader(NGramSource &source) : source_(source) {}
+
+    bool Sorted() const { return source_.TrieOrder(); }
+
+    void Begin(unsigned int n) {
+      source_.BeginOrder(n);
+      words_.resize(n);
+    }
+
+    template <class Weights> void Read(unsigned int n, WordIndex *reversed, Weights &weights) {
+      ProbBackoff read;
+      UTIL_THROW_IF(!source_.Next(&*words_.begin(), read), FormatLoadException, "Fewer " << n << "-grams than the counts say");
+      std::copy(words_.begin(), words_.end(), std::reverse_iterator<WordIndex*>(reversed + n));
+      CopyWeights(read, weights);
+    }
+
+    void End() {}
+
+  private:
+    NGramSource &source_;
+    std::vector<WordIndex> words_;
+};
+
+} // namespace ngram
+} // namespace lm
+
+#endif // LM_NGRAM_SOURCE_H
@@ -8,6 +8,7 @@
 
 #include <cstddef>
 #include <iosfwd>
+#include <iterator>
 #include <vector>
 
 namespace lm {
@@ -90,6 +91,30 @@ template <class Voc, class Weights, class Iterator> void ReadNGram(util::FilePie
   }
 }
 
+// The n-grams of each order after the unigrams, for builders that can also read an NGramSource.
+template <class Voc> class ARPAReader {
+  public:
+    ARPAReader(util::FilePiece &f, const Voc &vocab, PositiveProbWarn &warn)
+      : f_(f), vocab_(vocab), warn_(warn) {}
+
+    // ARPA files are not in any particular order.
+    bool Sorted() const { return false; }
+
+    void Begin(unsigned int n) { ReadNGramHeader(f_, n); }
+
+    // Writes vocab ids of the n words in reverse order.
+    template <class Weights> void Read(unsigned int n, WordIndex *reversed, Weights &weights) {
+      ReadNGram(f_, n, vocab_, std::reverse_iterator<WordIndex*>(reversed + n), weights, warn_);
+    }
+
+    void End() { ReadEnd(f_); }
+
+  private:
+    util::FilePiece &f_;
+    const Voc &vocab_;
+    PositiveProbWarn &warn_;
+};
+
 } // namespace lm
 
 #endif // LM_READ_ARPA_H
@@ -19,6 +19,7 @@ namespace util { class FilePiece; }
 namespace lm {
 namespace ngram {
 class BinaryFormat;
+class NGramSource;
 class ProbingVocabulary;
 namespace detail {
 
@@ -86,6 +87,8 @@ template <class Value> class HashedSearch {
 
     void InitializeFromARPA(const char *file, util::FilePiece &f, const std::vector<uint64_t> &counts, const Config &config, ProbingVocabulary &vocab, BinaryFormat &backing);
 
+    void InitializeFromSource(NGramSource &source, const std::vector<uint64_t> &counts, const Config &config, ProbingVocabulary &vocab, BinaryFormat &backing);
+
     unsigned char Order() const {
       return middle_.size() + 2;
     }
@@ -136,11 +139,31 @@ template <class Value> class HashedSearch {
       return true;
     }
 
+    // Prefetch the entries that scoring word after the reversed context
+    // [context_rbegin, context_rend) will probe.  Keys are hashes of the
+    // words, so every order can be fetched without waiting on the lower ones.
+    void Prefetch(WordIndex word, const WordIndex *context_rbegin, const WordIndex *context_rend) const {
+#if defined(__GNUC__)
+      __builtin_prefetch(&unigram_.Lookup(word));
+#endif
+      Node node = static_cast<Node>(word);
+      for (const WordIndex *i = context_rbegin; i != context_rend; ++i) {
+        node = CombineWordHash(node, *i);
+        std::size_t order_minus_2 = i - context_rbegin;
+        if (order_minus_2 == middle_.size()) {
+          longest_.Prefetch(node);
+          return;
+        }
+        middle_[order_minus_2].Prefetch(node);
+      }
+    }
+
   private:
     // Interpret config's rest cost build policy and pass the right template argument to ApplyBuild.
-    void DispatchBuild(util::FilePiece &f, const std::vector<uint64_t> &counts, const Config &config, const ProbingVocabulary &vocab, PositiveProbWarn &warn);
+    // Reader gets the n-grams of each order from ARPA or an NGramSource.
+    template <class Reader> void DispatchBuild(Reader &reader, const std::vector<uint64_t> &counts, const Config &config, const ProbingVocabulary &vocab);
 
-    template <class Build> void ApplyBuild(util::FilePiece &f, const std::vector<uint64_t> &counts, const ProbingVocabulary &vocab, PositiveProbWarn &warn, const Build &build);
+    template <class Reader, class Build> void ApplyBuild(Reader &reader, const std::vector<uint64_t> &counts, const Build &build);
 
     class Unigram {
       public:
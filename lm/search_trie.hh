@@ -17,6 +17,7 @@
 namespace lm {
 namespace ngram {
 class BinaryFormat;
+class NGramSource;
 class SortedVocabulary;
 namespace trie {
 
@@ -61,6 +62,8 @@ template <class Quant, class Bhiksha> class TrieSearch {
 
     void InitializeFromARPA(const char *file, util::FilePiece &f, std::vector<uint64_t> &counts, const Config &config, SortedVocabulary &vocab, BinaryFormat &backing);
 
+    void InitializeFromSource(NGramSource &source, std::vector<uint64_t> &counts, const Config &config, SortedVocabulary &vocab, BinaryFormat &backing);
+
     unsigned char Order() const {
       return middle_end_ - middle_begin_ + 2;
     }
@@ -99,6 +102,14 @@ template <class Quant, class Bhiksha> class TrieSearch {
       return true;
     }
 
+    // Same interface as HashedSearch.  Only the unigram can be prefetched:
+    // where to look at each higher order depends on the lookup below it.
+    void Prefetch(WordIndex word, const WordIndex * /*context_rbegin*/, const WordIndex * /*context_rend*/) const {
+#if defined(__GNUC__)
+      __builtin_prefetch(&unigram_.Lookup(word));
+#endif
+    }
+
   private:
     friend void BuildTrie<Quant, Bhiksha>(SortedFiles &files, std::vector<uint64_t> &counts, const Config &config, TrieSearch<Quant, Bhiksha> &out, Quant &quant, SortedVocabulary &vocab, BinaryFormat &backing);
 
@@ -2,6 +2,7 @@
 
 #include "lm/config.hh"
 #include "lm/lm_exception.hh"
+#include "lm/ngram_source.hh"
 #include "lm/read_arpa.hh"
 #include "lm/vocab.hh"
 #include "lm/weights.hh"
@@ -198,7 +199,25 @@ SortedFiles::SortedFiles(const Config &config, util::FilePiece &f, std::vector<u
     CheckSpecials(config, vocab);
     if (!vocab.SawUnk()) ++counts[0];
   }
+  ARPAReader<SortedVocabulary> reader(f, vocab, warn);
+  ConvertAll(reader, counts, buffer, file_prefix);
+}
+
+SortedFiles::SortedFiles(const Config &config, NGramSource &source, std::vector<uint64_t> &counts, size_t buffer, const std::string &file_prefix, SortedVocabulary &vocab) {
+  UTIL_THROW_IF(!source.TrieOrder(), FormatLoadException, "The n-grams are not in trie order.");
+  unigram_.reset(util::MakeTemp(file_prefix));
+  {
+    size_t size_out = (counts[0] + 1) * sizeof(ProbBackoff);
+    util::scoped_mmap unigram_mmap(util::MapZeroedWrite(unigram_.get(), size_out), size_out);
+    ReadUnigrams(source, vocab, reinterpret_cast<ProbBackoff*>(unigram_mmap.get()));
+    CheckSpecials(config, vocab);
+    if (!vocab.SawUnk()) ++counts[0];
+  }
+  SourceReader reader(source);
+  ConvertAll(reader, counts, buffer, file_prefix);
+}
 
+template <class Reader> void SortedFiles::ConvertAll(Reader &reader, const std::vector<uint64_t> &counts, size_t buffer, const std::string &file_prefix) {
   // Only use as much buffer as we need.
   size_t buffer_use = 0;
   for (unsigned int order = 2; order < counts.size(); ++order) {
@@ -212,9 +231,9 @@ SortedFiles::SortedFiles(const Config &config, util::FilePiece &f, std::vector<u
   if (!mem.get()) UTIL_THROW(util::ErrnoException, "malloc failed for sort buffer size " << buffer);
 
   for (unsigned char order = 2; order <= counts.size(); ++order) {
-    ConvertToSorted(f, vocab, counts, file_prefix, order, warn, mem.get(), buffer);
+    ConvertToSorted(reader, counts, file_prefix, order, mem.get(), buffer);
   }
-  ReadEnd(f);
+  reader.End();
 }
 
 namespace {
@@ -237,8 +256,8 @@ class Closer {
 };
 } // namespace
 
-void SortedFiles::ConvertToSorted(util::FilePiece &f, const SortedVocabulary &vocab, const std::vector<uint64_t> &counts, const std::string &file_prefix, unsigned char order, PositiveProbWarn &warn, void *mem, std::size_t mem_size) {
-  ReadNGramHeader(f, order);
+template <class Reader> void SortedFiles::ConvertToSorted(Reader &reader, const std::vector<uint64_t> &counts, const std::string &file_prefix, unsigned char order, void *mem, std::size_t mem_size) {
+  reader.Begin(order);
   const size_t count = counts[order - 1];
   // Size of weights.  Does it include backoff?
   const size_t words_size = sizeof(WordIndex) * order;
@@ -250,30 +269,42 @@ void SortedFiles::ConvertToSorted(util::FilePiece &f, const SortedVocabulary &vo
   std::deque<FILE*> files, contexts;
   Closer files_closer(files), contexts_closer(contexts);
 
+  // Sorted input goes straight to one file.  Only the contexts need sorting.
+  const bool sorted = reader.Sorted();
+  EntryCompare less(order);
+  std::vector<WordIndex> last;
+  if (sorted) files.push_back(util::FMakeTemp(file_prefix));
+
   for (std::size_t batch = 0, done = 0; done < count; ++batch) {
     uint8_t *out = begin;
     uint8_t *out_end = out + std::min(count - done, batch_size) * entry_size;
     if (order == counts.size()) {
       for (; out != out_end; out += entry_size) {
-        std::reverse_iterator<WordIndex*> it(reinterpret_cast<WordIndex*>(out) + order);
-        ReadNGram(f, order, vocab, it, *reinterpret_cast<Prob*>(out + words_size), warn);
+        reader.Read(order, reinterpret_cast<WordIndex*>(out), *reinterpret_cast<Prob*>(out + words_size));
       }
     } else {
       for (; out != out_end; out += entry_size) {
-        std::reverse_iterator<WordIndex*> it(reinterpret_cast<WordIndex*>(out) + order);
-        ReadNGram(f, order, vocab, it, *reinterpret_cast<ProbBackoff*>(out + words_size), warn);
+        reader.Read(order, reinterpret_cast<WordIndex*>(out), *reinterpret_cast<ProbBackoff*>(out + words_size));
       }
     }
-    // Sort full records by full n-gram.
-    util::SizedProxy proxy_begin(begin, entry_size), proxy_end(out_end, entry_size);
-    // parallel_sort uses too much RAM.  TODO: figure out why windows sort doesn't like my proxies.
+    if (sorted) {
+      for (const uint8_t *i = begin; i != out_end; i += entry_size) {
+        UTIL_THROW_IF(!last.empty() && !less(&*last.begin(), i), FormatLoadException, "The " << static_cast<unsigned int>(order) << "-grams are not in trie order or contain duplicates.");
+        last.assign(reinterpret_cast<const WordIndex*>(i), reinterpret_cast<const WordIndex*>(i) + order);
+      }
+      util::WriteOrThrow(files.front(), begin, out_end - begin);
+    } else {
+      // Sort full records by full n-gram.
+      util::SizedProxy proxy_begin(begin, entry_size), proxy_end(out_end, entry_size);
+      // parallel_sort uses too much RAM.  TODO: figure out why windows sort doesn't like my proxies.
 #if defined(_WIN32) || defined(_WIN64)
-    std::stable_sort
+      std::stable_sort
 #else
-    std::sort
+      std::sort
 #endif
-        (NGramIter(proxy_begin), NGramIter(proxy_end), util::SizedCompare<EntryCompare>(EntryCompare(order)));
-    files.push_back(DiskFlush(begin, out_end, file_prefix));
+          (NGramIter(proxy_begin), NGramIter(proxy_end), util::SizedCompare<EntryCompare>(EntryCompare(order)));
+      files.push_back(DiskFlush(begin, out_end, file_prefix));
+    }
     contexts.push_back(WriteContextFile(begin, out_end, file_prefix, entry_size, order));
 
     done += (out_end - begin) / entry_size;
@@ -285,12 +316,14 @@ void SortedFiles::ConvertToSorted(util::FilePiece &f, const SortedVocabulary &vo
     files.push_back(MergeSortedFiles(files[0], files[1], file_prefix, weights_size, order, ThrowCombine()));
     files_closer.PopFront();
     files_closer.PopFront();
+  }
+  while (contexts.size() > 1) {
     contexts.push_back(MergeSortedFiles(contexts[0], contexts[1], file_prefix, 0, order - 1, FirstCombine()));
     contexts_closer.PopFront();
     contexts_closer.PopFront();
   }
 
-  if (!files.empty()) {
+  if (!contexts.empty()) {
     // Steal from closers.
     full_[order - 2].reset(files.front());
     files.pop_front();
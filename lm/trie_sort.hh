@@ -23,6 +23,7 @@ class FilePiece;
 namespace lm {
 class PositiveProbWarn;
 namespace ngram {
+class NGramSource;
 class SortedVocabulary;
 struct Config;
 
@@ -87,6 +88,9 @@ class SortedFiles {
     // Build from ARPA
     SortedFiles(const Config &config, util::FilePiece &f, std::vector<uint64_t> &counts, std::size_t buffer, const std::string &file_prefix, SortedVocabulary &vocab);
 
+    // Build from n-grams that are already in trie order, if source.TrieOrder().
+    SortedFiles(const Config &config, NGramSource &source, std::vector<uint64_t> &counts, std::size_t buffer, const std::string &file_prefix, SortedVocabulary &vocab);
+
     int StealUnigram() {
       return unigram_.release();
     }
@@ -100,7 +104,9 @@ class SortedFiles {
     }
 
   private:
-    void ConvertToSorted(util::FilePiece &f, const SortedVocabulary &vocab, const std::vector<uint64_t> &counts, const std::string &prefix, unsigned char order, PositiveProbWarn &warn, void *mem, std::size_t mem_size);
+    template <class Reader> void ConvertAll(Reader &reader, const std::vector<uint64_t> &counts, std::size_t buffer, const std::string &file_prefix);
+
+    template <class Reader> void ConvertToSorted(Reader &reader, const std::vector<uint64_t> &counts, const std::string &prefix, unsigned char order, void *mem, std::size_t mem_size);
 
     util::scoped_fd unigram_;
 
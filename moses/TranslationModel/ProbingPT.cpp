@@ -33,23 +33,22 @@ void ProbingPT::Load(AllOptions::ptr const& opts)
   SetFeaturesToApply();
 
   m_engine = new probingpt::QueryEngine(m_filePath.c_str(), load_method);
+  UTIL_THROW_IF2(m_engine->memScores,
+                 "Quantized ProbingPT tables are only supported by moses2");
 
   m_unkId = 456456546456;
 
   FactorCollection &vocab = FactorCollection::Instance();
 
   // source vocab
-  const std::map<uint64_t, std::string> &sourceVocab =
-    m_engine->getSourceVocab();
-  std::map<uint64_t, std::string>::const_iterator iterSource;
-  for (iterSource = sourceVocab.begin(); iterSource != sourceVocab.end();
-       ++iterSource) {
-    string wordStr = iterSource->second;
+  const probingpt::MappedColl &sourceVocab = m_engine->getSourceVocab();
+  for (size_t i = 0; i < sourceVocab.size(); ++i) {
+    StringPiece wordStr = sourceVocab.Get(i);
     //cerr << "wordStr=" << wordStr << endl;
 
     const Factor *factor = vocab.AddFactor(wordStr);
 
-    uint64_t probingId = iterSource->first;
+    uint64_t probingId = sourceVocab.GetId(i);
     size_t factorId = factor->GetId();
 
     if (factorId >= m_sourceVocab.size()) {
@@ -59,20 +58,15 @@ void ProbingPT::Load(AllOptions::ptr const& opts)
   }
 
   // target vocab
-  InputFileStream targetVocabStrme(m_filePath + "/TargetVocab.dat");
-  string line;
-  while (getline(targetVocabStrme, line)) {
-    vector<string> toks = Tokenize(line, "\t");
-    UTIL_THROW_IF2(toks.size() != 2, string("Incorrect format:") + line + "\n");
-
-    //cerr << "wordStr=" << toks[0] << endl;
+  const probingpt::MappedColl &targetVocab = m_engine->getTargetVocab();
+  if (targetVocab.size()) {
+    m_targetVocab.resize(targetVocab.GetId(targetVocab.size() - 1) + 1);
+  }
+  for (size_t i = 0; i < targetVocab.size(); ++i) {
+    //cerr << "wordStr=" << targetVocab.Get(i) << endl;
 
-    const Factor *factor = vocab.AddFactor(toks[0]);
-    uint32_t probingId = Scan<uint32_t>(toks[1]);
-
-    if (probingId >= m_targetVocab.size()) {
-      m_targetVocab.resize(probingId + 1);
-    }
+    const Factor *factor = vocab.AddFactor(targetVocab.Get(i));
+    uint32_t probingId = targetVocab.GetId(i);
 
     m_targetVocab[probingId] = factor;
   }
@@ -97,22 +91,24 @@ void ProbingPT::Load(AllOptions::ptr const& opts)
 
 void ProbingPT::CreateAlignmentMap(const std::string path)
 {
-  const std::vector< std::vector<unsigned char> > &probingAlignColl = m_engine->getAlignments();
-  m_aligns.resize(probingAlignColl.size(), NULL);
+  const probingpt::MappedColl &probingAlignColl = m_engine->getAlignments();
+  if (probingAlignColl.size()) {
+    m_aligns.resize(probingAlignColl.GetId(probingAlignColl.size() - 1) + 1, NULL);
+  }
 
   for (size_t i = 0; i < probingAlignColl.size(); ++i) {
     AlignmentInfo::CollType aligns;
 
-    const std::vector<unsigned char> &probingAligns = probingAlignColl[i];
-    for (size_t j = 0; j < probingAligns.size(); j += 2) {
-      size_t startPos = probingAligns[j];
-      size_t endPos = probingAligns[j+1];
+    StringPiece probingAligns = probingAlignColl.Get(i);
+    for (size_t j = 0; j + 1 < probingAligns.size(); j += 2) {
+      size_t startPos = (unsigned char) probingAligns[j];
+      size_t endPos = (unsigned char) probingAligns[j+1];
       //cerr << "startPos=" << startPos << " " << endPos << endl;
       aligns.insert(std::pair<size_t,size_t>(startPos, endPos));
     }
 
     const AlignmentInfo *align = AlignmentInfoCollection::Instance().Add(aligns);
-    m_aligns[i] = align;
+    m_aligns[probingAlignColl.GetId(i)] = align;
     //cerr << "align=" << align->Debug(system) << endl;
   }
 }
@@ -252,7 +248,8 @@ TargetPhraseCollection *ProbingPT::CreateTargetPhrases(
   query_result = m_engine->query(key);
   //cerr << "key2=" << query_result.second << endl;
 
-  if (query_result.first) {
+  // NONE = only a prefix of source phrases in the pt
+  if (query_result.first && query_result.second != NONE) {
     const char *offset = data + query_result.second;
     uint64_t *numTP = (uint64_t*) offset;
 
@@ -5,6 +5,7 @@
 #include "../TranslationModel/UnknownWordPenalty.h"
 #include "../TranslationModel/Transliteration.h"
 #include "../TranslationModel/Dynamic/DynamicPhraseTable.h"
+#include "../TranslationModel/CompactPT/PhraseTableCompact.h"
 
 #include "../LM/KENLM.h"
 #include "../LM/KENLMBatch.h"
@@ -60,6 +61,7 @@ FeatureRegistry::FeatureRegistry()
   MOSES_FNAME2("PhraseDictionaryTransliteration", Transliteration);
   MOSES_FNAME(UnknownWordPenalty);
   MOSES_FNAME(DynamicPhraseTable);
+  MOSES_FNAME2("PhraseDictionaryCompact", PhraseTableCompact);
 
   Add("KENLM", new KenFactory());
 
@@ -19,13 +19,81 @@ namespace Moses2
 {
 
 HypothesisColl::HypothesisColl(const ManagerBase &mgr)
-  :m_coll(MemPoolAllocator<const HypothesisBase*>(mgr.GetPool()))
+  :m_pool(mgr.GetPool())
+  ,m_slots(NULL)
+  ,m_mask(0)
+  ,m_size(0)
   ,m_sortedHypos(NULL)
 {
   m_bestScore = -std::numeric_limits<float>::infinity();
   m_worstScore = std::numeric_limits<float>::infinity();
 }
 
+size_t HypothesisColl::GetHome(size_t hash) const
+{
+  // state hashes are combined with boost::hash_combine. Mix the high bits in
+  uint64_t mixed = (uint64_t) hash * 0x9E3779B97F4A7C15ULL;
+  return (size_t) (mixed ^ (mixed >> 32)) & m_mask;
+}
+
+size_t HypothesisColl::FindSlot(size_t hash) const
+{
+  // slot with this hash, or the empty slot where it would go
+  size_t ind = GetHome(hash);
+  while (m_slots[ind].hypo && m_slots[ind].hash != hash) {
+    ind = (ind + 1) & m_mask;
+  }
+  return ind;
+}
+
+void HypothesisColl::Reserve(size_t size)
+{
+  // keep load factor <= 1/2
+  size_t capacity = m_slots ? m_mask + 1 : 0;
+  if (size * 2 > capacity) {
+    size_t newCapacity = std::max(capacity * 2, (size_t) 16);
+    while (size * 2 > newCapacity) {
+      newCapacity *= 2;
+    }
+    Rehash(newCapacity);
+  }
+}
+
+void HypothesisColl::Rehash(size_t capacity)
+{
+  Slot *oldSlots = m_slots;
+  size_t oldCapacity = m_slots ? m_mask + 1 : 0;
+
+  m_slots = m_pool.Allocate<Slot>(capacity);
+  m_mask = capacity - 1;
+  for (size_t i = 0; i < capacity; ++i) {
+    m_slots[i].hypo = NULL;
+  }
+
+  for (size_t i = 0; i < oldCapacity; ++i) {
+    const Slot &slot = oldSlots[i];
+    if (slot.hypo) {
+      m_slots[FindSlot(slot.hash)] = slot;
+    }
+  }
+
+  m_pool.Deallocate(oldSlots, oldCapacity);
+}
+
+size_t HypothesisColl::GetSlots(Slot *out) const
+{
+  size_t ind = 0;
+  if (m_slots) {
+    for (size_t i = 0; i <= m_mask; ++i) {
+      if (m_slots[i].hypo) {
+        out[ind++] = m_slots[i];
+      }
+    }
+  }
+  assert(ind == m_size);
+  return ind;
+}
+
 const HypothesisBase *HypothesisColl::GetBestHypo() const
 {
   if (GetSize() == 0) {
@@ -36,11 +104,12 @@ const HypothesisBase *HypothesisColl::GetBestHypo() const
   }
 
   SCORE bestScore = -std::numeric_limits<SCORE>::infinity();
-  const HypothesisBase *bestHypo;
-  BOOST_FOREACH(const HypothesisBase *hypo, m_coll) {
-    if (hypo->GetFutureScore() > bestScore) {
-      bestScore = hypo->GetFutureScore();
-      bestHypo = hypo;
+  const HypothesisBase *bestHypo = NULL;
+  for (size_t i = 0; i <= m_mask; ++i) {
+    const Slot &slot = m_slots[i];
+    if (slot.hypo && (bestHypo == NULL || slot.score > bestScore)) {
+      bestScore = slot.score;
+      bestHypo = slot.hypo;
     }
   }
   return bestHypo;
@@ -107,35 +176,33 @@ void HypothesisColl::Add(
 
 StackAdd HypothesisColl::Add(const HypothesisBase *hypo)
 {
-  std::pair<_HCType::iterator, bool> addRet = m_coll.insert(hypo);
+  Reserve(m_size + 1);
+
+  size_t hash = hypo->hash();
+  Slot &slot = m_slots[FindSlot(hash)];
   //cerr << endl << "new=" << hypo->Debug(hypo->GetManager().system) << endl;
 
   // CHECK RECOMBINATION
-  if (addRet.second) {
+  if (slot.hypo == NULL) {
     // equiv hypo doesn't exists
     //cerr << "Added " << hypo << endl;
+    slot.hypo = hypo;
+    slot.hash = hash;
+    slot.score = hypo->GetFutureScore();
+    ++m_size;
     return StackAdd(true, NULL);
   } else {
-    HypothesisBase *hypoExisting = const_cast<HypothesisBase*>(*addRet.first);
+    HypothesisBase *hypoExisting = const_cast<HypothesisBase*>(slot.hypo);
     //cerr << "hypoExisting=" << hypoExisting->Debug(hypo->GetManager().system) << endl;
 
-    if (hypo->GetFutureScore() > hypoExisting->GetFutureScore()) {
+    if (hypo->GetFutureScore() > slot.score) {
       // incoming hypo is better than the one we have
-  	  //cerr << "Add " << hypo << "(" << hypo->hash() << ")"
-	  //	  << " discard existing " << hypoExisting << "(" << hypoExisting->hash() << ")"
-	  //	  << endl;
-
-      const HypothesisBase * const &hypoExisting1 = *addRet.first;
-      const HypothesisBase *&hypoExisting2 =
-        const_cast<const HypothesisBase *&>(hypoExisting1);
-      hypoExisting2 = hypo;
+      slot.hypo = hypo;
+      slot.score = hypo->GetFutureScore();
 
       return StackAdd(true, hypoExisting);
     } else {
       // already storing the best hypo. discard incoming hypo
-      //cerr << "Keep existing " << hypoExisting << "(" << hypoExisting->hash() << ")"
-      //		  << " discard new " << hypo << "(" << hypo->hash() << ")"
-	  //		  << endl;
       return StackAdd(false, hypoExisting);
     }
   }
@@ -151,7 +218,7 @@ const Hypotheses &HypothesisColl::GetSortedAndPrunedHypos(
     // create sortedHypos first
     MemPool &pool = mgr.GetPool();
     m_sortedHypos = new (pool.Allocate<Hypotheses>()) Hypotheses(pool,
-        m_coll.size());
+        GetSize());
 
     SortHypos(mgr, m_sortedHypos->GetArray());
 
@@ -183,27 +250,39 @@ void HypothesisColl::PruneHypos(const ManagerBase &mgr, ArcLists &arcLists)
 
   Recycler<HypothesisBase*> &recycler = mgr.GetHypoRecycler();
 
-  const HypothesisBase **sortedHypos = (const HypothesisBase **) alloca(GetSize() * sizeof(const HypothesisBase *));
-  SortHypos(mgr, sortedHypos);
+  // select the best hypos on a copy of the slots, then rebuild the table
+  // from them. Cheaper than deleting the rest one by one
+  size_t size = GetSize();
+  Slot *slots = m_pool.Allocate<Slot>(size);
+  GetSlots(slots);
+
+  std::nth_element(slots, slots + maxStackSize - 1, slots + size,
+                   SlotScoreOrderer());
 
   // update worse score
-  m_worstScore = sortedHypos[maxStackSize - 1]->GetFutureScore();
+  m_worstScore = slots[maxStackSize - 1].score;
 
   // prune
-  for (size_t i = maxStackSize; i < GetSize(); ++i) {
-    HypothesisBase *hypo = const_cast<HypothesisBase*>(sortedHypos[i]);
+  for (size_t i = maxStackSize; i < size; ++i) {
+    HypothesisBase *hypo = const_cast<HypothesisBase*>(slots[i].hypo);
 
     // delete from arclist
     if (mgr.system.options.nbest.nbest_size) {
       arcLists.Delete(hypo);
     }
 
-    // delete from collection
-    Delete(hypo);
-
     recycler.Recycle(hypo);
   }
 
+  for (size_t i = 0; i <= m_mask; ++i) {
+    m_slots[i].hypo = NULL;
+  }
+  for (size_t i = 0; i < maxStackSize; ++i) {
+    m_slots[FindSlot(slots[i].hash)] = slots[i];
+  }
+  m_size = maxStackSize;
+
+  m_pool.Deallocate(slots, size);
 }
 
 void HypothesisColl::SortHypos(const ManagerBase &mgr, const HypothesisBase **sortedHypos) const
@@ -213,45 +292,31 @@ void HypothesisColl::SortHypos(const ManagerBase &mgr, const HypothesisBase **so
   //assert(GetSize() > maxStackSize);
   //assert(sortedHypos.size() == GetSize());
 
-  /*
-   cerr << "UNSORTED hypos: ";
-   BOOST_FOREACH(const HypothesisBase *hypo, m_coll) {
-     cerr << hypo << "(" << hypo->GetFutureScore() << ")" << " ";
-   }
-   cerr << endl;
-   */
-  size_t ind = 0;
-  BOOST_FOREACH(const HypothesisBase *hypo, m_coll) {
-    sortedHypos[ind] = hypo;
-    ++ind;
-  }
+  size_t size = GetSize();
+  Slot *slots = m_pool.Allocate<Slot>(size);
+  GetSlots(slots);
 
   size_t indMiddle;
   if (maxStackSize == 0) {
-    indMiddle = GetSize();
-  } else if (GetSize() > maxStackSize) {
+    indMiddle = size;
+  } else if (size > maxStackSize) {
     indMiddle = maxStackSize;
   } else {
     // GetSize() <= maxStackSize
-    indMiddle = GetSize();
+    indMiddle = size;
   }
 
-  const HypothesisBase **iterMiddle = sortedHypos + indMiddle;
-
   std::partial_sort(
-    sortedHypos,
-    iterMiddle,
-    sortedHypos + GetSize(),
-    HypothesisFutureScoreOrderer());
+    slots,
+    slots + indMiddle,
+    slots + size,
+    SlotScoreOrderer());
 
-  /*
-   cerr << "sorted hypos: ";
-   for (size_t i = 0; i < sortedHypos.size(); ++i) {
-     const HypothesisBase *hypo = sortedHypos[i];
-     cerr << hypo << " ";
-   }
-   cerr << endl;
-   */
+  for (size_t i = 0; i < size; ++i) {
+    sortedHypos[i] = slots[i].hypo;
+  }
+
+  m_pool.Deallocate(slots, size);
 }
 
 void HypothesisColl::Delete(const HypothesisBase *hypo)
@@ -259,14 +324,33 @@ void HypothesisColl::Delete(const HypothesisBase *hypo)
   //cerr << " Delete hypo=" << hypo << "(" << hypo->hash() << ")"
   //		<< " m_coll=" << m_coll.size() << endl;
 
-  size_t erased = m_coll.erase(hypo);
-  UTIL_THROW_IF2(erased != 1, "couldn't erase hypo " << hypo);
+  size_t hole = m_slots ? FindSlot(hypo->hash()) : 0;
+  UTIL_THROW_IF2(m_slots == NULL || m_slots[hole].hypo != hypo,
+                 "couldn't erase hypo " << hypo);
+
+  // backward shift the following hypos in the probe sequence
+  size_t ind = (hole + 1) & m_mask;
+  while (m_slots[ind].hypo) {
+    size_t home = GetHome(m_slots[ind].hash);
+    if (((ind - home) & m_mask) >= ((ind - hole) & m_mask)) {
+      m_slots[hole] = m_slots[ind];
+      hole = ind;
+    }
+    ind = (ind + 1) & m_mask;
+  }
+  m_slots[hole].hypo = NULL;
+  --m_size;
 }
 
 void HypothesisColl::Clear()
 {
   m_sortedHypos = NULL;
-  m_coll.clear();
+  if (m_slots) {
+    for (size_t i = 0; i <= m_mask; ++i) {
+      m_slots[i].hypo = NULL;
+    }
+  }
+  m_size = 0;
 
   m_bestScore = -std::numeric_limits<float>::infinity();
   m_worstScore = std::numeric_limits<float>::infinity();
@@ -275,9 +359,13 @@ void HypothesisColl::Clear()
 std::string HypothesisColl::Debug(const System &system) const
 {
   stringstream out;
-  BOOST_FOREACH (const HypothesisBase *hypo, m_coll) {
-    out << hypo->Debug(system);
-    out << std::endl << std::endl;
+  if (m_slots) {
+    for (size_t i = 0; i <= m_mask; ++i) {
+      if (m_slots[i].hypo) {
+        out << m_slots[i].hypo->Debug(system);
+        out << std::endl << std::endl;
+      }
+    }
   }
 
   return out.str();
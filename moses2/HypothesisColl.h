@@ -5,7 +5,6 @@
  *      Author: hieu
  */
 #pragma once
-#include <unordered_set>
 #include "HypothesisBase.h"
 #include "MemPoolAllocator.h"
 #include "Recycler.h"
@@ -32,7 +31,7 @@ public:
            ArcLists &arcLists);
 
   size_t GetSize() const {
-    return m_coll.size();
+    return m_size;
   }
 
   void Clear();
@@ -54,11 +53,28 @@ public:
   std::string Debug(const System &system) const;
 
 protected:
-  typedef std::unordered_set<const HypothesisBase*,
-		  UnorderedComparer<HypothesisBase>, UnorderedComparer<HypothesisBase>,
-          MemPoolAllocator<const HypothesisBase*> > _HCType;
+  // Flat open-addressing table with linear probing. Hypos recombine if
+  // their state hashes are equal, so each slot keeps the hash, computed once
+  // on insertion, and the future score. Probing, pruning and sorting then
+  // work on the slot array without touching the hypos
+  struct Slot {
+    const HypothesisBase *hypo; // NULL if empty
+    size_t hash;
+    SCORE score;
+  };
+
+  // best first
+  struct SlotScoreOrderer {
+    bool operator()(const Slot &a, const Slot &b) const {
+      return a.score > b.score;
+    }
+  };
+
+  MemPool &m_pool;
+  Slot *m_slots;
+  size_t m_mask; // capacity - 1. capacity is a power of 2
+  size_t m_size;
 
-  _HCType m_coll;
   mutable Hypotheses *m_sortedHypos;
 
   SCORE m_bestScore;
@@ -66,6 +82,12 @@ protected:
 
   StackAdd Add(const HypothesisBase *hypo);
 
+  size_t GetHome(size_t hash) const;
+  size_t FindSlot(size_t hash) const;
+  void Reserve(size_t size);
+  void Rehash(size_t capacity);
+  size_t GetSlots(Slot *out) const;
+
   void PruneHypos(const ManagerBase &mgr, ArcLists &arcLists);
   void SortHypos(const ManagerBase &mgr, const HypothesisBase **sortedHypos) const;
 
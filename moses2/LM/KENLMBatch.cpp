@@ -84,7 +84,6 @@ private:
 /////////////////////////////////////////////////////////////////
 KENLMBatch::KENLMBatch(size_t startInd, const std::string &line)
   :StatefulFeatureFunction(startInd, line)
-  ,m_numHypos(0)
 {
   cerr << "KENLMBatch::KENLMBatch" << endl;
   ReadParameters();
@@ -325,38 +324,113 @@ void KENLMBatch::SetParameter(const std::string& key,
 }
 
 void KENLMBatch::EvaluateWhenAppliedBatch(
+  const System &system,
   const Batch &batch) const
 {
-  {
-    // write lock
-    boost::unique_lock<boost::shared_mutex> lock(m_accessLock);
-    m_batches.push_back(&batch);
-    m_numHypos += batch.size();
+  // Same result as EvaluateWhenApplied() on each hypo. But the hypos are
+  // scored in lock-step, 1 word of every hypo at a time. The queries of each
+  // step are independent of each other, so they go to the LM as 1 batch
+  // which overlaps their cache misses
+  size_t size = batch.size();
+  if (size == 0) {
+    return;
   }
-  //cerr << "m_numHypos=" << m_numHypos << endl;
 
-  if (m_numHypos > 0) {
-    // process batch
-    EvaluateWhenAppliedBatch();
+  MemPool &pool = batch[0]->GetManager().GetPool();
+  size_t statefulInd = GetStatefulInd();
+  size_t maxWords = m_ngram->Order() - 1;
+
+  BatchItem *items = pool.Allocate<BatchItem>(size);
+  lm::WordIndex *ids = pool.Allocate<lm::WordIndex>(size * maxWords);
+
+  size_t numSteps = 0;
+  for (size_t i = 0; i < size; ++i) {
+    const Hypothesis &hypo = *batch[i];
+    BatchItem &item = items[i];
+    item.hypo = &hypo;
+    item.inState =
+      &static_cast<const KenLMState*>(hypo.GetPrevHypo()->GetState(statefulInd))->state;
+    item.ids = ids + i * maxWords;
+    item.numWords = std::min(hypo.GetTargetPhrase().GetSize(), maxWords);
+    item.score = 0;
+
+    for (size_t pos = 0; pos < item.numWords; ++pos) {
+      item.ids[pos] = TranslateID(hypo.GetCurrWord(pos));
+    }
+    numSteps = std::max(numSteps, item.numWords);
+  }
 
-    m_batches.clear();
-    m_numHypos = 0;
+  // 1 query for each hypo which still has words to score at this step
+  const Model::State **inStates = pool.Allocate<const Model::State*>(size);
+  Model::State **outStates = pool.Allocate<Model::State*>(size);
+  lm::WordIndex *words = pool.Allocate<lm::WordIndex>(size);
+  lm::FullScoreReturn *rets = pool.Allocate<lm::FullScoreReturn>(size);
+  BatchItem **queried = pool.Allocate<BatchItem*>(size);
+
+  for (size_t step = 0; step < numSteps; ++step) {
+    size_t numQueries = 0;
+    for (size_t i = 0; i < size; ++i) {
+      BatchItem &item = items[i];
+      if (step < item.numWords) {
+        inStates[numQueries] = item.inState;
+        outStates[numQueries] = &item.outState[step % 2];
+        words[numQueries] = item.ids[step];
+        queried[numQueries] = &item;
+        ++numQueries;
+      }
+    }
 
-    m_threadNeeded.notify_all();
-  } else {
-    boost::mutex::scoped_lock lock(m_mutex);
-    m_threadNeeded.wait(lock);
+    m_ngram->FullScoreBatch(inStates, words, outStates, rets, numQueries);
+
+    for (size_t i = 0; i < numQueries; ++i) {
+      BatchItem &item = *queried[i];
+      item.score += rets[i].prob;
+      item.inState = outStates[i];
+    }
   }
-}
 
-void KENLMBatch::EvaluateWhenAppliedBatch() const
-{
-  BOOST_FOREACH(const Batch *batch, m_batches) {
-    //cerr << "batch=" << batch->size() << endl;
-    BOOST_FOREACH(Hypothesis *hypo, *batch) {
-      hypo->EvaluateWhenApplied(*this);
+  pool.Deallocate(queried, size);
+  pool.Deallocate(rets, size);
+  pool.Deallocate(words, size);
+  pool.Deallocate(outStates, size);
+  pool.Deallocate(inStates, size);
+
+  for (size_t i = 0; i < size; ++i) {
+    BatchItem &item = items[i];
+    const Hypothesis &hypo = *item.hypo;
+    KenLMState &stateCast =
+      static_cast<KenLMState&>(*batch[i]->GetState(statefulInd));
+
+    if (item.numWords == 0) {
+      stateCast.state = *item.inState;
+      continue;
     }
+
+    const std::size_t begin = hypo.GetCurrTargetWordsRange().GetStartPos();
+    const std::size_t end = hypo.GetCurrTargetWordsRange().GetEndPos() + 1;
+    const std::size_t adjust_end = begin + item.numWords;
+
+    if (hypo.GetBitmap().IsComplete()) {
+      // Score end of sentence.
+      std::vector<lm::WordIndex> indices(maxWords);
+      const lm::WordIndex *last = LastIDs(hypo, &indices.front());
+      item.score += m_ngram->FullScoreForgotState(&indices.front(), last,
+                    m_ngram->GetVocabulary().EndSentence(), stateCast.state).prob;
+    } else if (adjust_end < end) {
+      // Get state after adding a long phrase.
+      std::vector<lm::WordIndex> indices(maxWords);
+      const lm::WordIndex *last = LastIDs(hypo, &indices.front());
+      m_ngram->GetState(&indices.front(), last, stateCast.state);
+    } else {
+      stateCast.state = *item.inState;
+    }
+
+    SCORE score = TransformLMScore(item.score);
+    batch[i]->GetScores().PlusEquals(system, *this, score);
   }
+
+  pool.Deallocate(ids, size * maxWords);
+  pool.Deallocate(items, size);
 }
 
 void KENLMBatch::EvaluateWhenApplied(const SCFG::Manager &mgr,
@@ -7,11 +7,6 @@
 #pragma once
 
 #include <boost/shared_ptr.hpp>
-#include <boost/bind.hpp>
-#include <boost/thread.hpp>
-#ifdef __linux
-#include <pthread.h>
-#endif
 
 #include "../FF/StatefulFeatureFunction.h"
 #include "lm/model.hh"
@@ -62,6 +57,7 @@ public:
                                    FFState &state) const;
 
   virtual void EvaluateWhenAppliedBatch(
+    const System &system,
     const Batch &batch) const;
 
 protected:
@@ -86,16 +82,15 @@ protected:
 
   std::vector<lm::WordIndex> m_lmIdLookup;
 
-  // batch
-  mutable std::vector<const Batch*> m_batches;
-  mutable size_t m_numHypos;
-
-  mutable boost::shared_mutex m_accessLock;
-
-  mutable boost::mutex m_mutex;
-  mutable boost::condition_variable m_threadNeeded;
-
-  void EvaluateWhenAppliedBatch() const;
+  // scratch space for scoring 1 hypo of a batch
+  struct BatchItem {
+    const Hypothesis *hypo;
+    const Model::State *inState;
+    Model::State outState[2];
+    lm::WordIndex *ids;
+    size_t numWords;
+    float score;
+  };
 
 };
 
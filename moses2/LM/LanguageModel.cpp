@@ -72,17 +72,31 @@ void LanguageModel::Load(System &system)
   InputFileStream infile(m_path);
   size_t lineNum = 0;
   string line;
+  std::vector<uint64_t> counts;
   while (getline(infile, line)) {
     if (++lineNum % 100000 == 0) {
       cerr << lineNum << " ";
     }
 
+    if (m_ngramMem.empty() && line.compare(0, 6, "ngram ") == 0) {
+      // header. eg. ngram 1=1234
+      size_t pos = line.find('=');
+      UTIL_THROW_IF2(pos == string::npos, "Malformed ARPA header line: " << line);
+      counts.push_back(Scan<uint64_t>(line.substr(pos + 1)));
+      continue;
+    }
+
     vector<string> substrings = Tokenize(line, "\t");
 
     if (substrings.size() < 2) continue;
 
     assert(substrings.size() == 2 || substrings.size() == 3);
 
+    if (m_ngramMem.empty()) {
+      UTIL_THROW_IF2(counts.empty(), "No n-gram counts in the ARPA header of " << m_path);
+      CreateTable(counts);
+    }
+
     SCORE prob = TransformLMScore(Scan<SCORE>(substrings[0]));
     if (substrings[1] == "<unk>") {
       m_oov = prob;
@@ -94,19 +108,45 @@ void LanguageModel::Load(System &system)
       backoff = TransformLMScore(Scan<SCORE>(substrings[2]));
     }
 
-    // ngram
+    // ngram, hashed from the last word backwards
     vector<string> key = Tokenize(substrings[1], " ");
 
-    vector<const Factor*> factorKey(key.size());
-    for (size_t i = 0; i < key.size(); ++i) {
-      factorKey[factorKey.size() - i - 1] = fc.AddFactor(key[i], system, false);
+    LMEntry entry;
+    entry.key = 0;
+    for (size_t i = key.size(); i > 0; --i) {
+      entry.key = CombineHash(entry.key, fc.AddFactor(key[i - 1], system, false));
     }
+    entry.value = LMScores(prob, backoff);
 
-    m_root.insert(factorKey, LMScores(prob, backoff));
+    NGramTable::MutableIterator iter;
+    m_ngrams.FindOrInsert(entry, iter);
+    iter->value = entry.value;
   }
 
 }
 
+void LanguageModel::CreateTable(const std::vector<uint64_t> &counts)
+{
+  uint64_t numNGrams = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    numNGrams += counts[i];
+  }
+
+  // zero-initialised. Key 0 is the empty bucket
+  std::size_t size = NGramTable::Size(numNGrams, 1.5);
+  m_ngramMem.resize(size / sizeof(LMEntry));
+  m_ngrams = NGramTable(&m_ngramMem[0], size);
+}
+
+const LMEntry *LanguageModel::Find(uint64_t key) const
+{
+  NGramTable::ConstIterator iter;
+  if (m_ngrams.Find(key, iter)) {
+    return iter;
+  }
+  return NULL;
+}
+
 void LanguageModel::SetParameter(const std::string& key,
                                  const std::string& value)
 {
@@ -244,61 +284,36 @@ std::pair<SCORE, void*> LanguageModel::Score(
   //cerr << "context=";
   //DebugContext(context);
 
-  std::pair<SCORE, void*> ret;
-
-  typedef Node<const Factor*, LMScores> LMNode;
-  const LMNode *node = m_root.getNode(context);
-  if (node) {
-    ret.first = node->getValue().prob;
-    ret.second = (void*) node;
-  } else {
-    SCORE backoff = 0;
-    std::vector<const Factor*> backOffContext(context.begin() + 1,
-        context.end());
-    node = m_root.getNode(backOffContext);
-    if (node) {
-      backoff = node->getValue().backoff;
+  // longest n-gram that ends in the newest word, context[0]
+  const LMEntry *found = NULL;
+  size_t foundLen = 0;
+  uint64_t key = 0;
+  for (size_t len = 1; len <= context.size(); ++len) {
+    key = CombineHash(key, context[len - 1]);
+    const LMEntry *entry = Find(key);
+    if (entry) {
+      found = entry;
+      foundLen = len;
     }
-
-    std::vector<const Factor*> newContext(context.begin(), context.end() - 1);
-    std::pair<SCORE, void*> newRet = Score(newContext);
-
-    ret.first = backoff + newRet.first;
-    ret.second = newRet.second;
   }
 
-  //cerr << "score=" << ret.first << endl;
-  return ret;
-}
-
-SCORE LanguageModel::BackoffScore(
-  const std::vector<const Factor*> &context) const
-{
-  //cerr << "backoff=";
-  //DebugContext(context);
-
-  SCORE ret;
-  size_t stoppedAtInd;
-  const Node<const Factor*, LMScores> &node = m_root.getNode(context,
-      stoppedAtInd);
-
-  if (stoppedAtInd == context.size()) {
-    // found entire ngram
-    ret = node.getValue().backoff;
-  } else {
-    if (stoppedAtInd == 0) {
-      ret = m_oov;
-      stoppedAtInd = 1;
-    } else {
-      ret = node.getValue().backoff;
+  std::pair<SCORE, void*> ret;
+  ret.first = found ? found->value.prob : m_oov;
+  ret.second = (void*) found;
+
+  // backoffs of the histories context[1, len) longer than the n-gram found
+  uint64_t histKey = 0;
+  for (size_t len = 2; len <= context.size(); ++len) {
+    histKey = CombineHash(histKey, context[len - 1]);
+    if (len > foundLen) {
+      const LMEntry *entry = Find(histKey);
+      if (entry) {
+        ret.first += entry->value.backoff;
+      }
     }
-
-    // recursive
-    std::vector<const Factor*> backoff(context.begin() + stoppedAtInd,
-                                       context.end());
-    ret += BackoffScore(backoff);
   }
 
+  //cerr << "score=" << ret.first << endl;
   return ret;
 }
 
@@ -7,9 +7,11 @@
 
 #pragma once
 
+#include <vector>
+#include <stdint.h>
+#include "util/probing_hash_table.hh"
 #include "../FF/StatefulFeatureFunction.h"
 #include "../TypeDef.h"
-#include "../InMemoryTrie/InMemoryTrie.h"
 #include "../legacy/Factor.h"
 #include "../legacy/Util2.h"
 
@@ -36,6 +38,26 @@ struct LMScores {
   float prob, backoff;
 };
 
+////////////////////////////////////////////////////////////////////////////////////////
+// n-gram in the hash table. Only the hash of the factor ids is kept, like KenLM's
+// probing model
+#pragma pack(push)
+#pragma pack(4)
+struct LMEntry {
+  typedef uint64_t Key;
+
+  uint64_t key;
+  LMScores value;
+
+  uint64_t GetKey() const {
+    return key;
+  }
+  void SetKey(uint64_t to) {
+    key = to;
+  }
+};
+#pragma pack(pop)
+
 ////////////////////////////////////////////////////////////////////////////////////////
 class LanguageModel: public StatefulFeatureFunction
 {
@@ -74,7 +96,11 @@ protected:
   FactorType m_factorType;
   size_t m_order;
 
-  InMemoryTrie<const Factor*, LMScores> m_root;
+  // all orders in 1 flat table, keyed by the hash of the n-gram, most
+  // recent word first
+  typedef util::ProbingHashTable<LMEntry, util::IdentityHash> NGramTable;
+  std::vector<LMEntry> m_ngramMem;
+  NGramTable m_ngrams;
   SCORE m_oov;
   const Factor *m_bos;
   const Factor *m_eos;
@@ -83,7 +109,16 @@ protected:
                    const Factor *factor) const;
   std::pair<SCORE, void*> Score(
     const std::vector<const Factor*> &context) const;
-  SCORE BackoffScore(const std::vector<const Factor*> &context) const;
+
+  void CreateTable(const std::vector<uint64_t> &counts);
+  const LMEntry *Find(uint64_t key) const;
+
+  static uint64_t CombineHash(uint64_t current, const Factor *factor) {
+    // same mixing as KenLM. 0 is the empty bucket
+    uint64_t ret = (current * 8978948897894561157ULL)
+                   ^ ((uint64_t) (1 + factor->GetId()) * 17894857484156487943ULL);
+    return ret ? ret : 1;
+  }
 
   void DebugContext(const std::vector<const Factor*> &context) const;
 };
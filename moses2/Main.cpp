@@ -1,5 +1,6 @@
 #include <iostream>
 #include <memory>
+#include <algorithm>
 #include <boost/pool/pool_alloc.hpp>
 #include "Main.h"
 #include "System.h"
@@ -55,6 +56,11 @@ int main(int argc, char** argv)
       batch_run(params, system, pool);
   }
 
+  pool.Stop(true);
+  cerr << "Thread pool: ";
+  pool.GetStats().Debug(cerr);
+  cerr << endl;
+
   cerr << "Decoding took " << timer.get_elapsed_time() << endl;
   //	cerr << "g_numHypos=" << g_numHypos << endl;
   cerr << "Finished" << endl;
@@ -91,10 +97,22 @@ void batch_run(Moses2::Parameter& params, Moses2::System& system, Moses2::Thread
 {
     istream& inStream = GetInputStream(params);
 
+    // bound the number of sentences that are queued, decoding or waiting to
+    // be written out in order, so memory stays flat whatever the input size
+    size_t numThreads = system.options.server.numThreads;
+    size_t window;
+    params.SetParameter(window, "batch-window", numThreads * 4);
+    window = std::max(window, std::max(numThreads, (size_t) 1));
+    // the whole window can be queued so the pool can start the longest
+    // sentences in it first
+    pool.SetQueueLimit(window);
+
     long translationId = 0;
     string line;
     while (getline(inStream, line)) {
         //cerr << "line=" << line << endl;
+        system.bestCollector->WaitForSlot(translationId, window);
+
         boost::shared_ptr<Moses2::TranslationTask> task(new Moses2::TranslationTask(system, line, translationId));
 
         //cerr << "START pool.Submit()" << endl;
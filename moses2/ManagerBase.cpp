@@ -20,6 +20,11 @@ using namespace std;
 
 namespace Moses2
 {
+#ifndef WIN32
+thread_local MemPool *ManagerBase::s_threadPool = NULL;
+thread_local Recycler<HypothesisBase*> *ManagerBase::s_threadHypoRecycler = NULL;
+#endif // WIN32
+
 ManagerBase::ManagerBase(System &sys, const TranslationTask &task,
                          const std::string &inputStr, long translationId)
   :system(sys)
@@ -37,10 +42,27 @@ ManagerBase::~ManagerBase()
 {
   system.featureFunctions.CleanUpAfterSentenceProcessing(*m_input);
 
+  // pools are per thread, so high-water mark and pages are for this thread so far
+  if (system.verbose >= 2) {
+    cerr << "Translation " << m_translationId << " manager pool: ";
+    GetPool().Debug(cerr);
+    cerr << endl << "Translation " << m_translationId << " system pool: ";
+    GetSystemPool().Debug(cerr);
+    cerr << endl;
+  }
+
   GetPool().Reset();
   GetHypoRecycler().Clear();
 }
 
+void ManagerBase::KeepAlive(const boost::shared_ptr<void> &obj) const
+{
+#ifdef WITH_THREADS
+  boost::mutex::scoped_lock lock(m_keepAliveMutex);
+#endif
+  m_keepAlive.push_back(obj);
+}
+
 void ManagerBase::InitPools()
 {
   m_pool = &system.GetManagerPool();
@@ -49,5 +71,23 @@ void ManagerBase::InitPools()
   //cerr << "pool size " << m_pool->Size() << " " << m_systemPool->Size() << endl;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////
+ManagerBase::ThreadScope::ThreadScope(MemPool &pool,
+                                      Recycler<HypothesisBase*> &hypoRecycler)
+{
+#ifndef WIN32
+  s_threadPool = &pool;
+  s_threadHypoRecycler = &hypoRecycler;
+#endif
+}
+
+ManagerBase::ThreadScope::~ThreadScope()
+{
+#ifndef WIN32
+  s_threadPool = NULL;
+  s_threadHypoRecycler = NULL;
+#endif
+}
+
 }
 
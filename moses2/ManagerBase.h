@@ -11,6 +11,11 @@
 #include <cstddef>
 #include <string>
 #include <deque>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#ifdef WITH_THREADS
+#include <boost/thread/mutex.hpp>
+#endif
 #include "Phrase.h"
 #include "MemPool.h"
 #include "Recycler.h"
@@ -46,6 +51,11 @@ public:
   virtual std::string OutputTransOpt() = 0;
 
   MemPool &GetPool() const {
+#ifndef WIN32
+    if (s_threadPool) {
+      return *s_threadPool;
+    }
+#endif
     return *m_pool;
   }
 
@@ -54,9 +64,31 @@ public:
   }
 
   Recycler<HypothesisBase*> &GetHypoRecycler() const {
+#ifndef WIN32
+    if (s_threadHypoRecycler) {
+      return *s_threadHypoRecycler;
+    }
+#endif
     return *m_hypoRecycler;
   }
 
+  /** While in scope, GetPool() and GetHypoRecycler() called on this thread
+   * return the given pool and recycler instead of the manager's own.
+   * Used by tasks that decode part of a sentence on another thread.
+   */
+  class ThreadScope
+  {
+  public:
+    ThreadScope(MemPool &pool, Recycler<HypothesisBase*> &hypoRecycler);
+    ~ThreadScope();
+  };
+
+  /** Keep obj alive until this manager is destroyed. Used for data shared
+   * between sentences, eg. cached target phrases, which may be evicted while
+   * this sentence is still using it.
+   */
+  void KeepAlive(const boost::shared_ptr<void> &obj) const;
+
   const InputType &GetInput() const {
     return *m_input;
   }
@@ -73,6 +105,16 @@ protected:
   mutable MemPool *m_pool, *m_systemPool;
   mutable Recycler<HypothesisBase*> *m_hypoRecycler;
 
+  mutable std::vector<boost::shared_ptr<void> > m_keepAlive;
+#ifdef WITH_THREADS
+  mutable boost::mutex m_keepAliveMutex;
+#endif
+
+#ifndef WIN32
+  thread_local static MemPool *s_threadPool;
+  thread_local static Recycler<HypothesisBase*> *s_threadHypoRecycler;
+#endif
+
   void InitPools();
 
 };
@@ -29,11 +29,16 @@ MemPool::Page::~Page()
 ////////////////////////////////////////////////////
 MemPool::MemPool(size_t initSize) :
   m_currSize(initSize), m_currPage(0)
+  ,m_used(0), m_highWaterMark(0), m_wasted(0), m_free(0)
 {
   Page *page = new Page(m_currSize);
   m_pages.push_back(page);
 
   current_ = page->mem;
+
+  std::fill(m_freeLists, m_freeLists + NUM_CLASSES, (FreeBlock*) NULL);
+  std::fill(m_numAllocs, m_numAllocs + NUM_CLASSES + 1, 0);
+  std::fill(m_numReused, m_numReused + NUM_CLASSES, 0);
   //cerr << "new memory pool";
 }
 
@@ -43,17 +48,75 @@ MemPool::~MemPool()
   RemoveAllInColl(m_pages);
 }
 
+// floor(log2(x)), x > 0
+static size_t HighestBit(unsigned long long x)
+{
+#ifdef __GNUC__
+  return 63 - __builtin_clzll(x);
+#else
+  size_t ret = 0;
+  while (x >>= 1) {
+    ++ret;
+  }
+  return ret;
+#endif
+}
+
+size_t MemPool::ClassForAllocate(std::size_t size)
+{
+  if (size <= 16 * NUM_SMALL_CLASSES) {
+    return (size + 15) / 16 - 1;
+  }
+  // ceil(log2(size)), 512 bytes and up
+  size_t log = HighestBit(size - 1) + 1;
+  size_t ret = NUM_SMALL_CLASSES + log - 9;
+  return std::min(ret, NUM_CLASSES);
+}
+
+size_t MemPool::ClassForFree(std::size_t size)
+{
+  if (size < 16 * (NUM_SMALL_CLASSES + 1)) {
+    return std::min(size / 16, NUM_SMALL_CLASSES) - 1;
+  }
+  // floor(log2(size))
+  size_t log = HighestBit(size);
+  size_t ret = NUM_SMALL_CLASSES + log - 9;
+  return std::min(ret, NUM_CLASSES - 1);
+}
+
+size_t MemPool::ClassSize(size_t sizeClass)
+{
+  if (sizeClass < NUM_SMALL_CLASSES) {
+    return (sizeClass + 1) * 16;
+  }
+  return (size_t) 512 << (sizeClass - NUM_SMALL_CLASSES);
+}
+
 uint8_t* MemPool::Allocate(std::size_t size) {
   if (size == 0) {
     return nullptr;
   }
+
+  size_t sizeClass = ClassForAllocate(size);
+  ++m_numAllocs[sizeClass];
+  if (sizeClass < NUM_CLASSES && m_freeLists[sizeClass]) {
+    FreeBlock *block = m_freeLists[sizeClass];
+    m_freeLists[sizeClass] = block->next;
+    m_free -= ClassSize(sizeClass);
+    ++m_numReused[sizeClass];
+    return (uint8_t*) block;
+  }
+
   //size = (size + 3) & 0xfffffffc;
   //size = (size + 7) & 0xfffffff8;
-  size = (size + 15) & 0xfffffff0;
+  size_t aligned = (size + 15) & ~((std::size_t) 15);
   //size = (size + 31) & 0xffffffe0;
+  m_wasted += aligned - size;
+  m_used += aligned;
+  m_highWaterMark = std::max(m_highWaterMark, m_used);
 
   uint8_t* ret = current_;
-  current_ += size;
+  current_ += aligned;
 
   assert(m_currPage < m_pages.size());
   Page& page = *m_pages[m_currPage];
@@ -61,12 +124,27 @@ uint8_t* MemPool::Allocate(std::size_t size) {
     // return what we got
   }
   else {
-    ret = More(size);
+    m_wasted += page.end - ret;
+    ret = More(aligned);
   }
   return ret;
 
 }
 
+void MemPool::Deallocate(void *p, std::size_t size)
+{
+  if (p == NULL || size == 0) {
+    return;
+  }
+
+  size_t aligned = (size + 15) & ~((std::size_t) 15);
+  size_t sizeClass = ClassForFree(aligned);
+  FreeBlock *block = (FreeBlock*) p;
+  block->next = m_freeLists[sizeClass];
+  m_freeLists[sizeClass] = block;
+  m_free += ClassSize(sizeClass);
+}
+
 uint8_t *MemPool::More(std::size_t size)
 {
   ++m_currPage;
@@ -91,6 +169,7 @@ uint8_t *MemPool::More(std::size_t size)
       return ret;
     } else {
       // recursive call More()
+      m_wasted += page.size;
       return More(size);
     }
   }
@@ -110,6 +189,11 @@ void MemPool::Reset()
 
   m_currPage = 0;
   current_ = m_pages[0]->mem;
+
+  std::fill(m_freeLists, m_freeLists + NUM_CLASSES, (FreeBlock*) NULL);
+  m_used = 0;
+  m_wasted = 0;
+  m_free = 0;
 }
 
 size_t MemPool::Size()
@@ -121,5 +205,28 @@ size_t MemPool::Size()
   return ret;
 }
 
+void MemPool::Debug(std::ostream &out) const
+{
+  size_t size = 0;
+  for (const Page *page: m_pages) {
+    size += page->size;
+  }
+
+  out << "size=" << size
+      << " pages=" << m_pages.size()
+      << " used=" << m_used
+      << " highWaterMark=" << m_highWaterMark
+      << " wasted=" << m_wasted
+      << " free=" << m_free
+      << " allocs(size:num/reused)=";
+  for (size_t i = 0; i < NUM_CLASSES; ++i) {
+    if (m_numAllocs[i]) {
+      out << ClassSize(i) << ":" << m_numAllocs[i] << "/" << m_numReused[i] << " ";
+    }
+  }
+  if (m_numAllocs[NUM_CLASSES]) {
+    out << "large:" << m_numAllocs[NUM_CLASSES];
+  }
 }
 
+}
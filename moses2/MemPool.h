@@ -30,6 +30,11 @@ class MemPool
     ~Page();
   };
 
+  // freed blocks are chained through their first bytes
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
 public:
   MemPool(std::size_t initSize = 10240);
 
@@ -45,33 +50,79 @@ public:
 
   template<typename T>
   T *Allocate(size_t num) {
-    size_t size = sizeof(T);
-    size_t m = size % 16;
-    size += m;
-
-    uint8_t *ret = Allocate(size * num);
+    // Allocate() aligns the whole block. Elements are sizeof(T) apart
+    uint8_t *ret = Allocate(sizeof(T) * num);
     return (T*) ret;
   }
 
+  /** Give back memory from Allocate() so it can be reused for a later
+   * allocation of similar size. size must be the size that was asked for.
+   * Used by MemPoolAllocator, ie. nodes and buffers of STL containers.
+   * Pools are per thread so the free lists need no locking.
+   */
+  void Deallocate(void *p, std::size_t size);
+
+  template<typename T>
+  void Deallocate(T *p, size_t num = 1) {
+    Deallocate((void*) p, sizeof(T) * num);
+  }
+
   // re-use pool
   void Reset();
 
   size_t Size();
 
+  // STATS
+  //! bytes handed out since the last Reset(), including alignment padding
+  size_t GetUsed() const {
+    return m_used;
+  }
+  //! max of GetUsed() over the life of the pool
+  size_t GetHighWaterMark() const {
+    return m_highWaterMark;
+  }
+  size_t GetNumPages() const {
+    return m_pages.size();
+  }
+  //! alignment padding and page ends skipped since the last Reset()
+  size_t GetWasted() const {
+    return m_wasted;
+  }
+  //! bytes in the free lists
+  size_t GetFree() const {
+    return m_free;
+  }
+
+  void Debug(std::ostream &out) const;
+
 private:
+  // 16-byte steps up to 256 bytes, then powers of 2 up to 1MB
+  static const size_t NUM_SMALL_CLASSES = 16;
+  static const size_t NUM_CLASSES = NUM_SMALL_CLASSES + 12;
+
   uint8_t *More(std::size_t size);
 
+  //! smallest class whose blocks all have at least size bytes
+  static size_t ClassForAllocate(std::size_t size);
+  //! largest class whose blocks have at most size bytes
+  static size_t ClassForFree(std::size_t size);
+  static size_t ClassSize(size_t sizeClass);
+
   std::vector<Page*> m_pages;
 
   size_t m_currSize;
   size_t m_currPage;
   uint8_t *current_;
 
+  FreeBlock *m_freeLists[NUM_CLASSES];
+
+  size_t m_used, m_highWaterMark, m_wasted, m_free;
+  size_t m_numAllocs[NUM_CLASSES + 1], m_numReused[NUM_CLASSES];
+
   // no copying
   MemPool(const MemPool &) = delete;
   MemPool &operator=(const MemPool &) = delete;
 };
 
-
 }
 
@@ -39,6 +39,7 @@ public:
 
   void deallocate(pointer p, size_type n) {
     //std::cerr << "deallocate " << p << " " << n << std::endl;
+    m_pool.Deallocate(p, n);
   }
 
   pointer allocate(size_type n, std::allocator<void>::const_pointer hint = 0) {
@@ -23,45 +23,46 @@ namespace NSCubePruningMiniStack
 ////////////////////////////////////////////////////////////////////////
 QueueItem *QueueItem::Create(QueueItem *currItem, Manager &mgr, CubeEdge &edge,
                              size_t hypoIndex, size_t tpIndex,
-                             QueueItemRecycler &queueItemRecycler)
+                             QueueItemRecycler &queueItemRecycler,
+                             bool evaluate)
 {
   QueueItem *ret;
   if (currItem) {
     // reuse incoming queue item to create new item
     ret = currItem;
-    ret->Init(mgr, edge, hypoIndex, tpIndex);
+    ret->Init(mgr, edge, hypoIndex, tpIndex, evaluate);
   } else if (!queueItemRecycler.empty()) {
     // use item from recycle bin
     ret = queueItemRecycler.back();
-    ret->Init(mgr, edge, hypoIndex, tpIndex);
+    ret->Init(mgr, edge, hypoIndex, tpIndex, evaluate);
     queueItemRecycler.pop_back();
   } else {
     // create new item
     ret = new (mgr.GetPool().Allocate<QueueItem>()) QueueItem(mgr, edge,
-        hypoIndex, tpIndex);
+        hypoIndex, tpIndex, evaluate);
   }
 
   return ret;
 }
 
 QueueItem::QueueItem(Manager &mgr, CubeEdge &edge, size_t hypoIndex,
-                     size_t tpIndex) :
+                     size_t tpIndex, bool evaluate) :
   edge(&edge), hypoIndex(hypoIndex), tpIndex(tpIndex)
 {
-  CreateHypothesis(mgr);
+  CreateHypothesis(mgr, evaluate);
 }
 
 void QueueItem::Init(Manager &mgr, CubeEdge &edge, size_t hypoIndex,
-                     size_t tpIndex)
+                     size_t tpIndex, bool evaluate)
 {
   this->edge = &edge;
   this->hypoIndex = hypoIndex;
   this->tpIndex = tpIndex;
 
-  CreateHypothesis(mgr);
+  CreateHypothesis(mgr, evaluate);
 }
 
-void QueueItem::CreateHypothesis(Manager &mgr)
+void QueueItem::CreateHypothesis(Manager &mgr, bool evaluate)
 {
   const Hypothesis *prevHypo =
     static_cast<const Hypothesis*>(edge->hypos[hypoIndex]);
@@ -76,7 +77,7 @@ void QueueItem::CreateHypothesis(Manager &mgr)
   hypo->Init(mgr, *prevHypo, edge->path, tp, edge->newBitmap,
              edge->estimatedScore);
 
-  if (!mgr.system.options.cube.lazy_scoring) {
+  if (evaluate && !mgr.system.options.cube.lazy_scoring) {
     hypo->EvaluateWhenApplied();
   }
 }
@@ -121,6 +122,50 @@ void CubeEdge::CreateFirst(Manager &mgr, Queue &queue,
   assert(setSeen);
 }
 
+void CubeEdge::CreateFirst(Manager &mgr, CubeEdge * const *begin,
+                           CubeEdge * const *end, Queue &queue,
+                           SeenPositions &seenPositions,
+                           QueueItemRecycler &queueItemRecycler)
+{
+  if (mgr.system.options.cube.lazy_scoring) {
+    for (CubeEdge * const *iter = begin; iter != end; ++iter) {
+      (*iter)->CreateFirst(mgr, queue, seenPositions, queueItemRecycler);
+    }
+    return;
+  }
+
+  // the top hypos of different edges are independent of each other. Score
+  // them together so feature functions can batch their work, eg. LM lookups.
+  // Then add them to the queue in the same order as CreateFirst() would
+  MemPool &pool = mgr.GetPool();
+  size_t size = end - begin;
+  QueueItem **items = pool.Allocate<QueueItem*>(size);
+  Batch batch(pool);
+  batch.reserve(size);
+
+  for (size_t i = 0; i < size; ++i) {
+    CubeEdge &edge = *begin[i];
+    assert(edge.hypos.size());
+    assert(edge.tps.GetSize());
+
+    items[i] = QueueItem::Create(NULL, mgr, edge, 0, 0, queueItemRecycler,
+                                 false);
+    batch.push_back(items[i]->hypo);
+
+    bool setSeen = edge.SetSeenPosition(0, 0, seenPositions);
+    assert(setSeen);
+    (void) setSeen;
+  }
+
+  mgr.system.featureFunctions.EvaluateWhenAppliedBatch(batch);
+
+  for (size_t i = 0; i < size; ++i) {
+    queue.push(items[i]);
+  }
+
+  pool.Deallocate(items, size);
+}
+
 void CubeEdge::CreateNext(Manager &mgr, QueueItem *item, Queue &queue,
                           SeenPositions &seenPositions,
                           QueueItemRecycler &queueItemRecycler)
@@ -128,24 +173,41 @@ void CubeEdge::CreateNext(Manager &mgr, QueueItem *item, Queue &queue,
   size_t hypoIndex = item->hypoIndex;
   size_t tpIndex = item->tpIndex;
 
+  // a pop has at most 2 successors. Score them together, then queue them.
+  // The next pop depends on their scores so they can't wait for more
+  QueueItem *newItems[2];
+  size_t numNew = 0;
+
   if (hypoIndex + 1 < hypos.size()
       && SetSeenPosition(hypoIndex + 1, tpIndex, seenPositions)) {
     // reuse incoming queue item to create new item
-    QueueItem *newItem = QueueItem::Create(item, mgr, *this, hypoIndex + 1,
-                                           tpIndex, queueItemRecycler);
-    assert(newItem == item);
-    queue.push(newItem);
+    newItems[numNew] = QueueItem::Create(item, mgr, *this, hypoIndex + 1,
+                                         tpIndex, queueItemRecycler, false);
+    assert(newItems[numNew] == item);
+    ++numNew;
     item = NULL;
   }
 
   if (tpIndex + 1 < tps.GetSize()
       && SetSeenPosition(hypoIndex, tpIndex + 1, seenPositions)) {
-    QueueItem *newItem = QueueItem::Create(item, mgr, *this, hypoIndex,
-                                           tpIndex + 1, queueItemRecycler);
-    queue.push(newItem);
+    newItems[numNew++] = QueueItem::Create(item, mgr, *this, hypoIndex,
+                                           tpIndex + 1, queueItemRecycler, false);
     item = NULL;
   }
 
+  if (numNew && !mgr.system.options.cube.lazy_scoring) {
+    Batch batch(mgr.GetPool());
+    batch.reserve(numNew);
+    for (size_t i = 0; i < numNew; ++i) {
+      batch.push_back(newItems[i]->hypo);
+    }
+    mgr.system.featureFunctions.EvaluateWhenAppliedBatch(batch);
+  }
+
+  for (size_t i = 0; i < numNew; ++i) {
+    queue.push(newItems[i]);
+  }
+
   if (item) {
     // recycle unused queue item
     queueItemRecycler.push_back(item);
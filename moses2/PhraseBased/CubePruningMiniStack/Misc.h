@@ -37,19 +37,24 @@ class QueueItem
 {
   ~QueueItem(); // NOT IMPLEMENTED. Use MemPool
 public:
+  // evaluate = false leaves the stateful feature functions to be evaluated
+  // by the caller, eg. as part of a batch
   static QueueItem *Create(QueueItem *currItem, Manager &mgr, CubeEdge &edge,
                            size_t hypoIndex, size_t tpIndex,
-                           QueueItemRecycler &queueItemRecycler);
-  QueueItem(Manager &mgr, CubeEdge &edge, size_t hypoIndex, size_t tpIndex);
+                           QueueItemRecycler &queueItemRecycler,
+                           bool evaluate = true);
+  QueueItem(Manager &mgr, CubeEdge &edge, size_t hypoIndex, size_t tpIndex,
+            bool evaluate = true);
 
-  void Init(Manager &mgr, CubeEdge &edge, size_t hypoIndex, size_t tpIndex);
+  void Init(Manager &mgr, CubeEdge &edge, size_t hypoIndex, size_t tpIndex,
+            bool evaluate = true);
 
   CubeEdge *edge;
   size_t hypoIndex, tpIndex;
   Hypothesis *hypo;
 
 protected:
-  void CreateHypothesis(Manager &mgr);
+  void CreateHypothesis(Manager &mgr, bool evaluate);
 };
 
 ///////////////////////////////////////////
@@ -87,6 +92,12 @@ public:
 
   void CreateFirst(Manager &mgr, Queue &queue, SeenPositions &seenPositions,
                    QueueItemRecycler &queueItemRecycler);
+
+  // CreateFirst() for all the edges, with the new hypos scored as 1 batch
+  static void CreateFirst(Manager &mgr, CubeEdge * const *begin,
+                          CubeEdge * const *end, Queue &queue,
+                          SeenPositions &seenPositions,
+                          QueueItemRecycler &queueItemRecycler);
   void CreateNext(Manager &mgr, QueueItem *item, Queue &queue,
                   SeenPositions &seenPositions,
                   QueueItemRecycler &queueItemRecycler);
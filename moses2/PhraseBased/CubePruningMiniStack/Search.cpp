@@ -4,6 +4,8 @@
  *  Created on: 16 Nov 2015
  *      Author: hieu
  */
+#include <unordered_map>
+#include <queue>
 #include <boost/foreach.hpp>
 #include "Search.h"
 #include "Stack.h"
@@ -17,6 +19,7 @@
 #include "../../System.h"
 #include "../../TranslationTask.h"
 #include "../../legacy/Util2.h"
+#include "../../legacy/ThreadPool.h"
 #include "../../PhraseBased/TargetPhrases.h"
 
 using namespace std;
@@ -40,11 +43,13 @@ Search::Search(Manager &mgr) :
 
   , m_queueItemRecycler(MemPoolAllocator<QueueItem*>(mgr.GetPool()))
 
+  , m_numRunning(0)
 {
 }
 
 Search::~Search()
 {
+  RemoveAllInColl(m_slots);
 }
 
 void Search::Decode()
@@ -72,7 +77,11 @@ void Search::Decode()
        ++stackInd) {
     //cerr << "stackInd=" << stackInd << endl;
     m_stack.Clear();
-    Decode(stackInd);
+    if (mgr.system.GetSearchPool()) {
+      DecodeParallel(stackInd);
+    } else {
+      Decode(stackInd);
+    }
     PostDecode(stackInd);
 
     //m_stack.DebugCounts();
@@ -103,10 +112,8 @@ void Search::Decode(size_t stackInd)
   // add top hypo from every edge into queue
   CubeEdges &edges = *m_cubeEdges[stackInd];
 
-  BOOST_FOREACH(CubeEdge *edge, edges) {
-    //cerr << *edge << " ";
-    edge->CreateFirst(mgr, m_queue, m_seenPositions, m_queueItemRecycler);
-  }
+  CubeEdge::CreateFirst(mgr, edges.data(), edges.data() + edges.size(),
+                        m_queue, m_seenPositions, m_queueItemRecycler);
 
   size_t pops = 0;
   while (!m_queue.empty() && pops < mgr.system.options.cube.pop_limit) {
@@ -148,6 +155,218 @@ void Search::Decode(size_t stackInd)
   }
 }
 
+////////////////////////////////////////////////////////////////////////
+class Search::MiniStackTask: public Task
+{
+public:
+  MiniStackTask(Search &search, MiniStackEdges &miniStack)
+    :m_search(search)
+    ,m_miniStack(miniStack)
+  {}
+
+  virtual void Run() {
+    m_search.RunMiniStackTask(m_miniStack);
+  }
+
+protected:
+  Search &m_search;
+  MiniStackEdges &m_miniStack;
+};
+
+void Search::DecodeParallel(size_t stackInd)
+{
+  // Cube pruning is done separately for each mini-stack of the new stack, on
+  // the system search pool. Edges of different mini-stacks don't share
+  // anything, so the pops of a single queue over all the edges are the pops
+  // of each mini-stack merged by score. Each mini-stack pops up to the pop
+  // limit, then the merge keeps the best pop limit hypos, in the order the
+  // serial search would add them. Apart from ties, and diverse hypos that
+  // lazy scoring has already scored, the search is the same as the serial
+  // one, and doesn't depend on thread scheduling
+  CubeEdges &edges = *m_cubeEdges[stackInd];
+
+  std::vector<MiniStackEdges> miniStacks;
+  std::unordered_map<Stack::HypoCoverage, size_t,
+      boost::hash<Stack::HypoCoverage> > miniStackInds;
+  BOOST_FOREACH(CubeEdge *edge, edges) {
+    Stack::HypoCoverage key(&edge->newBitmap, edge->path.range.GetEndPos());
+    std::pair<std::unordered_map<Stack::HypoCoverage, size_t,
+        boost::hash<Stack::HypoCoverage> >::iterator, bool> ret =
+          miniStackInds.insert(std::make_pair(key, miniStacks.size()));
+    if (ret.second) {
+      miniStacks.push_back(MiniStackEdges());
+    }
+    miniStacks[ret.first->second].edges.push_back(edge);
+  }
+
+  if (miniStacks.empty()) {
+    return;
+  }
+
+  // 1 slot for each search thread + this thread
+  if (m_slots.empty()) {
+    for (size_t i = 0; i <= mgr.system.options.cube.search_threads; ++i) {
+      m_slots.push_back(new WorkerSlot());
+    }
+    m_freeSlots = m_slots;
+  }
+
+  // feature functions may extend coverage bitmaps
+  mgr.GetBitmaps().SetThreadSafe(true);
+
+  ThreadPool &pool = *mgr.system.GetSearchPool();
+  m_numRunning = miniStacks.size();
+  m_exception = std::exception_ptr();
+  size_t submitted = 1;
+  try {
+    for (; submitted < miniStacks.size(); ++submitted) {
+      boost::shared_ptr<Task> task(new MiniStackTask(*this, miniStacks[submitted]));
+      pool.Submit(task);
+    }
+  } catch (...) {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_numRunning -= miniStacks.size() - submitted;
+    if (!m_exception) {
+      m_exception = std::current_exception();
+    }
+  }
+  RunMiniStackTask(miniStacks[0]);
+
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    while (m_numRunning) {
+      m_finished.wait(lock);
+    }
+  }
+
+  mgr.GetBitmaps().SetThreadSafe(false);
+
+  if (m_exception) {
+    std::rethrow_exception(m_exception);
+  }
+
+  // merge. Holds the future score of the next hypo of each mini-stack, and
+  // -index so ties go to the 1st mini-stack
+  std::priority_queue<std::pair<SCORE, long> > heads;
+  std::vector<size_t> next(miniStacks.size(), 0);
+  for (size_t i = 0; i < miniStacks.size(); ++i) {
+    if (!miniStacks[i].popped.empty()) {
+      heads.push(std::make_pair(miniStacks[i].popped[0].futureScore, -(long) i));
+    }
+  }
+
+  Recycler<HypothesisBase*> &hypoRecycler = mgr.GetHypoRecycler();
+  size_t popLimit = mgr.system.options.cube.pop_limit;
+  for (size_t pops = 0; pops < popLimit && !heads.empty(); ++pops) {
+    size_t i = -heads.top().second;
+    heads.pop();
+
+    MiniStackEdges &miniStack = miniStacks[i];
+    m_stack.Add(miniStack.popped[next[i]++].hypo, hypoRecycler, mgr.arcLists);
+    if (next[i] < miniStack.popped.size()) {
+      heads.push(std::make_pair(miniStack.popped[next[i]].futureScore, -(long) i));
+    }
+  }
+
+  // the serial search wouldn't have popped the rest
+  bool diversity = mgr.system.options.cube.diversity;
+  for (size_t i = 0; i < miniStacks.size(); ++i) {
+    MiniStackEdges &miniStack = miniStacks[i];
+    for (size_t j = next[i]; j < miniStack.popped.size(); ++j) {
+      const Popped &popped = miniStack.popped[j];
+      if (diversity && popped.first) {
+        m_stack.Add(popped.hypo, hypoRecycler, mgr.arcLists);
+      } else {
+        hypoRecycler.Recycle(popped.hypo);
+      }
+    }
+    BOOST_FOREACH(Hypothesis *hypo, miniStack.diverse) {
+      m_stack.Add(hypo, hypoRecycler, mgr.arcLists);
+    }
+  }
+}
+
+void Search::RunMiniStackTask(MiniStackEdges &miniStack)
+{
+  WorkerSlot *slot;
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    assert(!m_freeSlots.empty());
+    slot = m_freeSlots.back();
+    m_freeSlots.pop_back();
+  }
+
+  // the search thread waits for every task, so a failed task must still
+  // count itself out
+  try {
+    ManagerBase::ThreadScope scope(slot->pool, slot->hypoRecycler);
+    Decode(miniStack);
+  } catch (...) {
+    boost::mutex::scoped_lock lock(m_mutex);
+    if (!m_exception) {
+      m_exception = std::current_exception();
+    }
+  }
+
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_freeSlots.push_back(slot);
+    --m_numRunning;
+  }
+  m_finished.notify_all();
+}
+
+void Search::Decode(MiniStackEdges &miniStack)
+{
+  // same as Decode(stackInd) but with its own queue, for 1 mini-stack
+  MemPool &pool = mgr.GetPool();
+  Recycler<HypothesisBase*> &hypoRecycler = mgr.GetHypoRecycler();
+
+  MemPoolAllocator<QueueItem*> queueAlloc(pool);
+  std::vector<QueueItem*, MemPoolAllocator<QueueItem*> > container(queueAlloc);
+  CubeEdge::Queue queue(QueueItemOrderer(), container);
+  MemPoolAllocator<CubeEdge::SeenPositionItem> seenAlloc(pool);
+  CubeEdge::SeenPositions seenPositions(seenAlloc);
+  QueueItemRecycler queueItemRecycler(queueAlloc);
+
+  CubeEdge::CreateFirst(mgr, miniStack.edges.data(),
+                        miniStack.edges.data() + miniStack.edges.size(),
+                        queue, seenPositions, queueItemRecycler);
+
+  size_t popLimit = mgr.system.options.cube.pop_limit;
+  while (!queue.empty() && miniStack.popped.size() < popLimit) {
+    QueueItem *item = queue.top();
+    queue.pop();
+
+    CubeEdge *edge = item->edge;
+    Popped popped;
+    popped.hypo = item->hypo;
+    popped.futureScore = popped.hypo->GetFutureScore();
+    popped.first = item->hypoIndex == 0 && item->tpIndex == 0;
+
+    if (mgr.system.options.cube.lazy_scoring) {
+      popped.hypo->EvaluateWhenApplied();
+    }
+
+    miniStack.popped.push_back(popped);
+
+    edge->CreateNext(mgr, item, queue, seenPositions, queueItemRecycler);
+  }
+
+  // create hypo from every edge. Increase diversity
+  while (!queue.empty()) {
+    QueueItem *item = queue.top();
+    queue.pop();
+
+    if (mgr.system.options.cube.diversity
+        && item->hypoIndex == 0 && item->tpIndex == 0) {
+      miniStack.diverse.push_back(item->hypo);
+    } else {
+      hypoRecycler.Recycle(item->hypo);
+    }
+  }
+}
+
 void Search::PostDecode(size_t stackInd)
 {
   MemPool &pool = mgr.GetPool();
@@ -6,7 +6,11 @@
  */
 
 #pragma once
+#include <vector>
+#include <exception>
 #include <boost/pool/pool_alloc.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include "../Search.h"
 #include "Misc.h"
 #include "Stack.h"
@@ -54,6 +58,40 @@ protected:
   // decoding
   void Decode(size_t stackInd);
   void PostDecode(size_t stackInd);
+
+  // PARALLEL CUBE PRUNING
+  struct Popped {
+    Hypothesis *hypo;
+    SCORE futureScore; // when it was popped, before lazy scoring
+    bool first; // best hypo & best target phrase of its edge
+  };
+
+  // edges that create hypos for the same mini-stack, the hypos popped from
+  // them in order, and the hypos left in the queue that add diversity
+  struct MiniStackEdges {
+    std::vector<CubeEdge*> edges;
+    std::vector<Popped> popped;
+    std::vector<Hypothesis*> diverse;
+  };
+
+  // memory for hypos, queue items etc. created by a task. Each slot is used
+  // by one task at a time and lives as long as the sentence
+  struct WorkerSlot {
+    MemPool pool;
+    Recycler<HypothesisBase*> hypoRecycler;
+  };
+
+  class MiniStackTask;
+
+  std::vector<WorkerSlot*> m_slots, m_freeSlots;
+  size_t m_numRunning;
+  std::exception_ptr m_exception; // 1st thrown by a task, rethrown by the search thread
+  boost::mutex m_mutex;
+  boost::condition_variable m_finished;
+
+  void DecodeParallel(size_t stackInd);
+  void Decode(MiniStackEdges &miniStack);
+  void RunMiniStackTask(MiniStackEdges &miniStack);
 };
 
 }
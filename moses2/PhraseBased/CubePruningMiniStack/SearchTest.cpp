@@ -0,0 +1,143 @@
+#define BOOST_TEST_MODULE CubePruningMiniStackSearch
+// moses2_lib has a main() of its own, for the DLL API. The header-only
+// framework puts the test main() in this object, so it's the one linked
+#include <boost/test/included/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "../../Moses2Wrapper.h"
+
+using namespace std;
+using namespace Moses2;
+
+namespace
+{
+
+const char *PHRASE_TABLE =
+  "das ||| the ||| 0.6 0.5 0.6 0.5 ||| 0-0\n"
+  "das ||| this ||| 0.3 0.2 0.3 0.2 ||| 0-0\n"
+  "das ||| that ||| 0.1 0.2 0.1 0.2 ||| 0-0\n"
+  "das haus ||| the house ||| 0.7 0.6 0.7 0.6 ||| 0-0 1-1\n"
+  "haus ||| house ||| 0.8 0.7 0.8 0.7 ||| 0-0\n"
+  "haus ||| home ||| 0.2 0.3 0.2 0.3 ||| 0-0\n"
+  "ist ||| is ||| 0.8 0.7 0.8 0.7 ||| 0-0\n"
+  "ist ||| 's ||| 0.2 0.3 0.2 0.3 ||| 0-0\n"
+  "ist klein ||| is small ||| 0.6 0.5 0.6 0.5 ||| 0-0 1-1\n"
+  "klein ||| small ||| 0.7 0.6 0.7 0.6 ||| 0-0\n"
+  "klein ||| little ||| 0.3 0.4 0.3 0.4 ||| 0-0\n"
+  "groß ||| big ||| 0.7 0.6 0.7 0.6 ||| 0-0\n"
+  "groß ||| large ||| 0.3 0.3 0.3 0.3 ||| 0-0\n"
+  "nicht ||| not ||| 0.9 0.8 0.9 0.8 ||| 0-0\n"
+  "sehr ||| very ||| 0.9 0.8 0.9 0.8 ||| 0-0\n";
+
+const char *LM =
+  "\\data\\\n"
+  "ngram 1=14\n"
+  "ngram 2=9\n"
+  "\n"
+  "\\1-grams:\n"
+  "-1.5\t<unk>\t0\n"
+  "-99\t<s>\t-0.5\n"
+  "-1.2\t</s>\t0\n"
+  "-1.0\tthe\t-0.3\n"
+  "-1.4\tthis\t-0.2\n"
+  "-1.5\tthat\t-0.2\n"
+  "-1.1\thouse\t-0.3\n"
+  "-1.6\thome\t-0.2\n"
+  "-1.0\tis\t-0.3\n"
+  "-1.8\t's\t-0.1\n"
+  "-1.3\tsmall\t-0.2\n"
+  "-1.5\tlittle\t-0.1\n"
+  "-1.3\tbig\t-0.2\n"
+  "-1.2\tnot\t-0.2\n"
+  "\n"
+  "\\2-grams:\n"
+  "-0.3\t<s> the\n"
+  "-0.4\tthe house\n"
+  "-0.3\thouse is\n"
+  "-0.4\tis small\n"
+  "-0.5\tis not\n"
+  "-0.4\tnot big\n"
+  "-0.3\tsmall </s>\n"
+  "-0.3\tbig </s>\n"
+  "-0.6\tthis house\n"
+  "\n"
+  "\\end\\\n";
+
+const char *INPUT[] = {
+  "das haus ist klein",
+  "das haus ist nicht groß",
+  "klein ist das haus",
+  "sehr groß ist das haus nicht",
+  "das ist sehr klein"
+};
+
+void WriteFile(const boost::filesystem::path &path, const string &text)
+{
+  ofstream out(path.string().c_str());
+  out << text;
+}
+
+// A small model in a temporary directory, decoded with cube pruning.
+class Model
+{
+public:
+  Model()
+    :m_dir(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()) {
+    boost::filesystem::create_directory(m_dir);
+    WriteFile(m_dir / "pt.txt", PHRASE_TABLE);
+    WriteFile(m_dir / "lm.arpa", LM);
+  }
+
+  ~Model() {
+    boost::filesystem::remove_all(m_dir);
+  }
+
+  // n-best lists of the input
+  string Decode(size_t popLimit, size_t searchThreads) {
+    ostringstream ini;
+    ini << "[input-factors]\n0\n\n[mapping]\n0 T 0\n\n"
+        << "[distortion-limit]\n6\n\n[search-algorithm]\n1\n\n"
+        << "[n-best-list]\n-\n100\n\n"
+        << "[cube-pruning-pop-limit]\n" << popLimit << "\n\n"
+        << "[cube-pruning-search-threads]\n" << searchThreads << "\n\n"
+        << "[feature]\nUnknownWordPenalty\nWordPenalty\nPhrasePenalty\n"
+        << "PhraseDictionaryMemory name=TranslationModel0 num-features=4 path="
+        << (m_dir / "pt.txt").string() << " input-factor=0 output-factor=0 table-limit=20\n"
+        << "Distortion\n"
+        << "KENLM name=LM0 factor=0 path=lm.arpa order=2\n\n"
+        << "[weight]\nUnknownWordPenalty0= 1\nWordPenalty0= -1\nPhrasePenalty0= 0.2\n"
+        << "TranslationModel0= 0.2 0.2 0.2 0.2\nDistortion0= 0.3\nLM0= 0.5\n";
+    boost::filesystem::path iniPath = m_dir / "moses.ini";
+    WriteFile(iniPath, ini.str());
+
+    Moses2Wrapper decoder(iniPath.string());
+    string ret;
+    for (size_t i = 0; i < sizeof(INPUT) / sizeof(const char*); ++i) {
+      ret += decoder.Translate(INPUT[i], i, true);
+    }
+    return ret;
+  }
+
+private:
+  boost::filesystem::path m_dir;
+};
+
+}
+
+// Expanding the mini-stacks in parallel doesn't change the search, even when
+// the pop limit is reached.
+BOOST_AUTO_TEST_CASE(parallel_same_as_serial)
+{
+  Model model;
+  const size_t popLimits[] = { 2, 5, 1000 };
+  for (size_t i = 0; i < sizeof(popLimits) / sizeof(size_t); ++i) {
+    string serial = model.Decode(popLimits[i], 0);
+    BOOST_CHECK(!serial.empty());
+    BOOST_CHECK_EQUAL(serial, model.Decode(popLimits[i], 3));
+  }
+}
+
@@ -118,19 +118,23 @@ void Search::Extend(const Hypothesis &hypo, const InputPath &path)
 void Search::Extend(const Hypothesis &hypo, const TargetPhrases &tps,
                     const InputPath &path, const Bitmap &newBitmap, SCORE estimatedScore)
 {
+  // create all the new hypos first and score them as 1 batch, so feature
+  // functions can overlap their work, eg. LM lookups
+  MemPool &pool = mgr.GetPool();
+  Batch batch(pool);
+  batch.reserve(tps.GetSize());
+
   BOOST_FOREACH(const TargetPhraseImpl *tp, tps) {
-    Extend(hypo, *tp, path, newBitmap, estimatedScore);
+    Hypothesis *newHypo = Hypothesis::Create(mgr);
+    newHypo->Init(mgr, hypo, path, *tp, newBitmap, estimatedScore);
+    batch.push_back(newHypo);
   }
-}
 
-void Search::Extend(const Hypothesis &hypo, const TargetPhraseImpl &tp,
-                    const InputPath &path, const Bitmap &newBitmap, SCORE estimatedScore)
-{
-  Hypothesis *newHypo = Hypothesis::Create(mgr);
-  newHypo->Init(mgr, hypo, path, tp, newBitmap, estimatedScore);
-  newHypo->EvaluateWhenApplied();
+  mgr.system.featureFunctions.EvaluateWhenAppliedBatch(batch);
 
-  m_stacks.Add(newHypo, mgr.GetHypoRecycler(), mgr.arcLists);
+  BOOST_FOREACH(Hypothesis *newHypo, batch) {
+    m_stacks.Add(newHypo, mgr.GetHypoRecycler(), mgr.arcLists);
+  }
 }
 
 const Hypothesis *Search::GetBestHypo() const
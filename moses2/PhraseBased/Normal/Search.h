@@ -42,8 +42,6 @@ protected:
   void Extend(const Hypothesis &hypo, const InputPath &path);
   void Extend(const Hypothesis &hypo, const TargetPhrases &tps,
               const InputPath &path, const Bitmap &newBitmap, SCORE estimatedScore);
-  void Extend(const Hypothesis &hypo, const TargetPhraseImpl &tp,
-              const InputPath &path, const Bitmap &newBitmap, SCORE estimatedScore);
 
 };
 
@@ -13,6 +13,7 @@
 #include "FF/FeatureFunction.h"
 #include "TranslationModel/UnknownWordPenalty.h"
 #include "legacy/Util2.h"
+#include "legacy/ThreadPool.h"
 #include "util/exception.hh"
 
 using namespace std;
@@ -26,15 +27,26 @@ namespace Moses2
 #endif // WIN32
 
 System::System(const Parameter &paramsArg) :
-  params(paramsArg), featureFunctions(*this)
+  params(paramsArg), featureFunctions(*this), m_searchPool(NULL)
 {
   options.init(paramsArg);
   IsPb();
 
+#ifndef WIN32
+  // worker pools and recyclers of parallel search tasks are thread_local
+  if (isPb && options.cube.search_threads
+      && (options.search.algo == CubePruning
+          || options.search.algo == CubePruningMiniStack)) {
+    m_searchPool = new ThreadPool(options.cube.search_threads);
+    m_searchPool->SetQueueLimit(0);
+  }
+#endif
+
   bestCollector.reset(new OutputCollector());
 
   params.SetParameter(cpuAffinityOffset, "cpu-affinity-offset", -1);
   params.SetParameter(cpuAffinityOffsetIncr, "cpu-affinity-increment", 1);
+  params.SetParameter(verbose, "verbose", 1);
 
   const PARAM_VEC *section;
 
@@ -87,6 +99,7 @@ System::System(const Parameter &paramsArg) :
 
 System::~System()
 {
+  delete m_searchPool;
 }
 
 void System::LoadWeights()
@@ -33,6 +33,7 @@ class FeatureFunction;
 class StatefulFeatureFunction;
 class PhraseTable;
 class HypothesisBase;
+class ThreadPool;
 
 class System
 {
@@ -51,6 +52,7 @@ public:
   // moses.ini params
   int cpuAffinityOffset;
   int cpuAffinityOffsetIncr;
+  int verbose;
 
   System(const Parameter &paramsArg);
   virtual ~System();
@@ -63,11 +65,18 @@ public:
 
   Batch &GetBatch(MemPool &pool) const;
 
+  //! threads for intra-sentence parallel search. NULL if search is serial
+  ThreadPool *GetSearchPool() const {
+    return m_searchPool;
+  }
+
 protected:
   mutable FactorCollection m_vocab;
 
   mutable boost::thread_specific_ptr<Batch> m_batch;
 
+  ThreadPool *m_searchPool;
+
 #ifdef WIN32
   mutable boost::thread_specific_ptr<MemPool> m_managerPool;
   mutable boost::thread_specific_ptr<MemPool> m_systemPool;
@@ -0,0 +1,373 @@
+// $Id$
+// vim:tabstop=2
+/***********************************************************************
+Moses - factored phrase-based language decoder
+Copyright (C) 2006 University of Edinburgh
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+***********************************************************************/
+
+#include "PhraseDecoder.h"
+#include "PhraseTableCompact.h"
+#include "../../System.h"
+#include "../../SubPhrase.h"
+#include "../../legacy/FactorCollection.h"
+#include "../../legacy/Util2.h"
+#include "util/exception.hh"
+
+using namespace std;
+
+namespace Moses2
+{
+
+PhraseDecoder::PhraseDecoder(
+  PhraseTableCompact &phraseTable,
+  const std::vector<FactorType> &input,
+  const std::vector<FactorType> &output)
+  : m_coding(None), m_numScoreComponent(0),
+    m_containsAlignmentInfo(true), m_maxRank(0), m_maxPhraseLength(0),
+    m_symbolTree(0), m_multipleScoreTrees(false),
+    m_scoreTrees(1), m_alignTree(0),
+    m_phraseTable(phraseTable), m_input(input), m_output(output),
+    m_separator(" ||| ")
+{ }
+
+PhraseDecoder::~PhraseDecoder()
+{
+  if(m_symbolTree)
+    delete m_symbolTree;
+
+  for(size_t i = 0; i < m_scoreTrees.size(); i++)
+    if(m_scoreTrees[i])
+      delete m_scoreTrees[i];
+
+  if(m_alignTree)
+    delete m_alignTree;
+}
+
+size_t PhraseDecoder::Load(System &system, std::FILE* in)
+{
+  size_t start = std::ftell(in);
+  size_t read = 0;
+
+  read += std::fread(&m_coding, sizeof(m_coding), 1, in);
+  read += std::fread(&m_numScoreComponent, sizeof(m_numScoreComponent), 1, in);
+  read += std::fread(&m_containsAlignmentInfo, sizeof(m_containsAlignmentInfo), 1, in);
+  read += std::fread(&m_maxRank, sizeof(m_maxRank), 1, in);
+  read += std::fread(&m_maxPhraseLength, sizeof(m_maxPhraseLength), 1, in);
+
+  if(m_coding == REnc) {
+    // the map is complete, so it can be read by several threads without locking
+    StringVector<unsigned char, unsigned, std::allocator> sourceSymbols;
+    sourceSymbols.load(in);
+    for (unsigned i = 0; i < sourceSymbols.size(); ++i) {
+      m_sourceSymbolsMap[sourceSymbols[i].str()] = i;
+    }
+
+    size_t size;
+    read += std::fread(&size, sizeof(size_t), 1, in);
+    m_lexicalTableIndex.resize(size);
+    read += std::fread(&m_lexicalTableIndex[0], sizeof(size_t), size, in);
+
+    read += std::fread(&size, sizeof(size_t), 1, in);
+    m_lexicalTable.resize(size);
+    read += std::fread(&m_lexicalTable[0], sizeof(SrcTrg), size, in);
+  }
+
+  // intern all target words now, rather than each time a phrase is decoded
+  StringVector<unsigned char, unsigned, std::allocator> targetSymbols;
+  targetSymbols.load(in);
+
+  FactorCollection &vocab = system.GetVocab();
+  m_targetFactors.resize(targetSymbols.size() * m_output.size());
+  for (unsigned i = 0; i < targetSymbols.size(); ++i) {
+    string symbol = targetSymbols[i].str();
+    if (m_output.size() == 1) {
+      m_targetFactors[i] = vocab.AddFactor(symbol, system, false);
+    } else {
+      vector<string> toks = Tokenize(symbol, "|");
+      UTIL_THROW_IF2(toks.size() != m_output.size(),
+                     "Target word " << symbol << " doesn't have " << m_output.size() << " factors");
+      for (size_t j = 0; j < toks.size(); ++j) {
+        m_targetFactors[i * m_output.size() + j] = vocab.AddFactor(toks[j], system, false);
+      }
+    }
+  }
+
+  m_symbolTree = new CanonicalHuffman<unsigned>(in);
+
+  read += std::fread(&m_multipleScoreTrees, sizeof(m_multipleScoreTrees), 1, in);
+  if(m_multipleScoreTrees) {
+    m_scoreTrees.resize(m_numScoreComponent);
+    for(size_t i = 0; i < m_numScoreComponent; i++)
+      m_scoreTrees[i] = new CanonicalHuffman<float>(in);
+  } else {
+    m_scoreTrees.resize(1);
+    m_scoreTrees[0] = new CanonicalHuffman<float>(in);
+  }
+
+  if(m_containsAlignmentInfo)
+    m_alignTree = new CanonicalHuffman<AlignPoint>(in);
+
+  size_t end = std::ftell(in);
+  return end - start;
+}
+
+bool PhraseDecoder::AddTargetWord(unsigned symbol, TPCompact &targetPhrase) const
+{
+  size_t numFactors = m_output.size();
+  if ((symbol + 1) * numFactors > m_targetFactors.size()) {
+    return false;
+  }
+
+  targetPhrase.words.push_back(Word());
+  Word &word = targetPhrase.words.back();
+  for (size_t i = 0; i < numFactors; ++i) {
+    word[m_output[i]] = m_targetFactors[symbol * numFactors + i];
+  }
+  return true;
+}
+
+TargetPhraseVectorPtr PhraseDecoder::CreateTargetPhraseCollection(
+  const Phrase<Word> &sourcePhrase, bool topLevel)
+{
+  TargetPhraseVectorPtr tpv(new TargetPhraseVector());
+  size_t bitsLeft = 0;
+
+  if(m_coding == PREnc) {
+    std::pair<TargetPhraseVectorPtr, size_t> cachedPhraseColl
+      = m_decodingCache.Retrieve(sourcePhrase);
+
+    // Has been cached and is complete or does not need to be completed
+    if(cachedPhraseColl.first != NULL && (!topLevel || cachedPhraseColl.second == 0))
+      return cachedPhraseColl.first;
+
+    // Has been cached, but is incomplete
+    else if(cachedPhraseColl.first != NULL) {
+      bitsLeft = cachedPhraseColl.second;
+      tpv->resize(cachedPhraseColl.first->size());
+      std::copy(cachedPhraseColl.first->begin(),
+                cachedPhraseColl.first->end(),
+                tpv->begin());
+    }
+  }
+
+  // Retrieve source phrase identifier
+  std::string sourcePhraseString = sourcePhrase.GetString(m_input);
+  size_t sourcePhraseId = m_phraseTable.m_hash[sourcePhraseString + m_separator];
+
+  if(sourcePhraseId != m_phraseTable.m_hash.GetSize()) {
+    // Retrieve compressed and encoded target phrase collection
+    std::string encodedPhraseCollection;
+    if(m_phraseTable.m_inMemory)
+      encodedPhraseCollection = m_phraseTable.m_targetPhrasesMemory[sourcePhraseId].str();
+    else
+      encodedPhraseCollection = m_phraseTable.m_targetPhrasesMapped[sourcePhraseId].str();
+
+    BitWrapper<> encodedBitStream(encodedPhraseCollection);
+    if(m_coding == PREnc && bitsLeft)
+      encodedBitStream.SeekFromEnd(bitsLeft);
+
+    // Decompress and decode target phrase collection
+    return DecodeCollection(tpv, encodedBitStream, sourcePhrase, topLevel);
+  } else
+    return TargetPhraseVectorPtr();
+}
+
+TargetPhraseVectorPtr PhraseDecoder::DecodeCollection(
+  TargetPhraseVectorPtr tpv, BitWrapper<> &encodedBitStream,
+  const Phrase<Word> &sourcePhrase, bool topLevel)
+{
+  bool extending = tpv->size();
+  size_t bitsLeft = encodedBitStream.TellFromEnd();
+
+  std::vector<int> sourceWords;
+  if(m_coding == REnc) {
+    for(size_t i = 0; i < sourcePhrase.GetSize(); i++) {
+      std::string sourceWord = sourcePhrase[i].GetString(m_input);
+      boost::unordered_map<std::string, unsigned>::const_iterator iter
+        = m_sourceSymbolsMap.find(sourceWord);
+      sourceWords.push_back(iter == m_sourceSymbolsMap.end() ? -1 : (int) iter->second);
+    }
+  }
+
+  unsigned phraseStopSymbol = 0;
+  AlignPoint alignStopSymbol(-1, -1);
+
+  enum DecodeState { New, Symbol, Score, Alignment, Add } state = New;
+
+  size_t srcSize = sourcePhrase.GetSize();
+  bool useAlignmentInfo = m_phraseTable.m_useAlignmentInfo;
+
+  TPCompact* targetPhrase = NULL;
+  while(encodedBitStream.TellFromEnd()) {
+
+    if(state == New) {
+      tpv->push_back(TPCompact());
+      targetPhrase = &tpv->back();
+      targetPhrase->scores.reserve(m_numScoreComponent);
+
+      state = Symbol;
+    }
+
+    if(state == Symbol) {
+      unsigned symbol = m_symbolTree->Read(encodedBitStream);
+      if(symbol == phraseStopSymbol) {
+        state = Score;
+      } else {
+        if(m_coding == REnc) {
+          size_t type = GetREncType(symbol);
+
+          if(type == 1) {
+            if (!AddTargetWord(DecodeREncSymbol1(symbol), *targetPhrase))
+              return TargetPhraseVectorPtr();
+          } else {
+            size_t rank, srcPos;
+            if (type == 2) {
+              rank = DecodeREncSymbol2Rank(symbol);
+              srcPos = DecodeREncSymbol2Position(symbol);
+            } else {
+              rank = DecodeREncSymbol3(symbol);
+              srcPos = targetPhrase->words.size();
+            }
+
+            if(srcPos >= sourceWords.size() || sourceWords[srcPos] < 0)
+              return TargetPhraseVectorPtr();
+
+            size_t trgPos = targetPhrase->words.size();
+            if (!AddTargetWord(GetTranslation(sourceWords[srcPos], rank), *targetPhrase))
+              return TargetPhraseVectorPtr();
+            if(useAlignmentInfo)
+              targetPhrase->alignment.insert(AlignPointSizeT(srcPos, trgPos));
+          }
+        } else if(m_coding == PREnc) {
+          // if the symbol is just a word
+          if(GetPREncType(symbol) == 1) {
+            if (!AddTargetWord(DecodePREncSymbol1(symbol), *targetPhrase))
+              return TargetPhraseVectorPtr();
+          }
+          // if the symbol is a subphrase pointer
+          else {
+            int left = DecodePREncSymbol2Left(symbol);
+            int right = DecodePREncSymbol2Right(symbol);
+            unsigned rank = DecodePREncSymbol2Rank(symbol);
+
+            int srcStart = left + targetPhrase->words.size();
+            int srcEnd   = srcSize - right - 1;
+
+            // false positive consistency check
+            if(0 > srcStart || srcStart > srcEnd || unsigned(srcEnd) >= srcSize)
+              return TargetPhraseVectorPtr();
+
+            // false positive consistency check
+            if(m_maxRank && rank > m_maxRank)
+              return TargetPhraseVectorPtr();
+
+            // set subphrase by default to itself
+            TargetPhraseVectorPtr subTpv = tpv;
+
+            // if range smaller than source phrase retrieve subphrase
+            if(unsigned(srcEnd - srcStart + 1) != srcSize) {
+              SubPhrase<Word> subPhrase = sourcePhrase.GetSubPhrase(srcStart, srcEnd - srcStart + 1);
+              subTpv = CreateTargetPhraseCollection(subPhrase, false);
+            } else {
+              // false positive consistency check
+              if(rank >= tpv->size()-1)
+                return TargetPhraseVectorPtr();
+            }
+
+            // false positive consistency check
+            if(subTpv != NULL && rank < subTpv->size()) {
+              // insert the subphrase into the main target phrase.
+              // Copy, subTp may be in tpv which may reallocate
+              TPCompact subTp = subTpv->at(rank);
+              if(useAlignmentInfo) {
+                // reconstruct the alignment data based on the alignment of the subphrase
+                for(std::set<AlignPointSizeT>::const_iterator it = subTp.alignment.begin();
+                    it != subTp.alignment.end(); it++) {
+                  targetPhrase->alignment.insert(AlignPointSizeT(srcStart + it->first,
+                                                 targetPhrase->words.size() + it->second));
+                }
+              }
+              targetPhrase->words.insert(targetPhrase->words.end(),
+                                         subTp.words.begin(), subTp.words.end());
+            } else
+              return TargetPhraseVectorPtr();
+          }
+        } else {
+          if (!AddTargetWord(symbol, *targetPhrase))
+            return TargetPhraseVectorPtr();
+        }
+      }
+    } else if(state == Score) {
+      size_t idx = m_multipleScoreTrees ? targetPhrase->scores.size() : 0;
+      float score = m_scoreTrees[idx]->Read(encodedBitStream);
+      targetPhrase->scores.push_back(score);
+
+      if(targetPhrase->scores.size() == m_numScoreComponent) {
+        if(m_containsAlignmentInfo)
+          state = Alignment;
+        else
+          state = Add;
+      }
+    } else if(state == Alignment) {
+      AlignPoint alignPoint = m_alignTree->Read(encodedBitStream);
+      if(alignPoint == alignStopSymbol) {
+        state = Add;
+      } else {
+        if(useAlignmentInfo)
+          targetPhrase->alignment.insert(AlignPointSizeT(alignPoint));
+      }
+    }
+
+    if(state == Add) {
+      if(useAlignmentInfo) {
+        size_t targetSize = targetPhrase->words.size();
+        for(std::set<AlignPointSizeT>::const_iterator it = targetPhrase->alignment.begin();
+            it != targetPhrase->alignment.end(); it++) {
+          if(it->first >= srcSize || it->second >= targetSize)
+            return TargetPhraseVectorPtr();
+        }
+      }
+
+      if(m_coding == PREnc) {
+        if(!m_maxRank || tpv->size() <= m_maxRank)
+          bitsLeft = encodedBitStream.TellFromEnd();
+
+        if(!topLevel && m_maxRank && tpv->size() >= m_maxRank)
+          break;
+      }
+
+      if(encodedBitStream.TellFromEnd() <= 8)
+        break;
+
+      state = New;
+    }
+  }
+
+  if(m_coding == PREnc && !extending) {
+    bitsLeft = bitsLeft > 8 ? bitsLeft : 0;
+    m_decodingCache.Cache(sourcePhrase, tpv, bitsLeft, m_maxRank);
+  }
+
+  return tpv;
+}
+
+void PhraseDecoder::PruneCache()
+{
+  m_decodingCache.Prune();
+}
+
+}
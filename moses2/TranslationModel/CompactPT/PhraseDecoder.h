@@ -0,0 +1,160 @@
+// $Id$
+// vim:tabstop=2
+/***********************************************************************
+Moses - factored phrase-based language decoder
+Copyright (C) 2006 University of Edinburgh
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+***********************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <boost/unordered_map.hpp>
+
+#include "../../TypeDef.h"
+#include "../../Phrase.h"
+#include "StringVector.h"
+#include "CanonicalHuffman.h"
+#include "TargetPhraseCollectionCache.h"
+
+namespace Moses2
+{
+
+class System;
+class Factor;
+class PhraseTableCompact;
+
+/** Decodes the Huffman/rank-encoded target phrase collections of a .minphr
+ * file, created by processPhraseTableMin. Same file format as the decoder of
+ * moses' PhraseDictionaryCompact.
+ * Target words are interned in the vocab when the table is loaded, decoding
+ * doesn't touch strings.
+ */
+class PhraseDecoder
+{
+protected:
+  typedef std::pair<unsigned char, unsigned char> AlignPoint;
+  typedef std::pair<unsigned, unsigned> SrcTrg;
+
+  enum Coding { None, REnc, PREnc } m_coding;
+
+  size_t m_numScoreComponent;
+  bool m_containsAlignmentInfo;
+  size_t m_maxRank;
+  size_t m_maxPhraseLength;
+
+  // REnc only
+  boost::unordered_map<std::string, unsigned> m_sourceSymbolsMap;
+  std::vector<size_t> m_lexicalTableIndex;
+  std::vector<SrcTrg> m_lexicalTable;
+
+  // target symbol id -> factor of each output factor type
+  std::vector<const Factor*> m_targetFactors;
+
+  CanonicalHuffman<unsigned>* m_symbolTree;
+
+  bool m_multipleScoreTrees;
+  std::vector<CanonicalHuffman<float>*> m_scoreTrees;
+
+  CanonicalHuffman<AlignPoint>* m_alignTree;
+
+  TargetPhraseCollectionCache m_decodingCache;
+
+  PhraseTableCompact &m_phraseTable;
+  const std::vector<FactorType> &m_input;
+  const std::vector<FactorType> &m_output;
+
+  std::string m_separator;
+
+  size_t GetREncType(unsigned encodedSymbol) const {
+    return (encodedSymbol >> 30) + 1;
+  }
+
+  size_t GetPREncType(unsigned encodedSymbol) const {
+    return (encodedSymbol >> 31) + 1;
+  }
+
+  unsigned GetTranslation(unsigned srcIdx, size_t rank) const {
+    size_t srcTrgIdx = m_lexicalTableIndex[srcIdx];
+    return m_lexicalTable[srcTrgIdx + rank].second;
+  }
+
+  unsigned DecodeREncSymbol1(unsigned encodedSymbol) const {
+    return encodedSymbol & ~(3 << 30);
+  }
+
+  unsigned DecodeREncSymbol2Rank(unsigned encodedSymbol) const {
+    return encodedSymbol & ~(255 << 24);
+  }
+
+  unsigned DecodeREncSymbol2Position(unsigned encodedSymbol) const {
+    return (encodedSymbol & ~(3 << 30)) >> 24;
+  }
+
+  unsigned DecodeREncSymbol3(unsigned encodedSymbol) const {
+    return encodedSymbol & ~(3 << 30);
+  }
+
+  unsigned DecodePREncSymbol1(unsigned encodedSymbol) const {
+    return encodedSymbol & ~(1 << 31);
+  }
+
+  int DecodePREncSymbol2Left(unsigned encodedSymbol) const {
+    return ((encodedSymbol >> 25) & 63) - 32;
+  }
+
+  int DecodePREncSymbol2Right(unsigned encodedSymbol) const {
+    return ((encodedSymbol >> 19) & 63) - 32;
+  }
+
+  unsigned DecodePREncSymbol2Rank(unsigned encodedSymbol) const {
+    return encodedSymbol & 524287;
+  }
+
+  //! false if symbol id is out of range, ie. a false positive from the hash
+  bool AddTargetWord(unsigned symbol, TPCompact &targetPhrase) const;
+
+  TargetPhraseVectorPtr DecodeCollection(TargetPhraseVectorPtr tpv,
+                                         BitWrapper<> &encodedBitStream,
+                                         const Phrase<Word> &sourcePhrase,
+                                         bool topLevel);
+
+public:
+  PhraseDecoder(PhraseTableCompact &phraseTable,
+                const std::vector<FactorType> &input,
+                const std::vector<FactorType> &output);
+
+  ~PhraseDecoder();
+
+  size_t Load(System &system, std::FILE* in);
+
+  size_t GetMaxSourcePhraseLength() const {
+    return m_maxPhraseLength;
+  }
+
+  size_t GetNumScoreComponent() const {
+    return m_numScoreComponent;
+  }
+
+  TargetPhraseVectorPtr CreateTargetPhraseCollection(const Phrase<Word> &sourcePhrase,
+      bool topLevel = false);
+
+  void PruneCache();
+};
+
+}
@@ -0,0 +1,169 @@
+/*
+ * PhraseTableCompact.cpp
+ */
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include "PhraseTableCompact.h"
+#include "PhraseDecoder.h"
+#include "../../System.h"
+#include "../../PhraseBased/InputPath.h"
+#include "../../PhraseBased/Manager.h"
+#include "../../PhraseBased/TargetPhraseImpl.h"
+#include "../../PhraseBased/TargetPhrases.h"
+#include "../../FF/FeatureFunctions.h"
+#include "util/exception.hh"
+
+using namespace std;
+
+namespace Moses2
+{
+
+PhraseTableCompact::PhraseTableCompact(size_t startInd, const std::string &line)
+  :PhraseTable(startInd, line)
+  ,m_inMemory(false)
+  ,m_useAlignmentInfo(true)
+  ,m_hash(10, 16)
+  ,m_phraseDecoder(NULL)
+{
+  ReadParameters();
+}
+
+PhraseTableCompact::~PhraseTableCompact()
+{
+  delete m_phraseDecoder;
+}
+
+void PhraseTableCompact::SetParameter(const std::string& key, const std::string& value)
+{
+  if (key == "in-memory") {
+    m_inMemory = Scan<bool>(value);
+  } else {
+    PhraseTable::SetParameter(key, value);
+  }
+}
+
+void PhraseTableCompact::Load(System &system)
+{
+  std::string tFilePath = m_path;
+
+  std::string suffix = ".minphr";
+  if (!boost::algorithm::ends_with(tFilePath, suffix)) tFilePath += suffix;
+  UTIL_THROW_IF2(!FileExists(tFilePath), "File " << tFilePath << " does not exist");
+
+  m_phraseDecoder = new PhraseDecoder(*this, m_input, m_output);
+
+  std::FILE* pFile = std::fopen(tFilePath.c_str() , "r");
+  UTIL_THROW_IF2(pFile == NULL, "File " << tFilePath << " could not be opened");
+
+  size_t indexSize = m_hash.Load(pFile);
+  size_t coderSize = m_phraseDecoder->Load(system, pFile);
+
+  size_t phraseSize;
+  if(m_inMemory)
+    // Load target phrase collections into memory
+    phraseSize = m_targetPhrasesMemory.load(pFile, false);
+  else
+    // Keep target phrase collections on disk
+    phraseSize = m_targetPhrasesMapped.load(pFile, true);
+
+  UTIL_THROW_IF2(indexSize == 0 || coderSize == 0 || phraseSize == 0,
+                 "Not successfully loaded");
+  UTIL_THROW_IF2(m_phraseDecoder->GetNumScoreComponent() != m_numScores,
+                 tFilePath << " has " << m_phraseDecoder->GetNumScoreComponent()
+                 << " scores, num-features=" << m_numScores);
+}
+
+TargetPhrases *PhraseTableCompact::Lookup(const Manager &mgr, MemPool &pool,
+    InputPath &inputPath) const
+{
+  const SubPhrase<Moses2::Word> &sourcePhrase = inputPath.subPhrase;
+
+  // There is no such source phrase if source phrase is longer than longest
+  // observed source phrase during compilation
+  if(sourcePhrase.GetSize() > m_phraseDecoder->GetMaxSourcePhraseLength()) {
+    return NULL;
+  }
+
+  TargetPhraseVectorPtr tpv
+    = m_phraseDecoder->CreateTargetPhraseCollection(sourcePhrase, true);
+  if (tpv == NULL || tpv->empty()) {
+    return NULL;
+  }
+
+  const System &system = mgr.system;
+  const FeatureFunctions &ffs = system.featureFunctions;
+
+  TargetPhrases *tps = new (pool.Allocate<TargetPhrases>()) TargetPhrases(pool, tpv->size());
+  BOOST_FOREACH(const TPCompact &tpCompact, *tpv) {
+    TargetPhraseImpl *tp = CreateTargetPhrase(pool, system, tpCompact);
+    ffs.EvaluateInIsolation(pool, system, sourcePhrase, *tp);
+    tps->AddTargetPhrase(*tp);
+  }
+
+  tps->SortAndPrune(m_tableLimit);
+  ffs.EvaluateAfterTablePruning(pool, *tps, sourcePhrase);
+  //cerr << *tps << endl;
+
+  return tps;
+}
+
+TargetPhraseImpl *PhraseTableCompact::CreateTargetPhrase(MemPool &pool,
+    const System &system, const TPCompact &tpCompact) const
+{
+  size_t size = tpCompact.words.size();
+  TargetPhraseImpl *tp =
+    new (pool.Allocate<TargetPhraseImpl>()) TargetPhraseImpl(pool, *this, system, size);
+
+  for (size_t pos = 0; pos < size; ++pos) {
+    const Word &word = tpCompact.words[pos];
+    Word &outWord = (*tp)[pos];
+    BOOST_FOREACH(FactorType factorType, m_output) {
+      outWord[factorType] = word[factorType];
+    }
+  }
+
+  // scores are already log and floored by processPhraseTableMin
+  tp->GetScores().PlusEquals(system, *this, tpCompact.scores);
+
+  if (m_useAlignmentInfo) {
+    tp->SetAlignTerm(tpCompact.alignment);
+  }
+
+  return tp;
+}
+
+void PhraseTableCompact::CleanUpAfterSentenceProcessing(const System &system, const InputType &input) const
+{
+  m_phraseDecoder->PruneCache();
+}
+
+void PhraseTableCompact::InitActiveChart(
+  MemPool &pool,
+  const SCFG::Manager &mgr,
+  SCFG::InputPath &path) const
+{
+  UTIL_THROW2("Not implemented");
+}
+
+void PhraseTableCompact::Lookup(MemPool &pool,
+                                const SCFG::Manager &mgr,
+                                size_t maxChartSpan,
+                                const SCFG::Stacks &stacks,
+                                SCFG::InputPath &path) const
+{
+  UTIL_THROW2("Not implemented");
+}
+
+void PhraseTableCompact::LookupGivenNode(
+  MemPool &pool,
+  const SCFG::Manager &mgr,
+  const SCFG::ActiveChartEntry &prevEntry,
+  const SCFG::Word &wordSought,
+  const Moses2::Hypotheses *hypos,
+  const Moses2::Range &subPhraseRange,
+  SCFG::InputPath &outPath) const
+{
+  UTIL_THROW2("Not implemented");
+}
+
+}
@@ -0,0 +1,74 @@
+/*
+ * PhraseTableCompact.h
+ *
+ * Phrase-based phrase table which reads .minphr files, created by
+ * processPhraseTableMin, directly. The counterpart of moses'
+ * PhraseDictionaryCompact.
+ */
+#pragma once
+
+#include <cstdio>
+#include "../PhraseTable.h"
+#include "BlockHashIndex.h"
+#include "StringVector.h"
+
+namespace Moses2
+{
+
+class PhraseDecoder;
+struct TPCompact;
+
+class PhraseTableCompact: public PhraseTable
+{
+  friend class PhraseDecoder;
+
+public:
+  PhraseTableCompact(size_t startInd, const std::string &line);
+  virtual ~PhraseTableCompact();
+
+  virtual void Load(System &system);
+  virtual void SetParameter(const std::string& key, const std::string& value);
+
+  virtual TargetPhrases *Lookup(const Manager &mgr, MemPool &pool,
+                                InputPath &inputPath) const;
+
+  virtual void CleanUpAfterSentenceProcessing(const System &system, const InputType &input) const;
+
+  // scfg
+  virtual void InitActiveChart(
+    MemPool &pool,
+    const SCFG::Manager &mgr,
+    SCFG::InputPath &path) const;
+
+  virtual void Lookup(
+    MemPool &pool,
+    const SCFG::Manager &mgr,
+    size_t maxChartSpan,
+    const SCFG::Stacks &stacks,
+    SCFG::InputPath &path) const;
+
+protected:
+  bool m_inMemory;
+  bool m_useAlignmentInfo;
+
+  BlockHashIndex m_hash;
+  PhraseDecoder *m_phraseDecoder;
+
+  StringVector<unsigned char, size_t, MmapAllocator>  m_targetPhrasesMapped;
+  StringVector<unsigned char, size_t, std::allocator> m_targetPhrasesMemory;
+
+  TargetPhraseImpl *CreateTargetPhrase(MemPool &pool, const System &system,
+                                       const TPCompact &tpCompact) const;
+
+  virtual void LookupGivenNode(
+    MemPool &pool,
+    const SCFG::Manager &mgr,
+    const SCFG::ActiveChartEntry &prevEntry,
+    const SCFG::Word &wordSought,
+    const Moses2::Hypotheses *hypos,
+    const Moses2::Range &subPhraseRange,
+    SCFG::InputPath &outPath) const;
+
+};
+
+}
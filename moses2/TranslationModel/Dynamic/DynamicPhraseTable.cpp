@@ -143,6 +143,33 @@ TargetPhrases* DynamicPhraseTable::Lookup(const Manager &mgr, MemPool &pool,
   return tps;
 }
 
+void DynamicPhraseTable::LookupBatch(const Manager &mgr,
+                                     const std::vector<InputPath*> &paths) const
+{
+  // extend the previous span's node by 1 word, if it's this span's prefix
+  const InputPathBase *prevPath = NULL;
+  const PBNODE *prevNode = NULL;
+
+  BOOST_FOREACH(InputPath *path, paths) {
+    const SubPhrase<Moses2::Word> &phrase = path->subPhrase;
+
+    const PBNODE *node;
+    if (path->prefixPath && path->prefixPath == prevPath) {
+      node = prevNode ? prevNode->Find(m_input, phrase.Back()) : NULL;
+    } else {
+      node = &m_rootPb;
+      for (size_t i = 0; node && i < phrase.GetSize(); ++i) {
+        node = node->Find(m_input, phrase[i]);
+      }
+    }
+
+    path->AddTargetPhrases(*this, node ? node->GetTargetPhrases() : NULL);
+
+    prevPath = path;
+    prevNode = node;
+  }
+}
+
 void DynamicPhraseTable::CleanUpAfterSentenceProcessing(const System &system, const InputType &input) const {
    m_rootPb.CleanNode(); //TODO  : clean this
 }
@@ -53,6 +53,8 @@ public:
 
   virtual TargetPhrases *Lookup(const Manager &mgr, MemPool &pool,
                                 InputPath &inputPath) const;
+  virtual void LookupBatch(const Manager &mgr,
+                           const std::vector<InputPath*> &paths) const;
 
   virtual void InitActiveChart(
     MemPool &pool,
@@ -158,6 +158,34 @@ TargetPhrases* MSPT::Lookup(const Manager &mgr, MemPool &pool,
   return tps;
 }
 
+void MSPT::LookupBatch(const Manager &mgr,
+                       const std::vector<InputPath*> &paths) const
+{
+  // A span's node is a child of its prefix's node, which was found just before it.
+  // Only walk from the root when the prefix wasn't looked up
+  const InputPathBase *prevPath = NULL;
+  const PBNODE *prevNode = NULL;
+
+  BOOST_FOREACH(InputPath *path, paths) {
+    const SubPhrase<Moses2::Word> &phrase = path->subPhrase;
+
+    const PBNODE *node;
+    if (path->prefixPath && path->prefixPath == prevPath) {
+      node = prevNode ? prevNode->Find(m_input, phrase.Back()) : NULL;
+    } else {
+      node = m_rootPb;
+      for (size_t i = 0; node && i < phrase.GetSize(); ++i) {
+        node = node->Find(m_input, phrase[i]);
+      }
+    }
+
+    path->AddTargetPhrases(*this, node ? node->GetTargetPhrases() : NULL);
+
+    prevPath = path;
+    prevNode = node;
+  }
+}
+
 void MSPT::InitActiveChart(
   MemPool &pool,
   const SCFG::Manager &mgr,
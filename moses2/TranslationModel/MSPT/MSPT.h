@@ -54,6 +54,8 @@ public:
   virtual void Load(System &system);
   virtual TargetPhrases *Lookup(const Manager &mgr, MemPool &pool,
                                 InputPath &inputPath) const;
+  virtual void LookupBatch(const Manager &mgr,
+                           const std::vector<InputPath*> &paths) const;
 
   virtual void InitActiveChart(
     MemPool &pool,
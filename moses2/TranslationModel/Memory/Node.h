@@ -26,6 +26,7 @@ public:
 
   Node()
     :m_targetPhrases(NULL)
+    ,m_source(NULL)
     ,m_unsortedTPS(NULL)
   {}
 
@@ -86,6 +87,50 @@ public:
       system.featureFunctions.EvaluateAfterTablePruning(system.GetSystemPool(), *m_targetPhrases, *m_source);
 
       delete m_unsortedTPS;
+      m_unsortedTPS = NULL;
+    }
+  }
+
+  //! move all rules of other into this node. Target phrases of a source phrase in both are concatenated, this node's 1st
+  void Merge(Node &other) {
+    BOOST_FOREACH(typename Children::value_type &val, other.m_children) {
+      typename Children::iterator iter = m_children.find(val.first);
+      if (iter == m_children.end()) {
+        m_children[val.first].Swap(val.second);
+      } else {
+        iter->second.Merge(val.second);
+      }
+    }
+    other.m_children.clear();
+
+    if (other.m_unsortedTPS) {
+      if (m_unsortedTPS == NULL) {
+        m_unsortedTPS = other.m_unsortedTPS;
+        m_source = other.m_source;
+      } else {
+        m_unsortedTPS->insert(m_unsortedTPS->end(), other.m_unsortedTPS->begin(), other.m_unsortedTPS->end());
+        delete other.m_unsortedTPS;
+      }
+      other.m_unsortedTPS = NULL;
+    }
+  }
+
+  void Swap(Node &other) {
+    m_children.swap(other.m_children);
+    std::swap(m_targetPhrases, other.m_targetPhrases);
+    std::swap(m_source, other.m_source);
+    std::swap(m_unsortedTPS, other.m_unsortedTPS);
+  }
+
+  typedef std::pair<const Phrase<WORD>*, const std::vector<TP*>*> Rules;
+
+  //! source phrase and target phrases of every node, before SortAndPrune()
+  void GetRules(std::vector<Rules> &rules) const {
+    if (m_unsortedTPS) {
+      rules.push_back(Rules(m_source, m_unsortedTPS));
+    }
+    BOOST_FOREACH(const typename Children::value_type &val, m_children) {
+      val.second.GetRules(rules);
     }
   }
 
@@ -6,7 +6,12 @@
  */
 
 #include <cassert>
+#include <algorithm>
 #include <boost/foreach.hpp>
+#ifdef WITH_THREADS
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#endif
 #include "PhraseTableMemory.h"
 #include "../../PhraseBased/PhraseImpl.h"
 #include "../../Phrase.h"
@@ -15,6 +20,7 @@
 #include "../../InputPathsBase.h"
 #include "../../legacy/InputFileStream.h"
 #include "util/exception.hh"
+#include "util/murmur_hash.hh"
 
 #include "../../PhraseBased/InputPath.h"
 #include "../../PhraseBased/TargetPhraseImpl.h"
@@ -34,12 +40,34 @@ namespace Moses2
 {
 
 
+////////////////////////////////////////////////////////////////////////
+
+PhraseTableMemory::LoadShard::LoadShard(MemPool &targetPool, bool isPb, bool keepRawScores)
+  :targetPool(&targetPool)
+  ,rootPb(isPb ? new PBNODE() : NULL)
+  ,rootSCFG(isPb ? NULL : new SCFGNODE())
+  ,rawScores(keepRawScores ? new PtMem::Snapshot::RawScores() : NULL)
+#ifdef WITH_THREADS
+  ,queue(4)
+#endif
+{
+}
+
+PhraseTableMemory::LoadShard::~LoadShard()
+{
+  delete rootPb;
+  delete rootSCFG;
+  delete rawScores;
+}
+
 ////////////////////////////////////////////////////////////////////////
 
 PhraseTableMemory::PhraseTableMemory(size_t startInd, const std::string &line)
   :PhraseTable(startInd, line)
   ,m_rootPb(NULL)
   ,m_rootSCFG(NULL)
+  ,m_loadThreads(0)
+  ,m_snapshot(NULL)
 {
   ReadParameters();
 }
@@ -48,92 +76,138 @@ PhraseTableMemory::~PhraseTableMemory()
 {
   delete m_rootPb;
   delete m_rootSCFG;
+  delete m_snapshot;
+  RemoveAllInColl(m_loadPools);
+}
+
+void PhraseTableMemory::SetParameter(const std::string& key, const std::string& value)
+{
+  if (key == "load-threads") {
+    // default is the number of decoding threads
+    m_loadThreads = Scan<size_t>(value);
+  } else if (key == "snapshot") {
+    m_snapshotPath = value;
+  } else {
+    PhraseTable::SetParameter(key, value);
+  }
 }
 
 void PhraseTableMemory::Load(System &system)
 {
-  FactorCollection &vocab = system.GetVocab();
-  MemPool &systemPool = system.GetSystemPool();
-  MemPool tmpSourcePool;
+  if (!m_snapshotPath.empty()) {
+    if (system.isPb) {
+      m_snapshot = new PtMem::Snapshot(*this, m_input, m_tableLimit);
+      if (m_snapshot->Load(system, m_snapshotPath, m_path)) {
+        return;
+      }
+    } else {
+      cerr << "Snapshots only work with phrase-based models, ignoring "
+           << m_snapshotPath << endl;
+    }
+  }
 
-  if (system.isPb) {
-    m_rootPb = new PBNODE();
-  } else {
-    m_rootSCFG = new SCFGNODE();
-    //cerr << "m_rootSCFG=" << m_rootSCFG << endl;
+  size_t numThreads = 1;
+#ifdef WITH_THREADS
+  numThreads = m_loadThreads;
+  if (numThreads == 0) {
+    numThreads = std::min<size_t>(system.options.server.numThreads,
+                                  boost::thread::hardware_concurrency());
+  }
+  numThreads = std::max<size_t>(numThreads, 1);
+#endif
+
+  // each thread adds rules to its own trie. Target phrases are in pools owned
+  // by the phrase table as the threads' system pools go when the threads do
+  std::vector<LoadShard*> shards(numThreads);
+  for (size_t i = 0; i < numThreads; ++i) {
+    m_loadPools.push_back(new MemPool());
+    shards[i] = new LoadShard(*m_loadPools.back(), system.isPb, m_snapshot != NULL);
   }
 
-  vector<string> toks;
   size_t lineNum = 0;
   InputFileStream strme(m_path);
   string line;
-  while (getline(strme, line)) {
-    if (++lineNum % 1000000 == 0) {
-      cerr << lineNum << " ";
-    }
-    toks.clear();
-    TokenizeMultiCharSeparator(toks, line, "|||");
-    UTIL_THROW_IF2(toks.size() < 3, "Wrong format");
-    //cerr << "line=" << line << endl;
-    //cerr << "system.isPb=" << system.isPb << endl;
-
-    if (system.isPb) {
-      PhraseImpl *source = PhraseImpl::CreateFromString(tmpSourcePool, vocab, system,
-                           toks[0]);
-      //cerr << "created soure" << endl;
-      TargetPhraseImpl *target = TargetPhraseImpl::CreateFromString(systemPool, *this, system,
-                                 toks[1]);
-      //cerr << "created target" << endl;
-      target->GetScores().CreateFromString(toks[2], *this, system, true);
-      //cerr << "created scores:" << *target << endl;
-
-      if (toks.size() >= 4) {
-        //cerr << "alignstr=" << toks[3] << endl;
-        target->SetAlignmentInfo(toks[3]);
+  if (numThreads == 1) {
+    vector<string> toks;
+    while (getline(strme, line)) {
+      if (++lineNum % 1000000 == 0) {
+        cerr << lineNum << " ";
       }
+      ParseLine(system, *shards[0], line, toks);
+    }
+  } else {
+#ifdef WITH_THREADS
+    // lines are given to threads by their 1st source word, so all rules of a
+    // source phrase are added by the same thread in the order of the file
+    const size_t batchSize = 10000;
+    std::vector<std::vector<string>*> batches(numThreads);
+    boost::thread_group threads;
+    for (size_t i = 0; i < numThreads; ++i) {
+      batches[i] = new vector<string>();
+      threads.create_thread(boost::bind(&PhraseTableMemory::ParseShard, this,
+                                        boost::ref(system), boost::ref(*shards[i])));
+    }
 
-      // properties
-      if (toks.size() == 7) {
-        //target->properties = (char*) system.systemPool.Allocate(toks[6].size() + 1);
-        //strcpy(target->properties, toks[6].c_str());
+    while (getline(strme, line)) {
+      if (++lineNum % 1000000 == 0) {
+        cerr << lineNum << " ";
       }
 
-      system.featureFunctions.EvaluateInIsolation(systemPool, system, *source,
-          *target);
-      //cerr << "EvaluateInIsolation:" << *target << endl;
-      m_rootPb->AddRule(m_input, *source, target);
+      size_t shardInd = GetShardInd(line, numThreads);
+      std::vector<string> &batch = *batches[shardInd];
+      batch.push_back(string());
+      batch.back().swap(line);
 
-      //cerr << "target=" << target->Debug(system) << endl;
-    } else {
-      SCFG::PhraseImpl *source = SCFG::PhraseImpl::CreateFromString(tmpSourcePool, vocab, system,
-                                 toks[0]);
-      //cerr << "created source:" << *source << endl;
-      SCFG::TargetPhraseImpl *target = SCFG::TargetPhraseImpl::CreateFromString(systemPool, *this,
-                                       system, toks[1]);
+      if (batch.size() == batchSize) {
+        shards[shardInd]->queue.Produce(batches[shardInd]);
+        batches[shardInd] = new vector<string>();
+      }
+    }
 
-      //cerr << "created target " << *target << " source=" << *source << endl;
+    for (size_t i = 0; i < numThreads; ++i) {
+      shards[i]->queue.Produce(batches[i]);
+      shards[i]->queue.Produce(NULL);
+    }
+    threads.join_all();
+#endif
+  }
 
-      target->GetScores().CreateFromString(toks[2], *this, system, true);
-      //cerr << "created scores:" << *target << endl;
+  BOOST_FOREACH(const LoadShard *shard, shards) {
+    UTIL_THROW_IF2(!shard->error.empty(), shard->error);
+  }
 
-      //vector<SCORE> scores = Tokenize<SCORE>(toks[2]);
-      //target->sortScore = (scores.size() >= 3) ? TransformScore(scores[2]) : 0;
+  // merge the tries. Source phrases in different shards are different
+  if (system.isPb) {
+    m_rootPb = shards[0]->rootPb;
+    shards[0]->rootPb = NULL;
+    for (size_t i = 1; i < numThreads; ++i) {
+      m_rootPb->Merge(*shards[i]->rootPb);
+    }
+  } else {
+    m_rootSCFG = shards[0]->rootSCFG;
+    shards[0]->rootSCFG = NULL;
+    for (size_t i = 1; i < numThreads; ++i) {
+      m_rootSCFG->Merge(*shards[i]->rootSCFG);
+    }
+    //cerr << "m_rootSCFG=" << m_rootSCFG << endl;
+  }
 
-      target->SetAlignmentInfo(toks[3]);
+  if (m_snapshot) {
+    PtMem::Snapshot::RawScores &rawScores = *shards[0]->rawScores;
+    for (size_t i = 1; i < numThreads; ++i) {
+      rawScores.insert(shards[i]->rawScores->begin(), shards[i]->rawScores->end());
+    }
 
-      // properties
-      if (toks.size() == 7) {
-        //target->properties = (char*) system.systemPool.Allocate(toks[6].size() + 1);
-        //strcpy(target->properties, toks[6].c_str());
-      }
+    std::vector<PtMem::Snapshot::Rules> rules;
+    m_rootPb->GetRules(rules);
+    m_snapshot->Write(system, rules, rawScores, m_snapshotPath, m_path);
 
-      system.featureFunctions.EvaluateInIsolation(systemPool, system, *source,
-          *target);
-      //cerr << "EvaluateInIsolation:" << *target << endl;
-      m_rootSCFG->AddRule(m_input, *source, target);
-    }
+    // use the tries for this run, they're already loaded
+    delete m_snapshot;
+    m_snapshot = NULL;
   }
 
+  MemPool &systemPool = system.GetSystemPool();
   if (system.isPb) {
     m_rootPb->SortAndPrune(m_tableLimit, systemPool, system);
     //cerr << "root=" << &m_rootPb << endl;
@@ -148,12 +222,147 @@ void PhraseTableMemory::Load(System &system)
   }
   cerr << endl;
   */
+
+  // source phrases aren't needed after pruning
+  RemoveAllInColl(shards);
+}
+
+void PhraseTableMemory::ParseShard(System &system, LoadShard &shard) const
+{
+#ifdef WITH_THREADS
+  vector<string> toks;
+  vector<string> *lines;
+  while ((lines = shard.queue.Consume()) != NULL) {
+    // keep taking lines after an error so the reader isn't blocked
+    if (shard.error.empty()) {
+      try {
+        BOOST_FOREACH(const string &line, *lines) {
+          ParseLine(system, shard, line, toks);
+        }
+      } catch (const std::exception &e) {
+        shard.error = e.what();
+      }
+    }
+    delete lines;
+  }
+#endif
+}
+
+size_t PhraseTableMemory::GetShardInd(const std::string &line, size_t numShards) const
+{
+  size_t start = line.find_first_not_of(' ');
+  size_t end = line.find(' ', start);
+  if (start == string::npos) {
+    return 0;
+  }
+  if (end == string::npos) {
+    end = line.size();
+  }
+
+  // hash the factors the trie is keyed on
+  uint64_t hash = 0;
+  string word = line.substr(start, end - start);
+  if (word.find('|') == string::npos) {
+    hash = util::MurmurHashNative(word.data(), word.size());
+  } else {
+    vector<string> factors = Tokenize(word, "|");
+    BOOST_FOREACH(FactorType factorType, m_input) {
+      if (factorType < factors.size()) {
+        const string &factor = factors[factorType];
+        hash = util::MurmurHashNative(factor.data(), factor.size(), hash);
+      }
+    }
+  }
+  return hash % numShards;
+}
+
+void PhraseTableMemory::ParseLine(System &system, LoadShard &shard,
+                                  const std::string &line, std::vector<std::string> &toks) const
+{
+  FactorCollection &vocab = system.GetVocab();
+  MemPool &targetPool = *shard.targetPool;
+
+  toks.clear();
+  TokenizeMultiCharSeparator(toks, line, "|||");
+  UTIL_THROW_IF2(toks.size() < 3, "Wrong format");
+  //cerr << "line=" << line << endl;
+  //cerr << "system.isPb=" << system.isPb << endl;
+
+  if (system.isPb) {
+    PhraseImpl *source = PhraseImpl::CreateFromString(shard.sourcePool, vocab, system,
+                         toks[0]);
+    //cerr << "created soure" << endl;
+    TargetPhraseImpl *target = TargetPhraseImpl::CreateFromString(targetPool, *this, system,
+                               toks[1]);
+    //cerr << "created target" << endl;
+    target->GetScores().CreateFromString(toks[2], *this, system, true);
+    //cerr << "created scores:" << *target << endl;
+
+    if (shard.rawScores) {
+      vector<SCORE> scores = Tokenize<SCORE>(toks[2]);
+      UTIL_THROW_IF2(scores.size() != GetNumScores(), "Wrong number of scores in " << line);
+      SCORE *rawScores = targetPool.Allocate<SCORE>(scores.size());
+      for (size_t i = 0; i < scores.size(); ++i) {
+        rawScores[i] = FloorScore(TransformScore(scores[i]));
+      }
+      (*shard.rawScores)[target] = rawScores;
+    }
+
+    if (toks.size() >= 4) {
+      //cerr << "alignstr=" << toks[3] << endl;
+      target->SetAlignmentInfo(toks[3]);
+    }
+
+    // properties
+    if (toks.size() == 7) {
+      //target->properties = (char*) system.systemPool.Allocate(toks[6].size() + 1);
+      //strcpy(target->properties, toks[6].c_str());
+    }
+
+    system.featureFunctions.EvaluateInIsolation(targetPool, system, *source,
+        *target);
+    //cerr << "EvaluateInIsolation:" << *target << endl;
+    shard.rootPb->AddRule(m_input, *source, target);
+
+    //cerr << "target=" << target->Debug(system) << endl;
+  } else {
+    SCFG::PhraseImpl *source = SCFG::PhraseImpl::CreateFromString(shard.sourcePool, vocab, system,
+                               toks[0]);
+    //cerr << "created source:" << *source << endl;
+    SCFG::TargetPhraseImpl *target = SCFG::TargetPhraseImpl::CreateFromString(targetPool, *this,
+                                     system, toks[1]);
+
+    //cerr << "created target " << *target << " source=" << *source << endl;
+
+    target->GetScores().CreateFromString(toks[2], *this, system, true);
+    //cerr << "created scores:" << *target << endl;
+
+    //vector<SCORE> scores = Tokenize<SCORE>(toks[2]);
+    //target->sortScore = (scores.size() >= 3) ? TransformScore(scores[2]) : 0;
+
+    target->SetAlignmentInfo(toks[3]);
+
+    // properties
+    if (toks.size() == 7) {
+      //target->properties = (char*) system.systemPool.Allocate(toks[6].size() + 1);
+      //strcpy(target->properties, toks[6].c_str());
+    }
+
+    system.featureFunctions.EvaluateInIsolation(targetPool, system, *source,
+        *target);
+    //cerr << "EvaluateInIsolation:" << *target << endl;
+    shard.rootSCFG->AddRule(m_input, *source, target);
+  }
 }
 
 TargetPhrases* PhraseTableMemory::Lookup(const Manager &mgr, MemPool &pool,
     InputPath &inputPath) const
 {
   const SubPhrase<Moses2::Word> &phrase = inputPath.subPhrase;
+  if (m_snapshot) {
+    return m_snapshot->Lookup(mgr, pool, phrase);
+  }
+
   TargetPhrases *tps = m_rootPb->Find(m_input, phrase);
   return tps;
 }
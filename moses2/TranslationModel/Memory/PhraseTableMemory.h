@@ -6,10 +6,16 @@
  */
 #pragma once
 
+#include <string>
+#include <vector>
+#ifdef WITH_THREADS
+#include "util/pcqueue.hh"
+#endif
 #include "../PhraseTable.h"
 #include "../../legacy/Util2.h"
 #include "../../SCFG/InputPath.h"
 #include "Node.h"
+#include "Snapshot.h"
 #include "../../PhraseBased/PhraseImpl.h"
 #include "../../PhraseBased/TargetPhraseImpl.h"
 #include "../../PhraseBased/TargetPhrases.h"
@@ -52,6 +58,7 @@ public:
   virtual ~PhraseTableMemory();
 
   virtual void Load(System &system);
+  virtual void SetParameter(const std::string& key, const std::string& value);
   virtual TargetPhrases *Lookup(const Manager &mgr, MemPool &pool,
                                 InputPath &inputPath) const;
 
@@ -67,9 +74,36 @@ public:
               SCFG::InputPath &path) const;
 
 protected:
+  //! rules of the lines given to 1 loading thread
+  struct LoadShard {
+    MemPool *targetPool; // owned by the phrase table
+    MemPool sourcePool;
+    PBNODE *rootPb;
+    SCFGNODE *rootSCFG;
+    PtMem::Snapshot::RawScores *rawScores; // only if a snapshot will be written
+    std::string error;
+#ifdef WITH_THREADS
+    util::PCQueue<std::vector<std::string>*> queue;
+#endif
+
+    LoadShard(MemPool &targetPool, bool isPb, bool keepRawScores);
+    ~LoadShard();
+  };
+
   PBNODE    *m_rootPb;
   SCFGNODE  *m_rootSCFG;
 
+  size_t m_loadThreads;
+  std::vector<MemPool*> m_loadPools; // target phrases created while loading
+
+  std::string m_snapshotPath;
+  PtMem::Snapshot *m_snapshot; // used instead of m_rootPb if loaded
+
+  void ParseLine(System &system, LoadShard &shard, const std::string &line,
+                 std::vector<std::string> &toks) const;
+  void ParseShard(System &system, LoadShard &shard) const;
+  size_t GetShardInd(const std::string &line, size_t numShards) const;
+
   void LookupGivenNode(
     MemPool &pool,
     const SCFG::Manager &mgr,
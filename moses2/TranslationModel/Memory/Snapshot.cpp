@@ -0,0 +1,381 @@
+/*
+ * Snapshot.cpp
+ *
+ */
+#include <sys/stat.h>
+#include <alloca.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
+#include "Snapshot.h"
+#include "../PhraseTable.h"
+#include "../../System.h"
+#include "../../Scores.h"
+#include "../../MemPool.h"
+#include "../../AlignmentInfoCollection.h"
+#include "../../legacy/FactorCollection.h"
+#include "../../legacy/Factor.h"
+#include "../../PhraseBased/Manager.h"
+#include "../../PhraseBased/TargetPhraseImpl.h"
+#include "../../PhraseBased/TargetPhrases.h"
+#include "util/file.hh"
+#include "util/murmur_hash.hh"
+#include "util/exception.hh"
+
+using namespace std;
+
+namespace Moses2
+{
+namespace PtMem
+{
+
+namespace
+{
+const char MAGIC[8] = { 'M', 'O', 'S', 'E', 'S', '2', 'P', 'T' };
+const uint32_t VERSION = 1;
+
+void WriteUInt32(ostream &out, uint32_t val)
+{
+  out.write((const char*) &val, sizeof(val));
+}
+
+// pad to 8 bytes so the next section is aligned
+void Align(ostream &out)
+{
+  static const char zeros[8] = { 0 };
+  size_t pos = out.tellp();
+  if (pos % 8) {
+    out.write(zeros, 8 - pos % 8);
+  }
+}
+
+}
+
+const uint32_t Snapshot::NULL_ID;
+
+Snapshot::Snapshot(const PhraseTable &pt, const std::vector<FactorType> &input,
+                   size_t tableLimit)
+  :m_pt(pt)
+  ,m_input(input)
+  ,m_tableLimit(tableLimit)
+  ,m_header(NULL)
+{
+}
+
+uint64_t Snapshot::Hash(const uint32_t *ids, size_t num)
+{
+  uint64_t ret = util::MurmurHashNative(ids, num * sizeof(uint32_t));
+  // 0 is the empty bucket
+  return ret ? ret : 1;
+}
+
+bool Snapshot::Load(System &system, const std::string &path, const std::string &textPath)
+{
+  struct stat snapshotStat, textStat;
+  if (stat(path.c_str(), &snapshotStat) || stat(textPath.c_str(), &textStat)) {
+    return false;
+  }
+  if (snapshotStat.st_mtime < textStat.st_mtime) {
+    cerr << "Snapshot " << path << " is older than " << textPath << endl;
+    return false;
+  }
+
+  util::scoped_fd file(util::OpenReadOrThrow(path.c_str()));
+  uint64_t size = util::SizeOrThrow(file.get());
+  if (size < sizeof(Header)) {
+    return false;
+  }
+  util::MapRead(util::LAZY, file.get(), 0, size, m_mem);
+  const char *base = (const char*) m_mem.get();
+  m_header = (const Header*) base;
+
+  if (memcmp(m_header->magic, MAGIC, sizeof(MAGIC))
+      || m_header->version != VERSION
+      || m_header->numScores != m_pt.GetNumScores()
+      || m_header->numSourceFactors != m_input.size()
+      || m_header->textSize != (uint64_t) textStat.st_size) {
+    cerr << "Snapshot " << path << " wasn't created from this phrase table" << endl;
+    m_mem.reset();
+    m_header = NULL;
+    return false;
+  }
+
+  // vocab
+  FactorCollection &vocab = system.GetVocab();
+  const char *offset = base + m_header->vocabOffset;
+  m_factors.resize(m_header->vocabSize);
+  size_t maxId = 0;
+  for (size_t i = 0; i < m_factors.size(); ++i) {
+    uint32_t len = *(const uint32_t*) offset;
+    offset += sizeof(uint32_t);
+
+    const Factor *factor = vocab.AddFactor(StringPiece(offset, len), system, false);
+    m_factors[i] = factor;
+    maxId = std::max(maxId, factor->GetId());
+    offset += len;
+  }
+
+  m_ids.assign(maxId + 1, NULL_ID);
+  for (size_t i = 0; i < m_factors.size(); ++i) {
+    m_ids[m_factors[i]->GetId()] = i;
+  }
+
+  // alignments
+  offset = base + m_header->alignOffset;
+  m_aligns.resize(m_header->numAligns);
+  for (size_t i = 0; i < m_aligns.size(); ++i) {
+    const uint32_t *points = (const uint32_t*) offset;
+    uint32_t numPoints = points[0];
+    ++points;
+
+    AlignmentInfo::CollType coll;
+    for (size_t j = 0; j < numPoints; ++j) {
+      coll.insert(std::pair<size_t, size_t>(points[2 * j], points[2 * j + 1]));
+    }
+    m_aligns[i] = AlignmentInfoCollection::Instance().Add(coll);
+
+    offset += sizeof(uint32_t) * (1 + 2 * numPoints);
+  }
+
+  m_table = Table((void*) (base + m_header->tableOffset),
+                  Table::Size(m_header->numEntries, 1.5));
+
+  cerr << "Loaded snapshot " << path << " with " << m_header->numEntries
+       << " source phrases" << endl;
+  return true;
+}
+
+void Snapshot::Write(const System &system, const std::vector<Rules> &rules,
+                     const RawScores &rawScores, const std::string &path, const std::string &textPath) const
+{
+  // target words have as many factors as the most factored word
+  uint32_t numTargetFactors = 1;
+  BOOST_FOREACH(const Rules &sourceRules, rules) {
+    BOOST_FOREACH(const TargetPhraseImpl *tp, *sourceRules.second) {
+      for (size_t pos = 0; pos < tp->GetSize(); ++pos) {
+        const Word &word = (*tp)[pos];
+        for (uint32_t i = numTargetFactors; i < MAX_NUM_FACTORS; ++i) {
+          if (word[i]) {
+            numTargetFactors = i + 1;
+          }
+        }
+      }
+    }
+  }
+
+  boost::unordered_map<const Factor*, uint32_t> vocab;
+  std::vector<const Factor*> factors;
+  boost::unordered_map<const AlignmentInfo*, uint32_t> aligns;
+  std::vector<const AlignmentInfo*> alignList;
+
+  std::vector<char> tableMem(Table::Size(rules.size(), 1.5), 0);
+  Table table(&tableMem[0], tableMem.size());
+
+  string tmpPath = path + ".tmp";
+  ofstream out(tmpPath.c_str(), ios::out | ios::binary | ios::trunc);
+  UTIL_THROW_IF2(!out.is_open(), "Couldn't open " << tmpPath);
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+  out.write((const char*) &header, sizeof(header));
+
+  size_t numScores = m_pt.GetNumScores();
+  std::vector<uint32_t> sourceIds;
+  BOOST_FOREACH(const Rules &sourceRules, rules) {
+    const Phrase<Word> &source = *sourceRules.first;
+
+    // source phrase
+    sourceIds.clear();
+    for (size_t pos = 0; pos < source.GetSize(); ++pos) {
+      BOOST_FOREACH(FactorType factorType, m_input) {
+        const Factor *factor = source[pos][factorType];
+        uint32_t id = vocab.insert(std::make_pair(factor, factors.size())).first->second;
+        if (id == factors.size()) {
+          factors.push_back(factor);
+        }
+        sourceIds.push_back(id);
+      }
+    }
+
+    Entry entry;
+    entry.key = Hash(&sourceIds[0], sourceIds.size());
+    entry.offset = out.tellp();
+
+    Table::MutableIterator existing;
+    if (table.FindOrInsert(entry, existing)) {
+      // 2 source phrases with the same 64 bit hash. Very unlikely, use the text table
+      cerr << "Source phrase hash collision, not writing snapshot " << path << endl;
+      out.close();
+      remove(tmpPath.c_str());
+      return;
+    }
+
+    WriteUInt32(out, source.GetSize());
+    out.write((const char*) &sourceIds[0], sizeof(uint32_t) * sourceIds.size());
+
+    // target phrases
+    const std::vector<TargetPhraseImpl*> &tps = *sourceRules.second;
+    WriteUInt32(out, tps.size());
+    BOOST_FOREACH(const TargetPhraseImpl *tp, tps) {
+      const AlignmentInfo *align = &tp->GetAlignTerm();
+      uint32_t alignInd = aligns.insert(std::make_pair(align, alignList.size())).first->second;
+      if (alignInd == alignList.size()) {
+        alignList.push_back(align);
+      }
+
+      WriteUInt32(out, tp->GetSize());
+      WriteUInt32(out, alignInd);
+
+      RawScores::const_iterator scores = rawScores.find(tp);
+      UTIL_THROW_IF2(scores == rawScores.end(), "No scores for target phrase");
+      out.write((const char*) scores->second, sizeof(SCORE) * numScores);
+
+      for (size_t pos = 0; pos < tp->GetSize(); ++pos) {
+        const Word &word = (*tp)[pos];
+        for (size_t i = 0; i < numTargetFactors; ++i) {
+          const Factor *factor = word[i];
+          uint32_t id = NULL_ID;
+          if (factor) {
+            id = vocab.insert(std::make_pair(factor, factors.size())).first->second;
+            if (id == factors.size()) {
+              factors.push_back(factor);
+            }
+          }
+          WriteUInt32(out, id);
+        }
+      }
+    }
+  }
+
+  // vocab
+  Align(out);
+  header.vocabSize = factors.size();
+  header.vocabOffset = out.tellp();
+  BOOST_FOREACH(const Factor *factor, factors) {
+    StringPiece str = factor->GetString();
+    WriteUInt32(out, str.size());
+    out.write(str.data(), str.size());
+  }
+
+  // alignments
+  Align(out);
+  header.numAligns = alignList.size();
+  header.alignOffset = out.tellp();
+  BOOST_FOREACH(const AlignmentInfo *align, alignList) {
+    WriteUInt32(out, align->GetSize());
+    BOOST_FOREACH(const AlignmentInfo::CollType::value_type &point, *align) {
+      WriteUInt32(out, point.first);
+      WriteUInt32(out, point.second);
+    }
+  }
+
+  // hash table
+  Align(out);
+  header.numEntries = rules.size();
+  header.tableOffset = out.tellp();
+  out.write(&tableMem[0], tableMem.size());
+
+  struct stat textStat;
+  UTIL_THROW_IF2(stat(textPath.c_str(), &textStat), "Couldn't stat " << textPath);
+
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.numScores = numScores;
+  header.numSourceFactors = m_input.size();
+  header.numTargetFactors = numTargetFactors;
+  header.textSize = textStat.st_size;
+
+  out.seekp(0);
+  out.write((const char*) &header, sizeof(header));
+  out.close();
+  UTIL_THROW_IF2(!out, "Couldn't write " << tmpPath);
+
+  UTIL_THROW_IF2(rename(tmpPath.c_str(), path.c_str()),
+                 "Couldn't rename " << tmpPath << " to " << path);
+  cerr << "Wrote snapshot " << path << endl;
+}
+
+TargetPhrases *Snapshot::Lookup(const Manager &mgr, MemPool &pool,
+                                const Phrase<Word> &source) const
+{
+  // source phrase ids. Any word not in the snapshot means there are no rules
+  size_t numIds = source.GetSize() * m_input.size();
+  uint32_t *ids = (uint32_t*) alloca(numIds * sizeof(uint32_t));
+  for (size_t pos = 0; pos < source.GetSize(); ++pos) {
+    for (size_t i = 0; i < m_input.size(); ++i) {
+      const Factor *factor = source[pos][m_input[i]];
+      if (factor == NULL || factor->GetId() >= m_ids.size()) {
+        return NULL;
+      }
+      uint32_t id = m_ids[factor->GetId()];
+      if (id == NULL_ID) {
+        return NULL;
+      }
+      ids[pos * m_input.size() + i] = id;
+    }
+  }
+
+  Table::ConstIterator iter;
+  if (!m_table.Find(Hash(ids, numIds), iter)) {
+    return NULL;
+  }
+
+  const char *offset = (const char*) m_header + iter->offset;
+  uint32_t sourceSize = *(const uint32_t*) offset;
+  offset += sizeof(uint32_t);
+  if (sourceSize != source.GetSize()
+      || memcmp(offset, ids, numIds * sizeof(uint32_t))) {
+    return NULL;
+  }
+  offset += numIds * sizeof(uint32_t);
+
+  uint32_t numTP = *(const uint32_t*) offset;
+  offset += sizeof(uint32_t);
+
+  const System &system = mgr.system;
+  TargetPhrases *tps = new (pool.Allocate<TargetPhrases>()) TargetPhrases(pool, numTP);
+  for (size_t i = 0; i < numTP; ++i) {
+    TargetPhraseImpl *tp = CreateTargetPhrase(pool, system, offset);
+    system.featureFunctions.EvaluateInIsolation(pool, system, source, *tp);
+    tps->AddTargetPhrase(*tp);
+  }
+
+  tps->SortAndPrune(m_tableLimit);
+  system.featureFunctions.EvaluateAfterTablePruning(pool, *tps, source);
+
+  return tps;
+}
+
+TargetPhraseImpl *Snapshot::CreateTargetPhrase(MemPool &pool, const System &system,
+    const char *&offset) const
+{
+  const uint32_t *info = (const uint32_t*) offset;
+  uint32_t numWords = info[0];
+  uint32_t alignInd = info[1];
+  offset += 2 * sizeof(uint32_t);
+
+  TargetPhraseImpl *tp = new (pool.Allocate<TargetPhraseImpl>())
+  TargetPhraseImpl(pool, m_pt, system, numWords);
+
+  tp->GetScores().PlusEquals(system, m_pt, (SCORE*) offset);
+  offset += sizeof(SCORE) * m_header->numScores;
+
+  const uint32_t *ids = (const uint32_t*) offset;
+  for (size_t pos = 0; pos < numWords; ++pos) {
+    Word &word = (*tp)[pos];
+    for (size_t i = 0; i < m_header->numTargetFactors; ++i) {
+      uint32_t id = *ids++;
+      word[i] = (id == NULL_ID) ? NULL : m_factors[id];
+    }
+  }
+  offset = (const char*) ids;
+
+  tp->SetAlignTerm(*m_aligns[alignInd]);
+
+  return tp;
+}
+
+}
+}
@@ -0,0 +1,110 @@
+/*
+ * Snapshot.h
+ *
+ * Binary image of a phrase-based PhraseTableMemory. It's written after the
+ * text table has been parsed and is mmapped and used in place on later runs,
+ * so nothing is parsed or loaded into tries.
+ *
+ * Target phrases are stored in the order they were in the text table, with
+ * only the phrase table's scores. They're scored and pruned when looked up,
+ * like ProbingPT, so a snapshot stays valid when the weights change.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+#include "util/mmap.hh"
+#include "util/probing_hash_table.hh"
+#include "../../TypeDef.h"
+#include "../../Phrase.h"
+
+namespace Moses2
+{
+class System;
+class Manager;
+class MemPool;
+class PhraseTable;
+class Factor;
+class AlignmentInfo;
+class TargetPhraseImpl;
+class TargetPhrases;
+class Word;
+
+namespace PtMem
+{
+
+class Snapshot
+{
+public:
+  //! source phrase & its target phrases, as given by Node::GetRules()
+  typedef std::pair<const Phrase<Word>*, const std::vector<TargetPhraseImpl*>*> Rules;
+
+  //! the phrase table's scores of each target phrase, as they were in the text table.
+  // Target phrases only keep the weighted total unless n-best lists are output
+  typedef boost::unordered_map<const TargetPhraseImpl*, const SCORE*> RawScores;
+
+  Snapshot(const PhraseTable &pt, const std::vector<FactorType> &input,
+           size_t tableLimit);
+
+  //! false if there's no snapshot at path, or it's older than textPath or for a different table
+  bool Load(System &system, const std::string &path, const std::string &textPath);
+
+  //! write the rules, parsed from textPath, to path
+  void Write(const System &system, const std::vector<Rules> &rules,
+             const RawScores &rawScores, const std::string &path, const std::string &textPath) const;
+
+  TargetPhrases *Lookup(const Manager &mgr, MemPool &pool,
+                        const Phrase<Word> &source) const;
+
+protected:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t numScores, numSourceFactors, numTargetFactors;
+    uint64_t textSize; // size of the text table it was created from
+    uint64_t vocabSize, vocabOffset;
+    uint64_t numAligns, alignOffset;
+    uint64_t numEntries, tableOffset;
+  };
+
+  struct Entry {
+    typedef uint64_t Key;
+    Key key;
+    uint64_t offset;
+
+    Key GetKey() const {
+      return key;
+    }
+
+    void SetKey(Key to) {
+      key = to;
+    }
+  };
+  typedef util::ProbingHashTable<Entry, boost::hash<uint64_t> > Table;
+
+  static const uint32_t NULL_ID = 0xffffffff;
+
+  const PhraseTable &m_pt;
+  const std::vector<FactorType> &m_input;
+  size_t m_tableLimit;
+
+  util::scoped_memory m_mem;
+  const Header *m_header;
+  Table m_table;
+
+  std::vector<const Factor*> m_factors; // snapshot id -> factor
+  std::vector<uint32_t> m_ids; // factor id -> snapshot id
+  std::vector<const AlignmentInfo*> m_aligns;
+
+  static uint64_t Hash(const uint32_t *ids, size_t num);
+
+  TargetPhraseImpl *CreateTargetPhrase(MemPool &pool, const System &system,
+                                       const char *&offset) const;
+};
+
+}
+}
+
@@ -74,18 +74,28 @@ bool PhraseTable::SatisfyBackoff(const Manager &mgr, const InputPath &path) cons
 
 void PhraseTable::Lookup(const Manager &mgr, InputPathsBase &inputPaths) const
 {
+  std::vector<InputPath*> paths;
   BOOST_FOREACH(InputPathBase *pathBase, inputPaths) {
     InputPath *path = static_cast<InputPath*>(pathBase);
     //cerr << "path=" << path->range << " ";
 
     if (SatisfyBackoff(mgr, *path)) {
-      TargetPhrases *tpsPtr = Lookup(mgr, mgr.GetPool(), *path);
-      //cerr << "tpsPtr=" << tpsPtr << endl;
-
-      path->AddTargetPhrases(*this, tpsPtr);
+      paths.push_back(path);
     }
   }
 
+  LookupBatch(mgr, paths);
+}
+
+void PhraseTable::LookupBatch(const Manager &mgr,
+                              const std::vector<InputPath*> &paths) const
+{
+  BOOST_FOREACH(InputPath *path, paths) {
+    TargetPhrases *tpsPtr = Lookup(mgr, mgr.GetPool(), *path);
+    //cerr << "tpsPtr=" << tpsPtr << endl;
+
+    path->AddTargetPhrases(*this, tpsPtr);
+  }
 }
 
 TargetPhrases *PhraseTable::Lookup(const Manager &mgr, MemPool &pool,
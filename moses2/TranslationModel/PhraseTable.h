@@ -44,6 +44,11 @@ public:
   virtual TargetPhrases *Lookup(const Manager &mgr, MemPool &pool,
                                 InputPath &inputPath) const;
 
+  //! look up all spans of a sentence at once & add their target phrases.
+  // Paths are in order of start position, then length. Default is 1 path at a time
+  virtual void LookupBatch(const Manager &mgr,
+                           const std::vector<InputPath*> &paths) const;
+
   void SetPtInd(size_t ind) {
     m_ptInd = ind;
   }
@@ -4,11 +4,14 @@
  *  Created on: 3 Nov 2015
  *      Author: hieu
  */
+#include <algorithm>
 #include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
 #include "ProbingPT.h"
 #include "probingpt/querying.h"
 #include "probingpt/probing_hash_utils.h"
 #include "util/exception.hh"
+#include "util/usage.hh"
 #include "../System.h"
 #include "../Scores.h"
 #include "../Phrase.h"
@@ -70,12 +73,29 @@ std::pair<bool, uint64_t> ProbingPT::ActiveChartEntryProbing::GetKey(const SCFG:
 ProbingPT::ProbingPT(size_t startInd, const std::string &line)
   :PhraseTable(startInd, line)
   ,load_method(util::POPULATE_OR_READ)
+  ,m_decodeLimit(0)
+  ,m_adaptiveCacheSize(0)
+  ,m_adaptiveCachePb(NULL)
+  ,m_adaptiveCacheSCFG(NULL)
 {
   ReadParameters();
 }
 
 ProbingPT::~ProbingPT()
 {
+  if (m_adaptiveCachePb) {
+    cerr << GetName() << " adaptive cache: ";
+    m_adaptiveCachePb->Debug(cerr);
+    cerr << endl;
+  }
+  if (m_adaptiveCacheSCFG) {
+    cerr << GetName() << " adaptive cache: ";
+    m_adaptiveCacheSCFG->Debug(cerr);
+    cerr << endl;
+  }
+
+  delete m_adaptiveCachePb;
+  delete m_adaptiveCacheSCFG;
   delete m_engine;
 }
 
@@ -88,12 +108,9 @@ void ProbingPT::Load(System &system)
   FactorCollection &vocab = system.GetVocab();
 
   // source vocab
-  const std::map<uint64_t, std::string> &sourceVocab =
-    m_engine->getSourceVocab();
-  std::map<uint64_t, std::string>::const_iterator iterSource;
-  for (iterSource = sourceVocab.begin(); iterSource != sourceVocab.end();
-       ++iterSource) {
-    string wordStr = iterSource->second;
+  const probingpt::MappedColl &sourceVocab = m_engine->getSourceVocab();
+  for (size_t i = 0; i < sourceVocab.size(); ++i) {
+    string wordStr = sourceVocab.Get(i).as_string();
     bool isNT;
     //cerr << "wordStr=" << wordStr << endl;
     ReformatWord(system, wordStr, isNT);
@@ -101,7 +118,7 @@ void ProbingPT::Load(System &system)
 
     const Factor *factor = vocab.AddFactor(wordStr, system, isNT);
 
-    uint64_t probingId = iterSource->first;
+    uint64_t probingId = sourceVocab.GetId(i);
     size_t factorId = factor->GetId();
 
     if (factorId >= m_sourceVocab.size()) {
@@ -111,23 +128,19 @@ void ProbingPT::Load(System &system)
   }
 
   // target vocab
-  InputFileStream targetVocabStrme(m_path + "/TargetVocab.dat");
-  string line;
-  while (getline(targetVocabStrme, line)) {
-    vector<string> toks = Tokenize(line, "\t");
-    UTIL_THROW_IF2(toks.size() != 2, string("Incorrect format:") + line + "\n");
-
+  const probingpt::MappedColl &targetVocab = m_engine->getTargetVocab();
+  if (targetVocab.size()) {
+    m_targetVocab.resize(targetVocab.GetId(targetVocab.size() - 1) + 1);
+  }
+  for (size_t i = 0; i < targetVocab.size(); ++i) {
+    string wordStr = targetVocab.Get(i).as_string();
     bool isNT;
-    //cerr << "wordStr=" << toks[0] << endl;
-    ReformatWord(system, toks[0], isNT);
-    //cerr << "wordStr=" << toks[0] << endl;
-
-    const Factor *factor = vocab.AddFactor(toks[0], system, isNT);
-    uint32_t probingId = Scan<uint32_t>(toks[1]);
+    //cerr << "wordStr=" << wordStr << endl;
+    ReformatWord(system, wordStr, isNT);
+    //cerr << "wordStr=" << wordStr << endl;
 
-    if (probingId >= m_targetVocab.size()) {
-      m_targetVocab.resize(probingId + 1);
-    }
+    const Factor *factor = vocab.AddFactor(wordStr, system, isNT);
+    uint32_t probingId = targetVocab.GetId(i);
 
     std::pair<bool, const Factor*> ele(isNT, factor);
     m_targetVocab[probingId] = ele;
@@ -136,8 +149,19 @@ void ProbingPT::Load(System &system)
   // alignments
   CreateAlignmentMap(system, m_path + "/Alignments.dat");
 
+  // quantized scores. The centers are already floored log probs
+  m_codebooks.assign(m_engine->centers.begin(), m_engine->centers.end());
+
   // cache
   CreateCache(system);
+
+  if (m_adaptiveCacheSize) {
+    if (system.isPb) {
+      m_adaptiveCachePb = new AdaptiveCachePb(m_adaptiveCacheSize);
+    } else {
+      m_adaptiveCacheSCFG = new AdaptiveCacheSCFG(m_adaptiveCacheSize);
+    }
+  }
 }
 
 void ProbingPT::SetParameter(const std::string& key, const std::string& value)
@@ -156,43 +180,189 @@ void ProbingPT::SetParameter(const std::string& key, const std::string& value)
     } else {
       UTIL_THROW2("load method not supported" << value);
     }
+  } else if (key == "decode-limit") {
+    m_decodeLimit = Scan<size_t>(value);
+  } else if (key == "adaptive-cache-size") {
+    // eg. 512M. Default unit is KB
+    m_adaptiveCacheSize = util::ParseSize(value);
   } else {
     PhraseTable::SetParameter(key, value);
   }
 }
 
+size_t ProbingPT::GetNumToDecode(uint64_t numTP) const
+{
+  // target phrases are stored best first, no need to look at the rest
+  size_t limit = m_decodeLimit ? m_decodeLimit : m_tableLimit;
+  if (m_engine->sorted && limit && limit < numTP) {
+    return limit;
+  }
+  return numTP;
+}
+
 void ProbingPT::CreateAlignmentMap(System &system, const std::string path)
 {
-  const std::vector< std::vector<unsigned char> > &probingAlignColl = m_engine->getAlignments();
-  m_aligns.resize(probingAlignColl.size(), NULL);
+  const probingpt::MappedColl &probingAlignColl = m_engine->getAlignments();
+  if (probingAlignColl.size()) {
+    m_aligns.resize(probingAlignColl.GetId(probingAlignColl.size() - 1) + 1, NULL);
+  }
 
   for (size_t i = 0; i < probingAlignColl.size(); ++i) {
     AlignmentInfo::CollType aligns;
 
-    const std::vector<unsigned char> &probingAligns = probingAlignColl[i];
-    for (size_t j = 0; j < probingAligns.size(); j += 2) {
-      size_t startPos = probingAligns[j];
-      size_t endPos = probingAligns[j+1];
+    StringPiece probingAligns = probingAlignColl.Get(i);
+    for (size_t j = 0; j + 1 < probingAligns.size(); j += 2) {
+      size_t startPos = (unsigned char) probingAligns[j];
+      size_t endPos = (unsigned char) probingAligns[j+1];
       //cerr << "startPos=" << startPos << " " << endPos << endl;
       aligns.insert(std::pair<size_t,size_t>(startPos, endPos));
     }
 
     const AlignmentInfo *align = AlignmentInfoCollection::Instance().Add(aligns);
-    m_aligns[i] = align;
+    m_aligns[probingAlignColl.GetId(i)] = align;
     //cerr << "align=" << align->Debug(system) << endl;
   }
 }
 
-void ProbingPT::Lookup(const Manager &mgr, InputPathsBase &inputPaths) const
+namespace
 {
-  BOOST_FOREACH(InputPathBase *pathBase, inputPaths) {
-    InputPath *path = static_cast<InputPath*>(pathBase);
+struct ShorterPath {
+  const std::vector<InputPath*> &paths;
 
-    if (SatisfyBackoff(mgr, *path)) {
-      TargetPhrases *tpsPtr;
-      tpsPtr = Lookup(mgr, mgr.GetPool(), *path);
-      path->AddTargetPhrases(*this, tpsPtr);
+  ShorterPath(const std::vector<InputPath*> &vpaths)
+    :paths(vpaths)
+  {}
+
+  bool operator()(size_t a, size_t b) const {
+    return paths[a]->subPhrase.GetSize() < paths[b]->subPhrase.GetSize();
+  }
+};
+}
+
+void ProbingPT::LookupBatch(const Manager &mgr,
+                            const std::vector<InputPath*> &paths) const
+{
+  // Spans are looked up shortest first, all spans of a length together. If
+  // the pt contains the prefixes of its source phrases, a span whose prefix
+  // isn't in the pt isn't either, so it's skipped
+  std::vector<size_t> order(paths.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), ShorterPath(paths));
+
+  boost::unordered_map<const InputPathBase*, size_t> pathInds;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    pathInds[paths[i]] = i;
+  }
+
+  std::vector<bool> inTable(paths.size(), false);
+  std::vector<Query> queries;
+
+  size_t i = 0;
+  while (i < order.size()) {
+    size_t size = paths[order[i]]->subPhrase.GetSize();
+    queries.clear();
+
+    for (; i < order.size() && paths[order[i]]->subPhrase.GetSize() == size; ++i) {
+      size_t pathInd = order[i];
+      InputPath &path = *paths[pathInd];
+
+      if (m_engine->prefixes && path.prefixPath) {
+        boost::unordered_map<const InputPathBase*, size_t>::const_iterator iterPrefix;
+        iterPrefix = pathInds.find(path.prefixPath);
+        if (iterPrefix != pathInds.end() && !inTable[iterPrefix->second]) {
+          path.AddTargetPhrases(*this, NULL);
+          continue;
+        }
+      }
+
+      std::pair<bool, uint64_t> keyStruct = GetKey(path.subPhrase);
+      if (!keyStruct.first) {
+        path.AddTargetPhrases(*this, NULL);
+        continue;
+      }
+
+      // check in caches
+      CachePb::const_iterator iter = m_cachePb.find(keyStruct.second);
+      if (iter != m_cachePb.end()) {
+        inTable[pathInd] = true;
+        path.AddTargetPhrases(*this, iter->second);
+        continue;
+      }
+
+      if (m_adaptiveCachePb) {
+        AdaptiveCachePb::EntryPtr entry = m_adaptiveCachePb->Find(keyStruct.second);
+        if (entry) {
+          mgr.KeepAlive(entry);
+          inTable[pathInd] = true;
+          path.AddTargetPhrases(*this, entry->tps);
+          continue;
+        }
+      }
+
+      queries.push_back(Query(keyStruct.second, pathInd));
     }
+
+    LookupQueries(mgr, paths, queries, inTable);
+  }
+}
+
+void ProbingPT::LookupQueries(const Manager &mgr,
+                              const std::vector<InputPath*> &paths,
+                              std::vector<Query> &queries,
+                              std::vector<bool> &inTable) const
+{
+  // Spans with the same source phrase are next to each other, and only looked up once.
+  // The hash table is probed, then the target phrases are read, so the cache
+  // misses of different spans overlap
+  std::sort(queries.begin(), queries.end());
+
+  for (size_t i = 0; i < queries.size(); ++i) {
+    if (i == 0 || queries[i].key != queries[i - 1].key) {
+      m_engine->prefetch(queries[i].key);
+    }
+  }
+
+  std::vector<std::pair<bool, uint64_t> > results(queries.size());
+  for (size_t i = 0; i < queries.size(); ++i) {
+    if (i && queries[i].key == queries[i - 1].key) {
+      results[i] = results[i - 1];
+      continue;
+    }
+
+    results[i] = m_engine->query(queries[i].key);
+    if (results[i].first && results[i].second != NONE) {
+      m_engine->prefetchTargets(results[i].second);
+    }
+  }
+
+  TargetPhrases *tps = NULL;
+  for (size_t i = 0; i < queries.size(); ++i) {
+    InputPath &path = *paths[queries[i].pathInd];
+    inTable[queries[i].pathInd] = results[i].first;
+
+    if (i && queries[i].key == queries[i - 1].key) {
+      path.AddTargetPhrases(*this, tps);
+      continue;
+    }
+
+    if (m_adaptiveCachePb) {
+      // the target phrases live in the entry's pool so they can be cached
+      AdaptiveCachePb::EntryPtr entry(new AdaptiveCachePb::Entry());
+      entry->tps = CreateTargetPhrases(entry->pool, mgr.system, path.subPhrase,
+                                       results[i]);
+      if (entry->tps) {
+        m_adaptiveCachePb->Add(queries[i].key, entry);
+        mgr.KeepAlive(entry);
+      }
+      tps = entry->tps;
+    } else {
+      tps = CreateTargetPhrases(mgr.GetPool(), mgr.system, path.subPhrase,
+                                results[i]);
+    }
+
+    path.AddTargetPhrases(*this, tps);
   }
 }
 
@@ -226,6 +396,25 @@ TargetPhrases* ProbingPT::Lookup(const Manager &mgr, MemPool &pool,
     return tps;
   }
 
+  if (m_adaptiveCachePb) {
+    AdaptiveCachePb::EntryPtr entry = m_adaptiveCachePb->Find(keyStruct.second);
+    if (entry) {
+      mgr.KeepAlive(entry);
+      return entry->tps;
+    }
+
+    // query pt. The target phrases live in the entry's pool so they can be cached
+    entry.reset(new AdaptiveCachePb::Entry());
+    // Phrases not in the pt are quick to look up, not worth caching
+    entry->tps = CreateTargetPhrases(entry->pool, mgr.system, sourcePhrase,
+                                     keyStruct.second);
+    if (entry->tps) {
+      m_adaptiveCachePb->Add(keyStruct.second, entry);
+      mgr.KeepAlive(entry);
+    }
+    return entry->tps;
+  }
+
   // query pt
   TargetPhrases *tps = CreateTargetPhrases(pool, mgr.system, sourcePhrase,
                        keyStruct.second);
@@ -256,22 +445,33 @@ std::pair<bool, uint64_t> ProbingPT::GetKey(const Phrase<Moses2::Word> &sourcePh
 TargetPhrases *ProbingPT::CreateTargetPhrases(MemPool &pool,
     const System &system, const Phrase<Moses2::Word> &sourcePhrase, uint64_t key) const
 {
-  TargetPhrases *tps = NULL;
-
   //Actual lookup
   std::pair<bool, uint64_t> query_result; // 1st=found, 2nd=target file offset
   query_result = m_engine->query(key);
   //cerr << "key2=" << query_result.second << endl;
 
-  if (query_result.first) {
+  return CreateTargetPhrases(pool, system, sourcePhrase, query_result);
+}
+
+TargetPhrases *ProbingPT::CreateTargetPhrases(MemPool &pool,
+    const System &system, const Phrase<Moses2::Word> &sourcePhrase,
+    const std::pair<bool, uint64_t> &query_result) const
+{
+  TargetPhrases *tps = NULL;
+
+  // NONE = only a prefix of source phrases in the pt
+  if (query_result.first && query_result.second != NONE) {
     const char *offset = m_engine->memTPS + query_result.second;
     uint64_t *numTP = (uint64_t*) offset;
 
-    tps = new (pool.Allocate<TargetPhrases>()) TargetPhrases(pool, *numTP);
+    size_t numToDecode = GetNumToDecode(*numTP);
+
+    tps = new (pool.Allocate<TargetPhrases>()) TargetPhrases(pool, numToDecode);
 
     offset += sizeof(uint64_t);
-    for (size_t i = 0; i < *numTP; ++i) {
-      TargetPhraseImpl *tp = CreateTargetPhrase(pool, system, offset);
+    const uint8_t *codes = GetScoreCodes(offset);
+    for (size_t i = 0; i < numToDecode; ++i) {
+      TargetPhraseImpl *tp = CreateTargetPhrase(pool, system, offset, codes);
       assert(tp);
       const FeatureFunctions &ffs = system.featureFunctions;
       ffs.EvaluateInIsolation(pool, system, sourcePhrase, *tp);
@@ -288,10 +488,54 @@ TargetPhrases *ProbingPT::CreateTargetPhrases(MemPool &pool,
   return tps;
 }
 
+const uint8_t *ProbingPT::GetScoreCodes(const char *&offset) const
+{
+  if (m_engine->memScores == NULL) {
+    return NULL;
+  }
+
+  // quantized. Collection starts with the position of its scores in the scores column
+  uint64_t scoresPos = *(const uint64_t*) offset;
+  offset += sizeof(uint64_t);
+  return m_engine->memScores + scoresPos;
+}
+
+SCORE *ProbingPT::ReadScores(MemPool &pool, const char *&offset,
+                             const uint8_t *&codes) const
+{
+  size_t totalNumScores = m_engine->num_scores + m_engine->num_lex_scores;
+
+  SCORE *ret;
+  if (codes) {
+    // quantized, look up the log scores
+    ret = pool.Allocate<SCORE>(totalNumScores);
+    size_t numCenters = m_engine->numCenters;
+    for (size_t i = 0; i < totalNumScores; ++i) {
+      ret[i] = m_codebooks[i * numCenters + codes[i]];
+    }
+    codes += totalNumScores;
+  } else if (m_engine->logProb) {
+    // use in place
+    ret = (SCORE*) offset;
+    offset += sizeof(SCORE) * totalNumScores;
+  } else {
+    // log score 1st
+    const SCORE *scores = (const SCORE*) offset;
+    ret = pool.Allocate<SCORE>(totalNumScores);
+    for (size_t i = 0; i < totalNumScores; ++i) {
+      ret[i] = FloorScore(TransformScore(scores[i]));
+    }
+    offset += sizeof(SCORE) * totalNumScores;
+  }
+
+  return ret;
+}
+
 TargetPhraseImpl *ProbingPT::CreateTargetPhrase(
   MemPool &pool,
   const System &system,
-  const char *&offset) const
+  const char *&offset,
+  const uint8_t *&codes) const
 {
   probingpt::TargetPhraseInfo *tpInfo = (probingpt::TargetPhraseInfo*) offset;
   size_t numRealWords = tpInfo->numWords / m_output.size();
@@ -303,37 +547,16 @@ TargetPhraseImpl *ProbingPT::CreateTargetPhrase(
   offset += sizeof(probingpt::TargetPhraseInfo);
 
   // scores
-  SCORE *scores = (SCORE*) offset;
-
-  size_t totalNumScores = m_engine->num_scores + m_engine->num_lex_scores;
-
-  if (m_engine->logProb) {
-    // set pt score for rule
-    tp->GetScores().PlusEquals(system, *this, scores);
-
-    // save scores for other FF, eg. lex RO. Just give the offset
-    if (m_engine->num_lex_scores) {
-      tp->scoreProperties = scores + m_engine->num_scores;
-    }
-  } else {
-    // log score 1st
-    SCORE *logScores = (SCORE*) alloca(totalNumScores * sizeof(SCORE));
-    for (size_t i = 0; i < totalNumScores; ++i) {
-      logScores[i] = FloorScore(TransformScore(scores[i]));
-    }
+  SCORE *scores = ReadScores(pool, offset, codes);
 
-    // set pt score for rule
-    tp->GetScores().PlusEquals(system, *this, logScores);
+  // set pt score for rule
+  tp->GetScores().PlusEquals(system, *this, scores);
 
-    // save scores for other FF, eg. lex RO.
-    tp->scoreProperties = pool.Allocate<SCORE>(m_engine->num_lex_scores);
-    for (size_t i = 0; i < m_engine->num_lex_scores; ++i) {
-      tp->scoreProperties[i] = logScores[i + m_engine->num_scores];
-    }
+  // save scores for other FF, eg. lex RO
+  if (m_engine->num_lex_scores) {
+    tp->scoreProperties = scores + m_engine->num_scores;
   }
 
-  offset += sizeof(SCORE) * totalNumScores;
-
   // words
   for (size_t targetPos = 0; targetPos < numRealWords; ++targetPos) {
     for (size_t i = 0; i < m_output.size(); ++i) {
@@ -571,7 +794,29 @@ void ProbingPT::LookupGivenNode(
     outPath.AddTargetPhrasesToPath(pool, mgr.system, *this, *tps, chartEntry->GetSymbolBind());
   } else {
     // not in cache. Lookup
-    std::pair<bool, SCFG::TargetPhrases*> tpsPair = CreateTargetPhrasesSCFG(pool, mgr.system, sourcePhrase, key.second);
+    AdaptiveCacheSCFG::EntryPtr entry;
+    if (m_adaptiveCacheSCFG) {
+      entry = m_adaptiveCacheSCFG->Find(key.second);
+    }
+
+    std::pair<bool, SCFG::TargetPhrases*> tpsPair;
+    if (entry) {
+      tpsPair.first = true;
+      tpsPair.second = entry->tps;
+      mgr.KeepAlive(entry);
+    } else if (m_adaptiveCacheSCFG) {
+      // rules live in the entry's pool so they can be cached.
+      // Prefixes without rules aren't worth caching
+      entry.reset(new AdaptiveCacheSCFG::Entry());
+      tpsPair = CreateTargetPhrasesSCFG(entry->pool, mgr.system, sourcePhrase, key.second);
+      if (tpsPair.second) {
+        entry->tps = tpsPair.second;
+        m_adaptiveCacheSCFG->Add(key.second, entry);
+        mgr.KeepAlive(entry);
+      }
+    } else {
+      tpsPair = CreateTargetPhrasesSCFG(pool, mgr.system, sourcePhrase, key.second);
+    }
     assert(tpsPair.first && tpsPair.second);
 
     if (tpsPair.first) {
@@ -598,7 +843,8 @@ void ProbingPT::LookupGivenNode(
 SCFG::TargetPhraseImpl *ProbingPT::CreateTargetPhraseSCFG(
   MemPool &pool,
   const System &system,
-  const char *&offset) const
+  const char *&offset,
+  const uint8_t *&codes) const
 {
   probingpt::TargetPhraseInfo *tpInfo = (probingpt::TargetPhraseInfo*) offset;
   SCFG::TargetPhraseImpl *tp =
@@ -608,37 +854,16 @@ SCFG::TargetPhraseImpl *ProbingPT::CreateTargetPhraseSCFG(
   offset += sizeof(probingpt::TargetPhraseInfo);
 
   // scores
-  SCORE *scores = (SCORE*) offset;
-
-  size_t totalNumScores = m_engine->num_scores + m_engine->num_lex_scores;
+  SCORE *scores = ReadScores(pool, offset, codes);
 
-  if (m_engine->logProb) {
-    // set pt score for rule
-    tp->GetScores().PlusEquals(system, *this, scores);
+  // set pt score for rule
+  tp->GetScores().PlusEquals(system, *this, scores);
 
-    // save scores for other FF, eg. lex RO. Just give the offset
-    if (m_engine->num_lex_scores) {
-      tp->scoreProperties = scores + m_engine->num_scores;
-    }
-  } else {
-    // log score 1st
-    SCORE *logScores = (SCORE*) alloca(totalNumScores * sizeof(SCORE));
-    for (size_t i = 0; i < totalNumScores; ++i) {
-      logScores[i] = FloorScore(TransformScore(scores[i]));
-    }
-
-    // set pt score for rule
-    tp->GetScores().PlusEquals(system, *this, logScores);
-
-    // save scores for other FF, eg. lex RO.
-    tp->scoreProperties = pool.Allocate<SCORE>(m_engine->num_lex_scores);
-    for (size_t i = 0; i < m_engine->num_lex_scores; ++i) {
-      tp->scoreProperties[i] = logScores[i + m_engine->num_scores];
-    }
+  // save scores for other FF, eg. lex RO
+  if (m_engine->num_lex_scores) {
+    tp->scoreProperties = scores + m_engine->num_scores;
   }
 
-  offset += sizeof(SCORE) * totalNumScores;
-
   // words
   for (size_t i = 0; i < tpInfo->numWords - 1; ++i) {
     uint32_t *probingId = (uint32_t*) offset;
@@ -713,12 +938,15 @@ std::pair<bool, SCFG::TargetPhrases*> ProbingPT::CreateTargetPhrasesSCFG(MemPool
       uint64_t *numTP = (uint64_t*) offset;
       //cerr << "numTP=" << *numTP << endl;
 
-      SCFG::TargetPhrases *tps = new (pool.Allocate<SCFG::TargetPhrases>()) SCFG::TargetPhrases(pool, *numTP);
+      size_t numToDecode = GetNumToDecode(*numTP);
+
+      SCFG::TargetPhrases *tps = new (pool.Allocate<SCFG::TargetPhrases>()) SCFG::TargetPhrases(pool, numToDecode);
       ret.second = tps;
 
       offset += sizeof(uint64_t);
-      for (size_t i = 0; i < *numTP; ++i) {
-        SCFG::TargetPhraseImpl *tp = CreateTargetPhraseSCFG(pool, system, offset);
+      const uint8_t *codes = GetScoreCodes(offset);
+      for (size_t i = 0; i < numToDecode; ++i) {
+        SCFG::TargetPhraseImpl *tp = CreateTargetPhraseSCFG(pool, system, offset, codes);
         assert(tp);
         //cerr << "tp=" << tp->Debug(mgr.system) << endl;
 
@@ -13,6 +13,7 @@
 #include <deque>
 #include <unordered_map>
 #include "PhraseTable.h"
+#include "TargetPhrasesCache.h"
 #include "../Vector.h"
 #include "../Phrase.h"
 #include "../SCFG/ActiveChart.h"
@@ -77,7 +78,8 @@ public:
   void Load(System &system);
 
   virtual void SetParameter(const std::string& key, const std::string& value);
-  void Lookup(const Manager &mgr, InputPathsBase &inputPaths) const;
+  virtual void LookupBatch(const Manager &mgr,
+                           const std::vector<InputPath*> &paths) const;
 
   uint64_t GetUnk() const {
     return m_unkId;
@@ -101,18 +103,52 @@ protected:
   std::vector< std::pair<bool, const Factor*> > m_targetVocab; // pt id -> factor*
   std::vector<const AlignmentInfo*> m_aligns;
   util::LoadMethod load_method;
+  size_t m_decodeLimit; // if pt is sorted, only read this many target phrases. 0 = table limit
 
   uint64_t m_unkId;
   probingpt::QueryEngine *m_engine;
 
   void CreateAlignmentMap(System &system, const std::string path);
 
+  size_t GetNumToDecode(uint64_t numTP) const;
+
   TargetPhrases *Lookup(const Manager &mgr, MemPool &pool,
                         InputPath &inputPath) const;
   TargetPhrases *CreateTargetPhrases(MemPool &pool, const System &system,
                                      const Phrase<Moses2::Word> &sourcePhrase, uint64_t key) const;
+  //! queryResult = what the hash table has for the source phrase
+  TargetPhrases *CreateTargetPhrases(MemPool &pool, const System &system,
+                                     const Phrase<Moses2::Word> &sourcePhrase,
+                                     const std::pair<bool, uint64_t> &queryResult) const;
+
+  // batch lookup
+  struct Query {
+    uint64_t key;
+    size_t pathInd;
+
+    Query(uint64_t vkey, size_t vpathInd)
+      :key(vkey)
+      ,pathInd(vpathInd)
+    {}
+
+    bool operator<(const Query &other) const {
+      return key < other.key || (key == other.key && pathInd < other.pathInd);
+    }
+  };
+
+  //! spans whose target phrases aren't cached, looked up & added to their paths
+  void LookupQueries(const Manager &mgr, const std::vector<InputPath*> &paths,
+                     std::vector<Query> &queries, std::vector<bool> &inTable) const;
   TargetPhraseImpl *CreateTargetPhrase(MemPool &pool, const System &system,
-                                       const char *&offset) const;
+                                       const char *&offset, const uint8_t *&codes) const;
+
+  // quantized tables: score i of code c is m_codebooks[i * num centers + c], as a log prob
+  std::vector<SCORE> m_codebooks;
+
+  //! quantized scores of a target phrase collection. NULL if scores are stored as floats
+  const uint8_t *GetScoreCodes(const char *&offset) const;
+  //! log pt scores followed by the lex RO scores of the next target phrase
+  SCORE *ReadScores(MemPool &pool, const char *&offset, const uint8_t *&codes) const;
 
   inline const std::pair<bool, const Factor*> *GetTargetFactor(uint32_t probingId) const {
     if (probingId >= m_targetVocab.size()) {
@@ -137,6 +173,14 @@ protected:
 
   void CreateCache(System &system);
 
+  // cache of lookups while decoding, shared by all threads. NULL = off
+  size_t m_adaptiveCacheSize; // bytes
+  typedef TargetPhrasesCache<TargetPhrases> AdaptiveCachePb;
+  AdaptiveCachePb *m_adaptiveCachePb;
+
+  typedef TargetPhrasesCache<SCFG::TargetPhrases> AdaptiveCacheSCFG;
+  AdaptiveCacheSCFG *m_adaptiveCacheSCFG;
+
   void ReformatWord(System &system, std::string &wordStr, bool &isNT);
 
   // SCFG
@@ -156,7 +200,8 @@ protected:
   SCFG::TargetPhraseImpl *CreateTargetPhraseSCFG(
     MemPool &pool,
     const System &system,
-    const char *&offset) const;
+    const char *&offset,
+    const uint8_t *&codes) const;
 
 
 };
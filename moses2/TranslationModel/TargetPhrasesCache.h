@@ -0,0 +1,242 @@
+/*
+ * TargetPhrasesCache.h
+ *
+ * Translation option cache shared by all decoding threads, keyed by a
+ * phrase table's hash of the source phrase.
+ *
+ * Each entry owns the MemPool its target phrases were created in, so it
+ * doesn't depend on the pool of the sentence which created it. Entries are
+ * handed out as shared pointers. A manager holds on to the entries it used
+ * (ManagerBase::KeepAlive()) so an entry can be evicted while sentences are
+ * still using it.
+ *
+ * Memory is bounded by the total size of the entries' pools. Each shard is
+ * an LRU list but a new entry is only admitted if it would evict entries
+ * which were looked up less often than itself (TinyLFU). Lookup frequencies
+ * are estimated by a count-min sketch whose counters are halved
+ * periodically, so the cache adapts to what's being translated.
+ */
+#pragma once
+
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#ifdef WITH_THREADS
+#include <boost/thread/mutex.hpp>
+#endif
+#include "../MemPool.h"
+
+namespace Moses2
+{
+
+template<typename TPS>
+class TargetPhrasesCache
+{
+public:
+  struct Entry {
+    MemPool pool;
+    TPS *tps;
+
+    Entry()
+      :pool(4096)
+      ,tps(NULL)
+    {}
+  };
+  typedef boost::shared_ptr<Entry> EntryPtr;
+
+  TargetPhrasesCache(size_t maxMemory, size_t numShards = 16)
+    :m_shards(numShards) {
+    size_t shardMemory = maxMemory / numShards;
+    // roughly 1 counter per 1KB of entries
+    size_t sketchWidth = 1024;
+    while (sketchWidth * 1024 < shardMemory) {
+      sketchWidth *= 2;
+    }
+
+    for (size_t i = 0; i < numShards; ++i) {
+      m_shards[i] = new Shard(shardMemory, sketchWidth);
+    }
+  }
+
+  virtual ~TargetPhrasesCache() {
+    for (size_t i = 0; i < m_shards.size(); ++i) {
+      delete m_shards[i];
+    }
+  }
+
+  //! NULL if not in cache. Counts as a use of key either way
+  EntryPtr Find(uint64_t key) {
+    Shard &shard = GetShard(key);
+#ifdef WITH_THREADS
+    boost::mutex::scoped_lock lock(shard.mutex);
+#endif
+    shard.sketch.Increment(key);
+
+    typename Shard::Map::iterator iter = shard.map.find(key);
+    if (iter == shard.map.end()) {
+      ++shard.misses;
+      return EntryPtr();
+    }
+
+    ++shard.hits;
+    shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+    return iter->second->entry;
+  }
+
+  //! entry for key, created after Find() missed. The cache decides whether to keep it
+  void Add(uint64_t key, const EntryPtr &entry) {
+    size_t size = entry->pool.Size();
+
+    Shard &shard = GetShard(key);
+#ifdef WITH_THREADS
+    boost::mutex::scoped_lock lock(shard.mutex);
+#endif
+    if (shard.map.count(key)) {
+      // another thread got there 1st
+      return;
+    }
+
+    // only admit if it's used more often than everything it would push out
+    size_t freed = 0;
+    unsigned freq = shard.sketch.Estimate(key);
+    typename Shard::LRU::reverse_iterator victim = shard.lru.rbegin();
+    while (shard.memory + size - freed > shard.maxMemory) {
+      if (victim == shard.lru.rend() || shard.sketch.Estimate(victim->key) >= freq) {
+        ++shard.rejected;
+        return;
+      }
+      freed += victim->size;
+      ++victim;
+    }
+
+    while (freed) {
+      const Node &node = shard.lru.back();
+      freed -= node.size;
+      shard.memory -= node.size;
+      shard.map.erase(node.key);
+      shard.lru.pop_back();
+      ++shard.evicted;
+    }
+
+    shard.lru.push_front(Node(key, entry, size));
+    shard.map[key] = shard.lru.begin();
+    shard.memory += size;
+    ++shard.admitted;
+  }
+
+  void Debug(std::ostream &out) const {
+    uint64_t hits = 0, misses = 0, admitted = 0, rejected = 0, evicted = 0;
+    size_t memory = 0, size = 0;
+    for (size_t i = 0; i < m_shards.size(); ++i) {
+      const Shard &shard = *m_shards[i];
+      hits += shard.hits;
+      misses += shard.misses;
+      admitted += shard.admitted;
+      rejected += shard.rejected;
+      evicted += shard.evicted;
+      memory += shard.memory;
+      size += shard.map.size();
+    }
+
+    out << "hits=" << hits << " misses=" << misses
+        << " hit rate=" << (hits + misses ? (float) hits / (hits + misses) : 0)
+        << " admitted=" << admitted << " rejected=" << rejected
+        << " evicted=" << evicted << " entries=" << size
+        << " memory=" << memory;
+  }
+
+protected:
+  //! count-min sketch of 4-bit counters, halved every 10 * width increments
+  class FrequencySketch
+  {
+  public:
+    FrequencySketch(size_t width)
+      :m_counters(width * DEPTH, 0)
+      ,m_mask(width - 1)
+      ,m_numIncrements(0)
+      ,m_resetAt(width * 10)
+    {}
+
+    void Increment(uint64_t key) {
+      for (size_t row = 0; row < DEPTH; ++row) {
+        uint8_t &counter = m_counters[Index(key, row)];
+        if (counter < 15) {
+          ++counter;
+        }
+      }
+
+      if (++m_numIncrements >= m_resetAt) {
+        for (size_t i = 0; i < m_counters.size(); ++i) {
+          m_counters[i] >>= 1;
+        }
+        m_numIncrements /= 2;
+      }
+    }
+
+    unsigned Estimate(uint64_t key) const {
+      unsigned ret = 15;
+      for (size_t row = 0; row < DEPTH; ++row) {
+        ret = std::min<unsigned>(ret, m_counters[Index(key, row)]);
+      }
+      return ret;
+    }
+
+  protected:
+    static const size_t DEPTH = 4;
+
+    std::vector<uint8_t> m_counters;
+    size_t m_mask, m_numIncrements, m_resetAt;
+
+    size_t Index(uint64_t key, size_t row) const {
+      static const uint64_t seeds[DEPTH] = {
+        0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+        0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL
+      };
+      uint64_t hash = (key + row) * seeds[row];
+      return row * (m_mask + 1) + ((hash >> 32) & m_mask);
+    }
+  };
+
+  struct Node {
+    uint64_t key;
+    EntryPtr entry;
+    size_t size;
+
+    Node(uint64_t key, const EntryPtr &entry, size_t size)
+      :key(key), entry(entry), size(size)
+    {}
+  };
+
+  struct Shard {
+    typedef std::list<Node> LRU;
+    typedef std::unordered_map<uint64_t, typename LRU::iterator> Map;
+
+#ifdef WITH_THREADS
+    boost::mutex mutex;
+#endif
+    LRU lru;
+    Map map;
+    FrequencySketch sketch;
+    size_t memory, maxMemory;
+    uint64_t hits, misses, admitted, rejected, evicted;
+
+    Shard(size_t maxMemory, size_t sketchWidth)
+      :sketch(sketchWidth)
+      ,memory(0)
+      ,maxMemory(maxMemory)
+      ,hits(0), misses(0), admitted(0), rejected(0), evicted(0)
+    {}
+  };
+
+  std::vector<Shard*> m_shards;
+
+  Shard &GetShard(uint64_t key) {
+    return *m_shards[(key ^ (key >> 29)) % m_shards.size()];
+  }
+};
+
+}
+
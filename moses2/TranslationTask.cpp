@@ -12,7 +12,17 @@ namespace Moses2
 TranslationTask::TranslationTask(System &system,
                                  const std::string &line,
                                  long translationId)
+  :m_cost(0)
 {
+  bool inToken = false;
+  for (size_t i = 0; i < line.size(); ++i) {
+    bool isSpace = (line[i] == ' ' || line[i] == '\t');
+    if (!isSpace && !inToken) {
+      ++m_cost;
+    }
+    inToken = !isSpace;
+  }
+
   if (system.isPb) {
     m_mgr = new Manager(system, *this, line, translationId);
   } else {
@@ -40,22 +50,41 @@ std::string TranslationTask::ReturnTranslation(bool nbest) const
 
 void TranslationTask::Run()
 {
+  // every collector has to get this sentence, even if it fails. The batch
+  // loop waits for it before submitting more
+  string best, nbest, transOpt;
+  try {
+    m_mgr->Decode();
 
-  m_mgr->Decode();
+    best = m_mgr->OutputBest() + "\n";
 
-  string out;
+    if (m_mgr->system.options.nbest.nbest_size) {
+      nbest = m_mgr->OutputNBest();
+    }
+
+    if (!m_mgr->system.options.output.detailed_transrep_filepath.empty()) {
+      transOpt = m_mgr->OutputTransOpt();
+    }
+  } catch (const std::exception &e) {
+    cerr << "Error translating line " << m_mgr->GetTranslationId() << ": " << e.what() << endl;
+    best = "\n";
+    nbest.clear();
+    transOpt.clear();
+  } catch (...) {
+    cerr << "Error translating line " << m_mgr->GetTranslationId() << endl;
+    best = "\n";
+    nbest.clear();
+    transOpt.clear();
+  }
 
-  out = m_mgr->OutputBest() + "\n";
-  m_mgr->system.bestCollector->Write(m_mgr->GetTranslationId(), out);
+  m_mgr->system.bestCollector->Write(m_mgr->GetTranslationId(), best);
 
   if (m_mgr->system.options.nbest.nbest_size) {
-    out = m_mgr->OutputNBest();
-    m_mgr->system.nbestCollector->Write(m_mgr->GetTranslationId(), out);
+    m_mgr->system.nbestCollector->Write(m_mgr->GetTranslationId(), nbest);
   }
 
   if (!m_mgr->system.options.output.detailed_transrep_filepath.empty()) {
-    out = m_mgr->OutputTransOpt();
-    m_mgr->system.detailedTranslationCollector->Write(m_mgr->GetTranslationId(), out);
+    m_mgr->system.detailedTranslationCollector->Write(m_mgr->GetTranslationId(), transOpt);
   }
 
   delete m_mgr;
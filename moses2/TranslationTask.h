@@ -18,8 +18,14 @@ public:
   virtual void Run();
   virtual std::string ReturnTranslation(bool nbest) const;
 
+  //! number of input tokens. Long sentences are decoded first
+  virtual size_t GetCost() const {
+    return m_cost;
+  }
+
 protected:
   ManagerBase *m_mgr;
+  size_t m_cost;
 };
 
 }
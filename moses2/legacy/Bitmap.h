@@ -28,6 +28,7 @@
 #include <cstring>
 #include <cmath>
 #include <cstdlib>
+#include <stdint.h>
 #include "Range.h"
 #include "../Array.h"
 
@@ -39,20 +40,21 @@ typedef unsigned long WordsBitmapID;
 
 /** Vector of boolean to represent whether a word has been translated or not.
  *
- * Implemented using a vector of char, which is usually the same representation
- * for the elements that a C array of bool would use.  A vector of bool, or a
- * Boost dynamic_bitset, could be much more efficient in theory.  Unfortunately
- * algorithms like std::find() are not optimized for vector<bool> on gcc or
- * clang, and dynamic_bitset lacks all the optimized search operations we want.
- * Only benchmarking will tell what works best.  Perhaps dynamic_bitset could
- * still be a dramatic improvement, if we flip the meaning of the bits around
- * so we can use its find_first() and find_next() for the most common searches.
+ * Packed 64 words to a machine word, so that searching for the first gap,
+ * the last translated word, the edges of a gap or overlap with a range goes
+ * a machine word at a time, using the count-leading/trailing-zeros
+ * instructions, rather than a byte per source word. Bits past the end of the
+ * sentence are always 0 so whole machine words can be hashed and compared.
  */
 class Bitmap
 {
   friend std::ostream& operator<<(std::ostream& out, const Bitmap& bitmap);
 private:
-  Array<char> m_bitmap; //! Ticks of words in sentence that have been done.
+  typedef uint64_t Block;
+  static const size_t BLOCK_BITS = 64;
+
+  Array<Block> m_bitmap; //! Ticks of words in sentence that have been done.
+  size_t m_size; //! Number of words in sentence
   size_t m_firstGap; //! Cached position of first gap, or NOT_FOUND.
   size_t m_numWordsCovered;
 
@@ -60,18 +62,109 @@ private:
 
   Bitmap& operator=(const Bitmap& other);
 
+  static size_t NumBlocks(size_t size) {
+    return (size + BLOCK_BITS - 1) / BLOCK_BITS;
+  }
+
+  //! bits [startBit, endBit] of a block, inclusive
+  static Block Mask(size_t startBit, size_t endBit) {
+    Block upTo = (endBit + 1 == BLOCK_BITS) ? ~Block(0) : ((Block(1) << (endBit + 1)) - 1);
+    return upTo & (~Block(0) << startBit);
+  }
+
+  static size_t CountTrailingZeros(Block block) {
+#ifdef __GNUC__
+    return __builtin_ctzll(block);
+#else
+    size_t ret = 0;
+    while (!(block & 1)) {
+      block >>= 1;
+      ++ret;
+    }
+    return ret;
+#endif
+  }
+
+  static size_t HighestBit(Block block) {
+#ifdef __GNUC__
+    return BLOCK_BITS - 1 - __builtin_clzll(block);
+#else
+    size_t ret = 0;
+    while (block >>= 1) {
+      ++ret;
+    }
+    return ret;
+#endif
+  }
+
+  static size_t PopCount(Block block) {
+#ifdef __GNUC__
+    return __builtin_popcountll(block);
+#else
+    size_t ret = 0;
+    for (; block; block &= block - 1) {
+      ++ret;
+    }
+    return ret;
+#endif
+  }
+
+  //! first position >= pos with the given value, or NOT_FOUND
+  size_t FindNext(size_t pos, bool value) const {
+    if (pos >= m_size) {
+      return NOT_FOUND;
+    }
+    size_t blockInd = pos / BLOCK_BITS;
+    Block block = (value ? m_bitmap[blockInd] : ~m_bitmap[blockInd])
+                  & (~Block(0) << (pos % BLOCK_BITS));
+    while (true) {
+      if (block) {
+        size_t ret = blockInd * BLOCK_BITS + CountTrailingZeros(block);
+        return ret < m_size ? ret : NOT_FOUND;
+      }
+      if (++blockInd == m_bitmap.size()) {
+        return NOT_FOUND;
+      }
+      block = value ? m_bitmap[blockInd] : ~m_bitmap[blockInd];
+    }
+  }
+
+  //! last position <= pos with the given value, or NOT_FOUND
+  size_t FindPrev(size_t pos, bool value) const {
+    size_t blockInd = pos / BLOCK_BITS;
+    Block block = (value ? m_bitmap[blockInd] : ~m_bitmap[blockInd])
+                  & Mask(0, pos % BLOCK_BITS);
+    while (true) {
+      if (block) {
+        return blockInd * BLOCK_BITS + HighestBit(block);
+      }
+      if (blockInd-- == 0) {
+        return NOT_FOUND;
+      }
+      block = value ? m_bitmap[blockInd] : ~m_bitmap[blockInd];
+    }
+  }
+
+  //! set or clear positions [startPos, endPos], inclusive
+  void SetBits(size_t startPos, size_t endPos, bool value) {
+    size_t startBlock = startPos / BLOCK_BITS, endBlock = endPos / BLOCK_BITS;
+    for (size_t blockInd = startBlock; blockInd <= endBlock; ++blockInd) {
+      Block mask = Mask(blockInd == startBlock ? startPos % BLOCK_BITS : 0,
+                        blockInd == endBlock ? endPos % BLOCK_BITS : BLOCK_BITS - 1);
+      if (value) {
+        m_bitmap[blockInd] |= mask;
+      } else {
+        m_bitmap[blockInd] &= ~mask;
+      }
+    }
+  }
+
   /** Update the first gap, when bits are flipped */
   void UpdateFirstGap(size_t startPos, size_t endPos, bool value) {
     if (value) {
       //may remove gap
       if (startPos <= m_firstGap && m_firstGap <= endPos) {
-        m_firstGap = NOT_FOUND;
-        for (size_t i = endPos + 1; i < m_bitmap.size(); ++i) {
-          if (!m_bitmap[i]) {
-            m_firstGap = i;
-            break;
-          }
-        }
+        m_firstGap = FindNext(endPos + 1, false);
       }
 
     } else {
@@ -88,9 +181,7 @@ private:
     size_t startPos = range.GetStartPos();
     size_t endPos = range.GetEndPos();
 
-    for(size_t pos = startPos; pos <= endPos; pos++) {
-      m_bitmap[pos] = true;
-    }
+    SetBits(startPos, endPos, true);
 
     m_numWordsCovered += range.GetNumWordsCovered();
     UpdateFirstGap(startPos, endPos, true);
@@ -115,37 +206,25 @@ public:
 
   //! position of last word not yet translated, or NOT_FOUND if everything already translated
   size_t GetLastGapPos() const {
-    for (int pos = int(m_bitmap.size()) - 1; pos >= 0; pos--) {
-      if (!m_bitmap[pos]) {
-        return pos;
-      }
-    }
-    // no starting pos
-    return NOT_FOUND;
+    return m_size ? FindPrev(m_size - 1, false) : NOT_FOUND;
   }
 
   //! position of last translated word
   size_t GetLastPos() const {
-    for (int pos = int(m_bitmap.size()) - 1; pos >= 0; pos--) {
-      if (m_bitmap[pos]) {
-        return pos;
-      }
-    }
-    // no starting pos
-    return NOT_FOUND;
+    return m_size ? FindPrev(m_size - 1, true) : NOT_FOUND;
   }
 
   //! whether a word has been translated at a particular position
   bool GetValue(size_t pos) const {
-    return bool(m_bitmap[pos]);
+    return (m_bitmap[pos / BLOCK_BITS] >> (pos % BLOCK_BITS)) & 1;
   }
   //! set value at a particular position
   void SetValue( size_t pos, bool value ) {
-    bool origValue = m_bitmap[pos];
+    bool origValue = GetValue(pos);
     if (origValue == value) {
       // do nothing
     } else {
-      m_bitmap[pos] = value;
+      SetBits(pos, pos, value);
       UpdateFirstGap(pos, pos, value);
       if (value) {
         ++m_numWordsCovered;
@@ -161,39 +240,39 @@ public:
   }
   //! whether the wordrange overlaps with any translated word in this bitmap
   bool Overlap(const Range &compare) const {
-    for (size_t pos = compare.GetStartPos(); pos <= compare.GetEndPos(); pos++) {
-      if (m_bitmap[pos])
+    size_t startPos = compare.GetStartPos(), endPos = compare.GetEndPos();
+    size_t startBlock = startPos / BLOCK_BITS, endBlock = endPos / BLOCK_BITS;
+    for (size_t blockInd = startBlock; blockInd <= endBlock; ++blockInd) {
+      Block mask = Mask(blockInd == startBlock ? startPos % BLOCK_BITS : 0,
+                        blockInd == endBlock ? endPos % BLOCK_BITS : BLOCK_BITS - 1);
+      if (m_bitmap[blockInd] & mask)
         return true;
     }
     return false;
   }
   //! number of elements
   size_t GetSize() const {
-    return m_bitmap.size();
+    return m_size;
   }
 
   inline size_t GetEdgeToTheLeftOf(size_t l) const {
     if (l == 0) return l;
-    while (l && !m_bitmap[l-1]) {
-      --l;
-    }
-    return l;
+    size_t pos = FindPrev(l - 1, true);
+    return pos == NOT_FOUND ? 0 : pos + 1;
   }
 
   inline size_t GetEdgeToTheRightOf(size_t r) const {
-    if (r+1 == m_bitmap.size()) return r;
-    return (
-             std::find(m_bitmap.begin() + r + 1, m_bitmap.end(), true) -
-             m_bitmap.begin()
-           ) - 1;
+    if (r+1 == m_size) return r;
+    size_t pos = FindNext(r + 1, true);
+    return (pos == NOT_FOUND ? m_size : pos) - 1;
   }
 
   //! converts bitmap into an integer ID: it consists of two parts: the first 16 bit are the pattern between the first gap and the last word-1, the second 16 bit are the number of filled positions. enforces a sentence length limit of 65535 and a max distortion of 16
   WordsBitmapID GetID() const {
-    assert(m_bitmap.size() < (1<<16));
+    assert(m_size < (1<<16));
 
     size_t start = GetFirstGapPos();
-    if (start == NOT_FOUND) start = m_bitmap.size(); // nothing left
+    if (start == NOT_FOUND) start = m_size; // nothing left
 
     size_t end = GetLastPos();
     if (end == NOT_FOUND) end = 0;// nothing translated yet
@@ -208,10 +287,10 @@ public:
 
   //! converts bitmap into an integer ID, with an additional span covered
   WordsBitmapID GetIDPlus( size_t startPos, size_t endPos ) const {
-    assert(m_bitmap.size() < (1<<16));
+    assert(m_size < (1<<16));
 
     size_t start = GetFirstGapPos();
-    if (start == NOT_FOUND) start = m_bitmap.size(); // nothing left
+    if (start == NOT_FOUND) start = m_size; // nothing left
 
     size_t end = GetLastPos();
     if (end == NOT_FOUND) end = 0;// nothing translated yet
@@ -8,7 +8,7 @@ namespace Moses2
 {
 
 Bitmaps::Bitmaps(MemPool &pool) :
-  m_pool(pool)
+  m_collSize(0), m_transitionsSize(0), m_initBitmap(NULL), m_pool(pool), m_threadSafe(false)
 {
 }
 
@@ -19,9 +19,70 @@ Bitmaps::~Bitmaps()
 void Bitmaps::Init(size_t inputSize,
                    const std::vector<bool> &initSourceCompleted)
 {
+  m_coll.assign(64, NULL);
+  Transition empty = { NULL, 0, 0, NULL };
+  m_transitions.assign(256, empty);
+
   m_initBitmap = new (m_pool.Allocate<Bitmap>()) Bitmap(m_pool, inputSize);
   m_initBitmap->Init(initSourceCompleted);
-  m_coll[m_initBitmap];
+  AddToColl(m_initBitmap);
+}
+
+uint64_t Bitmaps::TransitionHash(const Bitmap *bm, size_t startPos, size_t endPos)
+{
+  uint64_t hash = ((uint64_t) (uintptr_t) bm) ^ ((uint64_t) startPos << 48)
+                  ^ ((uint64_t) endPos << 32);
+  hash *= 0x9E3779B97F4A7C15ULL;
+  return hash ^ (hash >> 29);
+}
+
+void Bitmaps::AddToColl(const Bitmap *bm)
+{
+  if ((m_collSize + 1) * 2 > m_coll.size()) {
+    GrowColl();
+  }
+  size_t mask = m_coll.size() - 1;
+  size_t ind = bm->hash() & mask;
+  while (m_coll[ind]) {
+    ind = (ind + 1) & mask;
+  }
+  m_coll[ind] = bm;
+  ++m_collSize;
+}
+
+void Bitmaps::GrowColl()
+{
+  std::vector<const Bitmap*> old(m_coll.size() * 2, NULL);
+  old.swap(m_coll);
+
+  size_t mask = m_coll.size() - 1;
+  BOOST_FOREACH(const Bitmap *bm, old) {
+    if (bm) {
+      size_t ind = bm->hash() & mask;
+      while (m_coll[ind]) {
+        ind = (ind + 1) & mask;
+      }
+      m_coll[ind] = bm;
+    }
+  }
+}
+
+void Bitmaps::GrowTransitions()
+{
+  Transition empty = { NULL, 0, 0, NULL };
+  std::vector<Transition> old(m_transitions.size() * 2, empty);
+  old.swap(m_transitions);
+
+  size_t mask = m_transitions.size() - 1;
+  BOOST_FOREACH(const Transition &transition, old) {
+    if (transition.from) {
+      size_t ind = TransitionHash(transition.from, transition.startPos, transition.endPos) & mask;
+      while (m_transitions[ind].from) {
+        ind = (ind + 1) & mask;
+      }
+      m_transitions[ind] = transition;
+    }
+  }
 }
 
 const Bitmap &Bitmaps::GetNextBitmap(const Bitmap &bm, const Range &range)
@@ -36,35 +97,64 @@ const Bitmap &Bitmaps::GetNextBitmap(const Bitmap &bm, const Range &range)
 
   newBM->Init(bm, range);
 
-  Coll::const_iterator iter = m_coll.find(newBM);
-  if (iter == m_coll.end()) {
-    m_coll[newBM] = NextBitmaps();
-    return *newBM;
-  } else {
-    m_recycler.push(newBM);
-
-    return *iter->first;
+  size_t mask = m_coll.size() - 1;
+  for (size_t ind = newBM->hash() & mask; m_coll[ind]; ind = (ind + 1) & mask) {
+    if (*m_coll[ind] == *newBM) {
+      m_recycler.push(newBM);
+      return *m_coll[ind];
+    }
   }
+
+  AddToColl(newBM);
+  return *newBM;
 }
 
 const Bitmap &Bitmaps::GetBitmap(const Bitmap &bm, const Range &range)
 {
-  Coll::iterator iter = m_coll.find(&bm);
-  assert(iter != m_coll.end());
-
-  const Bitmap *newBM;
-  NextBitmaps &next = iter->second;
-  NextBitmaps::const_iterator iterNext = next.find(&range);
-  if (iterNext == next.end()) {
-    // not seen the link yet.
-    newBM = &GetNextBitmap(bm, range);
-    next[&range] = newBM;
-  } else {
-    // link exist
-    //std::cerr << "link exists" << endl;
-    newBM = iterNext->second;
+#ifdef WITH_THREADS
+  if (m_threadSafe) {
+    boost::mutex::scoped_lock lock(m_mutex);
+    return GetBitmapNoLock(bm, range);
   }
-  return *newBM;
+#endif
+  return GetBitmapNoLock(bm, range);
+}
+
+const Bitmap &Bitmaps::GetBitmapNoLock(const Bitmap &bm, const Range &range)
+{
+  size_t startPos = range.GetStartPos();
+  size_t endPos = range.GetEndPos();
+  uint64_t hash = TransitionHash(&bm, startPos, endPos);
+
+  size_t mask = m_transitions.size() - 1;
+  for (size_t ind = hash & mask; m_transitions[ind].from; ind = (ind + 1) & mask) {
+    const Transition &transition = m_transitions[ind];
+    if (transition.from == &bm && transition.startPos == startPos
+        && transition.endPos == endPos) {
+      // link exist
+      return *transition.to;
+    }
+  }
+
+  // not seen the link yet.
+  const Bitmap &newBM = GetNextBitmap(bm, range);
+
+  if ((m_transitionsSize + 1) * 2 > m_transitions.size()) {
+    GrowTransitions();
+    mask = m_transitions.size() - 1;
+  }
+  size_t ind = hash & mask;
+  while (m_transitions[ind].from) {
+    ind = (ind + 1) & mask;
+  }
+  Transition &transition = m_transitions[ind];
+  transition.from = &bm;
+  transition.startPos = startPos;
+  transition.endPos = endPos;
+  transition.to = &newBM;
+  ++m_transitionsSize;
+
+  return newBM;
 }
 
 }
@@ -1,8 +1,11 @@
 #pragma once
 
-#include <unordered_map>
-#include <set>
+#include <vector>
 #include <stack>
+#include <stdint.h>
+#ifdef WITH_THREADS
+#include <boost/thread/mutex.hpp>
+#endif
 #include "Bitmap.h"
 #include "Util2.h"
 
@@ -10,19 +13,41 @@ namespace Moses2
 {
 class MemPool;
 
+/** All coverage bitmaps used while decoding 1 sentence, and the transitions
+ * between them.
+ * Both are flat, open-addressing tables with linear probing. The bitmaps are
+ * unique so a transition is keyed by the bitmap's address and the span
+ * covered, rather than the Range object.
+ */
 class Bitmaps
 {
-  typedef std::unordered_map<const Range*, const Bitmap*> NextBitmaps;
-  typedef std::unordered_map<const Bitmap*, NextBitmaps,
-		  UnorderedComparer<Bitmap>, UnorderedComparer<Bitmap> > Coll;
-  //typedef std::set<const Bitmap*, OrderedComparer<Bitmap> > Coll;
-  Coll m_coll;
+  struct Transition {
+    const Bitmap *from;
+    uint32_t startPos, endPos;
+    const Bitmap *to;
+  };
+  std::vector<const Bitmap*> m_coll;
+  size_t m_collSize;
+  std::vector<Transition> m_transitions;
+  size_t m_transitionsSize;
+
   Bitmap *m_initBitmap;
 
   MemPool &m_pool;
   std::stack<Bitmap*> m_recycler;
 
+  bool m_threadSafe;
+#ifdef WITH_THREADS
+  boost::mutex m_mutex;
+#endif
+
+  static uint64_t TransitionHash(const Bitmap *bm, size_t startPos, size_t endPos);
+
   const Bitmap &GetNextBitmap(const Bitmap &bm, const Range &range);
+  void AddToColl(const Bitmap *bm);
+  void GrowColl();
+  void GrowTransitions();
+  const Bitmap &GetBitmapNoLock(const Bitmap &bm, const Range &range);
 public:
   Bitmaps(MemPool &pool);
   virtual ~Bitmaps();
@@ -32,6 +57,11 @@ public:
     return *m_initBitmap;
   }
   const Bitmap &GetBitmap(const Bitmap &bm, const Range &range);
+
+  //! lock GetBitmap(), eg. while feature functions run on several threads
+  void SetThreadSafe(bool threadSafe) {
+    m_threadSafe = threadSafe;
+  }
 };
 
 }
@@ -29,7 +29,6 @@
 namespace Moses2
 {
 
-struct FactorFriend;
 class FactorCollection;
 
 /** Represents a factor (word, POS, etc).
@@ -41,7 +40,6 @@ class Factor
 
   // only these classes are allowed to instantiate this class
   friend class FactorCollection;
-  friend struct FactorFriend;
 
   // FactorCollection writes here.
   // This is mutable so the pointer can be changed to pool-backed memory.
@@ -52,12 +50,8 @@ class Factor
   Factor() {
   }
 
-  // Needed for STL containers.  They'll delegate through FactorFriend, which is never exposed publicly.
-  Factor(const Factor &factor) :
-    m_string(factor.m_string), m_id(factor.m_id) {
-  }
-
   // Not implemented.  Shouldn't be called.
+  Factor(const Factor &factor);
   Factor &operator=(const Factor &factor);
 
 public:
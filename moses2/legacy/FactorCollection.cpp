@@ -23,6 +23,7 @@
 #ifdef WITH_THREADS
 #include <boost/thread/locks.hpp>
 #endif
+#include <cstring>
 #include <ostream>
 #include <string>
 #include "FactorCollection.h"
@@ -35,58 +36,148 @@ using namespace std;
 namespace Moses2
 {
 
-const Factor *FactorCollection::AddFactor(const StringPiece &factorString,
-    const System &system, bool isNonTerminal)
+////////////////////////////////////////////////////////////////////////////
+FactorCollection::Shard::Shard()
+  :m_size(0)
 {
-  FactorFriend to_ins;
-  to_ins.in.m_string = factorString;
-  to_ins.in.m_id = (isNonTerminal) ? m_factorIdNonTerminal : m_factorId;
-  Set & set = (isNonTerminal) ? m_set : m_setNonTerminal;
-  // If we're threaded, hope a read-only lock is sufficient.
-#ifdef WITH_THREADS
-  {
-    // read=lock scope
-    boost::shared_lock<boost::shared_mutex> read_lock(m_accessLock);
-    Set::const_iterator i = set.find(to_ins);
-    if (i != set.end()) return &i->in;
+  m_table.store(CreateTable(16), std::memory_order_relaxed);
+}
+
+FactorCollection::Shard::~Shard()
+{
+  DeleteTable(m_table.load());
+  for (size_t i = 0; i < m_oldTables.size(); ++i) {
+    DeleteTable(m_oldTables[i]);
+  }
+}
+
+FactorCollection::Table *FactorCollection::Shard::CreateTable(size_t numSlots)
+{
+  Table *table = new Table();
+  table->mask = numSlots - 1;
+  table->slots = new std::atomic<const Factor*>[numSlots];
+  for (size_t i = 0; i < numSlots; ++i) {
+    table->slots[i].store(NULL, std::memory_order_relaxed);
   }
-  boost::unique_lock<boost::shared_mutex> lock(m_accessLock);
-#endif // WITH_THREADS
-  std::pair<Set::iterator, bool> ret(set.insert(to_ins));
-  if (ret.second) {
-    ret.first->in.m_string.set(
-      memcpy(m_string_backing.Allocate(factorString.size()),
-             factorString.data(), factorString.size()), factorString.size());
-    if (isNonTerminal) {
-      m_factorIdNonTerminal++;
-      UTIL_THROW_IF2(m_factorIdNonTerminal >= moses_MaxNumNonterminals,
-                     "Number of non-terminals exceeds maximum size reserved. Adjust parameter moses_MaxNumNonterminals, then recompile");
-    } else {
-      m_factorId++;
+  return table;
+}
+
+void FactorCollection::Shard::DeleteTable(Table *table)
+{
+  delete[] table->slots;
+  delete table;
+}
+
+const Factor *FactorCollection::Shard::Find(const StringPiece &str,
+    uint64_t hash) const
+{
+  const Table &table = GetTable();
+  for (size_t ind = hash & table.mask;; ind = (ind + 1) & table.mask) {
+    const Factor *factor = table.slots[ind].load(std::memory_order_acquire);
+    if (factor == NULL) {
+      return NULL;
     }
+    if (factor->GetString() == str) {
+      return factor;
+    }
+  }
+}
+
+const Factor *FactorCollection::Shard::Add(const StringPiece &str,
+    uint64_t hash, size_t id)
+{
+  // keep load factor <= 1/2
+  if ((m_size + 1) * 2 > GetTable().mask + 1) {
+    Grow();
   }
 
-  const Factor *factor = &ret.first->in;
+  char *strMem = (char*) m_stringBacking.Allocate(str.size());
+  memcpy(strMem, str.data(), str.size());
+
+  Factor *factor = new (m_factorBacking.Allocate(sizeof(Factor))) Factor();
+  factor->m_string = StringPiece(strMem, str.size());
+  factor->m_id = id;
+
+  // fully constructed before it's visible to readers
+  const Table &table = GetTable();
+  size_t ind = hash & table.mask;
+  while (table.slots[ind].load(std::memory_order_relaxed)) {
+    ind = (ind + 1) & table.mask;
+  }
+  table.slots[ind].store(factor, std::memory_order_release);
+  ++m_size;
 
   return factor;
 }
 
-const Factor *FactorCollection::GetFactor(const StringPiece &factorString,
+void FactorCollection::Shard::Grow()
+{
+  Table *oldTable = m_table.load(std::memory_order_relaxed);
+  Table *newTable = CreateTable((oldTable->mask + 1) * 2);
+
+  for (size_t i = 0; i <= oldTable->mask; ++i) {
+    const Factor *factor = oldTable->slots[i].load(std::memory_order_relaxed);
+    if (factor) {
+      StringPiece str = factor->GetString();
+      size_t ind = util::MurmurHashNative(str.data(), str.size()) & newTable->mask;
+      while (newTable->slots[ind].load(std::memory_order_relaxed)) {
+        ind = (ind + 1) & newTable->mask;
+      }
+      newTable->slots[ind].store(factor, std::memory_order_relaxed);
+    }
+  }
+
+  // readers may still be probing the old table
+  m_table.store(newTable, std::memory_order_release);
+  m_oldTables.push_back(oldTable);
+}
+
+////////////////////////////////////////////////////////////////////////////
+const Factor *FactorCollection::AddFactor(const StringPiece &factorString,
+    const System &system, bool isNonTerminal)
+{
+  return AddFactor(factorString, isNonTerminal);
+}
+
+const Factor *FactorCollection::AddFactor(const StringPiece &factorString,
     bool isNonTerminal)
 {
-  FactorFriend to_find;
-  to_find.in.m_string = factorString;
-  to_find.in.m_id = (isNonTerminal) ? m_factorIdNonTerminal : m_factorId;
-  Set & set = (isNonTerminal) ? m_set : m_setNonTerminal;
-  {
-    // read=lock scope
+  uint64_t hash = util::MurmurHashNative(factorString.data(), factorString.size());
+  Shard &shard = (isNonTerminal ? m_shardsNonTerminal : m_shards)[GetShardInd(hash)];
+
+  // fast path. Most words are already there
+  const Factor *factor = shard.Find(factorString, hash);
+  if (factor) {
+    return factor;
+  }
+
 #ifdef WITH_THREADS
-    boost::shared_lock<boost::shared_mutex> read_lock(m_accessLock);
-#endif // WITH_THREADS
-    Set::const_iterator i = set.find(to_find);
-    if (i != set.end()) return &i->in;
+  boost::mutex::scoped_lock lock(shard.m_mutex);
+#endif
+  // may have been added since
+  factor = shard.Find(factorString, hash);
+  if (factor) {
+    return factor;
+  }
+
+  size_t id;
+  if (isNonTerminal) {
+    id = m_factorIdNonTerminal++;
+    UTIL_THROW_IF2(id + 1 >= moses_MaxNumNonterminals,
+                   "Number of non-terminals exceeds maximum size reserved. Adjust parameter moses_MaxNumNonterminals, then recompile");
+  } else {
+    id = m_factorId++;
   }
-  return NULL;
+
+  return shard.Add(factorString, hash, id);
+}
+
+const Factor *FactorCollection::GetFactor(const StringPiece &factorString,
+    bool isNonTerminal)
+{
+  uint64_t hash = util::MurmurHashNative(factorString.data(), factorString.size());
+  const Shard &shard = (isNonTerminal ? m_shardsNonTerminal : m_shards)[GetShardInd(hash)];
+  return shard.Find(factorString, hash);
 }
 
 FactorCollection::~FactorCollection()
@@ -96,12 +187,14 @@ FactorCollection::~FactorCollection()
 // friend
 ostream& operator<<(ostream& out, const FactorCollection& factorCollection)
 {
-#ifdef WITH_THREADS
-  boost::shared_lock<boost::shared_mutex> lock(factorCollection.m_accessLock);
-#endif
-  for (FactorCollection::Set::const_iterator i = factorCollection.m_set.begin();
-       i != factorCollection.m_set.end(); ++i) {
-    out << i->in;
+  for (size_t i = 0; i < FactorCollection::NUM_SHARDS; ++i) {
+    const FactorCollection::Table &table = factorCollection.m_shards[i].GetTable();
+    for (size_t j = 0; j <= table.mask; ++j) {
+      const Factor *factor = table.slots[j].load(std::memory_order_acquire);
+      if (factor) {
+        out << *factor;
+      }
+    }
   }
   return out;
 }
@@ -27,13 +27,13 @@
 #endif
 
 #ifdef WITH_THREADS
-#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/mutex.hpp>
 #endif
 
 #include "util/murmur_hash.hh"
-#include <unordered_set>
+#include <atomic>
+#include <vector>
 
-#include <functional>
 #include <string>
 
 #include "util/string_piece.hh"
@@ -45,17 +45,6 @@ namespace Moses2
 
 class System;
 
-/** We don't want Factor to be copyable by anybody.  But we also want to store
- * it in an STL container.  The solution is that Factor's copy constructor is
- * private and friended to FactorFriend.  The STL containers can delegate
- * copying, so friending the container isn't sufficient.  STL containers see
- * FactorFriend's public copy constructor and everybody else sees Factor's
- * private copy constructor.
- */
-struct FactorFriend {
-  Factor in;
-};
-
 /** collection of factors
  *
  * All Factors in moses are accessed and created by a FactorCollection.
@@ -63,38 +52,68 @@ struct FactorFriend {
  * from being created on the stack, etc), their memory addresses can
  * be used as keys to uniquely identify them.
  * Only 1 FactorCollection object should be created.
+ *
+ * Factors are spread over NUM_SHARDS shards by the hash of their string.
+ * Each shard is an open-addressing table of Factor pointers. Lookups don't
+ * take any lock: tables are only published once filled in, and tables
+ * replaced by a bigger one are kept until the collection is destroyed, so a
+ * reader never sees freed memory. Inserts lock only their own shard.
+ * Factors never move once created.
  */
 class FactorCollection
 {
   friend std::ostream& operator<<(std::ostream&, const FactorCollection&);
   friend class System;
+  friend class FactorCollectionBenchmark;
 
-  struct HashFactor: public std::unary_function<const FactorFriend &,
-      std::size_t> {
-    std::size_t operator()(const FactorFriend &factor) const {
-      return util::MurmurHashNative(factor.in.m_string.data(),
-                                    factor.in.m_string.size());
-    }
+  struct Table {
+    size_t mask; // number of slots - 1. power of 2
+    std::atomic<const Factor*> *slots;
   };
-  struct EqualsFactor: public std::binary_function<const FactorFriend &,
-      const FactorFriend &, bool> {
-    bool operator()(const FactorFriend &left, const FactorFriend &right) const {
-      return left.in.GetString() == right.in.GetString();
-    }
-  };
-  typedef std::unordered_set<FactorFriend, HashFactor, EqualsFactor> Set;
-  Set m_set;
-  Set m_setNonTerminal;
 
-  util::Pool m_string_backing;
+  class Shard
+  {
+  public:
+    Shard();
+    ~Shard();
+
+    const Factor *Find(const StringPiece &str, uint64_t hash) const;
+
+    // must hold the shard lock
+    const Factor *Add(const StringPiece &str, uint64_t hash, size_t id);
+
+    const Table &GetTable() const {
+      return *m_table.load(std::memory_order_acquire);
+    }
 
 #ifdef WITH_THREADS
-  //reader-writer lock
-  mutable boost::shared_mutex m_accessLock;
+    boost::mutex m_mutex;
 #endif
 
-  size_t m_factorIdNonTerminal; /**< unique, contiguous ids, starting from 0, for each non-terminal factor */
-  size_t m_factorId; /**< unique, contiguous ids, starting from moses_MaxNumNonterminals, for each terminal factor */
+  protected:
+    std::atomic<Table*> m_table;
+    std::vector<Table*> m_oldTables;
+    size_t m_size;
+
+    util::Pool m_factorBacking, m_stringBacking;
+
+    void Grow();
+    static Table *CreateTable(size_t numSlots);
+    static void DeleteTable(Table *table);
+  };
+
+  static const size_t NUM_SHARDS = 64; // power of 2
+
+  // the low bits pick the slot within a shard, the high bits pick the shard
+  static size_t GetShardInd(uint64_t hash) {
+    return (size_t) (hash >> 58) & (NUM_SHARDS - 1);
+  }
+
+  Shard m_shards[NUM_SHARDS];
+  Shard m_shardsNonTerminal[NUM_SHARDS];
+
+  std::atomic<size_t> m_factorIdNonTerminal; /**< unique, contiguous ids, starting from 0, for each non-terminal factor */
+  std::atomic<size_t> m_factorId; /**< unique, contiguous ids, starting from moses_MaxNumNonterminals, for each terminal factor */
 
   //! constructor. only the 1 static variable can be created
   FactorCollection() :
@@ -109,9 +128,11 @@ public:
    */
   const Factor *AddFactor(const StringPiece &factorString, const System &system,
                           bool isNonTerminal);
+  const Factor *AddFactor(const StringPiece &factorString,
+                          bool isNonTerminal = false);
 
   size_t GetNumNonTerminals() {
-    return m_factorIdNonTerminal;
+    return m_factorIdNonTerminal.load();
   }
 
   const Factor *GetFactor(const StringPiece &factorString, bool isNonTerminal =
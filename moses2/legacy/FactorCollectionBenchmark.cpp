@@ -0,0 +1,174 @@
+/*
+ * FactorCollectionBenchmark.cpp
+ *
+ * Thread-scaling benchmark of FactorCollection::AddFactor(), against the
+ * previous implementation: one std::unordered_set behind a reader-writer lock.
+ * Each thread looks up a stream of words drawn from a Zipf-like distribution
+ * over a shared vocabulary, with a proportion of unique words (OOVs) which
+ * have to be inserted.
+ */
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <cstdlib>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include "FactorCollection.h"
+#include "Timer.h"
+#include "util/pool.hh"
+#include "util/murmur_hash.hh"
+
+using namespace std;
+
+namespace Moses2
+{
+
+// the previous FactorCollection
+class LockedFactorCollection
+{
+  struct Entry {
+    StringPiece str;
+    size_t id;
+  };
+  struct HashEntry {
+    size_t operator()(const Entry &entry) const {
+      return util::MurmurHashNative(entry.str.data(), entry.str.size());
+    }
+  };
+  struct EqualsEntry {
+    bool operator()(const Entry &left, const Entry &right) const {
+      return left.str == right.str;
+    }
+  };
+  typedef std::unordered_set<Entry, HashEntry, EqualsEntry> Set;
+  Set m_set;
+  util::Pool m_stringBacking;
+  boost::shared_mutex m_accessLock;
+  size_t m_id;
+
+public:
+  LockedFactorCollection()
+    :m_id(0) {
+  }
+
+  const void *AddFactor(const StringPiece &str) {
+    Entry entry;
+    entry.str = str;
+    {
+      boost::shared_lock<boost::shared_mutex> readLock(m_accessLock);
+      Set::const_iterator iter = m_set.find(entry);
+      if (iter != m_set.end()) return &*iter;
+    }
+    boost::unique_lock<boost::shared_mutex> lock(m_accessLock);
+    entry.id = m_id;
+    std::pair<Set::iterator, bool> ret = m_set.insert(entry);
+    if (ret.second) {
+      Entry &inserted = const_cast<Entry&>(*ret.first);
+      inserted.str = StringPiece((const char*) memcpy(
+                                   m_stringBacking.Allocate(str.size()), str.data(), str.size()), str.size());
+      ++m_id;
+    }
+    return &*ret.first;
+  }
+};
+
+// each thread gets its own word stream. OOVs are unique to the thread
+void CreateWords(const vector<string> &vocab, size_t numWords,
+                 size_t oovPercent, size_t threadInd, vector<string> &words)
+{
+  unsigned int seed = threadInd + 1;
+  words.resize(numWords);
+  for (size_t i = 0; i < numWords; ++i) {
+    if ((size_t) rand_r(&seed) % 100 < oovPercent) {
+      stringstream strme;
+      strme << "oov" << threadInd << "_" << i;
+      words[i] = strme.str();
+    } else {
+      // roughly Zipfian. Most lookups hit a few frequent words
+      double r = (double) rand_r(&seed) / RAND_MAX;
+      size_t ind = (size_t) (r * r * r * (vocab.size() - 1));
+      words[i] = vocab[ind];
+    }
+  }
+}
+
+// FactorCollection can only be created by its friends
+class FactorCollectionBenchmark
+{
+public:
+  template<typename Collection>
+  static Collection *Create() {
+    return new Collection();
+  }
+};
+
+template<typename Collection>
+void AddWords(Collection *coll, const vector<string> *words, size_t *checksum)
+{
+  size_t sum = 0;
+  for (size_t i = 0; i < words->size(); ++i) {
+    sum += (size_t) coll->AddFactor((*words)[i]) & 0xff;
+  }
+  *checksum = sum;
+}
+
+template<typename Collection>
+double Run(const vector<vector<string> > &words, size_t numThreads)
+{
+  boost::scoped_ptr<Collection> coll(FactorCollectionBenchmark::Create<Collection>());
+  vector<size_t> checksums(numThreads);
+
+  Timer timer;
+  timer.start();
+
+  boost::thread_group threads;
+  for (size_t i = 0; i < numThreads; ++i) {
+    threads.create_thread(boost::bind(&AddWords<Collection>, coll.get(), &words[i], &checksums[i]));
+  }
+  threads.join_all();
+
+  return timer.get_elapsed_time();
+}
+
+}
+
+using namespace Moses2;
+
+int main(int argc, char** argv)
+{
+  if (argc < 2) {
+    cerr << "Usage: " << argv[0] << " max-threads [words-per-thread=2000000] [vocab-size=100000] [oov-percent=5]" << endl;
+    return 1;
+  }
+  size_t maxThreads = atoi(argv[1]);
+  size_t numWords = argc > 2 ? atoi(argv[2]) : 2000000;
+  size_t vocabSize = argc > 3 ? atoi(argv[3]) : 100000;
+  size_t oovPercent = argc > 4 ? atoi(argv[4]) : 5;
+
+  vector<string> vocab(vocabSize);
+  for (size_t i = 0; i < vocabSize; ++i) {
+    stringstream strme;
+    strme << "word" << i;
+    vocab[i] = strme.str();
+  }
+
+  vector<vector<string> > words(maxThreads);
+  for (size_t i = 0; i < maxThreads; ++i) {
+    CreateWords(vocab, numWords, oovPercent, i, words[i]);
+  }
+
+  cout << "threads\tlocked\tsharded\tspeedup" << endl;
+  for (size_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+    double locked = Run<LockedFactorCollection>(words, numThreads);
+    double sharded = Run<FactorCollection>(words, numThreads);
+    cout << numThreads << "\t" << locked << "\t" << sharded << "\t"
+         << locked / sharded << endl;
+  }
+
+  return 0;
+}
@@ -71,6 +71,9 @@ void OutputCollector::Write(int sourceId, const std::string& output, const std::
         m_debugs.erase(debugIter);
       }
     }
+#ifdef WITH_THREADS
+    m_written.notify_all();
+#endif
   }
   else {
     //save for later
@@ -79,5 +82,14 @@ void OutputCollector::Write(int sourceId, const std::string& output, const std::
   }
 }
 
+void OutputCollector::WaitForSlot(int sourceId, size_t maxPending) {
+#ifdef WITH_THREADS
+  boost::mutex::scoped_lock lock(m_mutex);
+  while (sourceId >= m_nextOutput + (int) maxPending) {
+    m_written.wait(lock);
+  }
+#endif
+}
+
 }
 
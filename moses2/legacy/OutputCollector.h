@@ -21,6 +21,7 @@
 
 #ifdef WITH_THREADS
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #endif
 
 #ifdef BOOST_HAS_PTHREADS
@@ -67,6 +68,12 @@ public:
   void Write(int sourceId, const std::string& output, const std::string& debug =
     "");
 
+  /**
+   * Block until sourceId is less than maxPending ahead of the next output to
+   * be written. Bounds the number of sentences in flight in batch mode.
+   **/
+  void WaitForSlot(int sourceId, size_t maxPending);
+
 private:
   std::unordered_map<int, std::string> m_outputs;
   std::unordered_map<int, std::string> m_debugs;
@@ -77,6 +84,7 @@ private:
   bool m_isHoldingDebugStream;
 #ifdef WITH_THREADS
   boost::mutex m_mutex;
+  boost::condition_variable m_written;
 #endif
 
 public:
@@ -124,6 +124,8 @@ Parameter::Parameter()
   //    "if present, allow dropping of source words"); //da = drop any (word); see -du for comparison
   AddParam(search_opts, "threads", "th",
            "number of threads to use in decoding (defaults to single-threaded)");
+  AddParam(search_opts, "batch-window",
+           "maximum number of sentences in flight in batch mode, ie. queued, decoding or waiting to be written (default 4 x threads)");
 
   // distortion options
   po::options_description disto_opts("Distortion options");
@@ -144,6 +146,8 @@ Parameter::Parameter()
            "How many hypotheses should be created for each coverage. (default = 0)");
   AddParam(cube_opts, "cube-pruning-lazy-scoring", "cbls",
            "Don't fully score a hypothesis until it is popped");
+  AddParam(cube_opts, "cube-pruning-search-threads", "cbst",
+           "Expand the mini-stacks of each stack in parallel on this many extra threads. Same output as the serial search, apart from ties. (default = 0, serial)");
   //AddParam(cube_opts, "cube-pruning-deterministic-search", "cbds",
   //    "Break ties deterministically during search");
 
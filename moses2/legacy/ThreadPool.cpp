@@ -26,6 +26,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <math.h>
+#include <algorithm>
+#include <cassert>
 #include <thread>
 
 #include "ThreadPool.h"
@@ -40,8 +43,13 @@ namespace Moses2
 
 ThreadPool::ThreadPool(size_t numThreads, int cpuAffinityOffset,
                        int cpuAffinityIncr) :
+  m_nextWorker(0), m_numQueued(0),
   m_stopped(false), m_stopping(false), m_queueLimit(numThreads*2)
 {
+  for (size_t i = 0; i < numThreads; ++i) {
+    m_workers.push_back(new Worker());
+  }
+
 #if defined(_WIN32) || defined(_WIN64)
   size_t numCPU = std::thread::hardware_concurrency();
 #else
@@ -53,7 +61,7 @@ ThreadPool::ThreadPool(size_t numThreads, int cpuAffinityOffset,
 
   for (size_t i = 0; i < numThreads; ++i) {
     boost::thread *thread = m_threads.create_thread(
-                              boost::bind(&ThreadPool::Execute, this));
+                              boost::bind(&ThreadPool::Execute, this, i));
 
 #ifdef __linux
     if (cpuAffinityOffset >= 0) {
@@ -89,45 +97,133 @@ ThreadPool::ThreadPool(size_t numThreads, int cpuAffinityOffset,
   }
 }
 
-void ThreadPool::Execute()
+ThreadPool::~ThreadPool()
 {
-  do {
-    boost::shared_ptr<Task> task;
+  Stop();
+  for (size_t i = 0; i < m_workers.size(); ++i) {
+    delete m_workers[i];
+  }
+}
+
+void ThreadPool::Execute(size_t workerInd)
+{
+  while (true) {
+    QueuedTask queued;
     {
-      // Find a job to perform
+      // m_numQueued is the number of tasks in the deques. Tasks are pushed
+      // and popped under m_mutex, so there is one to pop once it's non-zero
       boost::mutex::scoped_lock lock(m_mutex);
-      if (m_tasks.empty() && !m_stopped) {
+      while (m_numQueued == 0 && !m_stopped) {
         m_threadNeeded.wait(lock);
       }
-      if (!m_stopped && !m_tasks.empty()) {
-        task = m_tasks.front();
-        m_tasks.pop();
+      if (m_stopped) {
+        return;
       }
+      bool popped = Pop(workerInd, queued);
+      assert(popped);
+      (void) popped;
+      --m_numQueued;
     }
+    m_threadAvailable.notify_all();
+
     //Execute job
-    if (task) {
-      // must read from task before run. otherwise task may be deleted by main thread
-      // race condition
-      task->DeleteAfterExecution();
-      task->Run();
+    Clock::time_point start = Clock::now();
+
+    // must read from task before run. otherwise task may be deleted by main thread
+    // race condition
+    queued.task->DeleteAfterExecution();
+    queued.task->Run();
+
+    Clock::time_point end = Clock::now();
+    {
+      boost::mutex::scoped_lock lock(m_statsMutex);
+      m_stats.Add(std::chrono::duration<double>(start - queued.submitted).count(),
+                  std::chrono::duration<double>(end - start).count());
     }
-    m_threadAvailable.notify_all();
-  } while (!m_stopped);
+  }
+}
+
+bool ThreadPool::PopFront(Worker &worker, QueuedTask &out)
+{
+  boost::mutex::scoped_lock lock(worker.mutex);
+  if (worker.tasks.empty()) {
+    return false;
+  }
+  out = worker.tasks.front();
+  worker.tasks.pop_front();
+  return true;
+}
+
+bool ThreadPool::Pop(size_t workerInd, QueuedTask &out)
+{
+  if (PopFront(*m_workers[workerInd], out)) {
+    return true;
+  }
+
+  // steal the most costly task from the other threads
+  while (true) {
+    Worker *victim = NULL;
+    size_t maxCost = 0;
+    for (size_t i = 1; i < m_workers.size(); ++i) {
+      Worker &other = *m_workers[(workerInd + i) % m_workers.size()];
+      boost::mutex::scoped_lock lock(other.mutex);
+      if (!other.tasks.empty()
+          && (victim == NULL || other.tasks.front().cost > maxCost)) {
+        victim = &other;
+        maxCost = other.tasks.front().cost;
+      }
+    }
+
+    if (victim == NULL) {
+      return false;
+    }
+    if (PopFront(*victim, out)) {
+      return true;
+    }
+    // lost the race for it. Look again
+  }
 }
 
 void ThreadPool::Submit(boost::shared_ptr<Task> task)
 {
+  QueuedTask queued;
+  queued.task = task;
+  queued.cost = task->GetCost();
+
   boost::mutex::scoped_lock lock(m_mutex);
   if (m_stopping) {
     throw runtime_error("ThreadPool stopping - unable to accept new jobs");
   }
-  while (m_queueLimit > 0 && m_tasks.size() >= m_queueLimit) {
+  if (m_workers.empty()) {
+    throw runtime_error("ThreadPool has no threads");
+  }
+  while (m_queueLimit > 0 && m_numQueued >= m_queueLimit) {
     m_threadAvailable.wait(lock);
   }
-  m_tasks.push(task);
+  queued.submitted = Clock::now();
+
+  Worker &worker = *m_workers[m_nextWorker];
+  m_nextWorker = (m_nextWorker + 1) % m_workers.size();
+  {
+    // keep deque sorted by descending cost, FIFO within equal cost
+    boost::mutex::scoped_lock workerLock(worker.mutex);
+    std::deque<QueuedTask>::iterator iter = worker.tasks.end();
+    while (iter != worker.tasks.begin() && (iter - 1)->cost < queued.cost) {
+      --iter;
+    }
+    worker.tasks.insert(iter, queued);
+  }
+  ++m_numQueued;
+
   m_threadNeeded.notify_all();
 }
 
+ThreadPoolStats ThreadPool::GetStats() const
+{
+  boost::mutex::scoped_lock lock(m_statsMutex);
+  return m_stats;
+}
+
 void ThreadPool::Stop(bool processRemainingJobs)
 {
   {
@@ -139,7 +235,7 @@ void ThreadPool::Stop(bool processRemainingJobs)
   if (processRemainingJobs) {
     boost::mutex::scoped_lock lock(m_mutex);
     //wait for queue to drain.
-    while (!m_tasks.empty() && !m_stopped) {
+    while (m_numQueued && !m_stopped) {
       m_threadAvailable.wait(lock);
     }
   }
@@ -153,5 +249,84 @@ void ThreadPool::Stop(bool processRemainingJobs)
   m_threads.join_all();
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////
+ThreadPoolStats::ThreadPoolStats()
+  :m_numTasks(0)
+  ,m_totalWait(0)
+  ,m_maxWait(0)
+  ,m_totalRun(0)
+  ,m_maxRun(0)
+{
+  for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+    m_waitHist[i] = 0;
+    m_runHist[i] = 0;
+  }
+}
+
+size_t ThreadPoolStats::Bucket(double secs)
+{
+  double usecs = secs * 1000000;
+  if (usecs < 1) {
+    return 0;
+  }
+  size_t ret = (size_t) log2(usecs) + 1;
+  return std::min(ret, NUM_BUCKETS - 1);
+}
+
+void ThreadPoolStats::Add(double wait, double run)
+{
+  ++m_numTasks;
+  m_totalWait += wait;
+  m_maxWait = std::max(m_maxWait, wait);
+  m_totalRun += run;
+  m_maxRun = std::max(m_maxRun, run);
+  ++m_waitHist[Bucket(wait)];
+  ++m_runHist[Bucket(run)];
+}
+
+double ThreadPoolStats::GetMeanWait() const
+{
+  return m_numTasks ? m_totalWait / m_numTasks : 0;
+}
+
+double ThreadPoolStats::GetMeanRun() const
+{
+  return m_numTasks ? m_totalRun / m_numTasks : 0;
 }
 
+double ThreadPoolStats::Percentile(const size_t *hist, size_t total, float p)
+{
+  size_t needed = (size_t) ceil(total * p);
+  size_t seen = 0;
+  for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+    seen += hist[i];
+    if (seen >= needed && seen) {
+      // upper bound of bucket i
+      return ldexp(1.0, i) / 1000000;
+    }
+  }
+  return 0;
+}
+
+double ThreadPoolStats::GetWaitPercentile(float p) const
+{
+  return std::min(Percentile(m_waitHist, m_numTasks, p), m_maxWait);
+}
+
+double ThreadPoolStats::GetRunPercentile(float p) const
+{
+  return std::min(Percentile(m_runHist, m_numTasks, p), m_maxRun);
+}
+
+void ThreadPoolStats::Debug(std::ostream &out) const
+{
+  out << "tasks=" << m_numTasks
+      << " wait(mean/p50/p99/max)="
+      << GetMeanWait() << "/" << GetWaitPercentile(0.5) << "/"
+      << GetWaitPercentile(0.99) << "/" << m_maxWait
+      << " run(mean/p50/p99/max)="
+      << GetMeanRun() << "/" << GetRunPercentile(0.5) << "/"
+      << GetRunPercentile(0.99) << "/" << m_maxRun;
+}
+
+}
@@ -22,8 +22,9 @@
 #pragma once
 
 #include <iostream>
-#include <queue>
+#include <deque>
 #include <vector>
+#include <chrono>
 
 #include <boost/shared_ptr.hpp>
 
@@ -54,10 +55,62 @@ public:
   virtual bool DeleteAfterExecution() {
     return true;
   }
+  /**
+   * Estimated relative run time, eg. input length. Queued tasks with the
+   * highest cost are started first. Tasks of equal cost run in FIFO order.
+   **/
+  virtual size_t GetCost() const {
+    return 0;
+  }
   virtual ~Task() {
   }
 };
 
+/** Queue-wait and run time of the tasks executed by a ThreadPool.
+ * Times are in seconds. Percentiles are read off a log2 histogram of
+ * microseconds, so they are upper bounds within a factor of 2.
+ */
+class ThreadPoolStats
+{
+public:
+  ThreadPoolStats();
+
+  void Add(double wait, double run);
+
+  size_t GetNumTasks() const {
+    return m_numTasks;
+  }
+  double GetMeanWait() const;
+  double GetMeanRun() const;
+  double GetMaxWait() const {
+    return m_maxWait;
+  }
+  double GetMaxRun() const {
+    return m_maxRun;
+  }
+  double GetWaitPercentile(float p) const;
+  double GetRunPercentile(float p) const;
+
+  void Debug(std::ostream &out) const;
+
+protected:
+  static const size_t NUM_BUCKETS = 40;
+
+  size_t m_numTasks;
+  double m_totalWait, m_maxWait;
+  double m_totalRun, m_maxRun;
+  size_t m_waitHist[NUM_BUCKETS], m_runHist[NUM_BUCKETS];
+
+  static size_t Bucket(double secs);
+  static double Percentile(const size_t *hist, size_t total, float p);
+};
+
+/**
+ * Work-stealing pool. Each thread owns a deque of tasks ordered by
+ * descending Task::GetCost(), so the longest tasks are started first. Submit
+ * deals tasks round-robin to the deques. A thread whose deque is empty
+ * steals the most costly task from the other threads' deques.
+ **/
 class ThreadPool
 {
 public:
@@ -67,9 +120,7 @@ public:
   explicit ThreadPool(size_t numThreads, int cpuAffinityOffset = -1,
                       int cpuAffinityIncr = 1);
 
-  ~ThreadPool() {
-    Stop();
-  }
+  ~ThreadPool();
 
   /**
    * Add a job to the threadpool.
@@ -89,13 +140,37 @@ public:
     m_queueLimit = limit;
   }
 
+  /**
+   * Snapshot of the queue-wait and run time statistics so far.
+   **/
+  ThreadPoolStats GetStats() const;
+
 private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct QueuedTask {
+    boost::shared_ptr<Task> task;
+    size_t cost;
+    Clock::time_point submitted;
+  };
+
+  struct Worker {
+    boost::mutex mutex;
+    std::deque<QueuedTask> tasks;
+  };
+
   /**
    * The main loop executed by each thread.
    **/
-  void Execute();
+  void Execute(size_t workerInd);
+
+  bool Pop(size_t workerInd, QueuedTask &out);
+  bool PopFront(Worker &worker, QueuedTask &out);
+
+  std::vector<Worker*> m_workers;
+  size_t m_nextWorker;
+  size_t m_numQueued;
 
-  std::queue<boost::shared_ptr<Task> > m_tasks;
   boost::thread_group m_threads;
   boost::mutex m_mutex;
   boost::condition_variable m_threadNeeded;
@@ -103,6 +178,9 @@ private:
   bool m_stopped;
   bool m_stopping;
   size_t m_queueLimit;
+
+  mutable boost::mutex m_statsMutex;
+  ThreadPoolStats m_stats;
 };
 
 class TestTask: public Task
@@ -12,6 +12,7 @@ CubePruningOptions()
   , diversity(DEFAULT_CUBE_PRUNING_DIVERSITY)
   , lazy_scoring(false)
   , deterministic_search(false)
+  , search_threads(0)
 {}
 
 bool
@@ -23,6 +24,7 @@ init(Parameter const& param)
   param.SetParameter(diversity, "cube-pruning-diversity",
                      DEFAULT_CUBE_PRUNING_DIVERSITY);
   param.SetParameter(lazy_scoring, "cube-pruning-lazy-scoring", false);
+  param.SetParameter(search_threads, "cube-pruning-search-threads", (size_t) 0);
   //param.SetParameter(deterministic_search, "cube-pruning-deterministic-search", false);
   return true;
 }
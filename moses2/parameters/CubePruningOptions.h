@@ -12,6 +12,7 @@ struct
   size_t  diversity;
   bool lazy_scoring;
   bool deterministic_search;
+  size_t  search_threads;
 
   bool init(Parameter const& param);
   CubePruningOptions(Parameter const& param);
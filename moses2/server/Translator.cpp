@@ -4,6 +4,7 @@
  *  Created on: 1 Apr 2016
  *      Author: hieu
  */
+#include <iostream>
 #include <boost/shared_ptr.hpp>
 #include "Translator.h"
 #include "TranslationRequest.h"
@@ -30,7 +31,10 @@ Translator::Translator(Server& server, System &system)
 
 Translator::~Translator()
 {
-  // TODO Auto-generated destructor stub
+  m_threadPool.Stop(true);
+  cerr << "Thread pool: ";
+  m_threadPool.GetStats().Debug(cerr);
+  cerr << endl;
 }
 
 void Translator::execute(xmlrpc_c::paramList const& paramList,
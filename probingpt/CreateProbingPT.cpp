@@ -2,6 +2,7 @@
 #include <boost/program_options.hpp>
 #include "util/usage.hh"
 #include "storing.h"
+#include "MappedColl.h"
 #include "InputFileStream.h"
 #include "OutputFileStream.h"
 #include "moses/Util.h"
@@ -18,18 +19,32 @@ int main(int argc, char* argv[])
   bool log_prob = false;
   bool scfg = false;
   int max_cache_size = 50000;
+  size_t threads = 1;
+  size_t num_shards = 0;
+  string memory = "1G";
+  string temp_dir;
+  vector<float> weights;
+  size_t quantize = 0;
+  bool mappedOnly = false;
 
   namespace po = boost::program_options;
   po::options_description desc("Options");
   desc.add_options()
   ("help", "Print help messages")
-  ("input-pt", po::value<string>()->required(), "Text pt")
+  ("input-pt", po::value<string>(), "Text pt")
   ("output-dir", po::value<string>()->required(), "Directory when binary files will be written")
   ("num-scores", po::value<int>()->default_value(num_scores), "Number of pt scores")
   ("num-lex-scores", po::value<int>()->default_value(num_lex_scores), "Number of lexicalized reordering scores")
   ("log-prob", "log (and floor) probabilities before storing")
   ("max-cache-size", po::value<int>()->default_value(max_cache_size), "Maximum number of high-count source lines to write to cache file. 0=no cache, negative=no limit")
   ("scfg", "Rules are SCFG in Moses format (ie. with non-terms and LHS")
+  ("threads", po::value<size_t>()->default_value(threads), "Number of threads parsing the phrase table")
+  ("num-shards", po::value<size_t>()->default_value(num_shards), "Number of shards the phrase table is split into. Each is sorted in memory. 0=enough for each to fit in half of --memory")
+  ("memory", po::value<string>()->default_value(memory), "Memory for buffering shards before they are spilled to disk, eg. 2G, 500M")
+  ("temp-dir", po::value<string>(), "Directory for temporary files. Default=output-dir")
+  ("weights", po::value<string>(), "Weights of the pt scores, eg. \"0.2 0.2 0.2 0.2\". Target phrases are stored best first by the weighted sum of their log scores, and the decoder only reads the first table-limit of them. Without weights, all target phrases are read")
+  ("quantize", po::value<size_t>()->default_value(quantize), "Store each score in 1 byte, as one of 2^N values of a per-feature codebook. 0=store floats, 1-8=number of bits")
+  ("mapped-only", "Don't binarize a pt, only add the binary vocabs and alignments to the existing pt in output-dir")
 
   ;
 
@@ -60,13 +75,35 @@ int main(int argc, char* argv[])
   if (vm.count("max-cache-size")) max_cache_size = vm["max-cache-size"].as<int>();
   if (vm.count("log-prob")) log_prob = true;
   if (vm.count("scfg")) scfg = true;
+  if (vm.count("threads")) threads = vm["threads"].as<size_t>();
+  if (vm.count("num-shards")) num_shards = vm["num-shards"].as<size_t>();
+  if (vm.count("memory")) memory = vm["memory"].as<string>();
+  if (vm.count("temp-dir")) temp_dir = vm["temp-dir"].as<string>();
+  if (vm.count("weights")) weights = Moses::Tokenize<float>(vm["weights"].as<string>());
+  if (vm.count("quantize")) quantize = vm["quantize"].as<size_t>();
+  if (vm.count("mapped-only")) mappedOnly = true;
+
+  if (mappedOnly) {
+    probingpt::writeMappedColls(outPath);
+    return 0;
+  }
 
+  if (inPath.empty()) {
+    std::cerr << "ERROR: the option '--input-pt' is required but missing" << std::endl << std::endl;
+    std::cerr << desc << std::endl;
+    return EXIT_FAILURE;
+  }
 
   if (scfg) {
     inPath = ReformatSCFGFile(inPath);
   }
 
-  probingpt::createProbingPT(inPath, outPath, num_scores, num_lex_scores, log_prob, max_cache_size, scfg);
+  probingpt::createProbingPT(inPath, outPath, num_scores, num_lex_scores, log_prob, max_cache_size, scfg,
+                             threads, num_shards, util::ParseSize(memory), temp_dir, weights,
+                             quantize);
+
+  // vocabs & alignments that are mmapped by the decoder, rather than parsed
+  probingpt::writeMappedColls(outPath);
 
   //util::PrintUsage(std::cout);
   return 0;
@@ -99,15 +136,5 @@ std::string ReformatSCFGFile(const std::string &path)
   inFile.Close();
   outFile.Close();
 
-  string sortedPath = path + ".reformat.sorted.gz";
-  string tmpPath = path + ".tmp ";
-  string cmd = "mkdir " + tmpPath
-               + " && gzip -dc " + reformattedPath + " | LC_ALL=C sort -T " + tmpPath + " | gzip -c > " + sortedPath;
-  system(cmd.c_str());
-
-  cmd = "rm -rf " + tmpPath + " " + reformattedPath;
-  system(cmd.c_str());
-
-  return sortedPath;
+  return reformattedPath;
 }
-
@@ -0,0 +1,142 @@
+/*
+ * MappedColl.cpp
+ *
+ */
+#include <algorithm>
+#include <fstream>
+#include "MappedColl.h"
+#include "InputFileStream.h"
+#include "util/exception.hh"
+#include "moses2/legacy/Util2.h"
+
+using namespace std;
+
+namespace probingpt
+{
+
+MappedColl::MappedColl()
+  :m_size(0)
+  ,m_entries(NULL)
+  ,m_data(NULL)
+{
+}
+
+void MappedColl::Load(const std::string &path, util::LoadMethod load_method)
+{
+  m_file.reset(util::OpenReadOrThrow(path.c_str()));
+  uint64_t size = util::SizeFile(m_file.get());
+  util::MapRead(load_method, m_file.get(), 0, size, m_memory);
+  Init((const char*) m_memory.get(), size, path);
+}
+
+void MappedColl::Create(const Coll &coll)
+{
+  Serialize(coll, m_owned);
+  Init(m_owned.data(), m_owned.size(), "");
+}
+
+void MappedColl::Write(const std::string &path, const Coll &coll)
+{
+  std::string out;
+  Serialize(coll, out);
+
+  // written under another name first, so a process loading the pt never sees half a file
+  std::string tempPath = path + ".tmp";
+  std::ofstream file(tempPath.c_str(), std::ios::out | std::ios::binary);
+  UTIL_THROW_IF2(!file.is_open(), "Couldn't open " << tempPath);
+  file.write(out.data(), out.size());
+  file.close();
+  UTIL_THROW_IF2(!file, "Couldn't write " << tempPath);
+
+  UTIL_THROW_IF2(rename(tempPath.c_str(), path.c_str()),
+                 "Couldn't rename " << tempPath << " to " << path);
+}
+
+void MappedColl::Serialize(const Coll &coll, std::string &out)
+{
+  // in id order, so the file doesn't depend on hash table order
+  Coll sorted(coll);
+  std::sort(sorted.begin(), sorted.end());
+
+  uint64_t num = sorted.size();
+  out.clear();
+  out.append((const char*) &num, sizeof(num));
+
+  Entry entry;
+  entry.offset = 0;
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    entry.id = sorted[i].first;
+    out.append((const char*) &entry, sizeof(entry));
+    entry.offset += sorted[i].second.size();
+  }
+  entry.id = 0;
+  out.append((const char*) &entry, sizeof(entry));
+
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    out += sorted[i].second;
+  }
+}
+
+void MappedColl::Init(const char *mem, size_t memSize, const std::string &path)
+{
+  UTIL_THROW_IF2(memSize < sizeof(uint64_t), "Corrupt file " << path);
+  m_size = *(const uint64_t*) mem;
+
+  size_t dataStart = sizeof(uint64_t) + (m_size + 1) * sizeof(Entry);
+  UTIL_THROW_IF2(memSize < dataStart, "Corrupt file " << path);
+  m_entries = (const Entry*) (mem + sizeof(uint64_t));
+  m_data = mem + dataStart;
+  UTIL_THROW_IF2(dataStart + m_entries[m_size].offset != memSize,
+                 "Corrupt file " << path);
+}
+
+void writeMappedColls(const std::string &basePath)
+{
+  MappedColl::Coll coll;
+
+  readVocab(coll, basePath + "/source_vocabids");
+  MappedColl::Write(basePath + "/SourceVocab.bin", coll);
+
+  coll.clear();
+  readVocab(coll, basePath + "/TargetVocab.dat");
+  MappedColl::Write(basePath + "/TargetVocab.bin", coll);
+
+  coll.clear();
+  readAlignments(coll, basePath + "/Alignments.dat");
+  MappedColl::Write(basePath + "/Alignments.bin", coll);
+}
+
+void readVocab(MappedColl::Coll &coll, const std::string &path)
+{
+  InputFileStream strme(path);
+
+  std::string line;
+  while (getline(strme, line)) {
+    std::vector<std::string> toks = Moses2::Tokenize(line, "\t");
+    UTIL_THROW_IF2(toks.size() != 2, "Incorrect format in " << path << ": " << line);
+
+    uint64_t id = Moses2::Scan<uint64_t>(toks[1]);
+    coll.push_back(MappedColl::Coll::value_type(id, toks[0]));
+  }
+}
+
+void readAlignments(MappedColl::Coll &coll, const std::string &path)
+{
+  InputFileStream strme(path);
+
+  // each alignment point is a byte
+  std::string line;
+  while (getline(strme, line)) {
+    std::vector<std::string> toks = Moses2::Tokenize(line, "\t ");
+    UTIL_THROW_IF2(toks.size() == 0, "Corrupt alignment file");
+
+    uint64_t alignInd = Moses2::Scan<uint64_t>(toks[0]);
+    std::string aligns;
+    for (size_t i = 1; i < toks.size(); ++i) {
+      aligns += (char) Moses2::Scan<size_t>(toks[i]);
+    }
+    coll.push_back(MappedColl::Coll::value_type(alignInd, aligns));
+  }
+}
+
+}
@@ -0,0 +1,79 @@
+/*
+ * MappedColl.h
+ *
+ * Binary form of the pt's vocabularies and alignments. Each is a list of
+ * (id, byte string) entries that's used where it's mmapped, so nothing is
+ * parsed at load time and processes loading the same pt share the pages.
+ */
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include <inttypes.h>
+#include "util/mmap.hh"
+#include "util/file.hh"
+#include "util/string_piece.hh"
+
+namespace probingpt
+{
+
+class MappedColl
+{
+public:
+  typedef std::vector<std::pair<uint64_t, std::string> > Coll;
+
+  MappedColl();
+
+  //! mmap a file written by Write()
+  void Load(const std::string &path, util::LoadMethod load_method);
+
+  //! use coll directly, for pts without binary files
+  void Create(const Coll &coll);
+
+  static void Write(const std::string &path, const Coll &coll);
+
+  size_t size() const {
+    return m_size;
+  }
+
+  uint64_t GetId(size_t ind) const {
+    return m_entries[ind].id;
+  }
+
+  StringPiece Get(size_t ind) const {
+    return StringPiece(m_data + m_entries[ind].offset,
+                       m_entries[ind + 1].offset - m_entries[ind].offset);
+  }
+
+protected:
+  /* format:
+   *   uint64 num entries
+   *   Entry entries[num entries + 1], the last only marks the end of the data
+   *   char data[]
+   */
+  struct Entry {
+    uint64_t id;
+    uint64_t offset; // in data
+  };
+
+  size_t m_size;
+  const Entry *m_entries;
+  const char *m_data;
+
+  util::scoped_fd m_file;
+  util::scoped_memory m_memory;
+  std::string m_owned; // Create()
+
+  static void Serialize(const Coll &coll, std::string &out);
+  void Init(const char *mem, size_t memSize, const std::string &path);
+};
+
+//! write binary vocabs and alignments for the text ones in basePath
+void writeMappedColls(const std::string &basePath);
+
+//! text vocab files, ie. source_vocabids & TargetVocab.dat
+void readVocab(MappedColl::Coll &coll, const std::string &path);
+void readAlignments(MappedColl::Coll &coll, const std::string &path);
+
+}
+
@@ -0,0 +1,144 @@
+/*
+ * ScoreQuantizer.cpp
+ *
+ */
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <fstream>
+#include "ScoreQuantizer.h"
+#include "moses2/legacy/Util2.h"
+#include "util/murmur_hash.hh"
+#include "util/exception.hh"
+
+using namespace std;
+
+namespace probingpt
+{
+
+ScoreQuantizer::ScoreQuantizer(size_t bits, bool logProb, size_t sampleSize)
+  :m_numCenters(1 << bits)
+  ,m_logProb(logProb)
+  ,m_sampleSize(sampleSize)
+  ,m_numScores(0)
+  ,m_threshold(std::numeric_limits<uint64_t>::max())
+{
+  UTIL_THROW_IF2(bits == 0 || bits > 8, "Scores can be quantized to 1-8 bits, not " << bits);
+}
+
+void ScoreQuantizer::AddSample(uint64_t lineNum, const std::vector<float> &scores)
+{
+  uint64_t hash = util::MurmurHashNative(&lineNum, sizeof(lineNum));
+  if (hash >= m_threshold) {
+    return;
+  }
+
+#ifdef WITH_THREADS
+  boost::mutex::scoped_lock lock(m_mutex);
+#endif
+  if (m_samples.empty()) {
+    m_numScores = scores.size();
+  }
+  UTIL_THROW_IF2(scores.size() != m_numScores,
+                 "Expected " << m_numScores << " scores on line " << lineNum + 1
+                 << ", not " << scores.size());
+
+  Sample sample(hash, scores);
+  for (size_t i = 0; i < sample.second.size(); ++i) {
+    sample.second[i] = ToLog(sample.second[i]);
+  }
+  m_samples.push(sample);
+  if (m_samples.size() > m_sampleSize) {
+    m_samples.pop();
+    m_threshold = m_samples.top().first;
+  }
+}
+
+void ScoreQuantizer::Train()
+{
+  m_centers.resize(m_numScores * m_numCenters);
+
+  std::vector<Sample> samples;
+  samples.reserve(m_samples.size());
+  while (!m_samples.empty()) {
+    samples.push_back(m_samples.top());
+    m_samples.pop();
+  }
+
+  std::vector<float> values(samples.size());
+  for (size_t feature = 0; feature < m_numScores; ++feature) {
+    for (size_t i = 0; i < samples.size(); ++i) {
+      values[i] = samples[i].second[feature];
+    }
+    std::sort(values.begin(), values.end());
+
+    // bins of equal size, centered on their mean. Same as lm/quantize.cc
+    float *centers = &m_centers[feature * m_numCenters];
+    std::vector<float>::const_iterator start = values.begin(), finish;
+    for (size_t i = 0; i < m_numCenters; ++i, start = finish) {
+      finish = values.begin() + (values.size() * (i + 1)) / m_numCenters;
+      if (finish == start) {
+        // zero length bin
+        centers[i] = i ? centers[i - 1] : (values.empty() ? 0 : values.front());
+      } else {
+        centers[i] = std::accumulate(start, finish, 0.0) / (finish - start);
+      }
+    }
+  }
+}
+
+uint8_t ScoreQuantizer::Encode(size_t feature, float score) const
+{
+  score = ToLog(score);
+  const float *begin = &m_centers[feature * m_numCenters];
+  const float *end = begin + m_numCenters;
+
+  // nearest center
+  const float *upper = std::lower_bound(begin, end, score);
+  if (upper == end) {
+    return m_numCenters - 1;
+  }
+  if (upper != begin && score - *(upper - 1) < *upper - score) {
+    --upper;
+  }
+  return upper - begin;
+}
+
+// same as the decoder does to scores of unquantized tables
+float ScoreQuantizer::ToLog(float score) const
+{
+  return m_logProb ? score : Moses2::FloorScore(log(score));
+}
+
+/* format:
+ *   uint32 num scores, uint32 num centers
+ *   float centers, for each feature
+ */
+void ScoreQuantizer::Save(const std::string &path) const
+{
+  std::ofstream out(path.c_str(), std::ios::out | std::ios::binary);
+  UTIL_THROW_IF2(!out.is_open(), "Couldn't open " << path);
+
+  uint32_t numScores = m_numScores, numCenters = m_numCenters;
+  out.write((const char*) &numScores, sizeof(numScores));
+  out.write((const char*) &numCenters, sizeof(numCenters));
+  out.write((const char*) m_centers.data(), m_centers.size() * sizeof(float));
+}
+
+void ScoreQuantizer::Load(const std::string &path, size_t &numCenters,
+                          std::vector<float> &centers)
+{
+  std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+  UTIL_THROW_IF2(!in.is_open(), "Couldn't open " << path);
+
+  uint32_t numScores, numCentersIn;
+  in.read((char*) &numScores, sizeof(numScores));
+  in.read((char*) &numCentersIn, sizeof(numCentersIn));
+  numCenters = numCentersIn;
+
+  centers.resize(numScores * numCenters);
+  in.read((char*) centers.data(), centers.size() * sizeof(float));
+  UTIL_THROW_IF2(!in, "Couldn't read " << path);
+}
+
+}
@@ -0,0 +1,68 @@
+/*
+ * ScoreQuantizer.h
+ *
+ * Per-feature codebooks for storing target phrase scores in 1 byte each,
+ * binned like KenLM's SeparatelyQuantize: each feature's values are split
+ * into bins of equal size and a score is stored as the index of the nearest
+ * bin center.
+ * Codebooks are trained on a sample of the rules. The sample is chosen by a
+ * hash of the line number, so it doesn't depend on the number of threads.
+ * Scores are binned as the floored log probs the decoder uses, so the
+ * centers are log probs whether or not the pt was.
+ */
+#pragma once
+#include <string>
+#include <vector>
+#include <queue>
+#include <atomic>
+#include <limits>
+#include <inttypes.h>
+#ifdef WITH_THREADS
+#include <boost/thread/mutex.hpp>
+#endif
+
+namespace probingpt
+{
+
+class ScoreQuantizer
+{
+public:
+  // logProb: scores given to AddSample() and Encode() are already log probs
+  ScoreQuantizer(size_t bits, bool logProb, size_t sampleSize = 100000);
+
+  // can be called by many threads at once
+  void AddSample(uint64_t lineNum, const std::vector<float> &scores);
+
+  void Train();
+
+  uint8_t Encode(size_t feature, float score) const;
+
+  void Save(const std::string &path) const;
+
+  /** centers of feature i's codebook are centers[i * numCenters ...]
+   */
+  static void Load(const std::string &path, size_t &numCenters,
+                   std::vector<float> &centers);
+
+protected:
+  typedef std::pair<uint64_t, std::vector<float> > Sample;
+
+  size_t m_numCenters;
+  bool m_logProb;
+  size_t m_sampleSize;
+  size_t m_numScores;
+
+  // lines with the smallest hashes
+  std::priority_queue<Sample> m_samples;
+  std::atomic<uint64_t> m_threshold;
+#ifdef WITH_THREADS
+  boost::mutex m_mutex;
+#endif
+
+  std::vector<float> m_centers;
+
+  float ToLog(float score) const;
+};
+
+}
+
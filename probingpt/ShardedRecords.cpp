@@ -0,0 +1,75 @@
+/*
+ * ShardedRecords.cpp
+ */
+#include <algorithm>
+#include <cstring>
+#include "ShardedRecords.h"
+#include "moses2/legacy/Util2.h"
+
+using namespace std;
+
+namespace probingpt
+{
+
+ShardedRecords::ShardedRecords(const std::string &tempPrefix, size_t numShards,
+                               uint64_t maxMemory)
+  :m_tempPrefix(tempPrefix)
+  ,m_shards(numShards)
+  ,m_maxBuffer(std::max<uint64_t>(maxMemory / numShards, 1024 * 1024))
+  ,m_spilled(0)
+{
+  for (size_t i = 0; i < numShards; ++i) {
+    m_shards[i] = new Shard();
+  }
+}
+
+ShardedRecords::~ShardedRecords()
+{
+  Moses2::RemoveAllInColl(m_shards);
+}
+
+void ShardedRecords::Append(size_t shardInd, const std::string &data)
+{
+  Shard &shard = *m_shards[shardInd];
+#ifdef WITH_THREADS
+  boost::mutex::scoped_lock lock(shard.mutex);
+#endif
+  shard.buffer.append(data);
+  if (shard.buffer.size() >= m_maxBuffer) {
+    Spill(shard);
+  }
+}
+
+void ShardedRecords::Spill(Shard &shard)
+{
+  if (shard.file.get() == -1) {
+    shard.file.reset(util::MakeTemp(m_tempPrefix));
+  }
+  util::WriteOrThrow(shard.file.get(), shard.buffer.data(), shard.buffer.size());
+  shard.fileSize += shard.buffer.size();
+
+  m_spilled += shard.buffer.size();
+
+  // give the memory back
+  std::string().swap(shard.buffer);
+}
+
+void ShardedRecords::Load(size_t shardInd, std::string &out)
+{
+  Shard &shard = *m_shards[shardInd];
+
+  out.resize(shard.fileSize + shard.buffer.size());
+  if (shard.fileSize) {
+    util::SeekOrThrow(shard.file.get(), 0);
+    util::ReadOrThrow(shard.file.get(), &out[0], shard.fileSize);
+  }
+  if (shard.buffer.size()) {
+    memcpy(&out[shard.fileSize], shard.buffer.data(), shard.buffer.size());
+  }
+
+  delete m_shards[shardInd];
+  m_shards[shardInd] = new Shard();
+}
+
+}
+
@@ -0,0 +1,70 @@
+/*
+ * ShardedRecords.h
+ *
+ * Records of a phrase table being binarised, partitioned into shards by
+ * source phrase so that each shard can later be loaded, sorted and written
+ * on its own. Shards are kept in memory until they reach their share of the
+ * memory budget, then spilled to a temporary file.
+ */
+#pragma once
+#include <string>
+#include <vector>
+#include <inttypes.h>
+#include <atomic>
+#ifdef WITH_THREADS
+#include <boost/thread/mutex.hpp>
+#endif
+#include "util/file.hh"
+
+namespace probingpt
+{
+
+class ShardedRecords
+{
+public:
+  // temporary files are created then unlinked, with names starting with tempPrefix
+  ShardedRecords(const std::string &tempPrefix, size_t numShards,
+                 uint64_t maxMemory);
+  virtual ~ShardedRecords();
+
+  size_t GetNumShards() const {
+    return m_shards.size();
+  }
+
+  // can be called by many threads at once
+  void Append(size_t shardInd, const std::string &data);
+
+  // number of bytes spilled to disk, over all shards
+  uint64_t GetSpilled() const {
+    return m_spilled;
+  }
+
+  /** All data appended to a shard, in the order it was appended. The shard
+   * is released afterwards. Not thread-safe
+   */
+  void Load(size_t shardInd, std::string &out);
+
+protected:
+  struct Shard {
+#ifdef WITH_THREADS
+    boost::mutex mutex;
+#endif
+    std::string buffer;
+    util::scoped_fd file;
+    uint64_t fileSize;
+
+    Shard()
+      :fileSize(0)
+    {}
+  };
+
+  std::string m_tempPrefix;
+  std::vector<Shard*> m_shards;
+  size_t m_maxBuffer;
+  std::atomic<uint64_t> m_spilled;
+
+  void Spill(Shard &shard);
+};
+
+}
+
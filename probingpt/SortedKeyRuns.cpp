@@ -0,0 +1,93 @@
+/*
+ * SortedKeyRuns.cpp
+ */
+#include <algorithm>
+#include "SortedKeyRuns.h"
+
+using namespace std;
+
+namespace probingpt
+{
+
+namespace
+{
+// keys read at a time from each run
+const size_t RUN_BUFFER = 4096;
+}
+
+SortedKeyRuns::SortedKeyRuns(const std::string &tempPrefix)
+  :m_file(util::MakeTemp(tempPrefix))
+  ,m_size(0)
+  ,m_started(false)
+  ,m_last(0)
+{
+}
+
+void SortedKeyRuns::Append(const std::vector<uint64_t> &keys)
+{
+  if (keys.empty()) {
+    return;
+  }
+  util::WriteOrThrow(m_file.get(), keys.data(), keys.size() * sizeof(uint64_t));
+
+  Run run;
+  run.begin = m_size;
+  run.end = m_size + keys.size();
+  run.offset = run.begin;
+  run.pos = 0;
+  m_runs.push_back(run);
+  m_size += keys.size();
+}
+
+void SortedKeyRuns::Rewind()
+{
+  m_heap = std::priority_queue<Head, std::vector<Head>, std::greater<Head> >();
+  m_started = false;
+
+  for (size_t i = 0; i < m_runs.size(); ++i) {
+    Run &run = m_runs[i];
+    run.buffer.clear();
+    run.offset = run.begin;
+    run.pos = 0;
+    Push(i);
+  }
+}
+
+bool SortedKeyRuns::Push(size_t runInd)
+{
+  Run &run = m_runs[runInd];
+  if (run.pos == run.buffer.size()) {
+    run.offset += run.buffer.size();
+    if (run.offset == run.end) {
+      // finished. Free the buffer
+      std::vector<uint64_t>().swap(run.buffer);
+      run.pos = 0;
+      return false;
+    }
+    run.buffer.resize(std::min<uint64_t>(RUN_BUFFER, run.end - run.offset));
+    util::ErsatzPRead(m_file.get(), run.buffer.data(),
+                      run.buffer.size() * sizeof(uint64_t), run.offset * sizeof(uint64_t));
+    run.pos = 0;
+  }
+  m_heap.push(Head(run.buffer[run.pos++], runInd));
+  return true;
+}
+
+bool SortedKeyRuns::Next(uint64_t &key)
+{
+  while (!m_heap.empty()) {
+    Head head = m_heap.top();
+    m_heap.pop();
+    Push(head.second);
+
+    if (!m_started || head.first != m_last) {
+      m_started = true;
+      m_last = key = head.first;
+      return true;
+    }
+  }
+  return false;
+}
+
+}
+
@@ -0,0 +1,55 @@
+/*
+ * SortedKeyRuns.h
+ *
+ * Sorted runs of 64-bit keys, one per shard, kept in a temporary file. The
+ * runs are read back as a single merged sequence without duplicates, so only
+ * one buffer per run has to be held in memory.
+ */
+#pragma once
+#include <string>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <inttypes.h>
+#include "util/file.hh"
+
+namespace probingpt
+{
+
+class SortedKeyRuns
+{
+public:
+  // the temporary file is created then unlinked, with a name starting with tempPrefix
+  explicit SortedKeyRuns(const std::string &tempPrefix);
+
+  // keys must be sorted and unique
+  void Append(const std::vector<uint64_t> &keys);
+
+  // start reading the merge of all runs. Can be called more than once
+  void Rewind();
+
+  // next key of the merge, each key once. false at the end
+  bool Next(uint64_t &key);
+
+protected:
+  struct Run {
+    uint64_t begin, end; // in keys, within the file
+    uint64_t offset; // of the buffer
+    std::vector<uint64_t> buffer;
+    size_t pos;
+  };
+  typedef std::pair<uint64_t, size_t> Head; // key, run index
+
+  util::scoped_fd m_file;
+  uint64_t m_size;
+  std::vector<Run> m_runs;
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head> > m_heap;
+  bool m_started;
+  uint64_t m_last;
+
+  // advance run to its next key and queue it. false if the run is finished
+  bool Push(size_t runInd);
+};
+
+}
+
@@ -4,12 +4,15 @@
  *  Created on: 19 Jan 2016
  *      Author: hieu
  */
+#include <cstring>
 #include <boost/foreach.hpp>
 #include "StoreTarget.h"
+#include "ScoreQuantizer.h"
 #include "line_splitter.h"
 #include "probing_hash_utils.h"
 #include "OutputFileStream.h"
 #include "moses2/legacy/Util2.h"
+#include "util/exception.hh"
 
 using namespace std;
 
@@ -18,6 +21,7 @@ namespace probingpt
 
 StoreTarget::StoreTarget(const std::string &basepath)
   :m_basePath(basepath)
+  ,m_quantizer(NULL)
   ,m_vocab(basepath + "/TargetVocab.dat")
 {
   std::string path = basepath + "/TargetColl.dat";
@@ -38,6 +42,15 @@ StoreTarget::~StoreTarget()
   m_vocab.Save();
 }
 
+void StoreTarget::SetQuantizer(const ScoreQuantizer &quantizer)
+{
+  m_quantizer = &quantizer;
+
+  std::string path = m_basePath + "/TargetScores.dat";
+  m_fileScores.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  UTIL_THROW_IF2(!m_fileScores.is_open(), "Couldn't create " << path);
+}
+
 uint64_t StoreTarget::Save()
 {
   uint64_t ret = m_fileTargetColl.tellp();
@@ -46,6 +59,12 @@ uint64_t StoreTarget::Save()
   uint64_t numTP = m_coll.size();
   m_fileTargetColl.write((char*) &numTP, sizeof(uint64_t));
 
+  if (m_quantizer) {
+    // where the scores of the target phrases start in the scores column
+    uint64_t scoresPos = m_fileScores.tellp();
+    m_fileTargetColl.write((char*) &scoresPos, sizeof(uint64_t));
+  }
+
   for (size_t i = 0; i < m_coll.size(); ++i) {
     Save(*m_coll[i]);
   }
@@ -61,7 +80,7 @@ uint64_t StoreTarget::Save()
 void StoreTarget::Save(const target_text &rule)
 {
   // metadata for each tp
-  TargetPhraseInfo tpInfo;
+  TargetPhraseInfo tpInfo = TargetPhraseInfo();
   tpInfo.alignTerm = GetAlignId(rule.word_align_term);
   tpInfo.alignNonTerm = GetAlignId(rule.word_align_non_term);
   tpInfo.numWords = rule.target_phrase.size();
@@ -71,9 +90,16 @@ void StoreTarget::Save(const target_text &rule)
   m_fileTargetColl.write((char*) &tpInfo, sizeof(TargetPhraseInfo));
 
   // scores
-  for (size_t i = 0; i < rule.prob.size(); ++i) {
-    float prob = rule.prob[i];
-    m_fileTargetColl.write((char*) &prob, sizeof(prob));
+  if (m_quantizer) {
+    for (size_t i = 0; i < rule.prob.size(); ++i) {
+      uint8_t code = m_quantizer->Encode(i, rule.prob[i]);
+      m_fileScores.write((char*) &code, sizeof(code));
+    }
+  } else {
+    for (size_t i = 0; i < rule.prob.size(); ++i) {
+      float prob = rule.prob[i];
+      m_fileTargetColl.write((char*) &prob, sizeof(prob));
+    }
   }
 
   // tp
@@ -103,13 +129,62 @@ void StoreTarget::SaveAlignment()
 
 }
 
+namespace
+{
+template<typename T>
+void WriteVal(std::string &out, const T &val)
+{
+  out.append((const char*) &val, sizeof(T));
+}
+
+template<typename T>
+T ReadVal(const char *&data)
+{
+  T ret;
+  memcpy(&ret, data, sizeof(T));
+  data += sizeof(T);
+  return ret;
+}
+
+void WriteAlign(std::string &out, const std::vector<size_t> &align)
+{
+  WriteVal<uint32_t>(out, align.size());
+  for (size_t i = 0; i < align.size(); ++i) {
+    WriteVal<uint32_t>(out, align[i]);
+  }
+}
+
+void ReadAlign(const char *&data, std::vector<size_t> &align)
+{
+  uint32_t size = ReadVal<uint32_t>(data);
+  align.resize(size);
+  for (size_t i = 0; i < size; ++i) {
+    align[i] = ReadVal<uint32_t>(data);
+  }
+}
+}
+
 void StoreTarget::Append(const line_text &line, bool log_prob, bool scfg)
 {
-  target_text *rule = new target_text;
-  //cerr << "line.target_phrase=" << line.target_phrase << endl;
+  std::string record;
+  Parse(line, log_prob, scfg, record);
+  AppendParsed(record.data(), record.size());
+}
+
+/* record format:
+ *   uint32 num scores, float scores
+ *   uint32 num terminal alignment points, uint32 points
+ *   uint32 num non-terminal alignment points, uint32 points
+ *   uint32 num target factors, for each: uint32 length, chars
+ */
+void StoreTarget::Parse(const line_text &line, bool log_prob, bool scfg,
+                        std::string &out)
+{
+  out.clear();
 
   // target_phrase
   vector<bool> nonTerms;
+  vector<StringPiece> factors;
   util::TokenIter<util::SingleCharacter> it;
   it = util::TokenIter<util::SingleCharacter>(line.target_phrase,
        util::SingleCharacter(' '));
@@ -131,13 +206,7 @@ void StoreTarget::Append(const line_text &line, bool log_prob, bool scfg)
     itFactor = util::TokenIter<util::SingleCharacter>(word,
                util::SingleCharacter('|'));
     while (itFactor) {
-      StringPiece factor = *itFactor;
-
-      string factorStr = factor.as_string();
-      uint32_t vocabId = m_vocab.GetVocabId(factorStr);
-
-      rule->target_phrase.push_back(vocabId);
-
+      factors.push_back(*itFactor);
       itFactor++;
     }
 
@@ -145,6 +214,7 @@ void StoreTarget::Append(const line_text &line, bool log_prob, bool scfg)
   }
 
   // probs
+  vector<float> probs;
   it = util::TokenIter<util::SingleCharacter>(line.prob,
        util::SingleCharacter(' '));
   while (it) {
@@ -156,19 +226,12 @@ void StoreTarget::Append(const line_text &line, bool log_prob, bool scfg)
       if (prob == 0.0f) prob = 0.0000000001;
     }
 
-    rule->prob.push_back(prob);
+    probs.push_back(prob);
     it++;
   }
 
-  /*
-  cerr << "nonTerms=";
-  for (size_t i = 0; i < nonTerms.size(); ++i) {
-    cerr << nonTerms[i] << " ";
-  }
-  cerr << endl;
-  */
-
   // alignment
+  vector<size_t> alignTerm, alignNonTerm;
   it = util::TokenIter<util::SingleCharacter>(line.word_align,
        util::SingleCharacter(' '));
   while (it) {
@@ -190,12 +253,11 @@ void StoreTarget::Append(const line_text &line, bool log_prob, bool scfg)
     //cerr << targetPos << "=" << nonTerm << endl;
 
     if (nonTerm) {
-      rule->word_align_non_term.push_back(sourcePos);
-      rule->word_align_non_term.push_back(targetPos);
-      //cerr << (int) rule->word_all1.back() << " ";
+      alignNonTerm.push_back(sourcePos);
+      alignNonTerm.push_back(targetPos);
     } else {
-      rule->word_align_term.push_back(sourcePos);
-      rule->word_align_term.push_back(targetPos);
+      alignTerm.push_back(sourcePos);
+      alignTerm.push_back(targetPos);
     }
 
     it++;
@@ -203,7 +265,7 @@ void StoreTarget::Append(const line_text &line, bool log_prob, bool scfg)
 
   // extra scores
   string prop = line.property.as_string();
-  AppendLexRO(prop, rule->prob, log_prob);
+  AppendLexRO(prop, probs, log_prob);
 
   //cerr << "line.property=" << line.property << endl;
   //cerr << "prop=" << prop << endl;
@@ -214,9 +276,59 @@ void StoreTarget::Append(const line_text &line, bool log_prob, bool scfg)
    rule->property.push_back(prop[i]);
    }
    */
+
+  WriteVal<uint32_t>(out, probs.size());
+  for (size_t i = 0; i < probs.size(); ++i) {
+    WriteVal<float>(out, probs[i]);
+  }
+
+  WriteAlign(out, alignTerm);
+  WriteAlign(out, alignNonTerm);
+
+  WriteVal<uint32_t>(out, factors.size());
+  for (size_t i = 0; i < factors.size(); ++i) {
+    WriteVal<uint32_t>(out, factors[i].size());
+    out.append(factors[i].data(), factors[i].size());
+  }
+}
+
+void StoreTarget::AppendParsed(const char *data, size_t size)
+{
+  const char *end = data + size;
+  target_text *rule = new target_text;
+
+  uint32_t numScores = ReadVal<uint32_t>(data);
+  rule->prob.resize(numScores);
+  for (size_t i = 0; i < numScores; ++i) {
+    rule->prob[i] = ReadVal<float>(data);
+  }
+
+  ReadAlign(data, rule->word_align_term);
+  ReadAlign(data, rule->word_align_non_term);
+
+  uint32_t numFactors = ReadVal<uint32_t>(data);
+  rule->target_phrase.resize(numFactors);
+  for (size_t i = 0; i < numFactors; ++i) {
+    uint32_t len = ReadVal<uint32_t>(data);
+    string factorStr(data, len);
+    data += len;
+
+    rule->target_phrase[i] = m_vocab.GetVocabId(factorStr);
+  }
+  UTIL_THROW_IF2(data != end, "Corrupt target phrase record");
+
   m_coll.push_back(rule);
 }
 
+void StoreTarget::GetScores(const char *data, std::vector<float> &scores)
+{
+  uint32_t numScores = ReadVal<uint32_t>(data);
+  scores.resize(numScores);
+  for (size_t i = 0; i < numScores; ++i) {
+    scores[i] = ReadVal<float>(data);
+  }
+}
+
 uint32_t StoreTarget::GetAlignId(const std::vector<size_t> &align)
 {
   boost::unordered_map<std::vector<size_t>, uint32_t>::iterator iter =
@@ -231,7 +343,7 @@ uint32_t StoreTarget::GetAlignId(const std::vector<size_t> &align)
 }
 
 void StoreTarget::AppendLexRO(std::string &prop, std::vector<float> &retvector,
-                              bool log_prob) const
+                              bool log_prob)
 {
   size_t startPos = prop.find("{{LexRO ");
 
@@ -18,6 +18,7 @@ namespace probingpt
 
 class line_text;
 class target_text;
+class ScoreQuantizer;
 
 class StoreTarget
 {
@@ -28,10 +29,28 @@ public:
   uint64_t Save();
   void SaveAlignment();
 
+  /** Store scores quantized in a separate column, TargetScores.dat, rather
+   * than as floats with each target phrase. Call before the 1st Save()
+   */
+  void SetQuantizer(const ScoreQuantizer &quantizer);
+
   void Append(const line_text &line, bool log_prob, bool scfg);
+
+  /** Parse the target side of a line into a compact binary record which
+   * AppendParsed() can read. Doesn't touch the vocab so it can be called by
+   * many threads at once.
+   */
+  static void Parse(const line_text &line, bool log_prob, bool scfg,
+                    std::string &out);
+  void AppendParsed(const char *data, size_t size);
+
+  // scores of a record from Parse(), including lexicalized reordering scores
+  static void GetScores(const char *data, std::vector<float> &scores);
 protected:
   std::string m_basePath;
   std::fstream m_fileTargetColl;
+  const ScoreQuantizer *m_quantizer;
+  std::ofstream m_fileScores;
   StoreVocab<uint32_t> m_vocab;
 
   typedef boost::unordered_map<std::vector<size_t>, uint32_t> Alignments;
@@ -42,8 +61,8 @@ protected:
   uint32_t GetAlignId(const std::vector<size_t> &align);
   void Save(const target_text &rule);
 
-  void AppendLexRO(std::string &prop, std::vector<float> &retvector,
-                   bool log_prob) const;
+  static void AppendLexRO(std::string &prop, std::vector<float> &retvector,
+                          bool log_prob);
 
 };
 
@@ -0,0 +1,54 @@
+#define BOOST_TEST_MODULE TableConfig
+#include <boost/test/unit_test.hpp>
+
+#include <sstream>
+
+#include "querying.h"
+#include "util/exception.hh"
+
+using namespace probingpt;
+
+BOOST_AUTO_TEST_CASE(current_version)
+{
+  std::istringstream in("API_VERSION\t16\nuniq_entries\t100\nnum_scores\t4\nnum_lex_scores\t0\n"
+                        "log_prob\t1\nsorted\t1\nprefixes\t1\nquantized\t8\n");
+  TableConfig config;
+  config.Load(in);
+  BOOST_CHECK_EQUAL(16, config.version);
+  BOOST_CHECK_EQUAL(100, config.uniq_entries);
+  BOOST_CHECK_EQUAL(4, config.num_scores);
+  BOOST_CHECK_EQUAL(0, config.num_lex_scores);
+  BOOST_CHECK(config.logProb);
+  BOOST_CHECK(config.sorted);
+  BOOST_CHECK(config.prefixes);
+  BOOST_CHECK_EQUAL(8U, config.quantized);
+}
+
+// Written by CreateProbingPT before the prefix entries, ranking and quantization.
+BOOST_AUTO_TEST_CASE(version_15)
+{
+  std::istringstream in("API_VERSION\t15\nuniq_entries\t100\nnum_scores\t4\nnum_lex_scores\t6\nlog_prob\t0\n");
+  TableConfig config;
+  config.Load(in);
+  BOOST_CHECK_EQUAL(15, config.version);
+  BOOST_CHECK_EQUAL(100, config.uniq_entries);
+  BOOST_CHECK_EQUAL(4, config.num_scores);
+  BOOST_CHECK_EQUAL(6, config.num_lex_scores);
+  BOOST_CHECK(!config.logProb);
+  BOOST_CHECK(!config.sorted);
+  BOOST_CHECK(!config.prefixes);
+  BOOST_CHECK_EQUAL(0U, config.quantized);
+}
+
+BOOST_AUTO_TEST_CASE(unsupported_version)
+{
+  std::istringstream old("API_VERSION\t14\nuniq_entries\t100\nnum_scores\t4\nnum_lex_scores\t0\nlog_prob\t1\n");
+  TableConfig config;
+  BOOST_CHECK_THROW(config.Load(old), util::Exception);
+
+  std::istringstream newer("API_VERSION\t17\nuniq_entries\t100\nnum_scores\t4\nnum_lex_scores\t0\nlog_prob\t1\n");
+  BOOST_CHECK_THROW(config.Load(newer), util::Exception);
+
+  std::istringstream missing("uniq_entries\t100\nnum_scores\t4\nnum_lex_scores\t0\nlog_prob\t1\n");
+  BOOST_CHECK_THROW(config.Load(missing), util::Exception);
+}
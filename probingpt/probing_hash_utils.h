@@ -14,7 +14,9 @@
 namespace probingpt
 {
 
-#define API_VERSION 15
+#define API_VERSION 16
+// tables of this version or newer can still be loaded
+#define OLDEST_API_VERSION 15
 
 //Hash table entry
 struct Entry {
@@ -1,4 +1,5 @@
 #include "querying.h"
+#include "ScoreQuantizer.h"
 #include "util/exception.hh"
 #include "moses2/legacy/Util2.h"
 #include <unordered_map>
@@ -8,32 +9,30 @@ using namespace std;
 namespace probingpt
 {
 
-QueryEngine::QueryEngine(const char * filepath, util::LoadMethod load_method)
+namespace
 {
+template<typename T>
+bool Get(const std::unordered_map<std::string, std::string> &keyValue, const std::string &sought, T &found)
+{
+  std::unordered_map<std::string, std::string>::const_iterator iter = keyValue.find(sought);
+  if (iter == keyValue.end()) {
+    return false;
+  }
+  found = Scan<T>(iter->second);
+  return true;
+}
 
-  //Create filepaths
-  std::string basepath(filepath);
-  std::string path_to_config = basepath + "/config";
-  std::string path_to_hashtable = basepath + "/probing_hash.dat";
-  std::string path_to_source_vocabid = basepath + "/source_vocabids";
-  std::string alignPath = basepath + "/Alignments.dat";
-
-  file_exits(basepath);
-
-  ///Source phrase vocabids
-  read_map(source_vocabids, path_to_source_vocabid.c_str());
-
-  // alignments
-  read_alignments(alignPath);
-
-  // target phrase
-  string targetCollPath = basepath + "/TargetColl.dat";
-  memTPS = readTable(targetCollPath.c_str(), load_method, fileTPS_, memoryTPS_);
+template<typename T>
+void GetRequired(const std::unordered_map<std::string, std::string> &keyValue, const std::string &sought, T &found)
+{
+  UTIL_THROW_IF2(!Get(keyValue, sought, found), sought << " not found in the config");
+}
+}
 
-  //Read config file
+void TableConfig::Load(std::istream &config)
+{
   std::unordered_map<std::string, std::string> keyValue;
 
-  std::ifstream config(path_to_config.c_str());
   std::string line;
   while (getline(config, line)) {
     std::vector<std::string> toks = Moses2::Tokenize(line, "\t");
@@ -41,51 +40,92 @@ QueryEngine::QueryEngine(const char * filepath, util::LoadMethod load_method)
     keyValue[ toks[0] ] = toks[1];
   }
 
-  bool found;
   //Check API version:
-  int version;
-  found = Get(keyValue, "API_VERSION", version);
-  if (!found) {
-    std::cerr << "Old or corrupted version of ProbingPT. Please rebinarize your phrase tables." << std::endl;
-  } else if (version != API_VERSION) {
-    std::cerr << "The ProbingPT API has changed. " << version << "!="
-              << API_VERSION << " Please rebinarize your phrase tables." << std::endl;
-    exit(EXIT_FAILURE);
+  UTIL_THROW_IF2(!Get(keyValue, "API_VERSION", version),
+                 "Old or corrupted version of ProbingPT. Please rebinarize your phrase tables.");
+  UTIL_THROW_IF2(version < OLDEST_API_VERSION || version > API_VERSION,
+                 "The ProbingPT API has changed. " << version << " isn't in "
+                 << OLDEST_API_VERSION << "-" << API_VERSION << " Please rebinarize your phrase tables.");
+
+  GetRequired(keyValue, "uniq_entries", uniq_entries);
+  GetRequired(keyValue, "num_scores", num_scores);
+  GetRequired(keyValue, "num_lex_scores", num_lex_scores);
+  // have the scores been log() and FloorScore()?
+  GetRequired(keyValue, "log_prob", logProb);
+
+  sorted = false;
+  prefixes = false;
+  quantized = 0;
+  if (version < 16) {
+    // tables binarized before target phrases were ranked, before phrase-based
+    // prefixes were stored and before quantization
+    return;
   }
+  Get(keyValue, "sorted", sorted);
+  Get(keyValue, "prefixes", prefixes);
+  Get(keyValue, "quantized", quantized);
+}
 
-  //Get tablesize.
-  int tablesize;
-  found = Get(keyValue, "uniq_entries", tablesize);
-  if (!found) {
-    std::cerr << "uniq_entries not found" << std::endl;
-    exit(EXIT_FAILURE);
-  }
+QueryEngine::QueryEngine(const char * filepath, util::LoadMethod load_method)
+{
 
-  //Number of scores
-  found = Get(keyValue, "num_scores", num_scores);
-  if (!found) {
-    std::cerr << "num_scores not found" << std::endl;
-    exit(EXIT_FAILURE);
-  }
+  //Create filepaths
+  std::string basepath(filepath);
+  std::string path_to_config = basepath + "/config";
+  std::string path_to_hashtable = basepath + "/probing_hash.dat";
+  std::string path_to_source_vocabid = basepath + "/source_vocabids";
+  std::string alignPath = basepath + "/Alignments.dat";
 
-  //How may scores from lex reordering models
-  found = Get(keyValue, "num_lex_scores", num_lex_scores);
-  if (!found) {
-    std::cerr << "num_lex_scores not found" << std::endl;
-    exit(EXIT_FAILURE);
-  }
+  file_exits(basepath);
 
-  // have the scores been log() and FloorScore()?
-  found = Get(keyValue, "log_prob", logProb);
-  if (!found) {
-    std::cerr << "logProb not found" << std::endl;
-    exit(EXIT_FAILURE);
+  // vocabs & alignments. Older pts only have them as text
+  if (Moses2::FileExists(basepath + "/SourceVocab.bin")) {
+    sourceVocab_.Load(basepath + "/SourceVocab.bin", load_method);
+    targetVocab_.Load(basepath + "/TargetVocab.bin", load_method);
+    alignColl_.Load(basepath + "/Alignments.bin", load_method);
+  } else {
+    MappedColl::Coll coll;
+    readVocab(coll, path_to_source_vocabid);
+    sourceVocab_.Create(coll);
+
+    coll.clear();
+    readVocab(coll, basepath + "/TargetVocab.dat");
+    targetVocab_.Create(coll);
+
+    coll.clear();
+    readAlignments(coll, alignPath);
+    alignColl_.Create(coll);
   }
 
-  config.close();
+  // target phrase
+  string targetCollPath = basepath + "/TargetColl.dat";
+  memTPS = readTable(targetCollPath.c_str(), load_method, fileTPS_, memoryTPS_);
+
+  //Read config file
+  std::ifstream configFile(path_to_config.c_str());
+  TableConfig config;
+  config.Load(configFile);
+  num_scores = config.num_scores;
+  num_lex_scores = config.num_lex_scores;
+  logProb = config.logProb;
+  sorted = config.sorted;
+  prefixes = config.prefixes;
+
+  // scores stored as codebook indices in their own column
+  memScores = NULL;
+  numCenters = 0;
+  if (config.quantized) {
+    ScoreQuantizer::Load(basepath + "/Quantization.dat", numCenters, centers);
+    UTIL_THROW_IF2(centers.size() != numCenters * (num_scores + num_lex_scores),
+                   "Codebooks don't match the number of scores");
+
+    string scoresPath = basepath + "/TargetScores.dat";
+    memScores = (const uint8_t*) readTable(scoresPath.c_str(), load_method,
+                                           fileScores_, memoryScores_);
+  }
 
   //Read hashtable
-  table_filesize = Table::Size(tablesize, 1.2);
+  table_filesize = Table::Size(config.uniq_entries, 1.2);
   mem = readTable(path_to_hashtable.c_str(), load_method, file_, memory_);
   Table table_init(mem, table_filesize);
   table = table_init;
@@ -119,28 +159,6 @@ std::pair<bool, uint64_t> QueryEngine::query(uint64_t key)
   return ret;
 }
 
-void QueryEngine::read_alignments(const std::string &alignPath)
-{
-  std::ifstream strm(alignPath.c_str());
-
-  string line;
-  while (getline(strm, line)) {
-    vector<string> toks = Moses2::Tokenize(line, "\t ");
-    UTIL_THROW_IF2(toks.size() == 0, "Corrupt alignment file");
-
-    uint32_t alignInd = Moses2::Scan<uint32_t>(toks[0]);
-    if (alignInd >= alignColl.size()) {
-      alignColl.resize(alignInd + 1);
-    }
-
-    Alignments &aligns = alignColl[alignInd];
-    for (size_t i = 1; i < toks.size(); ++i) {
-      size_t pos = Moses2::Scan<size_t>(toks[i]);
-      aligns.push_back(pos);
-    }
-  }
-}
-
 void QueryEngine::file_exits(const std::string &basePath)
 {
   if (!Moses2::FileExists(basePath + "/Alignments.dat")) {
@@ -6,6 +6,7 @@
 #include <algorithm> //toLower
 #include <deque>
 #include "vocabid.h"
+#include "MappedColl.h"
 #include "probing_hash_utils.h"
 #include "hash.h" //Includes line splitter
 #include "line_splitter.h"
@@ -15,12 +16,27 @@
 namespace probingpt
 {
 
+//! contents of the config file of a binarized table
+struct TableConfig {
+  int version;
+  int uniq_entries;
+  int num_scores;
+  int num_lex_scores;
+  bool logProb;
+  bool sorted;
+  bool prefixes;
+  size_t quantized; // bits per score, 0 if not quantized
+
+  //! throws if a key is missing or the table is too old or too new
+  void Load(std::istream &config);
+};
+
 class QueryEngine
 {
-  std::map<uint64_t, std::string> source_vocabids;
-
-  typedef std::vector<unsigned char> Alignments;
-  std::vector<Alignments> alignColl;
+  // mmapped from the .bin files if the pt has them, otherwise read from the text files
+  MappedColl sourceVocab_;
+  MappedColl targetVocab_;
+  MappedColl alignColl_; // alignment points, 1 byte each
 
   Table table;
   char *mem; //Memory for the table, necessary so that we can correctly destroy the object
@@ -37,42 +53,58 @@ class QueryEngine
   util::scoped_fd fileTPS_;
   util::scoped_memory memoryTPS_;
 
-  void read_alignments(const std::string &alignPath);
+  // quantized scores column
+  util::scoped_fd fileScores_;
+  util::scoped_memory memoryScores_;
+
   void file_exits(const std::string &basePath);
 
 public:
   int num_scores;
   int num_lex_scores;
   bool logProb;
+  bool sorted; // target phrases of each source phrase are stored best first
+  bool prefixes; // every prefix of a source phrase is in the table, phrase-based too
   const char *memTPS;
 
+  // quantized tables only. NULL otherwise
+  const uint8_t *memScores;
+  size_t numCenters;
+  std::vector<float> centers; // codebook of score i is centers[i * numCenters ...]
+
   QueryEngine(const char *, util::LoadMethod load_method);
   ~QueryEngine();
 
   std::pair<bool, uint64_t> query(uint64_t key);
 
-  const std::map<uint64_t, std::string> &getSourceVocab() const {
-    return source_vocabids;
+  //! bring the hash bucket of key into cache, before it's queried
+  void prefetch(uint64_t key) const {
+    table.Prefetch(key);
   }
 
-  const std::vector<Alignments> &getAlignments() const {
-    return alignColl;
+  //! bring the start of a target phrase collection into cache, before it's read
+  void prefetchTargets(uint64_t offset) const {
+#if defined(__GNUC__)
+    __builtin_prefetch(memTPS + offset);
+#endif
   }
 
-  uint64_t getKey(uint64_t source_phrase[], size_t size) const;
+  //! probing id & word
+  const MappedColl &getSourceVocab() const {
+    return sourceVocab_;
+  }
 
-  template<typename T>
-  inline bool Get(const std::unordered_map<std::string, std::string> &keyValue, const std::string &sought, T &found) const {
-    std::unordered_map<std::string, std::string>::const_iterator iter = keyValue.find(sought);
-    if (iter == keyValue.end()) {
-      return false;
-    }
+  //! target vocab id & word
+  const MappedColl &getTargetVocab() const {
+    return targetVocab_;
+  }
 
-    const std::string &foundStr = iter->second;
-    found = Scan<T>(foundStr);
-    return true;
+  //! alignment id & its source/target position pairs
+  const MappedColl &getAlignments() const {
+    return alignColl_;
   }
 
+  uint64_t getKey(uint64_t source_phrase[], size_t size) const;
 };
 
 }
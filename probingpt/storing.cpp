@@ -1,229 +1,416 @@
 #include <sys/stat.h>
-#include <boost/foreach.hpp>
+#include <algorithm>
+#include <cstring>
+#include <boost/scoped_ptr.hpp>
+#ifdef WITH_THREADS
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include "util/pcqueue.hh"
+#endif
 #include "line_splitter.h"
 #include "storing.h"
 #include "StoreTarget.h"
 #include "StoreVocab.h"
+#include "ShardedRecords.h"
+#include "SortedKeyRuns.h"
+#include "ScoreQuantizer.h"
 #include "moses2/legacy/Util2.h"
 #include "InputFileStream.h"
+#include "util/mmap.hh"
+#include "util/usage.hh"
+#include "util/ersatz_progress.hh"
+#include "util/exception.hh"
 
 using namespace std;
 
 namespace probingpt
 {
 
-///////////////////////////////////////////////////////////////////////
-void Node::Add(Table &table, const SourcePhrase &sourcePhrase, size_t pos)
+namespace
 {
-  if (pos < sourcePhrase.size()) {
-    uint64_t vocabId = sourcePhrase[pos];
-
-    Node *child;
-    Children::iterator iter = m_children.find(vocabId);
-    if (iter == m_children.end()) {
-      // New node. Write other children then discard them
-      BOOST_FOREACH(Children::value_type &valPair, m_children) {
-        Node &otherChild = valPair.second;
-        otherChild.Write(table);
-      }
-      m_children.clear();
-
-      // create new node
-      child = &m_children[vocabId];
-      assert(!child->done);
-      child->key = key + (vocabId << pos);
-    } else {
-      child = &iter->second;
+// 1 per phrase table line. Followed by the source phrase, then the target
+// record from StoreTarget::Parse()
+struct RecordHeader {
+  uint64_t key;
+  uint64_t lineNum;
+  float count; // source count for the cache. < 0 if none
+  uint32_t sourceSize;
+  uint32_t targetSize;
+};
+
+struct Record {
+  RecordHeader header;
+  StringPiece source;
+  const char *target;
+
+  // group by source phrase, keep the order of the input within a group
+  bool operator<(const Record &other) const {
+    if (header.key != other.header.key) {
+      return header.key < other.header.key;
+    }
+    int cmp = source.compare(other.source);
+    if (cmp) {
+      return cmp < 0;
     }
+    return header.lineNum < other.header.lineNum;
+  }
+};
+
+struct Batch {
+  uint64_t firstLineNum;
+  std::vector<std::string> lines;
+};
+
+const size_t BATCH_SIZE = 10000;
+
+float GetCount(const StringPiece &counts)
+{
+  std::string countStr = Moses2::Trim(counts.as_string());
+  if (!countStr.empty()) {
+    std::vector<float> toks = Moses2::Tokenize<float>(countStr);
+    if (toks.size() >= 2) {
+      return toks[1];
+    }
+  }
+  return -1;
+}
+
+void ParseBatch(const Batch &batch, ShardedRecords &shards, bool log_prob,
+                bool scfg, ScoreQuantizer *quantizer,
+                std::vector<std::string> &shardBuffers)
+{
+  std::string target;
+  std::vector<float> scores;
+  for (size_t i = 0; i < batch.lines.size(); ++i) {
+    line_text line = splitLine(batch.lines[i], scfg);
+    StoreTarget::Parse(line, log_prob, scfg, target);
+
+    RecordHeader header;
+    header.key = getKey(getVocabIDs(line.source_phrase));
+    header.lineNum = batch.firstLineNum + i;
+    header.count = GetCount(line.counts);
+    header.sourceSize = line.source_phrase.size();
+    header.targetSize = target.size();
+
+    if (quantizer) {
+      StoreTarget::GetScores(target.data(), scores);
+      quantizer->AddSample(header.lineNum, scores);
+    }
+
+    std::string &out = shardBuffers[header.key % shards.GetNumShards()];
+    out.append((const char*) &header, sizeof(RecordHeader));
+    out.append(line.source_phrase.data(), line.source_phrase.size());
+    out.append(target);
+  }
+
+  for (size_t i = 0; i < shardBuffers.size(); ++i) {
+    if (!shardBuffers[i].empty()) {
+      shards.Append(i, shardBuffers[i]);
+      shardBuffers[i].clear();
+    }
+  }
+}
+
+#ifdef WITH_THREADS
+void ParseBatches(util::PCQueue<Batch*> *queue, ShardedRecords *shards,
+                  bool log_prob, bool scfg, ScoreQuantizer *quantizer)
+{
+  std::vector<std::string> shardBuffers(shards->GetNumShards());
+  Batch *batch;
+  while (queue->Consume(batch)) {
+    ParseBatch(*batch, *shards, log_prob, scfg, quantizer, shardBuffers);
+    delete batch;
+  }
+}
+#endif
 
-    child->Add(table, sourcePhrase, pos + 1);
-  } else {
-    // this node was written previously 'cos it has rules
-    done = true;
+void ReadRecords(const std::string &data, std::vector<Record> &records)
+{
+  records.clear();
+  const char *curr = data.data(), *end = data.data() + data.size();
+  while (curr < end) {
+    Record record;
+    memcpy(&record.header, curr, sizeof(RecordHeader));
+    curr += sizeof(RecordHeader);
+    record.source = StringPiece(curr, record.header.sourceSize);
+    curr += record.header.sourceSize;
+    record.target = curr;
+    curr += record.header.targetSize;
+
+    records.push_back(record);
   }
 }
 
-void Node::Write(Table &table)
+// weighted sum of the log phrase table scores
+float GetRankScore(const Record &record, const std::vector<float> &weights,
+                   size_t numScores, bool log_prob, std::vector<float> &scores)
 {
-  //cerr << "START write " << done << " " << key << endl;
-  BOOST_FOREACH(Children::value_type &valPair, m_children) {
-    Node &child = valPair.second;
-    child.Write(table);
+  StoreTarget::GetScores(record.target, scores);
+
+  float ret = 0;
+  for (size_t i = 0; i < numScores && i < scores.size(); ++i) {
+    float score = log_prob ? scores[i] : Moses2::FloorScore(log(scores[i]));
+    ret += (weights.empty() ? 1.0f : weights[i]) * score;
   }
+  return ret;
+}
 
-  if (!done) {
-    // save
-    Entry sourceEntry;
-    sourceEntry.value = NONE;
-    sourceEntry.key = key;
+bool BetterRank(const std::pair<float, size_t> &a, const std::pair<float, size_t> &b)
+{
+  return a.first > b.first;
+}
 
-    //Put into table
-    table.Insert(sourceEntry);
+// shard size estimated from the input size. Compressed input, ~4x bigger
+size_t GetNumShards(const std::string &path, uint64_t maxMemory)
+{
+  util::scoped_fd file(util::OpenReadOrThrow(path.c_str()));
+  uint64_t size = util::SizeFile(file.get());
+  if (size == util::kBadSize) {
+    return 64;
+  }
+  if (path.size() > 3 && path.substr(path.size() - 3) == ".gz") {
+    size *= 4;
   }
+  uint64_t shardSize = std::max<uint64_t>(maxMemory / 2, 1);
+  return std::max<uint64_t>(1, (size + shardSize - 1) / shardSize);
+}
+
 }
 
 ///////////////////////////////////////////////////////////////////////
 void createProbingPT(const std::string &phrasetable_path,
                      const std::string &basepath, int num_scores, int num_lex_scores,
-                     bool log_prob, int max_cache_size, bool scfg)
+                     bool log_prob, int max_cache_size, bool scfg,
+                     size_t numThreads, size_t numShards,
+                     uint64_t maxMemory, const std::string &tempDir,
+                     const std::vector<float> &weights, size_t quantizeBits)
 {
 #if defined(_WIN32) || defined(_WIN64)
   std::cerr << "Create not implemented for Windows" << std::endl;
 #else
   std::cerr << "Starting..." << std::endl;
 
+  UTIL_THROW_IF2(!weights.empty() && weights.size() != (size_t) num_scores,
+                 "Need " << num_scores << " weights to rank target phrases, not " << weights.size());
+
   //Get basepath and create directory if missing
   mkdir(basepath.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
 
-  StoreTarget storeTarget(basepath);
+  std::string tempPrefix = (tempDir.empty() ? basepath : tempDir) + "/probingpt.tmp.";
+  if (numShards == 0) {
+    numShards = GetNumShards(phrasetable_path, maxMemory);
+  }
+  numThreads = std::max<size_t>(numThreads, 1);
+  std::cerr << "Using " << numThreads << " threads, " << numShards << " shards" << std::endl;
 
-  //Get uniq lines:
-  unsigned long uniq_entries = countUniqueSource(phrasetable_path);
+  ShardedRecords shards(tempPrefix, numShards, maxMemory);
 
-  //Source phrase vocabids
-  StoreVocab<uint64_t> sourceVocab(basepath + "/source_vocabids");
+  // codebooks are trained on a sample of the lines while they're parsed
+  boost::scoped_ptr<ScoreQuantizer> quantizer;
+  if (quantizeBits) {
+    quantizer.reset(new ScoreQuantizer(quantizeBits, log_prob));
+  }
 
-  //Read the file
-  util::FilePiece filein(phrasetable_path.c_str());
+  // 1. parse lines in parallel, partition them by source phrase
+  double startTime = util::WallTime();
+  uint64_t line_num = 0, bytesRead = 0;
+  {
+    util::FilePiece filein(phrasetable_path.c_str(), &std::cerr);
+
+#ifdef WITH_THREADS
+    util::PCQueue<Batch*> queue(numThreads * 2);
+    boost::thread_group threads;
+    for (size_t i = 0; i < numThreads; ++i) {
+      threads.create_thread(boost::bind(&ParseBatches, &queue, &shards, log_prob, scfg,
+                                        quantizer.get()));
+    }
+#else
+    std::vector<std::string> shardBuffers(numShards);
+#endif
 
-  //Init the probing hash table
-  size_t size = Table::Size(uniq_entries, 1.2);
-  char * mem = new char[size];
-  memset(mem, 0, size);
-  Table sourceEntries(mem, size);
+    Batch *batch = new Batch();
+    batch->firstLineNum = 0;
+    StringPiece lineStr;
+    while (filein.ReadLineOrEOF(lineStr)) {
+      batch->lines.push_back(lineStr.as_string());
+      bytesRead += lineStr.size() + 1;
+      ++line_num;
 
-  std::priority_queue<CacheItem*, std::vector<CacheItem*>, CacheItemOrderer> cache;
-  float totalSourceCount = 0;
+      if (batch->lines.size() == BATCH_SIZE) {
+#ifdef WITH_THREADS
+        queue.Produce(batch);
+#else
+        ParseBatch(*batch, shards, log_prob, scfg, quantizer.get(), shardBuffers);
+        delete batch;
+#endif
+        batch = new Batch();
+        batch->firstLineNum = line_num;
+      }
+    }
 
-  //Keep track of the size of each group of target phrases
-  size_t line_num = 0;
+#ifdef WITH_THREADS
+    queue.Produce(batch);
+    for (size_t i = 0; i < numThreads; ++i) {
+      queue.Produce(NULL);
+    }
+    threads.join_all();
+#else
+    ParseBatch(*batch, shards, log_prob, scfg, quantizer.get(), shardBuffers);
+    delete batch;
+#endif
+  }
 
-  //Read everything and processs
-  std::string prevSource;
+  double elapsed = std::max(util::WallTime() - startTime, 1e-6);
+  std::cerr << "Parsed " << line_num << " lines in " << elapsed << "s ("
+            << (uint64_t) (line_num / elapsed) << " lines/s, "
+            << (bytesRead / elapsed / 1048576) << " MB/s). Spilled "
+            << (shards.GetSpilled() / 1048576) << " MB to disk" << std::endl;
 
-  Node sourcePhrases;
-  sourcePhrases.done = true;
-  sourcePhrases.key = 0;
+  // 2. sort each shard by source phrase, write target phrases
+  startTime = util::WallTime();
 
-  while (true) {
-    try {
-      //Process line read
-      line_text line;
-      line = splitLine(filein.ReadLine(), scfg);
-      //cerr << "line=" << line.source_phrase << endl;
+  StoreTarget storeTarget(basepath);
+  if (quantizer) {
+    quantizer->Train();
+    quantizer->Save(basepath + "/Quantization.dat");
+    storeTarget.SetQuantizer(*quantizer);
+  }
+  StoreVocab<uint64_t> sourceVocab(basepath + "/source_vocabids");
 
-      ++line_num;
-      if (line_num % 1000000 == 0) {
-        std::cerr << line_num << " " << std::flush;
+  std::priority_queue<CacheItem*, std::vector<CacheItem*>, CacheItemOrderer> cache;
+  float totalSourceCount = 0;
+
+  // (source key, target coll position) of every source phrase. Kept on disk
+  // until the size of the hash table is known
+  util::scoped_fd entriesFile(util::MakeTemp(tempPrefix));
+  std::vector<Entry> entries;
+  uint64_t numEntries = 0;
+
+  // prefixes of source phrases which aren't source phrases themselves. Lets
+  // the decoder stop extending a span as soon as its prefix isn't in the table.
+  // Deduplicated per shard and kept on disk like the entries
+  SortedKeyRuns prefixRuns(tempPrefix);
+  std::vector<uint64_t> prefixes;
+
+  std::string data;
+  std::vector<Record> records;
+  std::vector<std::pair<float, size_t> > ranks;
+  std::vector<float> scores;
+  util::ErsatzProgress progress(numShards, &std::cerr, "Writing target phrases");
+  for (size_t shardInd = 0; shardInd < numShards; ++shardInd, ++progress) {
+    shards.Load(shardInd, data);
+    ReadRecords(data, records);
+    std::sort(records.begin(), records.end());
+
+    for (size_t begin = 0, end; begin < records.size(); begin = end) {
+      const Record &first = records[begin];
+      for (end = begin; end < records.size()
+           && records[end].header.key == first.header.key
+           && records[end].source == first.source; ++end) {
       }
 
-      //Add source phrases to vocabularyIDs
-      add_to_map(sourceVocab, line.source_phrase);
-
-      if (prevSource.empty()) {
-        // 1st line
-        prevSource = line.source_phrase.as_string();
-        storeTarget.Append(line, log_prob, scfg);
-      } else if (prevSource == line.source_phrase) {
-        //If we still have the same line, just append to it:
-        storeTarget.Append(line, log_prob, scfg);
-      } else {
-        assert(prevSource != line.source_phrase);
-
-        //Create a new entry even
-
-        // save
-        uint64_t targetInd = storeTarget.Save();
-
-        // next line
-        storeTarget.Append(line, log_prob, scfg);
-
-        //Create an entry for the previous source phrase:
-        Entry sourceEntry;
-        sourceEntry.value = targetInd;
-        //The key is the sum of hashes of individual words bitshifted by their position in the phrase.
-        //Probably not entirerly correct, but fast and seems to work fine in practise.
-        std::vector<uint64_t> vocabid_source = getVocabIDs(prevSource);
-        if (scfg) {
-          // storing prefixes?
-          sourcePhrases.Add(sourceEntries, vocabid_source);
-        }
-        sourceEntry.key = getKey(vocabid_source);
-
-        /*
-        cerr << "prevSource=" << prevSource << flush
-            << " vocabids=" << Debug(vocabid_source) << flush
-            << " key=" << sourceEntry.key << endl;
-        */
-        //Put into table
-        sourceEntries.Insert(sourceEntry);
-
-        // update cache - CURRENT source phrase, not prev
-        if (max_cache_size) {
-          std::string countStr = line.counts.as_string();
-          countStr = Moses2::Trim(countStr);
-          if (!countStr.empty()) {
-            std::vector<float> toks = Moses2::Tokenize<float>(countStr);
-            //cerr << "CACHE:" << line.source_phrase << " " << countStr << " " << toks[1] << endl;
-
-            if (toks.size() >= 2) {
-              totalSourceCount += toks[1];
-
-              // compute key for CURRENT source
-              std::vector<uint64_t> currVocabidSource = getVocabIDs(line.source_phrase.as_string());
-              uint64_t currKey = getKey(currVocabidSource);
-
-              CacheItem *item = new CacheItem(
-                Moses2::Trim(line.source_phrase.as_string()),
-                currKey,
-                toks[1]);
-              cache.push(item);
-
-              if (max_cache_size > 0 && cache.size() > max_cache_size) {
-                cache.pop();
-              }
-            }
-          }
-        }
+      // best first. Ties stay in input order
+      ranks.clear();
+      for (size_t i = begin; i < end; ++i) {
+        float score = GetRankScore(records[i], weights, num_scores, log_prob, scores);
+        ranks.push_back(std::pair<float, size_t>(score, i));
+      }
+      std::stable_sort(ranks.begin(), ranks.end(), BetterRank);
 
-        //Set prevLine
-        prevSource = line.source_phrase.as_string();
+      for (size_t i = 0; i < ranks.size(); ++i) {
+        const Record &record = records[ranks[i].second];
+        storeTarget.AppendParsed(record.target, record.header.targetSize);
       }
 
-    } catch (util::EndOfFileException e) {
-      std::cerr
-          << "Reading phrase table finished, writing remaining files to disk."
-          << std::endl;
+      Entry sourceEntry;
+      sourceEntry.key = first.header.key;
+      sourceEntry.value = storeTarget.Save();
+      entries.push_back(sourceEntry);
+      ++numEntries;
 
-      //After the final entry is constructed we need to add it to the phrase_table
-      //Create an entry for the previous source phrase:
-      uint64_t targetInd = storeTarget.Save();
+      //Add source phrases to vocabularyIDs
+      add_to_map(sourceVocab, first.source);
 
-      Entry sourceEntry;
-      sourceEntry.value = targetInd;
+      // storing prefixes
+      std::vector<uint64_t> vocabid_source = getVocabIDs(first.source);
+      for (size_t len = 1; len < vocabid_source.size(); ++len) {
+        prefixes.push_back(probingpt::getKey(vocabid_source.data(), len));
+      }
 
-      //The key is the sum of hashes of individual words. Probably not entirerly correct, but fast
-      std::vector<uint64_t> vocabid_source = getVocabIDs(prevSource);
-      sourceEntry.key = getKey(vocabid_source);
+      // update cache
+      if (max_cache_size && first.header.count >= 0) {
+        totalSourceCount += first.header.count;
 
-      //Put into table
-      sourceEntries.Insert(sourceEntry);
+        CacheItem *item = new CacheItem(
+          Moses2::Trim(first.source.as_string()),
+          first.header.key,
+          first.header.count);
+        cache.push(item);
 
-      break;
+        if (max_cache_size > 0 && cache.size() > max_cache_size) {
+          cache.pop();
+        }
+      }
     }
-  }
 
-  sourcePhrases.Write(sourceEntries);
+    std::sort(prefixes.begin(), prefixes.end());
+    prefixes.erase(std::unique(prefixes.begin(), prefixes.end()), prefixes.end());
+    prefixRuns.Append(prefixes);
+    prefixes.clear();
+
+    if (entries.size() >= 1000000 || shardInd + 1 == numShards) {
+      util::WriteOrThrow(entriesFile.get(), entries.data(), entries.size() * sizeof(Entry));
+      entries.clear();
+    }
+  }
+  std::string().swap(data);
+  std::vector<Record>().swap(records);
+  std::vector<uint64_t>().swap(prefixes);
 
   storeTarget.SaveAlignment();
+  sourceVocab.Save();
+  serialize_cache(cache, (basepath + "/cache"), totalSourceCount);
 
-  serialize_table(mem, size, (basepath + "/probing_hash.dat"));
+  // 3. hash table, built in its file
+  uint64_t numPrefixes = 0, key;
+  prefixRuns.Rewind();
+  while (prefixRuns.Next(key)) {
+    ++numPrefixes;
+  }
 
-  sourceVocab.Save();
+  uint64_t uniq_entries = numEntries + numPrefixes;
+  size_t size = Table::Size(uniq_entries, 1.2);
+  util::scoped_fd tableFile;
+  util::scoped_memory tableMem(
+    util::MapZeroedWrite((basepath + "/probing_hash.dat").c_str(), size, tableFile),
+    size, util::scoped_memory::MMAP_ALLOCATED);
+  Table sourceEntries(tableMem.get(), size);
+
+  util::SeekOrThrow(entriesFile.get(), 0);
+  entries.resize(1000000);
+  for (uint64_t done = 0; done < numEntries; ) {
+    size_t toRead = std::min<uint64_t>(entries.size(), numEntries - done);
+    util::ReadOrThrow(entriesFile.get(), entries.data(), toRead * sizeof(Entry));
+    for (size_t i = 0; i < toRead; ++i) {
+      sourceEntries.Insert(entries[i]);
+    }
+    done += toRead;
+  }
 
-  serialize_cache(cache, (basepath + "/cache"), totalSourceCount);
+  prefixRuns.Rewind();
+  while (prefixRuns.Next(key)) {
+    Table::ConstIterator iter;
+    if (!sourceEntries.Find(key, iter)) {
+      Entry sourceEntry;
+      sourceEntry.value = NONE;
+      sourceEntry.key = key;
+      sourceEntries.Insert(sourceEntry);
+    }
+  }
 
-  delete[] mem;
+  elapsed = std::max(util::WallTime() - startTime, 1e-6);
+  std::cerr << "Wrote " << numEntries << " source phrases in " << elapsed << "s ("
+            << (uint64_t) (numEntries / elapsed) << " source phrases/s)" << std::endl;
 
   //Write configfile
   std::ofstream configfile;
@@ -233,29 +420,15 @@ void createProbingPT(const std::string &phrasetable_path,
   configfile << "num_scores\t" << num_scores << '\n';
   configfile << "num_lex_scores\t" << num_lex_scores << '\n';
   configfile << "log_prob\t" << log_prob << '\n';
+  // without weights the order ignores the user's model, so the decoder
+  // mustn't cut off the rest
+  configfile << "sorted\t" << !weights.empty() << '\n';
+  configfile << "prefixes\t" << 1 << '\n';
+  configfile << "quantized\t" << quantizeBits << '\n';
   configfile.close();
 #endif
 }
 
-size_t countUniqueSource(const std::string &path)
-{
-  size_t ret = 0;
-  InputFileStream strme(path);
-
-  std::string line, prevSource;
-  while (std::getline(strme, line)) {
-    std::vector<std::string> toks = Moses2::TokenizeMultiCharSeparator(line, "|||");
-    assert(toks.size() != 0);
-
-    if (prevSource != toks[0]) {
-      prevSource = toks[0];
-      ++ret;
-    }
-  }
-
-  return ret;
-}
-
 void serialize_cache(
   std::priority_queue<CacheItem*, std::vector<CacheItem*>, CacheItemOrderer> &cache,
   const std::string &path, float totalSourceCount)
@@ -1,7 +1,5 @@
 #pragma once
 
-#include <boost/unordered_set.hpp>
-#include <boost/unordered_map.hpp>
 #include <cstdio>
 #include <sstream>
 #include <fstream>
@@ -21,28 +19,27 @@ namespace probingpt
 {
 typedef std::vector<uint64_t> SourcePhrase;
 
-
-class Node
-{
-  typedef boost::unordered_map<uint64_t, Node> Children;
-  Children m_children;
-
-public:
-  uint64_t key;
-  bool done;
-
-  Node()
-    :done(false)
-  {}
-
-  void Add(Table &table, const SourcePhrase &sourcePhrase, size_t pos = 0);
-  void Write(Table &table);
-};
-
-
+/** Binarize a phrase table. The input doesn't have to be sorted.
+ * Lines are parsed by numThreads threads into records which are partitioned
+ * by source phrase into numShards shards, held in memory up to maxMemory
+ * bytes then spilled to temporary files in tempDir. Each shard is then
+ * loaded, sorted by source phrase and written out. The hash table is built
+ * directly in its memory-mapped output file.
+ * numShards = 0 picks enough shards for each to fit in maxMemory / 2.
+ * tempDir = "" uses basepath.
+ * The target phrases of each source phrase are stored best first, ranked by
+ * the log of the num_scores phrase table scores, weighted by weights
+ * (all 1 if empty). The decoder then only has to read the first few.
+ * quantizeBits > 0 stores scores as 1 byte codebook indices in a separate
+ * column rather than as floats, see ScoreQuantizer.
+ */
 void createProbingPT(const std::string &phrasetable_path,
                      const std::string &basepath, int num_scores, int num_lex_scores,
-                     bool log_prob, int max_cache_size, bool scfg);
+                     bool log_prob, int max_cache_size, bool scfg,
+                     size_t numThreads = 1, size_t numShards = 0,
+                     uint64_t maxMemory = 1ULL << 30, const std::string &tempDir = "",
+                     const std::vector<float> &weights = std::vector<float>(),
+                     size_t quantizeBits = 0);
 uint64_t getKey(const std::vector<uint64_t> &source_phrase);
 
 std::vector<uint64_t> CreatePrefix(const std::vector<uint64_t> &vocabid_source, size_t endPos);
@@ -57,8 +54,6 @@ std::string Debug(const std::vector<T> &vec)
   return strm.str();
 }
 
-size_t countUniqueSource(const std::string &path);
-
 class CacheItem
 {
 public:
@@ -49,6 +49,8 @@ struct ChainConfig {
  */
 struct SortConfig {
 
+  SortConfig() : threads(1) {}
+
   /** Filename prefix where temporary files should be placed. */
   std::string temp_prefix;
 
@@ -57,6 +59,12 @@ struct SortConfig {
 
   /** Total memory to use when running alone. */
   std::size_t total_memory;
+
+  /**
+   * Threads sorting each block before it is written.  The merge passes
+   * still run in one thread per sort.
+   */
+  std::size_t threads;
 };
 
 }} // namespaces
@@ -29,10 +29,14 @@
 #include "util/scoped.hh"
 #include "util/sized_iterator.hh"
 
+#include <boost/thread/thread.hpp>
+
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <queue>
 #include <string>
+#include <vector>
 
 namespace util {
 namespace stream {
@@ -121,11 +125,54 @@ class Offsets {
     uint64_t output_sum_;
 };
 
+/* Where sorted blocks are read from: usually one file, but possibly several
+ * files read in place, addressed as if they were concatenated.  A block never
+ * spans two files.  Does not own the files.
+ */
+class BlockFiles {
+  public:
+    explicit BlockFiles(int fd) : fds_(1, fd), starts_(1, 0) {}
+
+    BlockFiles() {}
+
+    // Appends a file of this size.  Empty files hold no blocks so are skipped.
+    void Add(int fd, uint64_t size) {
+      if (!size) return;
+      starts_.push_back(Size());
+      fds_.push_back(fd);
+      ends_.push_back(starts_.back() + size);
+    }
+
+    bool IsFile(int fd) const {
+      return ends_.empty() && fds_.size() == 1 && fds_.front() == fd;
+    }
+
+    uint64_t Size() const {
+      if (ends_.empty()) return fds_.empty() ? 0 : SizeOrThrow(fds_.front());
+      return ends_.back();
+    }
+
+    void PRead(void *to, std::size_t amount, uint64_t offset) const {
+      if (fds_.size() == 1 && ends_.empty()) {
+        ErsatzPRead(fds_.front(), to, amount, offset);
+        return;
+      }
+      std::size_t file = std::upper_bound(starts_.begin(), starts_.end(), offset) - starts_.begin() - 1;
+      ErsatzPRead(fds_[file], to, amount, offset - starts_[file]);
+    }
+
+  private:
+    std::vector<int> fds_;
+    std::vector<uint64_t> starts_;
+    // Only for several files.
+    std::vector<uint64_t> ends_;
+};
+
 // A priority queue of entries backed by file buffers
 template <class Compare> class MergeQueue {
   public:
-    MergeQueue(int fd, std::size_t buffer_size, std::size_t entry_size, const Compare &compare)
-      : queue_(Greater(compare)), in_(fd), buffer_size_(buffer_size), entry_size_(entry_size) {}
+    MergeQueue(const BlockFiles &in, std::size_t buffer_size, std::size_t entry_size, const Compare &compare)
+      : queue_(Greater(compare)), in_(in), buffer_size_(buffer_size), entry_size_(entry_size) {}
 
     void Push(void *base, uint64_t offset, uint64_t amount) {
       queue_.push(Entry(base, in_, offset, amount, buffer_size_));
@@ -156,23 +203,23 @@ template <class Compare> class MergeQueue {
       public:
         Entry() {}
 
-        Entry(void *base, int fd, uint64_t offset, uint64_t amount, std::size_t buf_size) {
+        Entry(void *base, const BlockFiles &in, uint64_t offset, uint64_t amount, std::size_t buf_size) {
           offset_ = offset;
           remaining_ = amount;
           buffer_end_ = static_cast<uint8_t*>(base) + buf_size;
-          Read(fd, buf_size);
+          Read(in, buf_size);
         }
 
-        bool Increment(int fd, std::size_t buf_size, std::size_t entry_size) {
+        bool Increment(const BlockFiles &in, std::size_t buf_size, std::size_t entry_size) {
           current_ += entry_size;
           if (current_ != buffer_end_) return true;
-          return Read(fd, buf_size);
+          return Read(in, buf_size);
         }
 
         const void *Current() const { return current_; }
 
       private:
-        bool Read(int fd, std::size_t buf_size) {
+        bool Read(const BlockFiles &in, std::size_t buf_size) {
           current_ = buffer_end_ - buf_size;
           std::size_t amount;
           if (static_cast<uint64_t>(buf_size) < remaining_) {
@@ -183,7 +230,7 @@ template <class Compare> class MergeQueue {
             amount = remaining_;
             buffer_end_ = current_ + remaining_;
           }
-          ErsatzPRead(fd, current_, amount, offset_);
+          in.PRead(current_, amount, offset_);
           offset_ += amount;
           assert(current_ <= buffer_end_);
           remaining_ -= amount;
@@ -212,7 +259,7 @@ template <class Compare> class MergeQueue {
     typedef std::priority_queue<Entry, std::vector<Entry>, Greater> Queue;
     Queue queue_;
 
-    const int in_;
+    const BlockFiles &in_;
     const std::size_t buffer_size_;
     const std::size_t entry_size_;
 };
@@ -225,7 +272,7 @@ template <class Compare> class MergeQueue {
  */
 template <class Compare, class Combine> class MergingReader {
   public:
-    MergingReader(int in, Offsets *in_offsets, Offsets *out_offsets, std::size_t buffer_size, std::size_t total_memory, const Compare &compare, const Combine &combine) :
+    MergingReader(const BlockFiles &in, Offsets *in_offsets, Offsets *out_offsets, std::size_t buffer_size, std::size_t total_memory, const Compare &compare, const Combine &combine) :
         compare_(compare), combine_(combine),
         in_(in),
         in_offsets_(in_offsets), out_offsets_(out_offsets),
@@ -308,10 +355,10 @@ template <class Compare, class Combine> class MergingReader {
       const uint64_t block_size = position.GetChain().BlockSize();
       Link l(position);
       for (; offset + block_size < end; ++l, offset += block_size) {
-        ErsatzPRead(in_, l->Get(), block_size, offset);
+        in_.PRead(l->Get(), block_size, offset);
         l->SetValidSize(block_size);
       }
-      ErsatzPRead(in_, l->Get(), end - offset, offset);
+      in_.PRead(l->Get(), end - offset, offset);
       l->SetValidSize(end - offset);
       (++l).Poison();
       return;
@@ -320,7 +367,7 @@ template <class Compare, class Combine> class MergingReader {
     Compare compare_;
     Combine combine_;
 
-    int in_;
+    BlockFiles in_;
 
   protected:
     Offsets *in_offsets_;
@@ -337,8 +384,9 @@ template <class Compare, class Combine> class OwningMergingReader : public Mergi
   private:
     typedef MergingReader<Compare, Combine> P;
   public:
-    OwningMergingReader(int data, const Offsets &offsets, std::size_t buffer, std::size_t lazy, const Compare &compare, const Combine &combine)
-      : P(data, NULL, NULL, buffer, lazy, compare, combine),
+    // Reads blocks from in, which is data unless the sort read presorted files in place.
+    OwningMergingReader(const BlockFiles &in, int data, const Offsets &offsets, std::size_t buffer, std::size_t lazy, const Compare &compare, const Combine &combine)
+      : P(in, NULL, NULL, buffer, lazy, compare, combine),
         data_(data),
         offsets_(offsets) {}
 
@@ -357,30 +405,126 @@ template <class Compare, class Combine> class OwningMergingReader : public Mergi
 // Don't use this directly.  Worker that sorts blocks.
 template <class Compare> class BlockSorter {
   public:
-    BlockSorter(Offsets &offsets, const Compare &compare) :
-      offsets_(&offsets), compare_(compare) {}
+    BlockSorter(Offsets &offsets, const Compare &compare, std::size_t threads = 1) :
+      offsets_(&offsets), compare_(compare), threads_(std::max<std::size_t>(1, threads)) {}
 
     void Run(const ChainPosition &position) {
       const std::size_t entry_size = position.GetChain().EntrySize();
+      // Merging pieces of a block needs somewhere to put them.
+      scoped_malloc scratch;
+      if (threads_ > 1) scratch.reset(MallocOrThrow(position.GetChain().BlockSize()));
       for (Link link(position); link; ++link) {
         // Record the size of each block in a separate file.
         offsets_->Append(link->ValidSize());
-        void *end = static_cast<uint8_t*>(link->Get()) + link->ValidSize();
+        uint8_t *begin = static_cast<uint8_t*>(link->Get());
+        uint8_t *end = begin + link->ValidSize();
+        if (threads_ > 1) {
+          ParallelSort(begin, end, static_cast<uint8_t*>(scratch.get()), entry_size);
+        } else {
+          Sort(begin, end, entry_size);
+        }
+      }
+      offsets_->FinishedAppending();
+    }
+
+  private:
+    void Sort(uint8_t *begin, uint8_t *end, std::size_t entry_size) const {
 #if defined(_WIN32) || defined(_WIN64)
-        std::stable_sort
+      std::stable_sort
 #else
-        std::sort
+      std::sort
 #endif
-          (SizedIt(link->Get(), entry_size),
-           SizedIt(end, entry_size),
-           compare_);
+        (SizedIt(begin, entry_size),
+         SizedIt(end, entry_size),
+         compare_);
+    }
+
+    void Merge(const uint8_t *begin, const uint8_t *middle, const uint8_t *end, uint8_t *out, std::size_t entry_size) const {
+      std::merge(
+          SizedIt(const_cast<uint8_t*>(begin), entry_size), SizedIt(const_cast<uint8_t*>(middle), entry_size),
+          SizedIt(const_cast<uint8_t*>(middle), entry_size), SizedIt(const_cast<uint8_t*>(end), entry_size),
+          SizedIt(out, entry_size),
+          compare_);
+    }
+
+    // Thread bodies for ParallelSort.
+    class SortPiece {
+      public:
+        SortPiece(const BlockSorter &sorter, uint8_t *begin, uint8_t *end, std::size_t entry_size)
+          : sorter_(sorter), begin_(begin), end_(end), entry_size_(entry_size) {}
+
+        void operator()() const { sorter_.Sort(begin_, end_, entry_size_); }
+
+      private:
+        const BlockSorter &sorter_;
+        uint8_t *begin_, *end_;
+        std::size_t entry_size_;
+    };
+
+    class MergePieces {
+      public:
+        MergePieces(const BlockSorter &sorter, const uint8_t *begin, const uint8_t *middle, const uint8_t *end, uint8_t *out, std::size_t entry_size)
+          : sorter_(sorter), begin_(begin), middle_(middle), end_(end), out_(out), entry_size_(entry_size) {}
+
+        void operator()() const { sorter_.Merge(begin_, middle_, end_, out_, entry_size_); }
+
+      private:
+        const BlockSorter &sorter_;
+        const uint8_t *begin_, *middle_, *end_;
+        uint8_t *out_;
+        std::size_t entry_size_;
+    };
+
+    /* Each thread sorts a piece of the block, then pairs of pieces are merged
+     * in parallel, alternating between the block and scratch, until one piece
+     * is left.
+     */
+    void ParallelSort(uint8_t *begin, uint8_t *end, uint8_t *scratch, std::size_t entry_size) const {
+      const std::size_t entries = (end - begin) / entry_size;
+      // Threads aren't worth starting for tiny blocks.
+      const std::size_t pieces = std::min(threads_, entries / kMinimumPerThread);
+      if (pieces < 2) {
+        Sort(begin, end, entry_size);
+        return;
       }
-      offsets_->FinishedAppending();
+      std::vector<std::size_t> bounds(pieces + 1);
+      for (std::size_t i = 0; i <= pieces; ++i) {
+        bounds[i] = entries * i / pieces * entry_size;
+      }
+
+      {
+        boost::thread_group sorters;
+        for (std::size_t i = 1; i < pieces; ++i) {
+          sorters.create_thread(SortPiece(*this, begin + bounds[i], begin + bounds[i + 1], entry_size));
+        }
+        Sort(begin, begin + bounds[1], entry_size);
+        sorters.join_all();
+      }
+
+      uint8_t *from = begin, *to = scratch;
+      for (std::size_t width = 1; width < pieces; width *= 2) {
+        boost::thread_group mergers;
+        for (std::size_t i = 0; i < pieces; i += 2 * width) {
+          std::size_t middle = bounds[std::min(i + width, pieces)];
+          std::size_t last = bounds[std::min(i + 2 * width, pieces)];
+          if (middle == last) {
+            // Odd one out.
+            memcpy(to + bounds[i], from + bounds[i], last - bounds[i]);
+          } else {
+            mergers.create_thread(MergePieces(*this, from + bounds[i], from + middle, from + last, to + bounds[i], entry_size));
+          }
+        }
+        mergers.join_all();
+        std::swap(from, to);
+      }
+      if (from != begin) memcpy(begin, from, end - begin);
     }
 
-  private:
+    static const std::size_t kMinimumPerThread = 4096;
+
     Offsets *offsets_;
     SizedCompare<Compare> compare_;
+    std::size_t threads_;
 };
 
 class BadSortConfig : public Exception {
@@ -398,17 +542,42 @@ template <class Compare, class Combine = NeverCombine> class Sort {
         data_(MakeTemp(config.temp_prefix)),
         offsets_file_(MakeTemp(config.temp_prefix)), offsets_(offsets_file_.get()),
         compare_(compare), combine_(combine),
-        entry_size_(in.EntrySize()) {
+        entry_size_(in.EntrySize()),
+        in_(data_.get()) {
       UTIL_THROW_IF(!entry_size_, BadSortConfig, "Sorting entries of size 0");
       // Make buffer_size a multiple of the entry_size.
       config_.buffer_size -= config_.buffer_size % entry_size_;
       UTIL_THROW_IF(!config_.buffer_size, BadSortConfig, "Sort buffer too small");
       UTIL_THROW_IF(config_.total_memory < config_.buffer_size * 4, BadSortConfig, "Sorting memory " << config_.total_memory << " is too small for four buffers (two read and two write).");
-      in >> BlockSorter<Compare>(offsets_, compare_) >> WriteAndRecycle(data_.get());
+      in >> BlockSorter<Compare>(offsets_, compare_, config_.threads) >> WriteAndRecycle(data_.get());
+    }
+
+    /** Merges files that are each already sorted, such as the output of
+     * other processes' sorts.  They are read in place, not copied, so the
+     * caller keeps ownership and must keep them open until the sorted output
+     * has been read.
+     */
+    Sort(const std::vector<int> &sorted, std::size_t entry_size, const SortConfig &config, const Compare &compare = Compare(), const Combine &combine = Combine())
+      : config_(config),
+        data_(MakeTemp(config.temp_prefix)),
+        offsets_file_(MakeTemp(config.temp_prefix)), offsets_(offsets_file_.get()),
+        compare_(compare), combine_(combine),
+        entry_size_(entry_size) {
+      UTIL_THROW_IF(!entry_size_, BadSortConfig, "Sorting entries of size 0");
+      config_.buffer_size -= config_.buffer_size % entry_size_;
+      UTIL_THROW_IF(!config_.buffer_size, BadSortConfig, "Sort buffer too small");
+      UTIL_THROW_IF(config_.total_memory < config_.buffer_size * 4, BadSortConfig, "Sorting memory " << config_.total_memory << " is too small for four buffers (two read and two write).");
+      for (std::vector<int>::const_iterator i = sorted.begin(); i != sorted.end(); ++i) {
+        uint64_t size = SizeOrThrow(*i);
+        UTIL_THROW_IF(size % entry_size_, BadSortConfig, "Sorted file of size " << size << " does not hold entries of size " << entry_size_);
+        in_.Add(*i, size);
+        offsets_.Append(size);
+      }
+      offsets_.FinishedAppending();
     }
 
     uint64_t Size() const {
-      return SizeOrThrow(data_.get());
+      return in_.Size();
     }
 
     // Do merge sort, terminating when lazy merge could be done with the
@@ -425,7 +594,10 @@ template <class Compare, class Combine = NeverCombine> class Sort {
         return std::min<std::size_t>(size, offsets_.RemainingBlocks() * config_.buffer_size);
 
       scoped_fd data2(MakeTemp(config_.temp_prefix));
-      int fd_in = data_.get(), fd_out = data2.get();
+      // The first pass may read presorted files in place.  Those are not
+      // truncated and later passes alternate between data_ and data2.
+      BlockFiles in = in_;
+      int fd_in = in_is_data() ? data_.get() : -1, fd_out = data2.get();
       scoped_fd offsets2_file(MakeTemp(config_.temp_prefix));
       Offsets offsets2(offsets2_file.get());
       Offsets *offsets_in = &offsets_, *offsets_out = &offsets2;
@@ -443,10 +615,10 @@ template <class Compare, class Combine = NeverCombine> class Sort {
         if (size < static_cast<uint64_t>(reading_memory)) {
           reading_memory = static_cast<std::size_t>(size);
         }
-        SeekOrThrow(fd_in, 0);
+        if (fd_in != -1) SeekOrThrow(fd_in, 0);
         chain >>
           MergingReader<Compare, Combine>(
-              fd_in,
+              in,
               offsets_in, offsets_out,
               config_.buffer_size,
               reading_memory,
@@ -454,19 +626,26 @@ template <class Compare, class Combine = NeverCombine> class Sort {
           WriteAndRecycle(fd_out);
         chain.Wait();
         offsets_out->FinishedAppending();
-        ResizeOrThrow(fd_in, 0);
         offsets_in->Reset();
+        if (fd_in == -1) {
+          fd_in = data_.get();
+        } else {
+          ResizeOrThrow(fd_in, 0);
+        }
         std::swap(fd_in, fd_out);
         std::swap(offsets_in, offsets_out);
+        in = BlockFiles(fd_in);
         size = SizeOrThrow(fd_in);
       }
 
+      // The loop ran at least once, so fd_in is data_ or data2.
       SeekOrThrow(fd_in, 0);
       if (fd_in == data2.get()) {
         data_.reset(data2.release());
         offsets_file_.reset(offsets2_file.release());
         offsets_ = offsets2;
       }
+      in_ = BlockFiles(data_.get());
       if (offsets_.RemainingBlocks() <= 1) return 0;
       // No overflow because the while loop exited.
       return std::min(size, offsets_.RemainingBlocks() * static_cast<uint64_t>(config_.buffer_size));
@@ -477,7 +656,7 @@ template <class Compare, class Combine = NeverCombine> class Sort {
     void Output(Chain &out, std::size_t lazy_memory) {
       Merge(lazy_memory);
       out.SetProgressTarget(Size());
-      out >> OwningMergingReader<Compare, Combine>(data_.get(), offsets_, config_.buffer_size, lazy_memory, compare_, combine_);
+      out >> OwningMergingReader<Compare, Combine>(in_, data_.get(), offsets_, config_.buffer_size, lazy_memory, compare_, combine_);
       data_.release();
       offsets_file_.release();
     }
@@ -518,6 +697,20 @@ template <class Compare, class Combine = NeverCombine> class Sort {
     int StealCompleted() {
       // Merge all the way.
       Merge(0);
+      if (!in_is_data()) {
+        // One presorted file, which belongs to the caller.
+        if (offsets_.RemainingBlocks()) {
+          uint64_t size = in_.Size();
+          scoped_malloc buffer(MallocOrThrow(config_.buffer_size));
+          for (uint64_t offset = 0; offset < size;) {
+            std::size_t amount = static_cast<std::size_t>(std::min<uint64_t>(config_.buffer_size, size - offset));
+            in_.PRead(buffer.get(), amount, offset);
+            WriteOrThrow(data_.get(), buffer.get(), amount);
+            offset += amount;
+          }
+        }
+        in_ = BlockFiles(data_.get());
+      }
       SeekOrThrow(data_.get(), 0);
       offsets_file_.reset();
       return data_.release();
@@ -534,6 +727,10 @@ template <class Compare, class Combine = NeverCombine> class Sort {
     const Compare compare_;
     const Combine combine_;
     const std::size_t entry_size_;
+
+    // Where the blocks are: data_, or presorted files until a merge pass.
+    BlockFiles in_;
+    bool in_is_data() const { return in_.IsFile(data_.get()); }
 };
 
 // returns bytes to be read on demand.
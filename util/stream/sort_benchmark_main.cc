@@ -0,0 +1,119 @@
+#include "util/stream/chain.hh"
+#include "util/stream/sort.hh"
+#include "util/stream/stream.hh"
+#include "util/file.hh"
+#include "util/usage.hh"
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+#include <stdint.h>
+
+namespace util { namespace stream { namespace {
+
+// Records like lmplz's: kOrder 4-byte words followed by a float.
+const std::size_t kOrder = 5;
+const std::size_t kEntrySize = kOrder * sizeof(uint32_t) + sizeof(float);
+
+// Last word first, like SuffixOrder.
+struct SuffixCompare : public std::binary_function<const void *, const void *, bool> {
+  bool operator()(const void *first_void, const void *second_void) const {
+    const uint32_t *first = static_cast<const uint32_t*>(first_void);
+    const uint32_t *second = static_cast<const uint32_t*>(second_void);
+    for (std::size_t i = kOrder; i;) {
+      --i;
+      if (first[i] != second[i]) return first[i] < second[i];
+    }
+    return false;
+  }
+};
+
+// Zipf-ish words from a fixed seed so every run sorts the same records.
+class Generate {
+  public:
+    explicit Generate(uint64_t records) : records_(records) {}
+
+    void Run(const ChainPosition &position) {
+      uint64_t state = 88172645463325252ULL;
+      Stream out(position);
+      for (uint64_t i = 0; i < records_; ++i, ++out) {
+        uint32_t *words = static_cast<uint32_t*>(out.Get());
+        for (std::size_t w = 0; w < kOrder; ++w) {
+          state ^= state << 13;
+          state ^= state >> 7;
+          state ^= state << 17;
+          // Small ids are much more frequent, like a real vocabulary.
+          words[w] = static_cast<uint32_t>((state & 0xffffff) >> (state >> 59));
+        }
+        *reinterpret_cast<float*>(words + kOrder) = 0.0;
+      }
+      out.Poison();
+    }
+
+  private:
+    uint64_t records_;
+};
+
+class Check {
+  public:
+    explicit Check(bool &ok) : ok_(&ok) {}
+
+    void Run(const ChainPosition &position) {
+      SuffixCompare less;
+      uint8_t previous[kEntrySize];
+      bool first = true;
+      *ok_ = true;
+      for (Stream in(position); in; ++in) {
+        if (!first && less(in.Get(), previous)) *ok_ = false;
+        memcpy(previous, in.Get(), kEntrySize);
+        first = false;
+      }
+    }
+
+  private:
+    bool *ok_;
+};
+
+void Benchmark(uint64_t records, std::size_t memory, std::size_t threads) {
+  ChainConfig chain_config(kEntrySize, 2, memory);
+  SortConfig sort_config;
+  sort_config.temp_prefix = "/tmp/sort_benchmark";
+  sort_config.buffer_size = std::min<std::size_t>(64 << 20, memory / 8);
+  sort_config.total_memory = memory;
+  sort_config.threads = threads;
+
+  double start = WallTime();
+  Chain chain(chain_config);
+  chain >> Generate(records);
+  Sort<SuffixCompare> sorter(chain, sort_config);
+  chain.Wait(true);
+  double blocks = WallTime();
+
+  bool ok;
+  sorter.Output(chain);
+  chain >> Check(ok);
+  chain.Wait(true);
+  double end = WallTime();
+
+  std::cout << threads << '\t' << (blocks - start) << '\t' << (end - blocks) << '\t' << (end - start) << (ok ? "" : "\tNOT SORTED") << std::endl;
+}
+
+}}} // namespaces
+
+int main(int argc, char *argv[]) {
+  if (argc > 4) {
+    std::cerr << "Usage: " << argv[0] << " [records [memory [max threads]]]\n"
+      "Sorts random 5-gram records with 1, 2, 4, ... threads sorting each block.\n"
+      "Memory is for the chain and the merge, like lmplz -S." << std::endl;
+    return 1;
+  }
+  uint64_t records = argc > 1 ? boost::lexical_cast<uint64_t>(argv[1]) : 20000000;
+  std::size_t memory = argc > 2 ? util::ParseSize(argv[2]) : (1ULL << 30);
+  std::size_t max_threads = argc > 3 ? boost::lexical_cast<std::size_t>(argv[3]) : 64;
+  std::cout << "#threads\tblock sort seconds\tmerge seconds\ttotal seconds" << std::endl;
+  for (std::size_t threads = 1; threads <= max_threads; threads *= 2) {
+    util::stream::Benchmark(records, memory, threads);
+  }
+}
@@ -59,4 +59,106 @@ BOOST_AUTO_TEST_CASE(FromShuffled) {
   BOOST_CHECK(!sorted);
 }
 
+// Blocks big enough that each is split between the threads, with an odd number of pieces.
+BOOST_AUTO_TEST_CASE(FromShuffledThreads) {
+  std::vector<uint64_t> shuffled;
+  shuffled.reserve(kSize);
+  for (uint64_t i = 0; i < kSize; ++i) {
+    shuffled.push_back(i);
+  }
+  std::random_shuffle(shuffled.begin(), shuffled.end());
+
+  ChainConfig config;
+  config.entry_size = 8;
+  config.total_memory = kSize / 3 * 8 * 3;
+  config.block_count = 3;
+
+  SortConfig merge_config;
+  merge_config.temp_prefix = "sort_test_temp";
+  merge_config.buffer_size = 800;
+  merge_config.total_memory = 3300;
+  merge_config.threads = 3;
+
+  Chain chain(config);
+  chain >> Putter(shuffled);
+  BlockingSort(chain, merge_config, CompareUInt64(), NeverCombine());
+  Stream sorted;
+  chain >> sorted >> kRecycle;
+  for (uint64_t i = 0; i < kSize; ++i, ++sorted) {
+    BOOST_CHECK_EQUAL(i, *static_cast<const uint64_t*>(sorted.Get()));
+  }
+  BOOST_CHECK(!sorted);
+}
+
+// Files that are already sorted, merged in place.  More files than the lazy
+// merge can take force a merge pass that reads them.
+void TestPresorted(std::size_t files) {
+  SortConfig merge_config;
+  merge_config.temp_prefix = "sort_test_temp";
+  merge_config.buffer_size = 800;
+  merge_config.total_memory = 3300;
+
+  FixedArray<scoped_fd> owned(files + 1);
+  std::vector<int> fds;
+  for (std::size_t f = 0; f < files; ++f) {
+    owned.push_back(MakeTemp(merge_config.temp_prefix));
+    for (uint64_t i = f; i < kSize; i += files) {
+      WriteOrThrow(owned.back().get(), &i, sizeof(uint64_t));
+    }
+    fds.push_back(owned.back().get());
+  }
+  // Empty files hold no blocks.
+  owned.push_back(MakeTemp(merge_config.temp_prefix));
+  fds.push_back(owned.back().get());
+
+  ChainConfig config;
+  config.entry_size = 8;
+  config.total_memory = 800 * 3;
+  config.block_count = 3;
+  Chain chain(config);
+  Sort<CompareUInt64> sorter(fds, 8, merge_config);
+  BOOST_CHECK_EQUAL(kSize * 8, sorter.Size());
+  sorter.Output(chain);
+  Stream sorted;
+  chain >> sorted >> kRecycle;
+  for (uint64_t i = 0; i < kSize; ++i, ++sorted) {
+    BOOST_CHECK_EQUAL(i, *static_cast<const uint64_t*>(sorted.Get()));
+  }
+  BOOST_CHECK(!sorted);
+  chain.Wait();
+  // The caller's files are left alone.
+  for (std::size_t f = 0; f < files; ++f) {
+    BOOST_CHECK_EQUAL((kSize - f + files - 1) / files * 8, SizeOrThrow(fds[f]));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(PresortedLazy) {
+  TestPresorted(2);
+}
+
+BOOST_AUTO_TEST_CASE(PresortedMergePass) {
+  TestPresorted(5);
+}
+
+BOOST_AUTO_TEST_CASE(PresortedStealOne) {
+  SortConfig merge_config;
+  merge_config.temp_prefix = "sort_test_temp";
+  merge_config.buffer_size = 800;
+  merge_config.total_memory = 3300;
+  scoped_fd file(MakeTemp(merge_config.temp_prefix));
+  for (uint64_t i = 0; i < 1000; ++i) {
+    WriteOrThrow(file.get(), &i, sizeof(uint64_t));
+  }
+  std::vector<int> fds(1, file.get());
+  Sort<CompareUInt64> sorter(fds, 8, merge_config);
+  scoped_fd stolen(sorter.StealCompleted());
+  BOOST_CHECK(stolen.get() != file.get());
+  BOOST_REQUIRE_EQUAL(8000, SizeOrThrow(stolen.get()));
+  uint64_t value;
+  for (uint64_t i = 0; i < 1000; ++i) {
+    ReadOrThrow(stolen.get(), &value, sizeof(uint64_t));
+    BOOST_CHECK_EQUAL(i, value);
+  }
+}
+
 }}} // namespaces